@@ -0,0 +1,368 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <sys/sysctl.h>
+#endif
+
+#include "elementwise.hpp"
+
+// * Picking block sizes, tiles and thread counts by measuring them.
+// *
+// * The best configuration of a kernel depends on the machine (cache sizes,
+// * core count, GPU generation) and on the rough shape of the problem, so it
+// * is searched once per (kernel, shape class) on each machine and written
+// * to a small text cache:
+// *
+// *   repousse-tuning 1
+// *   <fingerprint>\t<key>\t<name>=<value> <name>=<value> ...
+// *
+// * The fingerprint names the hardware (CPU model, thread count, ISA, or the
+// * GPU), so one cache file can be shared between machines, and an entry is
+// * only ever used on the hardware it was measured on. A file with another
+// * version is ignored and replaced on the next save. Later runs load the
+// * file once at startup and look configurations up without measuring.
+// *
+// * `REPOUSSE_TUNE` chooses what happens on a lookup:
+// *   off     defaults only, the cache is not read
+// *   cached  cached entries, defaults otherwise (the default: never searches)
+// *   search  cached entries, searching (and saving) on a miss
+// *   retune  search every key once per process, replacing cached entries
+// * `REPOUSSE_TUNE_CACHE` overrides the file, which is otherwise
+// * `$XDG_CACHE_HOME/repousse/tuning.txt` or `~/.cache/repousse/tuning.txt`.
+
+namespace compute::autotune {
+
+/// @brief Named integer parameters of one kernel, e.g. {"kc": 256, "mc": 168}.
+using Config = std::map<std::string, std::size_t>;
+
+enum class Mode { Off, Cached, Search, Retune };
+
+inline auto modeName(Mode mode) -> const char* {
+  switch (mode) {
+    case Mode::Off:    return "off";
+    case Mode::Cached: return "cached";
+    case Mode::Search: return "search";
+    case Mode::Retune: return "retune";
+  }
+  return "?";
+}
+
+/// @brief `REPOUSSE_TUNE`, read once; unknown values fall back to `cached`.
+inline auto defaultMode() -> Mode {
+  static const Mode mode = [] {
+    if (const char* env = std::getenv("REPOUSSE_TUNE")) {
+      for (Mode candidate : {Mode::Off, Mode::Cached, Mode::Search, Mode::Retune}) {
+        if (std::string_view(modeName(candidate)) == env) { return candidate; }
+      }
+    }
+    return Mode::Cached;
+  }();
+  return mode;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Fingerprints and keys ...
+///////////////////////////////////////////////////////////////////////////////
+
+/// @brief `text` with tabs and line breaks (the cache's separators) turned into spaces.
+inline auto sanitize(std::string text) -> std::string {
+  std::ranges::replace_if(text, [](char c) { return c == '\t' || c == '\n' || c == '\r'; }, ' ');
+  return text;
+}
+
+/// @brief Marketing name of the CPU, or "unknown CPU".
+inline auto cpuModel() -> std::string {
+#ifdef __APPLE__
+  char brand[256] = {};
+  std::size_t size = sizeof(brand);
+  if (sysctlbyname("machdep.cpu.brand_string", brand, &size, nullptr, 0) == 0 && brand[0]) { return brand; }
+#else
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  std::string line;
+  // * x86 has "model name"; most ARM kernels only have "CPU part" per core.
+  std::string part;
+  while (std::getline(cpuinfo, line)) {
+    const std::size_t colon = line.find(':');
+    if (colon == std::string::npos) { continue; }
+    const std::string_view field = std::string_view(line).substr(0, line.find_last_not_of(" \t", colon - 1) + 1);
+    const std::string value = line.substr(std::min(line.size(), colon + 2));
+    if (field == "model name" && !value.empty()) { return value; }
+    if (field == "CPU part" && part.empty()) { part = "CPU part " + value; }
+  }
+  if (!part.empty()) { return part; }
+#endif
+  return "unknown CPU";
+}
+
+/**
+ * @brief The CPU as far as tuning cares: model, hardware threads and the
+ *  active ISA (`REPOUSSE_ISA` changes the kernels, so it changes the answer).
+ */
+inline auto cpuFingerprint() -> const std::string& {
+  static const std::string fingerprint = sanitize(
+    cpuModel() + " | " + std::to_string(std::max(1u, std::thread::hardware_concurrency())) + " threads | " +
+    std::string(elementwise::isaName(elementwise::activeIsa())));
+  return fingerprint;
+}
+
+/// @brief A device as far as tuning cares: its name, and the CPU it runs on.
+inline auto deviceFingerprint(const std::string& deviceName) -> std::string {
+  return sanitize(deviceName + " | " + cpuModel());
+}
+
+/**
+ * @brief Power-of-two bucket of a dimension: the smallest 2^i >= `size`,
+ *  clamped to [16, 16384]. Shapes in one bucket share a configuration.
+ */
+inline auto bucket(std::size_t size) -> std::size_t {
+  return std::clamp<std::size_t>(std::bit_ceil(std::max<std::size_t>(size, 1)), 16, 16384);
+}
+
+/// @brief "<bucket(m)>x<bucket(n)>x<bucket(k)>".
+inline auto shapeClass(std::size_t m, std::size_t n, std::size_t k) -> std::string {
+  return std::to_string(bucket(m)) + "x" + std::to_string(bucket(n)) + "x" + std::to_string(bucket(k));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Cache ...
+///////////////////////////////////////////////////////////////////////////////
+
+/// @brief "kc=256 mc=168"; the inverse of `parseConfig`.
+inline auto formatConfig(const Config& config) -> std::string {
+  std::string text;
+  for (const auto& [name, value] : config) {
+    if (!text.empty()) { text += ' '; }
+    text += name + "=" + std::to_string(value);
+  }
+  return text;
+}
+
+/// @brief Parses `formatConfig` output; nullopt if any field is malformed.
+inline auto parseConfig(std::string_view text) -> std::optional<Config> {
+  Config config;
+  while (!text.empty()) {
+    const std::size_t space = text.find(' ');
+    const std::string_view field = text.substr(0, space);
+    text = space == std::string_view::npos ? std::string_view{} : text.substr(space + 1);
+    if (field.empty()) { continue; }
+    const std::size_t equals = field.find('=');
+    if (equals == 0 || equals == std::string_view::npos) { return std::nullopt; }
+    std::size_t value = 0;
+    const std::string_view digits = field.substr(equals + 1);
+    const auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), value);
+    if (error != std::errc{} || end != digits.data() + digits.size()) { return std::nullopt; }
+    config[std::string(field.substr(0, equals))] = value;
+  }
+  if (config.empty()) { return std::nullopt; }
+  return config;
+}
+
+/**
+ * @brief The tuning cache file, loaded once and kept in memory.
+ * @details Lookups never touch the disk. `store` rewrites the whole file
+ *  through a temporary of its own (pid and random suffix) and a rename, so
+ *  readers never see half of it. Writers hold an advisory lock on
+ *  `<file>.lock` from re-reading the file to the rename, so the entries
+ *  other processes saved since the load are merged, not lost.
+ */
+class Cache {
+public:
+  static constexpr int kVersion = 1;
+
+  explicit Cache(std::filesystem::path path) : path_(std::move(path)) { entries_ = read(path_); }
+
+  Cache(const Cache&) = delete;
+  auto operator=(const Cache&) -> Cache& = delete;
+
+  auto path() const -> const std::filesystem::path& { return path_; }
+
+  auto size() const -> std::size_t {
+    std::lock_guard lock(mutex_);
+    return entries_.size();
+  }
+
+  auto find(const std::string& fingerprint, const std::string& key) const -> std::optional<Config> {
+    std::lock_guard lock(mutex_);
+    if (auto it = entries_.find({fingerprint, key}); it != entries_.end()) { return it->second; }
+    return std::nullopt;
+  }
+
+  /**
+   * @brief Records `config` for (`fingerprint`, `key`) and saves the file.
+   * @details The entry is kept in memory even when the save fails.
+   * @throws std::runtime_error if the file can't be written.
+   */
+  auto store(const std::string& fingerprint, const std::string& key, Config config) -> void {
+    std::lock_guard lock(mutex_);
+    entries_[{fingerprint, key}] = std::move(config);
+
+    std::error_code error;
+    if (path_.has_parent_path()) { std::filesystem::create_directories(path_.parent_path(), error); }
+    const FileLock fileLock(path_.string() + ".lock");
+    for (auto& [entry, saved] : read(path_)) { entries_.try_emplace(entry, std::move(saved)); }
+
+    std::filesystem::path temporary = path_;
+    temporary += "." + std::to_string(::getpid()) + "." + std::to_string(std::random_device{}()) + ".tmp";
+    {
+      std::ofstream out(temporary, std::ios::trunc);
+      out << "repousse-tuning " << kVersion << "\n";
+      for (const auto& [entry, saved] : entries_) {
+        out << entry.first << '\t' << entry.second << '\t' << formatConfig(saved) << '\n';
+      }
+      if (!out.flush()) {
+        out.close();
+        std::filesystem::remove(temporary, error);
+        throw std::runtime_error("Failed to write tuning cache '" + temporary.string() + "'.");
+      }
+    }
+    std::filesystem::rename(temporary, path_, error);
+    if (error) {
+      const std::string reason = error.message();
+      std::filesystem::remove(temporary, error);
+      throw std::runtime_error("Failed to replace tuning cache '" + path_.string() + "': " + reason);
+    }
+  }
+
+  /// @brief `REPOUSSE_TUNE_CACHE`, else the per-user cache directory.
+  static auto defaultPath() -> std::filesystem::path {
+    if (const char* env = std::getenv("REPOUSSE_TUNE_CACHE"); env && *env) { return env; }
+    if (const char* env = std::getenv("XDG_CACHE_HOME"); env && *env) {
+      return std::filesystem::path(env) / "repousse" / "tuning.txt";
+    }
+    if (const char* home = std::getenv("HOME"); home && *home) {
+      return std::filesystem::path(home) / ".cache" / "repousse" / "tuning.txt";
+    }
+    return "repousse-tuning.txt";
+  }
+
+  /// @brief Process-wide cache at `defaultPath()`, loaded on first use.
+  static auto global() -> Cache& {
+    static Cache cache(defaultPath());
+    return cache;
+  }
+
+private:
+  using Entries = std::map<std::pair<std::string, std::string>, Config>;
+
+  /// @brief Exclusive `flock` on `path` while alive; a no-op if it can't be taken.
+  class FileLock {
+  public:
+    explicit FileLock(const std::string& path) : fd_(::open(path.c_str(), O_RDWR | O_CREAT, 0644)) {
+      if (fd_ >= 0 && ::flock(fd_, LOCK_EX) != 0) {
+        ::close(fd_);
+        fd_ = -1;
+      }
+    }
+    FileLock(const FileLock&) = delete;
+    auto operator=(const FileLock&) -> FileLock& = delete;
+    ~FileLock() {
+      if (fd_ >= 0) { ::close(fd_); }
+    }
+
+  private:
+    int fd_;
+  };
+
+  /// @brief Entries of the file at `path`; none if it is missing or has another version.
+  static auto read(const std::filesystem::path& path) -> Entries {
+    Entries entries;
+    std::ifstream in(path);
+    std::string line;
+    if (!std::getline(in, line) || line != "repousse-tuning " + std::to_string(kVersion)) { return entries; }
+    while (std::getline(in, line)) {
+      const std::size_t first = line.find('\t');
+      const std::size_t second = first == std::string::npos ? first : line.find('\t', first + 1);
+      if (second == std::string::npos) { continue; }
+      if (auto config = parseConfig(std::string_view(line).substr(second + 1))) {
+        entries[{line.substr(0, first), line.substr(first + 1, second - first - 1)}] = std::move(*config);
+      }
+    }
+    return entries;
+  }
+
+  std::filesystem::path path_;
+  mutable std::mutex mutex_;
+  Entries entries_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// * Search ...
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Fastest of `repeats` runs of `run`, in seconds, after one untimed
+ *  warm-up run (first-touch page faults, packing buffers growing).
+ */
+template <typename Fn>
+auto bestOf(std::size_t repeats, Fn&& run) -> double {
+  using Clock = std::chrono::steady_clock;
+  run();
+  double best = std::numeric_limits<double>::infinity();
+  for (std::size_t i = 0; i < std::max<std::size_t>(repeats, 1); ++i) {
+    const auto start = Clock::now();
+    run();
+    best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+  }
+  return best;
+}
+
+/// @brief One parameter of a search and the values worth trying.
+struct Axis {
+  std::string name;
+  std::vector<std::size_t> values;
+};
+
+/**
+ * @brief Coordinate descent from `start`: for each axis in turn, times every
+ *  value with the other parameters at their best so far and keeps the
+ *  fastest. `time(config)` returns seconds, or infinity for a configuration
+ *  that can't run.
+ * @details One pass, so the cost is the sum of the axis sizes rather than
+ *  their product; order the axes from most to least influential.
+ */
+template <typename Time>
+auto search(Config start, std::span<const Axis> axes, Time&& time) -> Config {
+  Config best = std::move(start);
+  double bestTime = time(best);
+  for (const Axis& axis : axes) {
+    const std::size_t current = best[axis.name];
+    for (std::size_t value : axis.values) {
+      if (value == current) { continue; }
+      Config candidate = best;
+      candidate[axis.name] = value;
+      if (const double seconds = time(candidate); seconds < bestTime) {
+        best = std::move(candidate);
+        bestTime = seconds;
+      }
+    }
+  }
+  return best;
+}
+
+}  // namespace compute::autotune
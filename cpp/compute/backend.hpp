@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// * Backend-neutral view of the Metal objects every day's host code uses.
+// * The shape deliberately follows Metal (library -> pipeline -> queue ->
+// * dispatch with buffer indices) so a host function reads the same whichever
+// * implementation sits behind it. See `cpu_backend.hpp` and `metal_backend.hpp`.
+
+namespace compute {
+
+/// @brief Grid or threadgroup extent. Mirrors `MTL::Size`.
+struct Size {
+  std::size_t width  = 1;
+  std::size_t height = 1;
+  std::size_t depth  = 1;
+
+  auto count() const -> std::size_t { return width * height * depth; }
+};
+
+/// @brief A linear block of memory visible to both host and kernels.
+class Buffer {
+public:
+  virtual ~Buffer() = default;
+  virtual auto contents() -> void* = 0;
+  virtual auto length() const -> std::size_t = 0;
+
+  template <typename T>
+  auto as() -> T* { return static_cast<T*>(contents()); }
+};
+
+/// @brief A set of kernels loaded from one `.metallib` (or its CPU twin).
+class Library {
+public:
+  virtual ~Library() = default;
+  virtual auto name() const -> const std::string& = 0;
+};
+
+/// @brief A kernel ready to dispatch. Mirrors `MTL::ComputePipelineState`.
+class Pipeline {
+public:
+  virtual ~Pipeline() = default;
+  virtual auto functionName() const -> const std::string& = 0;
+  virtual auto maxTotalThreadsPerThreadgroup() const -> std::size_t = 0;
+  virtual auto threadExecutionWidth() const -> std::size_t = 0;
+};
+
+/**
+ * @brief Kernel arguments bound by index, like `setBuffer`/`setBytes` on a
+ *  compute encoder.
+ * @note `setBytes` copies the value, so the source may go out of scope before
+ *  the dispatch. Buffers are borrowed and must outlive it.
+ */
+class Arguments {
+public:
+  struct Slot {
+    Buffer* buffer = nullptr;
+    std::size_t offset = 0;
+    std::vector<std::byte> bytes;
+  };
+
+  auto setBuffer(Buffer& buffer, std::size_t offset, std::uint32_t index) -> Arguments& {
+    Slot& slot = slotAt(index);
+    slot.buffer = &buffer;
+    slot.offset = offset;
+    slot.bytes.clear();
+    return *this;
+  }
+
+  auto setBytes(const void* bytes, std::size_t length, std::uint32_t index) -> Arguments& {
+    Slot& slot = slotAt(index);
+    slot.buffer = nullptr;
+    slot.offset = 0;
+    slot.bytes.resize(length);
+    std::memcpy(slot.bytes.data(), bytes, length);
+    return *this;
+  }
+
+  template <typename T>
+  auto setValue(const T& value, std::uint32_t index) -> Arguments& {
+    return setBytes(&value, sizeof(T), index);
+  }
+
+  auto slots() const -> const std::vector<Slot>& { return slots_; }
+
+private:
+  auto slotAt(std::uint32_t index) -> Slot& {
+    if (index >= slots_.size()) { slots_.resize(index + 1); }
+    return slots_[index];
+  }
+
+  std::vector<Slot> slots_;
+};
+
+/**
+ * @brief Submits work to a device. Each dispatch blocks until the kernel has
+ *  finished, like `commit()` followed by `waitUntilCompleted()`.
+ */
+class Queue {
+public:
+  virtual ~Queue() = default;
+
+  /// @brief `grid` counts threads; edge threadgroups are clipped to the grid.
+  virtual auto dispatchThreads(
+    const Pipeline& pipeline,
+    const Arguments& arguments,
+    Size grid,
+    Size threadsPerThreadgroup) -> void = 0;
+
+  /// @brief `threadgroups` counts whole groups; the grid is `groups * threads`.
+  virtual auto dispatchThreadgroups(
+    const Pipeline& pipeline,
+    const Arguments& arguments,
+    Size threadgroups,
+    Size threadsPerThreadgroup) -> void = 0;
+};
+
+/// @brief Entry point of a backend. Mirrors `MTL::Device`.
+class Device {
+public:
+  virtual ~Device() = default;
+
+  virtual auto name() const -> std::string = 0;
+
+  /// @brief Uninitialised shared buffer of `length` bytes.
+  virtual auto newBuffer(std::size_t length) -> std::unique_ptr<Buffer> = 0;
+  /// @brief Shared buffer holding a copy of `length` bytes from `pointer`.
+  virtual auto newBuffer(const void* pointer, std::size_t length) -> std::unique_ptr<Buffer> = 0;
+  /**
+   * @brief Shared buffer over `length` bytes at `pointer`, without copying.
+   * @details `pointer` must be page-aligned and `length` a whole number of
+   *  pages (see `PageVector` in `memory.hpp`). The memory is borrowed and must
+   *  outlive the buffer.
+   * @throws std::runtime_error if the backend can't use the memory in place.
+   */
+  virtual auto newBufferNoCopy(void* pointer, std::size_t length) -> std::unique_ptr<Buffer> = 0;
+
+  /**
+   * @brief Loads a kernel library. The Metal backend reads the `.metallib` at
+   *  `path`; the CPU backend looks up the kernels registered under its stem.
+   * @throws std::runtime_error if the library can't be found.
+   */
+  virtual auto newLibrary(const std::filesystem::path& path) -> std::unique_ptr<Library> = 0;
+
+  /// @brief Whether `newLibraryFromSource` can compile kernel source at runtime.
+  virtual auto compilesSource() const -> bool { return false; }
+
+  /**
+   * @brief Compiles MSL `source` into a library called `name`.
+   * @throws std::runtime_error on backends that can't compile source (CPU),
+   *  or if compilation fails.
+   */
+  virtual auto newLibraryFromSource(
+    const std::string& name,
+    const std::string& source) -> std::unique_ptr<Library> {
+    (void)source;
+    throw std::runtime_error("Backend '" + this->name() + "' can't compile library '" + name + "' from source.");
+  }
+
+  /// @throws std::runtime_error if `library` has no function `functionName`.
+  virtual auto newPipeline(
+    const Library& library,
+    const std::string& functionName) -> std::unique_ptr<Pipeline> = 0;
+
+  virtual auto newQueue() -> std::unique_ptr<Queue> = 0;
+};
+
+}  // namespace compute
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "backend.hpp"
+#include "device.hpp"
+
+namespace compute {
+
+/**
+ * @brief Long-lived owner of a device, its loaded libraries, pipeline states
+ *  and one command queue.
+ * @details Loading a `.metallib` and building a pipeline state are one-time
+ *  costs. Host code that asks the context for `pipeline(path, fn)` pays them
+ *  on the first call only; later calls are a map lookup. Returned references
+ *  stay valid for the lifetime of the context.
+ *
+ *  Works with any `Device`, so the caching can be exercised against a
+ *  `CpuDevice` on machines without a GPU (`BM_PipelineLookup` in day 1
+ *  checks it through `stats()`).
+ */
+class Context {
+public:
+  struct Stats {
+    std::size_t libraryLoads   = 0;  // * `newLibrary` calls made on the device
+    std::size_t pipelineBuilds = 0;  // * `newPipeline` calls made on the device
+    std::size_t pipelineHits   = 0;  // * lookups served from the cache
+  };
+
+  explicit Context(std::unique_ptr<Device> device) : device_(std::move(device)) {
+    if (!device_) {
+      throw std::runtime_error("Context needs a device.");
+    }
+  }
+
+  Context(const Context&) = delete;
+  auto operator=(const Context&) -> Context& = delete;
+
+  auto device() -> Device& { return *device_; }
+
+  /// @brief Loads `path` on first use; later calls return the same library.
+  auto library(const std::filesystem::path& path) -> Library& {
+    std::lock_guard lock(mutex_);
+    return libraryLocked(path);
+  }
+
+  /// @brief Pipeline for `functionName` in the library at `libraryPath`, built once.
+  auto pipeline(
+    const std::filesystem::path& libraryPath,
+    const std::string& functionName) -> Pipeline& {
+    std::lock_guard lock(mutex_);
+    const auto key = std::make_pair(keyFor(libraryPath), functionName);
+    if (auto it = pipelines_.find(key); it != pipelines_.end()) {
+      ++stats_.pipelineHits;
+      return *it->second;
+    }
+    Library& library = libraryLocked(libraryPath);
+    auto pipeline = device_->newPipeline(library, functionName);
+    ++stats_.pipelineBuilds;
+    return *pipelines_.emplace(key, std::move(pipeline)).first->second;
+  }
+
+  /**
+   * @brief Pipeline for `functionName` in MSL `source` compiled at runtime,
+   *  cached by the source text.
+   * @throws std::runtime_error if the device can't compile source.
+   */
+  auto pipelineFromSource(
+    const std::string& name,
+    const std::string& source,
+    const std::string& functionName) -> Pipeline& {
+    std::lock_guard lock(mutex_);
+    const auto key = std::make_pair("source:" + source, functionName);
+    if (auto it = pipelines_.find(key); it != pipelines_.end()) {
+      ++stats_.pipelineHits;
+      return *it->second;
+    }
+    auto& library = libraries_[key.first];
+    if (!library) {
+      library = device_->newLibraryFromSource(name, source);
+      ++stats_.libraryLoads;
+    }
+    auto pipeline = device_->newPipeline(*library, functionName);
+    ++stats_.pipelineBuilds;
+    return *pipelines_.emplace(key, std::move(pipeline)).first->second;
+  }
+
+  /// @brief The context's command queue, created on first use and then reused.
+  auto queue() -> Queue& {
+    std::lock_guard lock(mutex_);
+    if (!queue_) { queue_ = device_->newQueue(); }
+    return *queue_;
+  }
+
+  auto stats() const -> Stats {
+    std::lock_guard lock(mutex_);
+    return stats_;
+  }
+
+  /// @brief Process-wide context on the default device, created on first use.
+  static auto shared() -> Context& {
+    static Context context(createDefaultDevice());
+    return context;
+  }
+
+private:
+  static auto keyFor(const std::filesystem::path& path) -> std::string {
+    return path.lexically_normal().string();
+  }
+
+  auto libraryLocked(const std::filesystem::path& path) -> Library& {
+    const std::string key = keyFor(path);
+    if (auto it = libraries_.find(key); it != libraries_.end()) {
+      return *it->second;
+    }
+    auto library = device_->newLibrary(path);
+    ++stats_.libraryLoads;
+    return *libraries_.emplace(key, std::move(library)).first->second;
+  }
+
+  // * Declaration order matters: pipelines and libraries must be released
+  // * before the device that created them.
+  std::unique_ptr<Device> device_;
+  std::unique_ptr<Queue> queue_;
+  std::map<std::string, std::unique_ptr<Library>> libraries_;
+  std::map<std::pair<std::string, std::string>, std::unique_ptr<Pipeline>> pipelines_;
+  mutable std::mutex mutex_;
+  Stats stats_;
+};
+
+}  // namespace compute
@@ -0,0 +1,762 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numbers>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "fft.hpp"
+#include "thread_pool.hpp"
+
+// * 1D convolution on the CPU: direct or FFT, picked per shape by a cost
+// * model calibrated on this host.
+// *
+// * Semantics follow `day2/convolution.metal` ("same" size, mask centred
+// * at `M / 2`, not flipped):
+// *
+// *   out[i] = sum_j signal[i + j - M/2] * mask[j],   0 <= i < N
+// *
+// * Samples outside [0, N) are zeros by default; `Boundary` selects clamp,
+// * reflect or wrap instead.
+// *
+// * The direct path costs N·M multiply-adds. The FFT path runs overlap-save
+// * over blocks of a 2·3·5-smooth length L: each block is one real FFT, one
+// * spectrum product and one inverse real FFT, so the cost grows with
+// * log(L) instead of M. Plans (`fft::RealPlan::get`) and mask spectra
+// * (`FftConvolver`) are cached, so repeated calls pay only for the
+// * transforms of the signal.
+
+namespace compute::convolution {
+
+enum class Method { Auto, Direct, Fft };
+
+inline auto methodName(Method method) -> const char* {
+  switch (method) {
+    case Method::Auto:   return "auto";
+    case Method::Direct: return "direct";
+    case Method::Fft:    return "fft";
+  }
+  return "unknown";
+}
+
+/**
+ * @brief What `signal[i]` is outside `[0, N)`.
+ *  - `Zero`: 0.
+ *  - `Clamp`: the nearest end sample.
+ *  - `Reflect`: mirrored about the end samples, which are not repeated
+ *    (`signal[-1] = signal[1]`).
+ *  - `Wrap`: periodic (`signal[-1] = signal[N - 1]`).
+ */
+enum class Boundary : std::uint32_t { Zero, Clamp, Reflect, Wrap };
+
+inline auto boundaryName(Boundary boundary) -> const char* {
+  switch (boundary) {
+    case Boundary::Zero:    return "zero";
+    case Boundary::Clamp:   return "clamp";
+    case Boundary::Reflect: return "reflect";
+    case Boundary::Wrap:    return "wrap";
+  }
+  return "unknown";
+}
+
+/// @brief Where index `index` of an `n`-sample signal reads from under
+///  `boundary`: an index in `[0, n)`, or -1 for a zero sample.
+inline auto boundaryIndex(std::ptrdiff_t index, std::size_t size, Boundary boundary) -> std::ptrdiff_t {
+  const auto n = static_cast<std::ptrdiff_t>(size);
+  if (index >= 0 && index < n) { return index; }
+  switch (boundary) {
+    case Boundary::Zero:  return -1;
+    case Boundary::Clamp: return std::clamp<std::ptrdiff_t>(index, 0, n - 1);
+    case Boundary::Wrap:  return (index % n + n) % n;
+    case Boundary::Reflect: {
+      if (n == 1) { return 0; }
+      const std::ptrdiff_t period = 2 * (n - 1);
+      const std::ptrdiff_t r = (index % period + period) % period;
+      return r < n ? r : period - r;
+    }
+  }
+  return -1;
+}
+
+/// @brief `signal[index]` for any index, extended past the ends by `boundary`.
+inline auto sampleAt(std::span<const float> signal, std::ptrdiff_t index, Boundary boundary) -> float {
+  const std::ptrdiff_t at = boundaryIndex(index, signal.size(), boundary);
+  return at < 0 ? 0.0f : signal[at];
+}
+
+inline auto requireOutputSize(std::size_t signal, std::size_t out) -> void {
+  if (signal != out) {
+    throw std::runtime_error(
+      "Convolution output must match the signal length: " +
+      std::to_string(signal) + " vs " + std::to_string(out) + ".");
+  }
+}
+
+inline auto requireMask(std::size_t mask) -> void {
+  if (mask == 0) { throw std::runtime_error("Convolution mask is empty."); }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Masks ...
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief `e^x` in constant expressions (`std::exp` is not constexpr before
+ *  C++26). Splits x = k·ln2 + r with |r| <= ln2/2, sums the Taylor series
+ *  of e^r (converged to double precision after 20 terms) and scales by 2^k.
+ */
+constexpr auto constexprExp(double x) -> double {
+  if (x != x) { return x; }
+  if (x < -745.0) { return 0.0; }
+  if (x > 709.0) { return std::numeric_limits<double>::infinity(); }
+  const double scaled = x / std::numbers::ln2;
+  auto k = static_cast<long>(scaled + (scaled >= 0.0 ? 0.5 : -0.5));
+  const double r = x - static_cast<double>(k) * std::numbers::ln2;
+  double term = 1.0, sum = 1.0;
+  for (int i = 1; i <= 20; ++i) {
+    term *= r / i;
+    sum += term;
+  }
+  for (; k > 0; --k) { sum *= 2.0; }
+  for (; k < 0; ++k) { sum *= 0.5; }
+  return sum;
+}
+
+/// @brief Normalised Gaussian of `M` taps centred at `M / 2`, built at compile time.
+template <std::size_t M>
+constexpr auto gaussianMask(float sigma) -> std::array<float, M> {
+  static_assert(M > 0, "Mask needs at least one tap.");
+  std::array<double, M> values{};
+  double sum = 0.0;
+  for (std::size_t i = 0; i < M; ++i) {
+    const double x = static_cast<double>(i) - static_cast<double>(M / 2);
+    values[i] = constexprExp(-x * x / (2.0 * sigma * sigma));
+    sum += values[i];
+  }
+  std::array<float, M> mask{};
+  for (std::size_t i = 0; i < M; ++i) { mask[i] = static_cast<float>(values[i] / sum); }
+  return mask;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Direct ...
+///////////////////////////////////////////////////////////////////////////////
+
+/// @brief Interior outputs `out[i]`, `i` in `[lo, hi)`: every tap is in bounds.
+using InteriorKernel = void (*)(const float* signal, const float* mask, std::size_t m, float* out, std::size_t lo, std::size_t hi);
+
+/// @brief Runtime width: tap-major, so the inner loop is a contiguous axpy
+///  the compiler vectorises.
+inline auto interiorAnyWidth(const float* signal, const float* mask, std::size_t m, float* out, std::size_t lo, std::size_t hi) -> void {
+  const std::size_t center = m / 2;
+  std::fill(out + lo, out + hi, 0.0f);
+  for (std::size_t j = 0; j < m; ++j) {
+    const float w = mask[j];
+    const float* in = signal + j - center;
+    for (std::size_t i = lo; i < hi; ++i) { out[i] += in[i] * w; }
+  }
+}
+
+/**
+ * @brief Width known at compile time: the taps are unrolled into one
+ *  expression per output, and the mask is copied into a local array the
+ *  compiler keeps in registers. Vectorised across outputs, so each output
+ *  is written once instead of once per tap.
+ */
+template <std::size_t M>
+inline auto interiorFixedWidth(const float* signal, const float* mask, std::size_t, float* out, std::size_t lo, std::size_t hi) -> void {
+  constexpr std::size_t center = M / 2;
+  float taps[M];
+  std::copy_n(mask, M, taps);
+  for (std::size_t i = lo; i < hi; ++i) {
+    const float* in = signal + i - center;
+    out[i] = [&]<std::size_t... J>(std::index_sequence<J...>) {
+      return ((in[J] * taps[J]) + ...);
+    }(std::make_index_sequence<M>{});
+  }
+}
+
+// * Widths with an unrolled kernel: the odd ones in [3, 63].
+constexpr std::size_t kMinFixedWidth = 3;
+constexpr std::size_t kMaxFixedWidth = 63;
+
+constexpr auto hasFixedWidth(std::size_t m) -> bool {
+  return m >= kMinFixedWidth && m <= kMaxFixedWidth && m % 2 == 1;
+}
+
+/// @brief The unrolled kernel for width `m`, or the runtime-width one.
+inline auto interiorKernel(std::size_t m) -> InteriorKernel {
+  static constexpr auto table = []<std::size_t... K>(std::index_sequence<K...>) {
+    return std::array<InteriorKernel, sizeof...(K)>{interiorFixedWidth<kMinFixedWidth + 2 * K>...};
+  }(std::make_index_sequence<(kMaxFixedWidth - kMinFixedWidth) / 2 + 1>{});
+  return hasFixedWidth(m) ? table[(m - kMinFixedWidth) / 2] : interiorAnyWidth;
+}
+
+/**
+ * @brief Outputs `[from, to)` that read past an end of the signal: their
+ *  inputs, boundary samples included, are gathered into a halo tile once,
+ *  and the same branch-free interior kernel runs over the tile.
+ */
+inline auto edgeTile(
+  std::span<const float> signal,
+  std::span<const float> mask,
+  float* out,
+  std::size_t from,
+  std::size_t to,
+  InteriorKernel interior,
+  Boundary boundary) -> void {
+  if (from >= to) { return; }
+  const std::size_t m = mask.size();
+  const std::size_t center = m / 2;
+  const std::size_t count = to - from;
+  std::vector<float> tile(count + m - 1);
+  const auto base = static_cast<std::ptrdiff_t>(from) - static_cast<std::ptrdiff_t>(center);
+  for (std::size_t k = 0; k < tile.size(); ++k) {
+    tile[k] = sampleAt(signal, base + static_cast<std::ptrdiff_t>(k), boundary);
+  }
+  // * Output `from + i` reads tile[i .. i + m - 1].
+  interior(tile.data() + center, mask.data(), m, out + from, 0, count);
+}
+
+/// @brief `out[i]` for `i` in `[begin, end)`, one thread, one L1-sized block.
+inline auto directBlock(
+  std::span<const float> signal,
+  std::span<const float> mask,
+  float* out,
+  std::size_t begin,
+  std::size_t end,
+  InteriorKernel interior = nullptr,
+  Boundary boundary = Boundary::Zero) -> void {
+  const auto n = static_cast<std::ptrdiff_t>(signal.size());
+  const auto m = static_cast<std::ptrdiff_t>(mask.size());
+  const std::ptrdiff_t center = m / 2;
+  // * Interior outputs never read past either end of the signal.
+  const std::ptrdiff_t lo = std::clamp<std::ptrdiff_t>(center, begin, end);
+  const std::ptrdiff_t hi = std::clamp<std::ptrdiff_t>(n - (m - 1 - center), lo, end);
+  if (!interior) { interior = interiorKernel(mask.size()); }
+  edgeTile(signal, mask, out, begin, lo, interior, boundary);
+  interior(signal.data(), mask.data(), mask.size(), out, lo, hi);
+  edgeTile(signal, mask, out, hi, end, interior, boundary);
+}
+
+// * 16 KiB of outputs stays in L1 across all the taps.
+constexpr std::size_t kDirectChunk = 4096;
+
+/// @brief `out[i]` for `i` in `[begin, end)`, one thread. `interior`
+///  overrides the kernel `interiorKernel` would pick.
+inline auto directRange(
+  std::span<const float> signal,
+  std::span<const float> mask,
+  float* out,
+  std::size_t begin,
+  std::size_t end,
+  InteriorKernel interior = nullptr,
+  Boundary boundary = Boundary::Zero) -> void {
+  if (!interior) { interior = interiorKernel(mask.size()); }
+  for (std::size_t block = begin; block < end; block += kDirectChunk) {
+    directBlock(signal, mask, out, block, std::min(block + kDirectChunk, end), interior, boundary);
+  }
+}
+
+inline auto direct(
+  std::span<const float> signal,
+  std::span<const float> mask,
+  std::span<float> out,
+  Boundary boundary = Boundary::Zero) -> void {
+  requireMask(mask.size());
+  requireOutputSize(signal.size(), out.size());
+  ThreadPool::global().parallelFor(signal.size(), kDirectChunk, [&](std::size_t begin, std::size_t end) {
+    directRange(signal, mask, out.data(), begin, end, nullptr, boundary);
+  });
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * FFT (overlap-save) ...
+///////////////////////////////////////////////////////////////////////////////
+
+/// @brief Smallest even 2·3·5-smooth length `>= n` (real FFTs need even lengths).
+inline auto nextFftSize(std::size_t n) -> std::size_t {
+  std::size_t size = fft::nextFastSize(std::max<std::size_t>(n, 2));
+  while (size % 2 != 0) { size = fft::nextFastSize(size + 1); }
+  return size;
+}
+
+/**
+ * @brief A mask with its spectra, one per FFT length, computed on first use.
+ * @details Thread-safe: spectra are built under a lock and never change
+ *  afterwards, so concurrent `apply` calls share them.
+ */
+class FftConvolver {
+public:
+  explicit FftConvolver(std::span<const float> mask) : mask_(mask.begin(), mask.end()) {
+    requireMask(mask_.size());
+  }
+
+  auto mask() const -> std::span<const float> { return mask_; }
+
+  /// @brief Spectrum of the reversed mask, zero padded to `fftSize`.
+  auto spectrum(std::size_t fftSize) const -> const std::vector<fft::Complex>& {
+    std::lock_guard lock(mutex_);
+    auto& spectrum = spectra_[fftSize];
+    if (spectrum.empty()) {
+      const auto plan = fft::RealPlan::get(fftSize);
+      std::vector<float> padded(fftSize, 0.0f);
+      // * Reversed, so the circular convolution computes the correlation.
+      std::reverse_copy(mask_.begin(), mask_.end(), padded.begin());
+      std::vector<fft::Complex> scratch(plan->scratchSize());
+      spectrum.resize(plan->bins());
+      plan->forward(padded.data(), spectrum.data(), scratch.data());
+    }
+    return spectrum;
+  }
+
+  /**
+   * @brief `out` = the signal convolved with the mask, overlap-save with
+   *  FFT length `fftSize` (0: let the host cost model choose).
+   * @details Blocks of `fftSize - M + 1` outputs are independent and run in
+   *  parallel on the global pool.
+   */
+  auto apply(
+    std::span<const float> signal,
+    std::span<float> out,
+    std::size_t fftSize = 0,
+    Boundary boundary = Boundary::Zero) const -> void;
+
+private:
+  std::vector<float> mask_;
+  mutable std::mutex mutex_;
+  mutable std::map<std::size_t, std::vector<fft::Complex>> spectra_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// * Cost model ...
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Predicted run time of each method, from three per-host constants.
+ * @details
+ *  - direct: `N * M * secondsPerTap`
+ *  - FFT: per overlap-save block of length L, two real FFTs at
+ *    `secondsPerFftPoint * L * log2(L)` and `L/2 + 1` spectrum products at
+ *    `secondsPerBin`. L is the candidate with the lowest total.
+ *  `host()` measures the constants once per process (a few milliseconds).
+ */
+struct CostModel {
+  double secondsPerTap = 0.25e-9;
+  double secondsPerFftPoint = 1.0e-9;  // * forward + inverse real FFT, per L·log2(L)
+  double secondsPerBin = 1.0e-9;
+
+  auto directSeconds(std::size_t n, std::size_t m) const -> double {
+    return static_cast<double>(n) * static_cast<double>(m) * secondsPerTap;
+  }
+
+  auto fftSeconds(std::size_t n, std::size_t m, std::size_t fftSize) const -> double {
+    if (fftSize < m + 1) { return std::numeric_limits<double>::infinity(); }
+    const double step = static_cast<double>(fftSize - m + 1);
+    const double blocks = std::ceil(static_cast<double>(n) / step);
+    const double l = static_cast<double>(fftSize);
+    return blocks * (secondsPerFftPoint * l * std::log2(l) + secondsPerBin * (l / 2 + 1));
+  }
+
+  /// @brief Overlap-save length with the lowest predicted time for (N, M).
+  auto bestFftSize(std::size_t n, std::size_t m) const -> std::size_t {
+    // * One block covering everything, or blocks a few times the mask.
+    const std::size_t whole = nextFftSize(n + m - 1);
+    std::size_t best = whole;
+    double bestSeconds = fftSeconds(n, m, best);
+    for (std::size_t factor : {2, 3, 4, 6, 8, 12, 16, 32, 64}) {
+      const std::size_t candidate = nextFftSize(factor * m);
+      if (candidate >= whole) { break; }
+      const double seconds = fftSeconds(n, m, candidate);
+      if (seconds < bestSeconds) {
+        best = candidate;
+        bestSeconds = seconds;
+      }
+    }
+    return best;
+  }
+
+  auto choose(std::size_t n, std::size_t m) const -> Method {
+    return fftSeconds(n, m, bestFftSize(n, m)) < directSeconds(n, m) ? Method::Fft : Method::Direct;
+  }
+
+  /// @brief Smallest mask length at which FFT is predicted to win for `n` samples.
+  auto crossoverMaskSize(std::size_t n) const -> std::size_t {
+    std::size_t lo = 1, hi = n;
+    if (choose(n, hi) == Method::Direct) { return n + 1; }
+    while (lo < hi) {
+      const std::size_t mid = lo + (hi - lo) / 2;
+      if (choose(n, mid) == Method::Fft) { hi = mid; }
+      else                               { lo = mid + 1; }
+    }
+    return lo;
+  }
+
+  /// @brief Times one thread of each kernel on this host.
+  static auto calibrate() -> CostModel {
+    using Clock = std::chrono::steady_clock;
+    auto best = [](int reps, auto&& fn) {
+      double seconds = std::numeric_limits<double>::infinity();
+      for (int r = 0; r < reps; ++r) {
+        const auto start = Clock::now();
+        fn();
+        seconds = std::min(seconds, std::chrono::duration<double>(Clock::now() - start).count());
+      }
+      return seconds;
+    };
+
+    CostModel model;
+    constexpr std::size_t kSignal = 1 << 14;
+    constexpr std::size_t kMask = 64;
+    std::vector<float> signal(kSignal, 1.0f), mask(kMask, 0.5f), out(kSignal);
+    model.secondsPerTap = best(5, [&] {
+      directRange(signal, mask, out.data(), 0, kSignal);
+    }) / static_cast<double>(kSignal * kMask);
+
+    constexpr std::size_t kFft = 4096;
+    const auto plan = fft::RealPlan::get(kFft);
+    std::vector<fft::Complex> bins(plan->bins()), scratch(plan->scratchSize());
+    std::vector<fft::Complex> spectrum(plan->bins(), fft::Complex(0.6f, 0.6f));
+    std::vector<float> block(kFft, 1.0f);
+    model.secondsPerFftPoint = best(20, [&] {
+      plan->forward(block.data(), bins.data(), scratch.data());
+      plan->inverse(bins.data(), block.data(), scratch.data());
+    }) / (kFft * std::log2(double(kFft)));
+    model.secondsPerBin = best(20, [&] {
+      for (std::size_t k = 0; k < bins.size(); ++k) { bins[k] = fft::mul(bins[k], spectrum[k]); }
+    }) / static_cast<double>(bins.size());
+    return model;
+  }
+
+  /// @brief The calibrated model for this host, measured on first use.
+  static auto host() -> const CostModel& {
+    static const CostModel model = calibrate();
+    return model;
+  }
+};
+
+inline auto FftConvolver::apply(
+  std::span<const float> signal,
+  std::span<float> out,
+  std::size_t fftSize,
+  Boundary boundary) const -> void {
+  requireOutputSize(signal.size(), out.size());
+  const std::size_t n = signal.size();
+  const std::size_t m = mask_.size();
+  if (n == 0) { return; }
+  if (fftSize == 0) { fftSize = CostModel::host().bestFftSize(n, m); }
+  fftSize = nextFftSize(std::max(fftSize, m + 1));
+
+  const auto plan = fft::RealPlan::get(fftSize);
+  const auto& maskSpectrum = spectrum(fftSize);
+  const std::size_t step = fftSize - m + 1;
+  const std::size_t blocks = (n + step - 1) / step;
+  const auto center = static_cast<std::ptrdiff_t>(m / 2);
+  const auto history = static_cast<std::ptrdiff_t>(m - 1);
+
+  ThreadPool::global().parallelFor(blocks, 1, [&](std::size_t first, std::size_t last) {
+    std::vector<float> block(fftSize);
+    std::vector<fft::Complex> bins(plan->bins()), scratch(plan->scratchSize());
+    for (std::size_t b = first; b < last; ++b) {
+      // * Output i reads inputs i - center .. i - center + M - 1, so the
+      // * block's `step` outputs need the `L` inputs from outBegin - center;
+      // * the first M - 1 circular results wrap around and are dropped.
+      const std::size_t outBegin = b * step;
+      const std::size_t count = std::min(step, n - outBegin);
+      const std::ptrdiff_t inBegin = static_cast<std::ptrdiff_t>(outBegin) - center;
+      for (std::size_t k = 0; k < fftSize; ++k) {
+        block[k] = sampleAt(signal, inBegin + static_cast<std::ptrdiff_t>(k), boundary);
+      }
+      plan->forward(block.data(), bins.data(), scratch.data());
+      for (std::size_t k = 0; k < bins.size(); ++k) { bins[k] = fft::mul(bins[k], maskSpectrum[k]); }
+      plan->inverse(bins.data(), block.data(), scratch.data());
+      std::copy_n(block.data() + history, count, out.data() + outBegin);
+    }
+  });
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Public API ...
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Process-wide `FftConvolver` for `mask`, so its spectra are computed
+ *  once however often the same mask is applied. Holds a handful of masks;
+ *  the cache is dropped wholesale when it fills.
+ */
+inline auto cachedConvolver(std::span<const float> mask) -> std::shared_ptr<const FftConvolver> {
+  constexpr std::size_t kMaxMasks = 32;
+  static std::mutex mutex;
+  static std::map<std::vector<float>, std::shared_ptr<const FftConvolver>> cache;
+  std::vector<float> key(mask.begin(), mask.end());
+  std::lock_guard lock(mutex);
+  if (auto it = cache.find(key); it != cache.end()) { return it->second; }
+  if (cache.size() >= kMaxMasks) { cache.clear(); }
+  auto convolver = std::make_shared<const FftConvolver>(mask);
+  cache.emplace(std::move(key), convolver);
+  return convolver;
+}
+
+/**
+ * @brief `out` = `signal` convolved with `mask` (see the top of this file).
+ * @return The method that ran: `Auto` resolves through `CostModel::host()`.
+ */
+inline auto convolve(
+  std::span<const float> signal,
+  std::span<const float> mask,
+  std::span<float> out,
+  Method method = Method::Auto,
+  Boundary boundary = Boundary::Zero) -> Method {
+  requireMask(mask.size());
+  requireOutputSize(signal.size(), out.size());
+  if (method == Method::Auto) { method = CostModel::host().choose(signal.size(), mask.size()); }
+  if (method == Method::Fft) { cachedConvolver(mask)->apply(signal, out, 0, boundary); }
+  else                       { direct(signal, mask, out, boundary); }
+  return method;
+}
+
+struct BatchShape {
+  std::size_t count;  // * signals in the batch
+  bool sharedMask;    // * one mask for all, or one per signal
+};
+
+/// @brief Checks a batch layout (see `convolveBatch`) and returns its shape.
+inline auto batchShape(
+  std::size_t samples, std::size_t length, std::size_t taps, std::size_t maskWidth) -> BatchShape {
+  requireMask(maskWidth);
+  if (length == 0 || samples % length != 0) {
+    throw std::runtime_error(
+      "Batch of " + std::to_string(samples) + " samples is not a whole number of " +
+      std::to_string(length) + "-sample signals.");
+  }
+  const std::size_t count = samples / length;
+  if (taps != maskWidth && taps != count * maskWidth) {
+    throw std::runtime_error(
+      "Batch masks must hold " + std::to_string(maskWidth) + " or " + std::to_string(count * maskWidth) +
+      " taps, got " + std::to_string(taps) + ".");
+  }
+  return {count, taps == maskWidth};
+}
+
+/**
+ * @brief Convolves `signals.size() / length` signals of `length` samples,
+ *  stored back to back, each into the matching slice of `out`.
+ * @details `masks` is either one mask of `maskWidth` taps shared by every
+ *  signal, or one mask per signal, back to back. The batch is one parallel
+ *  sweep: whole signals per task when there are enough of them to fill the
+ *  pool, otherwise one signal after the other, each spread over the pool.
+ * @return The method that ran, the same for every signal.
+ */
+inline auto convolveBatch(
+  std::span<const float> signals,
+  std::size_t length,
+  std::span<const float> masks,
+  std::size_t maskWidth,
+  std::span<float> out,
+  Method method = Method::Auto,
+  Boundary boundary = Boundary::Zero) -> Method {
+  requireOutputSize(signals.size(), out.size());
+  const auto [count, shared] = batchShape(signals.size(), length, masks.size(), maskWidth);
+  if (method == Method::Auto) { method = CostModel::host().choose(length, maskWidth); }
+
+  // * Shared masks keep their spectra across calls; per-signal ones are used once.
+  std::shared_ptr<const FftConvolver> sharedConvolver;
+  if (method == Method::Fft && shared) { sharedConvolver = cachedConvolver(masks); }
+  auto one = [&](std::size_t b) {
+    const auto signal = signals.subspan(b * length, length);
+    const auto mask = shared ? masks : masks.subspan(b * maskWidth, maskWidth);
+    const auto slice = out.subspan(b * length, length);
+    if (method == Method::Direct)  { direct(signal, mask, slice, boundary); }
+    else if (sharedConvolver)      { sharedConvolver->apply(signal, slice, 0, boundary); }
+    else                           { FftConvolver(mask).apply(signal, slice, 0, boundary); }
+  };
+
+  ThreadPool& pool = ThreadPool::global();
+  if (count >= 2 * pool.size()) {
+    // * Nested calls run serially, so each task is one thread's worth of signals.
+    const std::size_t grain = std::max<std::size_t>(1, kDirectChunk / length);
+    pool.parallelFor(count, grain, [&](std::size_t begin, std::size_t end) {
+      for (std::size_t b = begin; b < end; ++b) { one(b); }
+    });
+  } else {
+    for (std::size_t b = 0; b < count; ++b) { one(b); }
+  }
+  return method;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Streaming ...
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Convolution of an unbounded stream, one block of any size at a time.
+ * @details Every `process` call returns exactly as many samples as it was
+ *  given: the "same" convolution of everything pushed so far, delayed by
+ *  `latency()` samples (the first `latency()` outputs are zeros). `flush`
+ *  emits the last `latency()` outputs as if the stream ended there with
+ *  zero padding, so `process` + `flush` over a whole signal reproduces
+ *  `convolve` exactly (up to rounding).
+ *
+ *  Internally the stream is cut into hops of `hop()` outputs. A hop needs
+ *  the mask's lookahead (`M - 1 - M/2` samples) past its last output, so
+ *  `latency = hop + lookahead - 1`. Each hop runs overlap-save on one FFT
+ *  block, or the direct loop when the cost model says that is cheaper for
+ *  this (hop, M). State is the last `hop + M - 1` inputs and the pending
+ *  outputs; one filter is meant for one stream on one thread.
+ */
+class StreamingConvolver {
+public:
+  /**
+   * @param latency Delay in samples, at least the mask's lookahead. Lower is
+   *  more hops per sample; 0 picks the hop the cost model likes best.
+   * @throws std::runtime_error if `latency` is below the lookahead.
+   */
+  explicit StreamingConvolver(std::span<const float> mask, std::size_t latency = 0)
+    : convolver_(cachedConvolver(mask)) {
+    const std::size_t m = mask.size();
+    center_ = m / 2;
+    const std::size_t lookahead = m - 1 - center_;
+    if (latency == 0) {
+      // * An unbounded stream: what the model picks for a long signal.
+      const CostModel& model = CostModel::host();
+      constexpr std::size_t kLong = std::size_t{1} << 24;
+      const std::size_t hop = model.choose(kLong, m) == Method::Fft
+        ? model.bestFftSize(kLong, m) - m + 1
+        : kDirectChunk;
+      latency = hop + lookahead - 1;
+    }
+    if (latency < lookahead) {
+      throw std::runtime_error(
+        "Streaming convolution needs a latency of at least the mask's lookahead (" +
+        std::to_string(lookahead) + " samples), got " + std::to_string(latency) + ".");
+    }
+    latency_ = latency;
+    hop_ = latency - lookahead + 1;
+    window_ = hop_ + m - 1;
+    method_ = CostModel::host().choose(hop_, m);
+    if (method_ == Method::Fft) {
+      // * Any length that holds the window works: outputs past the hop are dropped.
+      plan_ = fft::RealPlan::get(nextFftSize(window_));
+      spectrum_ = &convolver_->spectrum(plan_->size());
+      block_.resize(plan_->size());
+      bins_.resize(plan_->bins());
+      scratch_.resize(plan_->scratchSize());
+    }
+    reset();
+  }
+
+  auto latency() const -> std::size_t { return latency_; }
+  auto hop() const -> std::size_t { return hop_; }
+  /// @brief How each hop is computed.
+  auto method() const -> Method { return method_; }
+
+  /// @brief Filters `in` into `out` (same size), `latency()` samples behind.
+  auto process(std::span<const float> in, std::span<float> out) -> void {
+    requireOutputSize(in.size(), out.size());
+    std::size_t done = 0;
+    while (done < in.size()) {
+      const std::size_t take = std::min(in.size() - done, window_ - (last_ - first_));
+      if (last_ + take > history_.size()) {
+        // * Out of room at the back: slide the live samples to the front.
+        std::copy(history_.begin() + first_, history_.begin() + last_, history_.begin());
+        last_ -= first_;
+        first_ = 0;
+      }
+      std::copy_n(in.begin() + done, take, history_.begin() + last_);
+      last_ += take;
+      if (last_ - first_ == window_) { runHop(); }
+      // * The pre-roll zeros guarantee a full hop of outputs is always ahead.
+      std::copy_n(ready_.begin() + head_, take, out.begin() + done);
+      head_ += take;
+      done += take;
+    }
+    if (head_ > hop_) {
+      ready_.erase(ready_.begin(), ready_.begin() + head_);
+      head_ = 0;
+    }
+  }
+
+  /// @brief The last `latency()` outputs (into `out`, which must hold that
+  ///  many), feeding zeros as the rest of the stream. Call `reset` to reuse.
+  auto flush(std::span<float> out) -> void {
+    const std::vector<float> zeros(latency_, 0.0f);
+    process(zeros, out);
+  }
+
+  /// @brief Back to the state of a new stream.
+  auto reset() -> void {
+    // * Samples before the stream starts are zeros. Room for several
+    // * windows, so sliding the history back is rare.
+    history_.assign(std::max<std::size_t>(4 * window_, kDirectChunk), 0.0f);
+    first_ = 0;
+    last_ = center_;
+    ready_.assign(latency_, 0.0f);
+    ready_.reserve(latency_ + 2 * hop_);
+    head_ = 0;
+  }
+
+private:
+  /// @brief `hop_` outputs from a full window: `out[k] = sum_j window[k + j] * mask[j]`.
+  auto runHop() -> void {
+    const std::size_t base = ready_.size();
+    ready_.resize(base + hop_);
+    float* out = ready_.data() + base;
+    const auto mask = convolver_->mask();
+    const float* window = history_.data() + first_;
+    if (method_ == Method::Fft) {
+      std::copy_n(window, window_, block_.begin());
+      std::fill(block_.begin() + window_, block_.end(), 0.0f);
+      plan_->forward(block_.data(), bins_.data(), scratch_.data());
+      for (std::size_t k = 0; k < bins_.size(); ++k) { bins_[k] = fft::mul(bins_[k], (*spectrum_)[k]); }
+      plan_->inverse(bins_.data(), block_.data(), scratch_.data());
+      std::copy_n(block_.begin() + (mask.size() - 1), hop_, out);
+    } else if (hop_ < mask.size()) {
+      // * Short hops: one dot product per output, vectorised along the mask.
+      for (std::size_t k = 0; k < hop_; ++k) {
+        float sum = 0.0f;
+        for (std::size_t j = 0; j < mask.size(); ++j) { sum += window[k + j] * mask[j]; }
+        out[k] = sum;
+      }
+    } else {
+      std::fill_n(out, hop_, 0.0f);
+      for (std::size_t j = 0; j < mask.size(); ++j) {
+        const float w = mask[j];
+        const float* in = window + j;
+        for (std::size_t k = 0; k < hop_; ++k) { out[k] += in[k] * w; }
+      }
+    }
+    // * Keep the M - 1 samples the next hop shares with this one.
+    first_ += hop_;
+  }
+
+  std::shared_ptr<const FftConvolver> convolver_;
+  std::size_t center_ = 0;
+  std::size_t latency_ = 0;
+  std::size_t hop_ = 0;
+  std::size_t window_ = 0;
+  Method method_ = Method::Direct;
+  std::shared_ptr<const fft::RealPlan> plan_;
+  const std::vector<fft::Complex>* spectrum_ = nullptr;
+  std::vector<float> block_;
+  std::vector<fft::Complex> bins_;
+  std::vector<fft::Complex> scratch_;
+  std::vector<float> history_;  // * inputs of the current window: [first_, last_)
+  std::size_t first_ = 0;
+  std::size_t last_ = 0;
+  std::vector<float> ready_;    // * outputs not yet returned, from `head_` on
+  std::size_t head_ = 0;
+};
+
+}  // namespace compute::convolution
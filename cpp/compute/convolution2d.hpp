@@ -0,0 +1,365 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "convolution.hpp"
+#include "thread_pool.hpp"
+
+// * 2D convolution of row-major float images on the CPU, built on the 1D
+// * kernels of `convolution.hpp`. Semantics extend the 1D ones ("same" size,
+// * mask centred at `(H/2, W/2)`, not flipped, `Boundary` on both axes):
+// *
+// *   out[y][x] = sum_{i,j} image[y + i - H/2][x + j - W/2] * mask[i][j]
+// *
+// * A separable (rank-1) mask, `mask[i][j] = column[i] * row[j]`, costs
+// * H + W multiply-adds per pixel instead of H·W: a row pass, then a column
+// * pass. The column pass reads tiles of a few columns, transposed so each
+// * column is contiguous, and runs the same 1D kernels down them. Any other
+// * mask goes through the direct path: each output tile gathers its input
+// * tile plus halo once, then sums one 1D row convolution per mask row.
+// * Both paths are split into tiles over the thread pool.
+
+namespace compute::convolution {
+
+enum class Path { Auto, Separable, Direct };
+
+inline auto pathName(Path path) -> const char* {
+  switch (path) {
+    case Path::Auto:      return "auto";
+    case Path::Separable: return "separable";
+    case Path::Direct:    return "direct";
+  }
+  return "unknown";
+}
+
+inline auto requireImage(std::size_t pixels, std::size_t width, std::size_t height) -> void {
+  if (pixels != width * height) {
+    throw std::runtime_error(
+      "Image of " + std::to_string(pixels) + " pixels is not " + std::to_string(width) + "x" + std::to_string(height) + ".");
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Separable masks ...
+///////////////////////////////////////////////////////////////////////////////
+
+/// @brief `mask[i][j] = column[i] * row[j]`.
+struct SeparableMask {
+  std::vector<float> column;
+  std::vector<float> row;
+};
+
+/// @brief The `height` x `width` mask `column ⊗ row`, row-major.
+inline auto outerProduct(std::span<const float> column, std::span<const float> row) -> std::vector<float> {
+  std::vector<float> mask(column.size() * row.size());
+  for (std::size_t i = 0; i < column.size(); ++i) {
+    for (std::size_t j = 0; j < row.size(); ++j) { mask[i * row.size() + j] = column[i] * row[j]; }
+  }
+  return mask;
+}
+
+/**
+ * @brief Splits a row-major `height` x `width` mask into a column and a row
+ *  vector, if it is rank 1.
+ * @details The factors come from the row and column through the largest
+ *  coefficient. The mask counts as separable when every coefficient of
+ *  their product is within `tolerance · max |mask|` of the original.
+ */
+inline auto separate(
+  std::span<const float> mask,
+  std::size_t width,
+  std::size_t height,
+  float tolerance = 1e-5f) -> std::optional<SeparableMask> {
+  requireImage(mask.size(), width, height);
+  if (mask.empty()) { return std::nullopt; }
+  const auto pivot = static_cast<std::size_t>(std::distance(
+    mask.begin(), std::max_element(mask.begin(), mask.end(), [](float a, float b) { return std::abs(a) < std::abs(b); })));
+  const float peak = mask[pivot];
+  if (peak == 0.0f) { return SeparableMask{std::vector<float>(height, 0.0f), std::vector<float>(width, 0.0f)}; }
+
+  SeparableMask factors{std::vector<float>(height), {}};
+  const std::size_t pivotRow = pivot / width, pivotColumn = pivot % width;
+  factors.row.assign(mask.begin() + pivotRow * width, mask.begin() + (pivotRow + 1) * width);
+  for (std::size_t i = 0; i < height; ++i) { factors.column[i] = mask[i * width + pivotColumn] / peak; }
+
+  const float limit = tolerance * std::abs(peak);
+  for (std::size_t i = 0; i < height; ++i) {
+    for (std::size_t j = 0; j < width; ++j) {
+      if (std::abs(factors.column[i] * factors.row[j] - mask[i * width + j]) > limit) { return std::nullopt; }
+    }
+  }
+  return factors;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Separable path ...
+///////////////////////////////////////////////////////////////////////////////
+
+// * Column-pass tile: 128 columns by 32 rows, about 23 KiB with the halo of
+// * a 15-tap mask, transposed in and out through L1. Narrower strips write
+// * too little of each output row per tile: with power-of-two widths those
+// * rows share cache sets and the stores stall.
+inline constexpr std::size_t kColumnTileWidth  = 128;
+inline constexpr std::size_t kColumnTileHeight = 32;
+
+/// @brief 4 floats in one register (GCC/Clang vector extension).
+typedef float Quad __attribute__((vector_size(4 * sizeof(float))));
+
+/// @brief `dst[c * stride + r] = rows[r][c]` for `r, c < 4`: four loads,
+///  eight shuffles, four stores.
+inline auto transpose4x4(const float* const* rows, float* dst, std::size_t stride) -> void {
+  Quad a, b, c, d;
+  std::memcpy(&a, rows[0], sizeof(Quad));
+  std::memcpy(&b, rows[1], sizeof(Quad));
+  std::memcpy(&c, rows[2], sizeof(Quad));
+  std::memcpy(&d, rows[3], sizeof(Quad));
+  const Quad ab0 = __builtin_shufflevector(a, b, 0, 4, 1, 5), ab1 = __builtin_shufflevector(a, b, 2, 6, 3, 7);
+  const Quad cd0 = __builtin_shufflevector(c, d, 0, 4, 1, 5), cd1 = __builtin_shufflevector(c, d, 2, 6, 3, 7);
+  const Quad t0 = __builtin_shufflevector(ab0, cd0, 0, 1, 4, 5), t1 = __builtin_shufflevector(ab0, cd0, 2, 3, 6, 7);
+  const Quad t2 = __builtin_shufflevector(ab1, cd1, 0, 1, 4, 5), t3 = __builtin_shufflevector(ab1, cd1, 2, 3, 6, 7);
+  std::memcpy(dst, &t0, sizeof(Quad));
+  std::memcpy(dst + stride, &t1, sizeof(Quad));
+  std::memcpy(dst + 2 * stride, &t2, sizeof(Quad));
+  std::memcpy(dst + 3 * stride, &t3, sizeof(Quad));
+}
+
+/// @brief Every row of `image` convolved with `mask`, into `out`.
+inline auto rowPass(
+  const float* image, std::size_t width, std::size_t height,
+  std::span<const float> mask, float* out, Boundary boundary) -> void {
+  const std::size_t grain = std::max<std::size_t>(kDirectChunk / std::max<std::size_t>(width, 1), 1);
+  ThreadPool::global().parallelFor(height, grain, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t y = begin; y < end; ++y) {
+      directRange({image + y * width, width}, mask, out + y * width, 0, width, nullptr, boundary);
+    }
+  });
+}
+
+/**
+ * @brief Every column of `image` convolved with `mask`, into `out`.
+ * @details Per tile, the source rows (halo and boundary included) are read
+ *  contiguously and transposed, 4x4 blocks at a time, into a tile where each
+ *  image column is one contiguous row. The 1D interior kernel runs along
+ *  each, and the results are transposed back the same way.
+ */
+inline auto columnPass(
+  const float* image, std::size_t width, std::size_t height,
+  std::span<const float> mask, float* out, Boundary boundary) -> void {
+  const std::size_t m = mask.size();
+  const std::size_t center = m / 2;
+  // * Rows of the transposed tile, padded to whole 4x4 blocks.
+  const std::size_t span = (kColumnTileHeight + m - 1 + 3) / 4 * 4;
+  const std::size_t tilesX = (width + kColumnTileWidth - 1) / kColumnTileWidth;
+  const std::size_t tilesY = (height + kColumnTileHeight - 1) / kColumnTileHeight;
+  const InteriorKernel interior = interiorKernel(m);
+
+  ThreadPool::global().parallelFor(tilesX * tilesY, 1, [&](std::size_t begin, std::size_t end) {
+    std::vector<float> tile(kColumnTileWidth * span);
+    std::vector<float> result(kColumnTileWidth * kColumnTileHeight);
+    const std::vector<float> zeros(kColumnTileWidth, 0.0f);
+    for (std::size_t t = begin; t < end; ++t) {
+      // * Neighbouring tasks share a band of rows, and so their halo.
+      const std::size_t x0 = t % tilesX * kColumnTileWidth;
+      const std::size_t y0 = t / tilesX * kColumnTileHeight;
+      const std::size_t columns = std::min(kColumnTileWidth, width - x0);
+      const std::size_t rows = std::min(kColumnTileHeight, height - y0);
+      const std::size_t inputs = rows + m - 1;
+      const std::size_t wholeColumns = columns / 4 * 4;
+
+      for (std::size_t k0 = 0; k0 < inputs; k0 += 4) {
+        std::array<const float*, 4> source;
+        for (std::size_t kk = 0; kk < 4; ++kk) {
+          const std::ptrdiff_t at = k0 + kk < inputs ? boundaryIndex(
+            static_cast<std::ptrdiff_t>(y0 + k0 + kk) - static_cast<std::ptrdiff_t>(center), height, boundary) : -1;
+          source[kk] = at < 0 ? zeros.data() : image + static_cast<std::size_t>(at) * width + x0;
+        }
+        for (std::size_t b = 0; b < wholeColumns; b += 4) {
+          const std::array<const float*, 4> block{source[0] + b, source[1] + b, source[2] + b, source[3] + b};
+          transpose4x4(block.data(), tile.data() + b * span + k0, span);
+        }
+        for (std::size_t b = wholeColumns; b < columns; ++b) {
+          for (std::size_t kk = 0; kk < 4; ++kk) { tile[b * span + k0 + kk] = source[kk][b]; }
+        }
+      }
+      for (std::size_t b = 0; b < columns; ++b) {
+        interior(tile.data() + b * span + center, mask.data(), m, result.data() + b * kColumnTileHeight, 0, rows);
+      }
+      const std::size_t wholeRows = rows / 4 * 4;
+      for (std::size_t r = 0; r < wholeRows; r += 4) {
+        float* dst = out + (y0 + r) * width + x0;
+        for (std::size_t b = 0; b < wholeColumns; b += 4) {
+          const float* src = result.data() + b * kColumnTileHeight + r;
+          const std::array<const float*, 4> block{
+            src, src + kColumnTileHeight, src + 2 * kColumnTileHeight, src + 3 * kColumnTileHeight};
+          transpose4x4(block.data(), dst + b, width);
+        }
+        for (std::size_t b = wholeColumns; b < columns; ++b) {
+          for (std::size_t rr = 0; rr < 4; ++rr) { dst[rr * width + b] = result[b * kColumnTileHeight + r + rr]; }
+        }
+      }
+      for (std::size_t r = wholeRows; r < rows; ++r) {
+        float* dst = out + (y0 + r) * width + x0;
+        for (std::size_t b = 0; b < columns; ++b) { dst[b] = result[b * kColumnTileHeight + r]; }
+      }
+    }
+  });
+}
+
+/// @brief `image` convolved with `column ⊗ row`. `out` may be `image`.
+inline auto convolveSeparable(
+  std::span<const float> image,
+  std::size_t width,
+  std::size_t height,
+  std::span<const float> column,
+  std::span<const float> row,
+  std::span<float> out,
+  Boundary boundary = Boundary::Zero) -> void {
+  requireImage(image.size(), width, height);
+  requireOutputSize(image.size(), out.size());
+  requireMask(column.size());
+  requireMask(row.size());
+  if (image.empty()) { return; }
+  // * Kept across calls: a fresh image-sized buffer costs a page fault per
+  // * 4 KiB, as much as the row pass itself.
+  thread_local std::vector<float> rows;
+  if (rows.size() < image.size()) { rows.resize(image.size()); }
+  rowPass(image.data(), width, height, row, rows.data(), boundary);
+  columnPass(rows.data(), width, height, column, out.data(), boundary);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Direct path ...
+///////////////////////////////////////////////////////////////////////////////
+
+// * Output tile of the direct path: 32 rows of 256 pixels. With a 15x15
+// * mask the input tile is 46 x 270 floats, about 49 KiB: L2, with the
+// * `maskHeight` rows one output row reads at a time in L1.
+inline constexpr std::size_t kDirectTileWidth  = 256;
+inline constexpr std::size_t kDirectTileHeight = 32;
+
+/**
+ * @brief `image` convolved with any `maskHeight` x `maskWidth` mask, H·W
+ *  multiply-adds per pixel. `out` must not overlap `image`.
+ * @details Each tile of outputs first gathers its input tile, boundary
+ *  applied, so the inner loops never check bounds. An output row is then
+ *  the sum of `maskHeight` 1D convolutions of tile rows, each through the
+ *  unrolled `interiorFixedWidth<W>` when W is odd and at most 63, which
+ *  covers the usual 3x3 to 15x15 masks.
+ */
+inline auto convolve2dDirect(
+  std::span<const float> image,
+  std::size_t width,
+  std::size_t height,
+  std::span<const float> mask,
+  std::size_t maskWidth,
+  std::size_t maskHeight,
+  std::span<float> out,
+  Boundary boundary = Boundary::Zero) -> void {
+  requireImage(image.size(), width, height);
+  requireImage(mask.size(), maskWidth, maskHeight);
+  requireOutputSize(image.size(), out.size());
+  requireMask(mask.size());
+  if (image.empty()) { return; }
+  const std::size_t cx = maskWidth / 2, cy = maskHeight / 2;
+  const std::size_t spanX = kDirectTileWidth + maskWidth - 1;
+  const std::size_t tilesX = (width + kDirectTileWidth - 1) / kDirectTileWidth;
+  const std::size_t tilesY = (height + kDirectTileHeight - 1) / kDirectTileHeight;
+  const InteriorKernel interior = interiorKernel(maskWidth);
+
+  ThreadPool::global().parallelFor(tilesX * tilesY, 1, [&](std::size_t begin, std::size_t end) {
+    std::vector<float> tile((kDirectTileHeight + maskHeight - 1) * spanX);
+    std::vector<float> partial(kDirectTileWidth);
+    for (std::size_t t = begin; t < end; ++t) {
+      const std::size_t x0 = t % tilesX * kDirectTileWidth;
+      const std::size_t y0 = t / tilesX * kDirectTileHeight;
+      const std::size_t columns = std::min(kDirectTileWidth, width - x0);
+      const std::size_t rows = std::min(kDirectTileHeight, height - y0);
+      const auto left = static_cast<std::ptrdiff_t>(x0) - static_cast<std::ptrdiff_t>(cx);
+
+      for (std::size_t k = 0; k < rows + maskHeight - 1; ++k) {
+        const std::ptrdiff_t source = boundaryIndex(
+          static_cast<std::ptrdiff_t>(y0 + k) - static_cast<std::ptrdiff_t>(cy), height, boundary);
+        float* dst = tile.data() + k * spanX;
+        if (source < 0) {
+          std::fill_n(dst, columns + maskWidth - 1, 0.0f);
+          continue;
+        }
+        // * In-range samples are one copy; only the halo past either end of
+        // * the row goes through the boundary rule.
+        const std::span<const float> row(image.data() + static_cast<std::size_t>(source) * width, width);
+        const auto inputs = static_cast<std::ptrdiff_t>(columns + maskWidth - 1);
+        const std::ptrdiff_t first = std::clamp<std::ptrdiff_t>(-left, 0, inputs);
+        const std::ptrdiff_t last = std::clamp<std::ptrdiff_t>(static_cast<std::ptrdiff_t>(width) - left, first, inputs);
+        for (std::ptrdiff_t j = 0; j < first; ++j) { dst[j] = sampleAt(row, left + j, boundary); }
+        std::copy(row.begin() + (left + first), row.begin() + (left + last), dst + first);
+        for (std::ptrdiff_t j = last; j < inputs; ++j) { dst[j] = sampleAt(row, left + j, boundary); }
+      }
+      for (std::size_t r = 0; r < rows; ++r) {
+        float* dst = out.data() + (y0 + r) * width + x0;
+        interior(tile.data() + r * spanX + cx, mask.data(), maskWidth, dst, 0, columns);
+        for (std::size_t i = 1; i < maskHeight; ++i) {
+          interior(tile.data() + (r + i) * spanX + cx, mask.data() + i * maskWidth, maskWidth, partial.data(), 0, columns);
+          for (std::size_t x = 0; x < columns; ++x) { dst[x] += partial[x]; }
+        }
+      }
+    }
+  });
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Public API ...
+///////////////////////////////////////////////////////////////////////////////
+
+/// @brief Whether a separable mask is cheaper as two passes. Those also
+///  write, re-read and transpose an intermediate image, worth about three
+///  taps per pixel: up to 5x5 stays direct, 7x7 and up split.
+inline auto worthSeparating(std::size_t maskWidth, std::size_t maskHeight) -> bool {
+  return maskWidth * maskHeight > 3 * (maskWidth + maskHeight);
+}
+
+/**
+ * @brief 2D convolution of a row-major `width` x `height` image with a
+ *  row-major `maskWidth` x `maskHeight` mask into `out`.
+ * @details `Path::Auto` takes the separable path when `separate` finds
+ *  factors and `worthSeparating` says the mask is big enough, and the
+ *  direct path otherwise. Forcing `Separable` on a mask that isn't throws.
+ *  `out` must not overlap `image`.
+ * @return The path that ran.
+ */
+inline auto convolve2d(
+  std::span<const float> image,
+  std::size_t width,
+  std::size_t height,
+  std::span<const float> mask,
+  std::size_t maskWidth,
+  std::size_t maskHeight,
+  std::span<float> out,
+  Path path = Path::Auto,
+  Boundary boundary = Boundary::Zero) -> Path {
+  requireImage(mask.size(), maskWidth, maskHeight);
+  requireMask(mask.size());
+  if (path == Path::Auto && !worthSeparating(maskWidth, maskHeight)) { path = Path::Direct; }
+  if (path != Path::Direct) {
+    if (const auto factors = separate(mask, maskWidth, maskHeight)) {
+      convolveSeparable(image, width, height, factors->column, factors->row, out, boundary);
+      return Path::Separable;
+    }
+    if (path == Path::Separable) {
+      throw std::runtime_error(
+        "The " + std::to_string(maskWidth) + "x" + std::to_string(maskHeight) + " mask is not separable.");
+    }
+  }
+  convolve2dDirect(image, width, height, mask, maskWidth, maskHeight, out, boundary);
+  return Path::Direct;
+}
+
+}  // namespace compute::convolution
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "backend.hpp"
+#include "context.hpp"
+#include "convolution.hpp"
+
+// * Device side of `convolution.hpp`: a whole batch of signals in one
+// * dispatch of `convolution_batched` (`day2/convolution.metal`), or one
+// * signal halo-tiled with a boundary rule, on Metal or on the CPU twins in
+// * `cpu_kernels.hpp`.
+
+namespace compute::convolution {
+
+/// @brief Kernel of `day2/convolution.metal` for a mask of `maskWidth` taps:
+///  the unrolled `convolution_<W>` when there is one, else `convolution`.
+inline auto kernelName(std::size_t maskWidth) -> std::string {
+  return hasFixedWidth(maskWidth) ? "convolution_" + std::to_string(maskWidth) : "convolution";
+}
+
+/**
+ * @brief Direct convolution through a `Context`.
+ * @details In `run`, the grid is (samples, signals): each thread computes
+ *  one output of one signal, and a threadgroup covers several short signals
+ *  at once so thousands of short channels still fill the GPU. Layouts are
+ *  the ones of `convolveBatch`. `runTiled` is the single-signal path with
+ *  threadgroup-memory tiles and a choice of `Boundary`.
+ */
+class DeviceConvolution {
+public:
+  explicit DeviceConvolution(Context& context, std::filesystem::path library = "./convolution.metallib")
+    : context_(context), library_(std::move(library)) {}
+
+  /// @brief Buffers already on the device, `count` signals of `length` samples.
+  auto run(
+    Buffer& signals, Buffer& masks, Buffer& out,
+    std::size_t count, std::size_t length, std::size_t maskWidth, bool sharedMask) -> void {
+    Pipeline& pipeline = context_.pipeline(library_, "convolution_batched");
+    const std::uint32_t width  = checked(maskWidth, "mask width");
+    const std::uint32_t input  = checked(length, "signal length");
+    const std::uint32_t stride = sharedMask ? 0 : width;
+    const std::uint32_t batch  = checked(count, "batch size");
+    checked(count * length, "batch sample count");
+
+    Arguments arguments;
+    arguments.setBuffer(signals, 0, 0).setBuffer(masks, 0, 1).setBuffer(out, 0, 2)
+             .setValue(width, 3).setValue(input, 4).setValue(stride, 5).setValue(batch, 6);
+    context_.queue().dispatchThreads(pipeline, arguments, {length, count, 1}, groupFor(pipeline, length));
+  }
+
+  /// @brief Host spans: uploads the batch, one dispatch, copies the outputs back.
+  auto convolve(
+    std::span<const float> signals,
+    std::size_t length,
+    std::span<const float> masks,
+    std::size_t maskWidth,
+    std::span<float> out) -> void {
+    requireOutputSize(signals.size(), out.size());
+    const auto [count, shared] = batchShape(signals.size(), length, masks.size(), maskWidth);
+    if (count == 0) { return; }
+    Device& device = context_.device();
+    auto signalBuf = device.newBuffer(signals.data(), signals.size_bytes());
+    auto maskBuf   = device.newBuffer(masks.data(), masks.size_bytes());
+    auto outBuf    = device.newBuffer(out.size_bytes());
+    run(*signalBuf, *maskBuf, *outBuf, count, length, maskWidth, shared);
+    std::copy_n(outBuf->as<float>(), out.size(), out.begin());
+  }
+
+  /**
+   * @brief One signal, halo-tiled: `convolution_tiled` over the interior,
+   *  then `convolution_edge_<boundary>` over the outputs near either end.
+   * @details Throws when the mask leaves no room for a threadgroup in the
+   *  kernel's tile (`kTileCapacity` floats).
+   */
+  auto runTiled(Buffer& signal, Buffer& mask, Buffer& out, std::size_t length, std::size_t maskWidth, Boundary boundary) -> void {
+    const std::uint32_t width = checked(maskWidth, "mask width");
+    const std::uint32_t input = checked(length, "signal length");
+    const std::size_t interior = length + 1 > maskWidth ? length + 1 - maskWidth : 0;
+    if (interior > 0) {
+      Pipeline& pipeline = context_.pipeline(library_, "convolution_tiled");
+      const std::uint32_t count = static_cast<std::uint32_t>(interior);
+      Arguments arguments;
+      arguments.setBuffer(signal, 0, 0).setBuffer(mask, 0, 1).setBuffer(out, maskWidth / 2 * sizeof(float), 2)
+               .setValue(width, 3).setValue(count, 4);
+      context_.queue().dispatchThreads(pipeline, arguments, {interior, 1, 1}, tileGroupFor(pipeline, maskWidth));
+    }
+    if (const std::size_t edges = length - interior; edges > 0) {
+      Pipeline& pipeline = context_.pipeline(library_, std::string("convolution_edge_") + boundaryName(boundary));
+      Arguments arguments;
+      arguments.setBuffer(signal, 0, 0).setBuffer(mask, 0, 1).setBuffer(out, 0, 2)
+               .setValue(width, 3).setValue(input, 4);
+      context_.queue().dispatchThreads(pipeline, arguments, {edges, 1, 1}, groupFor(pipeline, edges));
+    }
+  }
+
+  /// @brief Host spans: uploads, `runTiled`, copies the output back.
+  auto convolveTiled(
+    std::span<const float> signal,
+    std::span<const float> mask,
+    std::span<float> out,
+    Boundary boundary = Boundary::Zero) -> void {
+    requireMask(mask.size());
+    requireOutputSize(signal.size(), out.size());
+    if (signal.empty()) { return; }
+    Device& device = context_.device();
+    auto signalBuf = device.newBuffer(signal.data(), signal.size_bytes());
+    auto maskBuf   = device.newBuffer(mask.data(), mask.size_bytes());
+    auto outBuf    = device.newBuffer(out.size_bytes());
+    runTiled(*signalBuf, *maskBuf, *outBuf, signal.size(), mask.size(), boundary);
+    std::copy_n(outBuf->as<float>(), out.size(), out.begin());
+  }
+
+  /// @brief Floats of threadgroup memory in `convolution_tiled`.
+  static constexpr std::size_t kTileCapacity = 2048;
+
+private:
+  static auto checked(std::size_t n, const char* what) -> std::uint32_t {
+    if (n > UINT32_MAX) {
+      throw std::runtime_error(std::string("Device convolution indexes with 32 bits; ") + what + " is " + std::to_string(n) + ".");
+    }
+    return static_cast<std::uint32_t>(n);
+  }
+
+  // * Whole SIMD groups along the signal, up to 256 threads; short signals
+  // * stack several rows per group instead of leaving lanes idle.
+  static auto groupFor(const Pipeline& pipeline, std::size_t length) -> Size {
+    const std::size_t simd = std::max<std::size_t>(pipeline.threadExecutionWidth(), 1);
+    const std::size_t limit = std::max(simd, std::min<std::size_t>(pipeline.maxTotalThreadsPerThreadgroup(), 256));
+    const std::size_t width = std::min(limit, (length + simd - 1) / simd * simd);
+    return {width, limit / width, 1};
+  }
+
+  // * As wide as the tile allows, in whole SIMD groups, up to 256 threads.
+  static auto tileGroupFor(const Pipeline& pipeline, std::size_t maskWidth) -> Size {
+    const std::size_t simd = std::max<std::size_t>(pipeline.threadExecutionWidth(), 1);
+    const std::size_t limit = std::min<std::size_t>(pipeline.maxTotalThreadsPerThreadgroup(), 256);
+    const std::size_t room = maskWidth <= kTileCapacity ? kTileCapacity + 1 - maskWidth : 0;
+    const std::size_t width = std::min(limit, room) / simd * simd;
+    if (width == 0) {
+      throw std::runtime_error(
+        "Mask of " + std::to_string(maskWidth) + " taps leaves no room for a threadgroup in a "
+        + std::to_string(kTileCapacity) + "-float tile; use the untiled kernels.");
+    }
+    return {width, 1, 1};
+  }
+
+  Context& context_;
+  std::filesystem::path library_;
+};
+
+}  // namespace compute::convolution
@@ -0,0 +1,294 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "backend.hpp"
+#include "thread_pool.hpp"
+
+namespace compute {
+
+///////////////////////////////////////////////////////////////////////////////
+// * What a CPU kernel sees ...
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief One threadgroup's slice of the grid.
+ * @details A CPU kernel runs a whole threadgroup per call and loops over its
+ *  threads itself. That keeps per-thread call overhead out of the inner loop
+ *  and lets kernels that use threadgroup memory on the GPU (tiles, halos)
+ *  keep the same blocking with ordinary locals.
+ */
+struct Threadgroup {
+  Size position;  // * [[threadgroup_position_in_grid]]
+  Size origin;    // * [[thread_position_in_grid]] of the first thread
+  Size threads;   // * threads in this group, clipped to the grid edge
+  Size gridSize;  // * [[threads_per_grid]]
+};
+
+/// @brief Raw pointers to each bound argument, indexed like `[[buffer(n)]]`.
+class KernelArguments {
+public:
+  struct Binding {
+    void* data = nullptr;
+    std::size_t length = 0;
+  };
+
+  explicit KernelArguments(std::vector<Binding> bindings) : bindings_(std::move(bindings)) {}
+
+  template <typename T>
+  auto buffer(std::uint32_t index) const -> T* {
+    return static_cast<T*>(at(index).data);
+  }
+
+  template <typename T>
+  auto value(std::uint32_t index) const -> const T& {
+    const Binding& binding = at(index);
+    if (binding.length < sizeof(T)) {
+      throw std::runtime_error(
+        "Kernel argument " + std::to_string(index) + " is smaller than the requested type.");
+    }
+    return *static_cast<const T*>(binding.data);
+  }
+
+  auto length(std::uint32_t index) const -> std::size_t { return at(index).length; }
+
+private:
+  auto at(std::uint32_t index) const -> const Binding& {
+    if (index >= bindings_.size() || !bindings_[index].data) {
+      throw std::runtime_error("Kernel argument " + std::to_string(index) + " is not bound.");
+    }
+    return bindings_[index];
+  }
+
+  std::vector<Binding> bindings_;
+};
+
+using CpuKernel = std::function<void(const KernelArguments&, const Threadgroup&)>;
+
+/**
+ * @brief C++ twins of the `.metal` kernels, keyed by (library, function).
+ * @details The library name is the stem of the `.metallib` path the host code
+ *  asks for, so `newLibrary("./add_vec.metallib")` finds the kernels
+ *  registered under `"add_vec"`.
+ */
+class KernelRegistry {
+public:
+  auto add(std::string library, std::string function, CpuKernel kernel) -> KernelRegistry& {
+    kernels_[{std::move(library), std::move(function)}] = std::move(kernel);
+    return *this;
+  }
+
+  auto find(const std::string& library, const std::string& function) const -> const CpuKernel* {
+    auto it = kernels_.find({library, function});
+    return it == kernels_.end() ? nullptr : &it->second;
+  }
+
+  auto hasLibrary(const std::string& library) const -> bool {
+    auto it = kernels_.lower_bound({library, std::string{}});
+    return it != kernels_.end() && it->first.first == library;
+  }
+
+private:
+  std::map<std::pair<std::string, std::string>, CpuKernel> kernels_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// * CPU implementations of the backend interface ...
+///////////////////////////////////////////////////////////////////////////////
+
+class CpuBuffer final : public Buffer {
+public:
+  explicit CpuBuffer(std::size_t length)
+    : storage_(new std::byte[length]), contents_(storage_.get()), length_(length) {}
+
+  /// @brief Borrows `length` bytes at `contents`; nothing is copied or freed.
+  CpuBuffer(void* contents, std::size_t length)
+    : contents_(static_cast<std::byte*>(contents)), length_(length) {}
+
+  auto contents() -> void* override { return contents_; }
+  auto length() const -> std::size_t override { return length_; }
+
+private:
+  std::unique_ptr<std::byte[]> storage_;  // * empty when borrowed
+  std::byte* contents_;
+  std::size_t length_;
+};
+
+class CpuLibrary final : public Library {
+public:
+  explicit CpuLibrary(std::string name) : name_(std::move(name)) {}
+  auto name() const -> const std::string& override { return name_; }
+
+private:
+  std::string name_;
+};
+
+class CpuPipeline final : public Pipeline {
+public:
+  CpuPipeline(std::string functionName, const CpuKernel& kernel)
+    : functionName_(std::move(functionName)), kernel_(kernel) {}
+
+  auto functionName() const -> const std::string& override { return functionName_; }
+
+  // * Same limits an Apple GPU reports, so host-side threadgroup sizing is
+  // * identical on both backends.
+  auto maxTotalThreadsPerThreadgroup() const -> std::size_t override { return 1024; }
+  auto threadExecutionWidth() const -> std::size_t override { return 32; }
+
+  auto kernel() const -> const CpuKernel& { return kernel_; }
+
+private:
+  std::string functionName_;
+  const CpuKernel& kernel_;
+};
+
+class CpuQueue final : public Queue {
+public:
+  explicit CpuQueue(ThreadPool& pool) : pool_(pool) {}
+
+  auto dispatchThreads(
+    const Pipeline& pipeline,
+    const Arguments& arguments,
+    Size grid,
+    Size threadsPerThreadgroup) -> void override {
+    run(pipeline, arguments, grid, threadsPerThreadgroup);
+  }
+
+  auto dispatchThreadgroups(
+    const Pipeline& pipeline,
+    const Arguments& arguments,
+    Size threadgroups,
+    Size threadsPerThreadgroup) -> void override {
+    const Size grid{
+      threadgroups.width  * threadsPerThreadgroup.width,
+      threadgroups.height * threadsPerThreadgroup.height,
+      threadgroups.depth  * threadsPerThreadgroup.depth};
+    run(pipeline, arguments, grid, threadsPerThreadgroup);
+  }
+
+private:
+  static auto ceilDiv(std::size_t a, std::size_t b) -> std::size_t { return (a + b - 1) / b; }
+
+  auto run(const Pipeline& pipeline, const Arguments& arguments, Size grid, Size group) -> void {
+    const auto* cpuPipeline = dynamic_cast<const CpuPipeline*>(&pipeline);
+    if (!cpuPipeline) {
+      throw std::runtime_error("CPU queue was given a pipeline from another backend.");
+    }
+    if (group.count() == 0) {
+      throw std::runtime_error("Threadgroup size must be non-zero in every dimension.");
+    }
+    if (grid.count() == 0) { return; }
+
+    std::vector<KernelArguments::Binding> bindings;
+    bindings.reserve(arguments.slots().size());
+    for (const auto& slot : arguments.slots()) {
+      if (slot.buffer) {
+        bindings.push_back({
+          static_cast<std::byte*>(slot.buffer->contents()) + slot.offset,
+          slot.buffer->length() - slot.offset});
+      } else if (!slot.bytes.empty()) {
+        bindings.push_back({const_cast<std::byte*>(slot.bytes.data()), slot.bytes.size()});
+      } else {
+        bindings.push_back({});
+      }
+    }
+    const KernelArguments kernelArguments(std::move(bindings));
+
+    const Size groups{
+      ceilDiv(grid.width, group.width),
+      ceilDiv(grid.height, group.height),
+      ceilDiv(grid.depth, group.depth)};
+    const CpuKernel& kernel = cpuPipeline->kernel();
+
+    // * Threadgroups are independent by definition, so they are the unit of
+    // * work handed to the pool.
+    pool_.parallelFor(groups.count(), [&](std::size_t begin, std::size_t end) {
+      for (std::size_t linear = begin; linear < end; ++linear) {
+        Threadgroup tg;
+        tg.position = {
+          linear % groups.width,
+          (linear / groups.width) % groups.height,
+          linear / (groups.width * groups.height)};
+        tg.origin = {
+          tg.position.width  * group.width,
+          tg.position.height * group.height,
+          tg.position.depth  * group.depth};
+        tg.threads = {
+          std::min(group.width,  grid.width  - tg.origin.width),
+          std::min(group.height, grid.height - tg.origin.height),
+          std::min(group.depth,  grid.depth  - tg.origin.depth)};
+        tg.gridSize = grid;
+        kernel(kernelArguments, tg);
+      }
+    });
+  }
+
+  ThreadPool& pool_;
+};
+
+/**
+ * @brief Runs the C++ twins of the Metal kernels on a thread pool.
+ * @param registry Kernels this device can load; see `defaultKernelRegistry()`.
+ */
+class CpuDevice final : public Device {
+public:
+  explicit CpuDevice(const KernelRegistry& registry, ThreadPool& pool = ThreadPool::global())
+    : registry_(registry), pool_(pool) {}
+
+  auto name() const -> std::string override {
+    return "CPU (" + std::to_string(pool_.size()) + " threads)";
+  }
+
+  auto newBuffer(std::size_t length) -> std::unique_ptr<Buffer> override {
+    return std::make_unique<CpuBuffer>(length);
+  }
+
+  auto newBuffer(const void* pointer, std::size_t length) -> std::unique_ptr<Buffer> override {
+    auto buffer = std::make_unique<CpuBuffer>(length);
+    std::copy_n(static_cast<const std::byte*>(pointer), length, static_cast<std::byte*>(buffer->contents()));
+    return buffer;
+  }
+
+  // * Host memory is device memory here, so any pointer works as is.
+  auto newBufferNoCopy(void* pointer, std::size_t length) -> std::unique_ptr<Buffer> override {
+    return std::make_unique<CpuBuffer>(pointer, length);
+  }
+
+  auto newLibrary(const std::filesystem::path& path) -> std::unique_ptr<Library> override {
+    std::string name = path.stem().string();
+    if (!registry_.hasLibrary(name)) {
+      throw std::runtime_error("No CPU kernels registered for library '" + name + "'.");
+    }
+    return std::make_unique<CpuLibrary>(std::move(name));
+  }
+
+  auto newPipeline(
+    const Library& library,
+    const std::string& functionName) -> std::unique_ptr<Pipeline> override {
+    const CpuKernel* kernel = registry_.find(library.name(), functionName);
+    if (!kernel) {
+      throw std::runtime_error(
+        "Failed to get compute function '" + functionName + "' from '" + library.name() + "'.");
+    }
+    return std::make_unique<CpuPipeline>(functionName, *kernel);
+  }
+
+  auto newQueue() -> std::unique_ptr<Queue> override {
+    return std::make_unique<CpuQueue>(pool_);
+  }
+
+private:
+  const KernelRegistry& registry_;
+  ThreadPool& pool_;
+};
+
+}  // namespace compute
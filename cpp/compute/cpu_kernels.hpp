@@ -0,0 +1,444 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <utility>
+
+#include "convolution.hpp"
+#include "cpu_backend.hpp"
+#include "gemm.hpp"
+#include "gemm_batched.hpp"
+#include "precision.hpp"
+#include "reduce.hpp"
+
+// * C++ twins of the Metal kernels. Each one keeps the argument indices and
+// * semantics of its `.metal` source, so host code binds them identically.
+// * A kernel is called once per threadgroup (see `Threadgroup`).
+
+namespace compute::kernels {
+
+/// @brief Twin of `vector_add` in `day1/add_vec.metal`.
+inline auto vectorAdd(const KernelArguments& args, const Threadgroup& tg) -> void {
+  const float* inA = args.buffer<const float>(0);
+  const float* inB = args.buffer<const float>(1);
+  float*       out = args.buffer<float>(2);
+
+  const std::size_t begin = tg.origin.width;
+  const std::size_t end   = begin + tg.threads.width;
+  for (std::size_t gid = begin; gid < end; ++gid) {
+    out[gid] = inA[gid] + inB[gid];
+  }
+}
+
+/// @brief Twin of `vector_add_half` / `vector_add_bf16` in `day1/add_vec.metal`.
+template <precision::NarrowStorage T>
+inline auto vectorAddNarrow(const KernelArguments& args, const Threadgroup& tg) -> void {
+  const T* inA = args.buffer<const T>(0);
+  const T* inB = args.buffer<const T>(1);
+  T*       out = args.buffer<T>(2);
+
+  const std::size_t begin = tg.origin.width;
+  precision::loops<T>(precision::activeIsa()).add(inA + begin, inB + begin, out + begin, tg.threads.width);
+}
+
+/// @brief Twin of `convolution` in `day2/convolution.metal`.
+inline auto convolution(const KernelArguments& args, const Threadgroup& tg) -> void {
+  const float* input  = args.buffer<const float>(0);
+  const float* mask   = args.buffer<const float>(1);
+  float*       output = args.buffer<float>(2);
+  const std::uint32_t maskWidth  = args.value<std::uint32_t>(3);
+  const std::uint32_t inputWidth = args.value<std::uint32_t>(4);
+
+  const int center = static_cast<int>(maskWidth / 2);
+  const std::size_t begin = tg.origin.width;
+  const std::size_t end   = begin + tg.threads.width;
+  for (std::size_t threadId = begin; threadId < end && threadId < inputWidth; ++threadId) {
+    float sum = 0.0f;
+    for (std::uint32_t i = 0; i < maskWidth; ++i) {
+      const int idx = static_cast<int>(threadId) + static_cast<int>(i) - center;
+      if (idx >= 0 && idx < static_cast<int>(inputWidth)) {
+        sum += input[idx] * mask[i];
+      }
+    }
+    output[threadId] = sum;
+  }
+}
+
+/// @brief Twin of `convolution_<W>` (`convolution_fixed<W>`) in `day2/convolution.metal`.
+template <std::size_t W>
+inline auto convolutionFixed(const KernelArguments& args, const Threadgroup& tg) -> void {
+  const float* input  = args.buffer<const float>(0);
+  const float* mask   = args.buffer<const float>(1);
+  float*       output = args.buffer<float>(2);
+  const std::uint32_t inputWidth = args.value<std::uint32_t>(4);
+
+  const std::size_t begin = tg.origin.width;
+  const std::size_t end   = std::min<std::size_t>(begin + tg.threads.width, inputWidth);
+  if (begin >= end) { return; }
+  convolution::directRange(
+    {input, inputWidth}, {mask, W}, output, begin, end,
+    convolution::interiorFixedWidth<W>);
+}
+
+/**
+ * @brief Twin of `convolution_batched` in `day2/convolution.metal`.
+ * @details Each row of the threadgroup is one signal; its span of outputs
+ *  goes through the blocked direct loop of `convolution.hpp`.
+ */
+inline auto convolutionBatched(const KernelArguments& args, const Threadgroup& tg) -> void {
+  const float* input  = args.buffer<const float>(0);
+  const float* masks  = args.buffer<const float>(1);
+  float*       output = args.buffer<float>(2);
+  const std::uint32_t maskWidth  = args.value<std::uint32_t>(3);
+  const std::uint32_t inputWidth = args.value<std::uint32_t>(4);
+  const std::uint32_t maskStride = args.value<std::uint32_t>(5);
+  const std::uint32_t batch      = args.value<std::uint32_t>(6);
+
+  const std::size_t begin = tg.origin.width;
+  const std::size_t end   = std::min<std::size_t>(begin + tg.threads.width, inputWidth);
+  const std::size_t last  = std::min<std::size_t>(tg.origin.height + tg.threads.height, batch);
+  for (std::size_t row = tg.origin.height; row < last && begin < end; ++row) {
+    const std::span<const float> signal(input + row * inputWidth, inputWidth);
+    const std::span<const float> mask(masks + row * maskStride, maskWidth);
+    convolution::directRange(signal, mask, output + row * inputWidth, begin, end);
+  }
+}
+
+/**
+ * @brief Twin of `convolution_tiled` in `day2/convolution.metal`.
+ * @details The threadgroup's outputs and their halo are one contiguous,
+ *  cache-resident run of the input, so the interior kernel reads it in place.
+ */
+inline auto convolutionTiled(const KernelArguments& args, const Threadgroup& tg) -> void {
+  const float* input  = args.buffer<const float>(0);
+  const float* mask   = args.buffer<const float>(1);
+  float*       output = args.buffer<float>(2);
+  const std::uint32_t maskWidth = args.value<std::uint32_t>(3);
+  const std::uint32_t count     = args.value<std::uint32_t>(4);
+
+  const std::size_t begin = tg.origin.width;
+  const std::size_t end   = std::min<std::size_t>(begin + tg.threads.width, count);
+  if (begin >= end) { return; }
+  // * `output[t]` reads `input[t .. t + maskWidth)`: the same as the "same"
+  // * interior kernel with the signal shifted by the mask centre.
+  convolution::interiorKernel(maskWidth)(input + maskWidth / 2, mask, maskWidth, output, begin, end);
+}
+
+/// @brief Twin of `convolution_edge_<mode>` (`convolution_edge<Mode>`) in `day2/convolution.metal`.
+template <convolution::Boundary B>
+inline auto convolutionEdge(const KernelArguments& args, const Threadgroup& tg) -> void {
+  const float* input  = args.buffer<const float>(0);
+  const float* mask   = args.buffer<const float>(1);
+  float*       output = args.buffer<float>(2);
+  const std::size_t maskWidth  = args.value<std::uint32_t>(3);
+  const std::size_t inputWidth = args.value<std::uint32_t>(4);
+
+  const std::size_t interior = inputWidth + 1 > maskWidth ? inputWidth + 1 - maskWidth : 0;
+  const std::size_t left     = std::min(maskWidth / 2, inputWidth);
+  const std::size_t begin    = tg.origin.width;
+  const std::size_t end      = std::min(begin + tg.threads.width, inputWidth - interior);
+  if (begin >= end) { return; }
+  const std::span<const float> signal(input, inputWidth);
+  const std::span<const float> taps(mask, maskWidth);
+  const auto kernel = convolution::interiorKernel(maskWidth);
+  convolution::edgeTile(signal, taps, output, begin, std::min(end, left), kernel, B);
+  convolution::edgeTile(signal, taps, output, std::max(begin, left) + interior, end + interior, kernel, B);
+}
+
+/**
+ * @brief Twin of `mat_mul` in `day3/mat_mul.metal`.
+ * @details As on the GPU, the inner dimension comes from buffer 3 and the
+ *  result's width and height from buffer 4. Each threadgroup owns one block
+ *  of C and accumulates it row by row in i-k-j order, which keeps the B
+ *  accesses contiguous where the MSL version relies on the threadgroup tiles.
+ */
+inline auto matMul(const KernelArguments& args, const Threadgroup& tg) -> void {
+  const float* a      = args.buffer<const float>(0);
+  const float* b      = args.buffer<const float>(1);
+  float*       result = args.buffer<float>(2);
+  const std::uint32_t innerDim = args.value<std::uint32_t>(3);
+  const auto [width, height]   = args.value<std::array<std::uint32_t, 2>>(4);
+
+  const std::size_t x0 = tg.origin.width;
+  const std::size_t x1 = std::min<std::size_t>(x0 + tg.threads.width, width);
+  const std::size_t y1 = std::min<std::size_t>(tg.origin.height + tg.threads.height, height);
+  for (std::size_t y = tg.origin.height; y < y1; ++y) {
+    float* row = result + y * width;
+    for (std::size_t x = x0; x < x1; ++x) { row[x] = 0.0f; }
+    for (std::size_t k = 0; k < innerDim; ++k) {
+      const float aik = a[y * innerDim + k];
+      const float* bRow = b + k * width;
+      for (std::size_t x = x0; x < x1; ++x) {
+        row[x] += aik * bRow[x];
+      }
+    }
+  }
+}
+
+/**
+ * @brief Twin of `gemm` in `day3/mat_mul.metal`: the threadgroup's block of
+ *  C through the packed CPU GEMM, with the same transposes, strides and
+ *  alpha/beta as the shader.
+ */
+inline auto gemm(const KernelArguments& args, const Threadgroup& tg) -> void {
+  const float* a = args.buffer<const float>(0);
+  const float* b = args.buffer<const float>(1);
+  float*       c = args.buffer<float>(2);
+  const auto p = args.value<gemm::KernelParams>(3);
+
+  const std::size_t i0 = tg.origin.height, j0 = tg.origin.width;
+  if (i0 >= p.m || j0 >= p.n) { return; }
+  const std::size_t rows = std::min<std::size_t>(tg.threads.height, p.m - i0);
+  const std::size_t cols = std::min<std::size_t>(tg.threads.width, p.n - j0);
+  const auto transA = p.transA ? gemm::Transpose::Yes : gemm::Transpose::No;
+  const auto transB = p.transB ? gemm::Transpose::Yes : gemm::Transpose::No;
+  // * Row i0 of op(A) and column j0 of op(B) in the stored matrices.
+  const float* aBlock = a + (p.transA ? i0 : i0 * p.lda);
+  const float* bBlock = b + (p.transB ? j0 * p.ldb : j0);
+  const gemm::MicroKernel& kernel = gemm::microKernel(gemm::activeIsa());
+  gemm::multiply(
+    rows, cols, p.k, p.alpha, gemm::view(transA, aBlock, p.lda), gemm::view(transB, bBlock, p.ldb),
+    p.beta, c + i0 * p.ldc + j0, p.ldc, kernel, kernel.blocking);
+}
+
+/**
+ * @brief Elements [x0, x1) of C for products [y0, y1) of a batch, as
+ *  `batched_element` does them. A group that covers whole rows of C (the
+ *  usual case) runs them as one small product instead.
+ */
+template <typename Offsets>
+inline auto gemmBatchedBlock(
+  const KernelArguments& args, const Threadgroup& tg, const Offsets& offsets) -> void {
+  const float* a = args.buffer<const float>(0);
+  const float* b = args.buffer<const float>(1);
+  float*       c = args.buffer<float>(2);
+  const auto p = args.value<gemm::BatchParams>(3);
+
+  const std::size_t x0 = tg.origin.width;
+  const std::size_t x1 = std::min<std::size_t>(x0 + tg.threads.width, std::size_t{p.m} * p.n);
+  const std::size_t y1 = std::min<std::size_t>(tg.origin.height + tg.threads.height, p.count);
+  const bool wholeRows = x0 % p.n == 0 && (x1 % p.n == 0 || x1 == std::size_t{p.m} * p.n);
+  const std::size_t row0 = x0 / p.n, rows = (x1 - x0 + p.n - 1) / p.n;
+  const gemm::SmallProduct product = gemm::smallProduct(rows, p.n, p.k);
+  for (std::size_t y = tg.origin.height; y < y1; ++y) {
+    const auto [offsetA, offsetB, offsetC] = offsets(y);
+    if (wholeRows) {
+      product(
+        rows, p.n, p.k, p.alpha, a + offsetA + row0 * p.lda, p.lda, b + offsetB, p.ldb,
+        p.beta, c + offsetC + row0 * p.ldc, p.ldc);
+      continue;
+    }
+    for (std::size_t element = x0; element < x1; ++element) {
+      const std::size_t row = element / p.n, col = element % p.n;
+      const float* aRow = a + offsetA + row * p.lda;
+      const float* bCol = b + offsetB + col;
+      float sum = 0.0f;
+      for (std::size_t q = 0; q < p.k; ++q) { sum += aRow[q] * bCol[q * p.ldb]; }
+      float& out = c[offsetC + row * p.ldc + col];
+      out = p.beta == 0.0f ? p.alpha * sum : p.alpha * sum + p.beta * out;
+    }
+  }
+}
+
+/// @brief Twin of `gemm_batched` in `day3/mat_mul.metal`.
+inline auto gemmBatched(const KernelArguments& args, const Threadgroup& tg) -> void {
+  const auto p = args.value<gemm::BatchParams>(3);
+  gemmBatchedBlock(args, tg, [&](std::size_t i) {
+    return std::array<std::size_t, 3>{i * p.strideA, i * p.strideB, i * p.strideC};
+  });
+}
+
+/// @brief Twin of `gemm_batched_indexed` in `day3/mat_mul.metal`.
+inline auto gemmBatchedIndexed(const KernelArguments& args, const Threadgroup& tg) -> void {
+  const std::uint32_t* offsets = args.buffer<const std::uint32_t>(4);
+  gemmBatchedBlock(args, tg, [&](std::size_t i) {
+    return std::array<std::size_t, 3>{offsets[3 * i], offsets[3 * i + 1], offsets[3 * i + 2]};
+  });
+}
+
+/// @brief Twin of `golBuffer` in `day4/gol_buffer.metal` (toroidal grid).
+inline auto golBuffer(const KernelArguments& args, const Threadgroup& tg) -> void {
+  const std::uint32_t* inputGrid  = args.buffer<const std::uint32_t>(0);
+  std::uint32_t*       outputGrid = args.buffer<std::uint32_t>(1);
+  const std::uint32_t width  = args.value<std::uint16_t>(2);
+  const std::uint32_t height = args.value<std::uint16_t>(3);
+
+  for (std::size_t y = tg.origin.height; y < tg.origin.height + tg.threads.height && y < height; ++y) {
+    const std::uint32_t up   = static_cast<std::uint32_t>((y + height - 1) % height) * width;
+    const std::uint32_t mid  = static_cast<std::uint32_t>(y) * width;
+    const std::uint32_t down = static_cast<std::uint32_t>((y + 1) % height) * width;
+    for (std::size_t x = tg.origin.width; x < tg.origin.width + tg.threads.width && x < width; ++x) {
+      const std::uint32_t left  = static_cast<std::uint32_t>((x + width - 1) % width);
+      const std::uint32_t right = static_cast<std::uint32_t>((x + 1) % width);
+      const std::uint32_t self  = static_cast<std::uint32_t>(x);
+
+      const std::uint32_t liveNeighbors =
+        inputGrid[up + left]   + inputGrid[up + self]   + inputGrid[up + right] +
+        inputGrid[mid + left]                           + inputGrid[mid + right] +
+        inputGrid[down + left] + inputGrid[down + self] + inputGrid[down + right];
+
+      const std::uint32_t currentState = inputGrid[mid + self];
+      // * Same rules as the shader: survive on 2 or 3, birth on exactly 3.
+      outputGrid[mid + self] =
+        (liveNeighbors == 3 || (currentState == 1 && liveNeighbors == 2)) ? 1u : 0u;
+    }
+  }
+}
+
+/**
+ * @brief Calls `run(first, count)` for each contiguous run of indices below
+ *  `length` that the threads of `tg` visit with a grid-sized stride, the
+ *  loop every `reduce_*` kernel in `day1/reduce.metal` uses.
+ */
+template <typename Run>
+inline auto forGridStride(const Threadgroup& tg, std::size_t length, const Run& run) -> void {
+  for (std::size_t first = tg.origin.width; first < length; first += tg.gridSize.width) {
+    run(first, std::min(tg.threads.width, length - first));
+  }
+}
+
+/// @brief Twin of `reduce_sum` in `day1/reduce.metal`: one partial per group.
+inline auto reduceSum(const KernelArguments& args, const Threadgroup& tg) -> void {
+  const float* in       = args.buffer<const float>(0);
+  float*       partials = args.buffer<float>(1);
+  const std::uint32_t length = args.value<std::uint32_t>(2);
+
+  const auto& leaf = reduce::leaves(reduce::activeIsa());
+  float value = 0.0f;
+  forGridStride(tg, length, [&](std::size_t first, std::size_t n) { value += leaf.sum(in + first, n); });
+  partials[tg.position.width] = value;
+}
+
+/// @brief Twin of `reduce_dot` in `day1/reduce.metal`.
+inline auto reduceDot(const KernelArguments& args, const Threadgroup& tg) -> void {
+  const float* inA      = args.buffer<const float>(0);
+  const float* inB      = args.buffer<const float>(1);
+  float*       partials = args.buffer<float>(2);
+  const std::uint32_t length = args.value<std::uint32_t>(3);
+
+  const auto& leaf = reduce::leaves(reduce::activeIsa());
+  float value = 0.0f;
+  forGridStride(tg, length, [&](std::size_t first, std::size_t n) {
+    value += leaf.dot(inA + first, inB + first, n);
+  });
+  partials[tg.position.width] = value;
+}
+
+/// @brief Twin of `reduce_min` in `day1/reduce.metal`.
+inline auto reduceMin(const KernelArguments& args, const Threadgroup& tg) -> void {
+  const float* in       = args.buffer<const float>(0);
+  float*       partials = args.buffer<float>(1);
+  const std::uint32_t length = args.value<std::uint32_t>(2);
+
+  const auto& leaf = reduce::leaves(reduce::activeIsa());
+  float value = std::numeric_limits<float>::infinity();
+  forGridStride(tg, length, [&](std::size_t first, std::size_t n) {
+    value = std::min(value, leaf.minimum(in + first, n));
+  });
+  partials[tg.position.width] = value;
+}
+
+/// @brief Twin of `reduce_max` in `day1/reduce.metal`.
+inline auto reduceMax(const KernelArguments& args, const Threadgroup& tg) -> void {
+  const float* in       = args.buffer<const float>(0);
+  float*       partials = args.buffer<float>(1);
+  const std::uint32_t length = args.value<std::uint32_t>(2);
+
+  const auto& leaf = reduce::leaves(reduce::activeIsa());
+  float value = -std::numeric_limits<float>::infinity();
+  forGridStride(tg, length, [&](std::size_t first, std::size_t n) {
+    value = std::max(value, leaf.maximum(in + first, n));
+  });
+  partials[tg.position.width] = value;
+}
+
+// * Sentinel index of an empty (value, index) partial, as in the shader.
+constexpr std::uint32_t kNoIndex = 0xffffffffu;
+
+/// @brief Twin of `reduce_argmax` in `day1/reduce.metal`: largest value, first index.
+inline auto reduceArgmax(const KernelArguments& args, const Threadgroup& tg) -> void {
+  const float*   in      = args.buffer<const float>(0);
+  float*         values  = args.buffer<float>(1);
+  std::uint32_t* indices = args.buffer<std::uint32_t>(2);
+  const std::uint32_t length = args.value<std::uint32_t>(3);
+
+  const auto& leaf = reduce::leaves(reduce::activeIsa());
+  float best = -std::numeric_limits<float>::infinity();
+  std::uint32_t index = kNoIndex;
+  forGridStride(tg, length, [&](std::size_t first, std::size_t n) {
+    const reduce::Indexed local = leaf.argmax(in + first, n);
+    // * Runs come in increasing index order, so strict `>` keeps the first.
+    if (local.value > best || index == kNoIndex) {
+      best = local.value;
+      index = static_cast<std::uint32_t>(first + local.index);
+    }
+  });
+  values[tg.position.width] = best;
+  indices[tg.position.width] = index;
+}
+
+/// @brief Twin of `reduce_argmax_pairs` in `day1/reduce.metal` (pass 2 of argmax).
+inline auto reduceArgmaxPairs(const KernelArguments& args, const Threadgroup& tg) -> void {
+  const float*         inValues   = args.buffer<const float>(0);
+  const std::uint32_t* inIndices  = args.buffer<const std::uint32_t>(1);
+  float*               outValues  = args.buffer<float>(2);
+  std::uint32_t*       outIndices = args.buffer<std::uint32_t>(3);
+  const std::uint32_t length = args.value<std::uint32_t>(4);
+
+  float best = -std::numeric_limits<float>::infinity();
+  std::uint32_t index = kNoIndex;
+  forGridStride(tg, length, [&](std::size_t first, std::size_t n) {
+    for (std::size_t i = first; i < first + n; ++i) {
+      if (inValues[i] > best || (inValues[i] == best && inIndices[i] < index)) {
+        best = inValues[i];
+        index = inIndices[i];
+      }
+    }
+  });
+  outValues[tg.position.width] = best;
+  outIndices[tg.position.width] = index;
+}
+
+}  // namespace compute::kernels
+
+namespace compute {
+
+/// @brief Registry holding the twin of every kernel shipped as a `.metal` file.
+inline auto defaultKernelRegistry() -> KernelRegistry& {
+  static KernelRegistry registry = [] {
+    KernelRegistry r;
+    r.add("add_vec",     "vector_add",  kernels::vectorAdd);
+    r.add("add_vec",     "vector_add_half", kernels::vectorAddNarrow<precision::Half>);
+    r.add("add_vec",     "vector_add_bf16", kernels::vectorAddNarrow<precision::BFloat16>);
+    r.add("convolution", "convolution", kernels::convolution);
+    r.add("convolution", "convolution_batched", kernels::convolutionBatched);
+    r.add("convolution", "convolution_tiled",   kernels::convolutionTiled);
+    r.add("convolution", "convolution_edge_zero",    kernels::convolutionEdge<convolution::Boundary::Zero>);
+    r.add("convolution", "convolution_edge_clamp",   kernels::convolutionEdge<convolution::Boundary::Clamp>);
+    r.add("convolution", "convolution_edge_reflect", kernels::convolutionEdge<convolution::Boundary::Reflect>);
+    r.add("convolution", "convolution_edge_wrap",    kernels::convolutionEdge<convolution::Boundary::Wrap>);
+    [&]<std::size_t... K>(std::index_sequence<K...>) {
+      constexpr std::size_t first = convolution::kMinFixedWidth;
+      (r.add("convolution", "convolution_" + std::to_string(first + 2 * K), kernels::convolutionFixed<first + 2 * K>), ...);
+    }(std::make_index_sequence<(convolution::kMaxFixedWidth - convolution::kMinFixedWidth) / 2 + 1>{});
+    r.add("mat_mul",     "mat_mul",     kernels::matMul);
+    r.add("mat_mul",     "gemm",        kernels::gemm);
+    r.add("mat_mul",     "gemm_batched",         kernels::gemmBatched);
+    r.add("mat_mul",     "gemm_batched_indexed", kernels::gemmBatchedIndexed);
+    r.add("gol_buffer",  "golBuffer",   kernels::golBuffer);
+    r.add("reduce",      "reduce_sum",          kernels::reduceSum);
+    r.add("reduce",      "reduce_dot",          kernels::reduceDot);
+    r.add("reduce",      "reduce_min",          kernels::reduceMin);
+    r.add("reduce",      "reduce_max",          kernels::reduceMax);
+    r.add("reduce",      "reduce_argmax",       kernels::reduceArgmax);
+    r.add("reduce",      "reduce_argmax_pairs", kernels::reduceArgmaxPairs);
+    return r;
+  }();
+  return registry;
+}
+
+}  // namespace compute
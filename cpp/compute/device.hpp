@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+
+#include "backend.hpp"
+#include "cpu_backend.hpp"
+#include "cpu_kernels.hpp"
+#include "metal_backend.hpp"
+
+namespace compute {
+
+/**
+ * @brief Picks the backend for this machine.
+ * @details Metal on Apple platforms, the CPU backend everywhere else.
+ *  `REPOUSSE_BACKEND=cpu` forces the CPU backend on a Mac, which is handy for
+ *  checking the C++ kernels against the shaders.
+ */
+inline auto createDefaultDevice() -> std::unique_ptr<Device> {
+  const char* env = std::getenv("REPOUSSE_BACKEND");
+  const std::string_view requested = env ? env : "";
+
+  if (requested == "cpu") {
+    return std::make_unique<CpuDevice>(defaultKernelRegistry());
+  }
+#ifdef __APPLE__
+  return std::make_unique<MetalDevice>();
+#else
+  if (requested == "metal") {
+    throw std::runtime_error("The Metal backend is only available on Apple platforms.");
+  }
+  return std::make_unique<CpuDevice>(defaultKernelRegistry());
+#endif
+}
+
+}  // namespace compute
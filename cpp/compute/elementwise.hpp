@@ -0,0 +1,344 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REPOUSSE_X86 1
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define REPOUSSE_NEON 1
+#endif
+
+#include "thread_pool.hpp"
+
+// * Hand-vectorised elementwise float kernels with runtime ISA dispatch.
+// *
+// * Each ISA gets its own copy of the loops in `elementwise_kernels.inl`; the
+// * copy to use is picked once from CPUID (x86) or is NEON (arm64). The public
+// * functions split the range across `ThreadPool::global()` and switch to
+// * non-temporal stores once the working set can't stay in cache.
+
+namespace compute::elementwise {
+
+enum class Isa { Scalar, Avx2, Avx512, Neon };
+
+enum class Kind { Add, Sub, Mul, Fma, Saxpy, Axpby, Scale };
+constexpr std::size_t kKindCount = 7;
+
+/// @brief Whether an op reads its second / third input.
+constexpr auto usesB(Kind k) -> bool { return k != Kind::Scale; }
+constexpr auto usesC(Kind k) -> bool { return k == Kind::Fma; }
+
+template <Kind K>
+inline auto applyScalar(float a, float b, float c, float alpha, float beta) -> float {
+  if constexpr (K == Kind::Add)   { return a + b; }
+  if constexpr (K == Kind::Sub)   { return a - b; }
+  if constexpr (K == Kind::Mul)   { return a * b; }
+  if constexpr (K == Kind::Fma)   { return a * b + c; }
+  if constexpr (K == Kind::Saxpy) { return alpha * a + b; }
+  if constexpr (K == Kind::Axpby) { return alpha * a + beta * b; }
+  if constexpr (K == Kind::Scale) { return alpha * a; }
+}
+
+using LoopFn = void (*)(const float*, const float*, const float*, float*, std::size_t, float, float);
+// * [kind][streaming stores?]
+using LoopTable = std::array<std::array<LoopFn, 2>, kKindCount>;
+
+///////////////////////////////////////////////////////////////////////////////
+// * Per-ISA instantiations ...
+///////////////////////////////////////////////////////////////////////////////
+
+namespace scalar {
+struct Vec {
+  using type = float;
+  static constexpr std::size_t width = 1;
+  static constexpr bool masked = false;
+  static auto load(const float* p) -> type { return *p; }
+  static auto store(float* p, type v) -> void { *p = v; }
+  static auto stream(float* p, type v) -> void { *p = v; }
+  static auto set1(float v) -> type { return v; }
+  static auto add(type a, type b) -> type { return a + b; }
+  static auto sub(type a, type b) -> type { return a - b; }
+  static auto mul(type a, type b) -> type { return a * b; }
+  static auto fmadd(type a, type b, type c) -> type { return a * b + c; }
+  static auto fence() -> void {}
+};
+#include "elementwise_kernels.inl"
+}  // namespace scalar
+
+#ifdef REPOUSSE_X86
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2,fma"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+namespace avx2 {
+struct Vec {
+  using type = __m256;
+  static constexpr std::size_t width = 8;
+  static constexpr bool masked = false;
+  static inline auto load(const float* p) -> type { return _mm256_loadu_ps(p); }
+  static inline auto store(float* p, type v) -> void { _mm256_store_ps(p, v); }
+  static inline auto stream(float* p, type v) -> void { _mm256_stream_ps(p, v); }
+  static inline auto set1(float v) -> type { return _mm256_set1_ps(v); }
+  static inline auto add(type a, type b) -> type { return _mm256_add_ps(a, b); }
+  static inline auto sub(type a, type b) -> type { return _mm256_sub_ps(a, b); }
+  static inline auto mul(type a, type b) -> type { return _mm256_mul_ps(a, b); }
+  static inline auto fmadd(type a, type b, type c) -> type { return _mm256_fmadd_ps(a, b, c); }
+  static inline auto fence() -> void { _mm_sfence(); }
+};
+#include "elementwise_kernels.inl"
+}  // namespace avx2
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx512f"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#endif
+namespace avx512 {
+struct Vec {
+  using type = __m512;
+  static constexpr std::size_t width = 16;
+  static constexpr bool masked = true;
+  static inline auto load(const float* p) -> type { return _mm512_loadu_ps(p); }
+  static inline auto store(float* p, type v) -> void { _mm512_store_ps(p, v); }
+  static inline auto stream(float* p, type v) -> void { _mm512_stream_ps(p, v); }
+  static inline auto set1(float v) -> type { return _mm512_set1_ps(v); }
+  static inline auto add(type a, type b) -> type { return _mm512_add_ps(a, b); }
+  static inline auto sub(type a, type b) -> type { return _mm512_sub_ps(a, b); }
+  static inline auto mul(type a, type b) -> type { return _mm512_mul_ps(a, b); }
+  static inline auto fmadd(type a, type b, type c) -> type { return _mm512_fmadd_ps(a, b, c); }
+  static inline auto fence() -> void { _mm_sfence(); }
+  static inline auto mask(std::size_t n) -> __mmask16 {
+    return static_cast<__mmask16>((1u << n) - 1u);
+  }
+  static inline auto loadPartial(const float* p, std::size_t n) -> type {
+    return _mm512_maskz_loadu_ps(mask(n), p);
+  }
+  static inline auto storePartial(float* p, type v, std::size_t n) -> void {
+    _mm512_mask_storeu_ps(p, mask(n), v);
+  }
+};
+#include "elementwise_kernels.inl"
+}  // namespace avx512
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#endif  // REPOUSSE_X86
+
+#ifdef REPOUSSE_NEON
+namespace neon {
+struct Vec {
+  using type = float32x4_t;
+  static constexpr std::size_t width = 4;
+  static constexpr bool masked = false;
+  static inline auto load(const float* p) -> type { return vld1q_f32(p); }
+  static inline auto store(float* p, type v) -> void { vst1q_f32(p, v); }
+  // * No non-temporal store in NEON proper; a plain store is the best we have.
+  static inline auto stream(float* p, type v) -> void { vst1q_f32(p, v); }
+  static inline auto set1(float v) -> type { return vdupq_n_f32(v); }
+  static inline auto add(type a, type b) -> type { return vaddq_f32(a, b); }
+  static inline auto sub(type a, type b) -> type { return vsubq_f32(a, b); }
+  static inline auto mul(type a, type b) -> type { return vmulq_f32(a, b); }
+  static inline auto fmadd(type a, type b, type c) -> type { return vfmaq_f32(c, a, b); }
+  static inline auto fence() -> void {}
+};
+#include "elementwise_kernels.inl"
+}  // namespace neon
+#endif  // REPOUSSE_NEON
+
+///////////////////////////////////////////////////////////////////////////////
+// * Dispatch ...
+///////////////////////////////////////////////////////////////////////////////
+
+inline auto isaName(Isa isa) -> std::string_view {
+  switch (isa) {
+    case Isa::Scalar: return "scalar";
+    case Isa::Avx2:   return "avx2";
+    case Isa::Avx512: return "avx512";
+    case Isa::Neon:   return "neon";
+  }
+  return "unknown";
+}
+
+/// @brief Whether this CPU (and this build) can run `isa`.
+inline auto supported(Isa isa) -> bool {
+  switch (isa) {
+    case Isa::Scalar: return true;
+#ifdef REPOUSSE_X86
+    case Isa::Avx2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case Isa::Avx512:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx512f");
+#endif
+#ifdef REPOUSSE_NEON
+    case Isa::Neon: return true;
+#endif
+    default: return false;
+  }
+}
+
+/// @brief Widest supported ISA.
+inline auto detectIsa() -> Isa {
+  for (Isa isa : {Isa::Avx512, Isa::Avx2, Isa::Neon}) {
+    if (supported(isa)) { return isa; }
+  }
+  return Isa::Scalar;
+}
+
+/**
+ * @brief ISA used by default, chosen on first call.
+ * @details `REPOUSSE_ISA=scalar|avx2|avx512|neon` overrides detection when the
+ *  requested ISA is supported.
+ */
+inline auto activeIsa() -> Isa {
+  static const Isa isa = [] {
+    if (const char* env = std::getenv("REPOUSSE_ISA")) {
+      for (Isa candidate : {Isa::Scalar, Isa::Avx2, Isa::Avx512, Isa::Neon}) {
+        if (isaName(candidate) == env && supported(candidate)) { return candidate; }
+      }
+    }
+    return detectIsa();
+  }();
+  return isa;
+}
+
+inline auto loopTable(Isa isa) -> const LoopTable& {
+  if (!supported(isa)) {
+    throw std::runtime_error("ISA '" + std::string(isaName(isa)) + "' is not supported on this CPU.");
+  }
+  switch (isa) {
+#ifdef REPOUSSE_X86
+    case Isa::Avx2:   return avx2::table;
+    case Isa::Avx512: return avx512::table;
+#endif
+#ifdef REPOUSSE_NEON
+    case Isa::Neon:   return neon::table;
+#endif
+    default:          return scalar::table;
+  }
+}
+
+/**
+ * @brief Bytes touched per call above which stores bypass the cache.
+ * @note Past the last-level cache the written lines would be evicted before
+ *  anyone reads them, so non-temporal stores save the read-for-ownership.
+ */
+constexpr std::size_t kStreamingThresholdBytes = std::size_t{32} << 20;
+
+// * Chunks are multiples of 64 bytes so every chunk after the first starts on
+// * the same cache-line offset as the first.
+constexpr std::size_t kChunkFloats = std::size_t{1} << 15;
+
+/// @brief Runs one op over `n` elements on the global pool.
+inline auto run(
+  Kind kind,
+  const float* a,
+  const float* b,
+  const float* c,
+  float* out,
+  std::size_t n,
+  float alpha,
+  float beta,
+  Isa isa) -> void {
+  const std::size_t streams = 2 + usesB(kind) + usesC(kind);
+  const bool stream = n * sizeof(float) * streams >= kStreamingThresholdBytes;
+  const LoopFn fn = loopTable(isa)[static_cast<std::size_t>(kind)][stream];
+  ThreadPool::global().parallelFor(n, kChunkFloats, [&](std::size_t begin, std::size_t end) {
+    fn(a + begin,
+       b ? b + begin : nullptr,
+       c ? c + begin : nullptr,
+       out + begin,
+       end - begin, alpha, beta);
+  });
+}
+
+inline auto requireSameSize(std::size_t expected, std::size_t actual) -> void {
+  if (expected != actual) {
+    throw std::runtime_error(
+      "Elementwise operands differ in length: " +
+      std::to_string(expected) + " vs " + std::to_string(actual) + ".");
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Public API ...
+///////////////////////////////////////////////////////////////////////////////
+
+/// @brief out = a + b
+inline auto add(std::span<const float> a, std::span<const float> b, std::span<float> out,
+                Isa isa = activeIsa()) -> void {
+  requireSameSize(a.size(), b.size());
+  requireSameSize(a.size(), out.size());
+  run(Kind::Add, a.data(), b.data(), nullptr, out.data(), a.size(), 0.0f, 0.0f, isa);
+}
+
+/// @brief out = a - b
+inline auto sub(std::span<const float> a, std::span<const float> b, std::span<float> out,
+                Isa isa = activeIsa()) -> void {
+  requireSameSize(a.size(), b.size());
+  requireSameSize(a.size(), out.size());
+  run(Kind::Sub, a.data(), b.data(), nullptr, out.data(), a.size(), 0.0f, 0.0f, isa);
+}
+
+/// @brief out = a * b
+inline auto mul(std::span<const float> a, std::span<const float> b, std::span<float> out,
+                Isa isa = activeIsa()) -> void {
+  requireSameSize(a.size(), b.size());
+  requireSameSize(a.size(), out.size());
+  run(Kind::Mul, a.data(), b.data(), nullptr, out.data(), a.size(), 0.0f, 0.0f, isa);
+}
+
+/// @brief out = a * b + c, fused
+inline auto fma(std::span<const float> a, std::span<const float> b, std::span<const float> c,
+                std::span<float> out, Isa isa = activeIsa()) -> void {
+  requireSameSize(a.size(), b.size());
+  requireSameSize(a.size(), c.size());
+  requireSameSize(a.size(), out.size());
+  run(Kind::Fma, a.data(), b.data(), c.data(), out.data(), a.size(), 0.0f, 0.0f, isa);
+}
+
+/// @brief y = alpha * x + y
+inline auto saxpy(float alpha, std::span<const float> x, std::span<float> y,
+                  Isa isa = activeIsa()) -> void {
+  requireSameSize(x.size(), y.size());
+  run(Kind::Saxpy, x.data(), y.data(), nullptr, y.data(), x.size(), alpha, 0.0f, isa);
+}
+
+/// @brief y = alpha * x + beta * y
+inline auto axpby(float alpha, std::span<const float> x, float beta, std::span<float> y,
+                  Isa isa = activeIsa()) -> void {
+  requireSameSize(x.size(), y.size());
+  run(Kind::Axpby, x.data(), y.data(), nullptr, y.data(), x.size(), alpha, beta, isa);
+}
+
+/// @brief out = alpha * x
+inline auto scale(float alpha, std::span<const float> x, std::span<float> out,
+                  Isa isa = activeIsa()) -> void {
+  requireSameSize(x.size(), out.size());
+  run(Kind::Scale, x.data(), nullptr, nullptr, out.data(), x.size(), alpha, 0.0f, isa);
+}
+
+}  // namespace compute::elementwise
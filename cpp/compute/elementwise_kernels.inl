@@ -0,0 +1,129 @@
+// * Elementwise loop body, compiled once per instruction set.
+// *
+// * `elementwise.hpp` includes this file several times, each time inside its
+// * own namespace that defines a `Vec` traits struct and (on x86) inside a
+// * `#pragma GCC target` region. Everything here therefore gets compiled with
+// * that ISA enabled, and the intrinsics in `Vec` inline into the loops.
+// *
+// * `Vec` provides: `type`, `width`, `masked`, `load`, `store`, `stream`,
+// * `set1`, `add`, `sub`, `mul`, `fmadd` (a*b+c), `fence`, and, when
+// * `masked`, `loadPartial`/`storePartial` for the last `n < width` lanes.
+// !  No include guard on purpose.
+
+template <Kind K>
+inline auto apply(
+  typename Vec::type a,
+  typename Vec::type b,
+  typename Vec::type c,
+  typename Vec::type alpha,
+  typename Vec::type beta) -> typename Vec::type {
+  if constexpr (K == Kind::Add)   { return Vec::add(a, b); }
+  if constexpr (K == Kind::Sub)   { return Vec::sub(a, b); }
+  if constexpr (K == Kind::Mul)   { return Vec::mul(a, b); }
+  if constexpr (K == Kind::Fma)   { return Vec::fmadd(a, b, c); }
+  if constexpr (K == Kind::Saxpy) { return Vec::fmadd(alpha, a, b); }
+  if constexpr (K == Kind::Axpby) { return Vec::fmadd(alpha, a, Vec::mul(beta, b)); }
+  if constexpr (K == Kind::Scale) { return Vec::mul(alpha, a); }
+}
+
+/// @brief One full vector of `loop`, at element offset `at`.
+template <Kind K, bool Stream>
+inline auto step(
+  const float* a,
+  const float* b,
+  const float* c,
+  float* out,
+  std::size_t at,
+  typename Vec::type alpha,
+  typename Vec::type beta) -> void {
+  using V = typename Vec::type;
+  const V zero = Vec::set1(0.0f);
+  const V va = Vec::load(a + at);
+  const V vb = usesB(K) ? Vec::load(b + at) : zero;
+  const V vc = usesC(K) ? Vec::load(c + at) : zero;
+  const V r  = apply<K>(va, vb, vc, alpha, beta);
+  if constexpr (Stream) { Vec::stream(out + at, r); }
+  else                  { Vec::store(out + at, r); }
+}
+
+/// @brief Last `n < width` elements: one masked vector, or scalars.
+template <Kind K, typename T = Vec>
+inline auto tail(
+  const float* a,
+  const float* b,
+  const float* c,
+  float* out,
+  std::size_t n,
+  float alphaScalar,
+  float betaScalar) -> void {
+  if (n == 0) { return; }
+  if constexpr (T::masked) {
+    using V = typename T::type;
+    const V zero = T::set1(0.0f);
+    const V va = T::loadPartial(a, n);
+    const V vb = usesB(K) ? T::loadPartial(b, n) : zero;
+    const V vc = usesC(K) ? T::loadPartial(c, n) : zero;
+    T::storePartial(out, apply<K>(va, vb, vc, T::set1(alphaScalar), T::set1(betaScalar)), n);
+  } else {
+    for (std::size_t i = 0; i < n; ++i) {
+      out[i] = applyScalar<K>(
+        a[i], usesB(K) ? b[i] : 0.0f, usesC(K) ? c[i] : 0.0f, alphaScalar, betaScalar);
+    }
+  }
+}
+
+/**
+ * @brief `out[i] = op(a[i], b[i], c[i])` over `[0, n)`.
+ * @details Scalar head until `out` is aligned to a full vector, then a 4x
+ *  unrolled body with aligned (or non-temporal) stores and unaligned loads,
+ *  then a tail that is masked where the ISA allows it and scalar otherwise.
+ *  Inputs an op doesn't use (see `usesB`/`usesC`) are never dereferenced.
+ */
+template <Kind K, bool Stream>
+inline auto loop(
+  const float* a,
+  const float* b,
+  const float* c,
+  float* out,
+  std::size_t n,
+  float alphaScalar,
+  float betaScalar) -> void {
+  using V = typename Vec::type;
+  constexpr std::size_t W = Vec::width;
+  const V alpha = Vec::set1(alphaScalar);
+  const V beta  = Vec::set1(betaScalar);
+
+  std::size_t i = 0;
+
+  // * Head: peel scalars until the output is vector-aligned.
+  const std::size_t misalignment = (reinterpret_cast<std::uintptr_t>(out) / sizeof(float)) % W;
+  const std::size_t head = misalignment ? std::min(n, W - misalignment) : 0;
+  for (; i < head; ++i) {
+    out[i] = applyScalar<K>(
+      a[i], usesB(K) ? b[i] : 0.0f, usesC(K) ? c[i] : 0.0f, alphaScalar, betaScalar);
+  }
+
+  // * Body: aligned stores, four vectors per iteration.
+  for (; i + 4 * W <= n; i += 4 * W) {
+    step<K, Stream>(a, b, c, out, i,         alpha, beta);
+    step<K, Stream>(a, b, c, out, i + W,     alpha, beta);
+    step<K, Stream>(a, b, c, out, i + 2 * W, alpha, beta);
+    step<K, Stream>(a, b, c, out, i + 3 * W, alpha, beta);
+  }
+  for (; i + W <= n; i += W) { step<K, Stream>(a, b, c, out, i, alpha, beta); }
+
+  // * Tail
+  tail<K>(a + i, b ? b + i : nullptr, c ? c + i : nullptr, out + i, n - i, alphaScalar, betaScalar);
+
+  if constexpr (Stream) { Vec::fence(); }
+}
+
+inline const LoopTable table = {{
+  {loop<Kind::Add,   false>, loop<Kind::Add,   true>},
+  {loop<Kind::Sub,   false>, loop<Kind::Sub,   true>},
+  {loop<Kind::Mul,   false>, loop<Kind::Mul,   true>},
+  {loop<Kind::Fma,   false>, loop<Kind::Fma,   true>},
+  {loop<Kind::Saxpy, false>, loop<Kind::Saxpy, true>},
+  {loop<Kind::Axpby, false>, loop<Kind::Axpby, true>},
+  {loop<Kind::Scale, false>, loop<Kind::Scale, true>},
+}};
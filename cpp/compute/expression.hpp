@@ -0,0 +1,514 @@
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "context.hpp"
+#include "memory.hpp"
+#include "thread_pool.hpp"
+
+// * Lazy, fused elementwise expressions over float vectors.
+// *
+// * `a + b * c - d` doesn't compute anything; it builds a small tree of nodes
+// * that is evaluated in one pass when assigned to a `Vector` (or passed to
+// * `evaluate`). No temporaries, one trip through memory, packs of
+// * `kPackWidth` floats per step, chunks spread across the thread pool.
+// *
+// * The same tree can also be printed as a single Metal kernel
+// * (`mslKernelSource`) so the GPU path fuses the same way.
+
+namespace compute::expr {
+
+#if defined(__AVX512F__)
+constexpr std::size_t kPackWidth = 16;
+#elif defined(__AVX__)
+constexpr std::size_t kPackWidth = 8;
+#else
+constexpr std::size_t kPackWidth = 4;  // * SSE2 / NEON
+#endif
+
+/// @brief `kPackWidth` floats in one register (GCC/Clang vector extension).
+typedef float Pack __attribute__((vector_size(kPackWidth * sizeof(float))));
+
+inline auto loadPack(const float* p) -> Pack {
+  Pack v;
+  std::memcpy(&v, p, sizeof(Pack));
+  return v;
+}
+
+inline auto storePack(float* p, Pack v) -> void {
+  std::memcpy(p, &v, sizeof(Pack));
+}
+
+class Vector;
+
+/// @brief An input array of a tree, and the `Vector` that owns it (if any),
+///  whose device buffer can then be reused.
+struct LeafRef {
+  const float* data;
+  const Vector* owner;
+};
+
+/**
+ * @brief What a tree reads: its distinct input arrays, in first-seen order
+ *  (their index is their buffer index in the generated kernel), and its
+ *  scalar nodes, in tree order (their index into the kernel's `scalars`).
+ * @details Scalars are kernel arguments rather than literals, so the source
+ *  (and the pipeline cached on it) depends only on the tree's shape.
+ */
+struct LeafList {
+  std::vector<LeafRef> arrays;
+  std::vector<const float*> scalars;
+};
+
+inline auto leafIndex(const LeafList& leaves, const float* data) -> std::size_t {
+  const auto& arrays = leaves.arrays;
+  return static_cast<std::size_t>(
+    std::find_if(arrays.begin(), arrays.end(), [data](const LeafRef& leaf) { return leaf.data == data; }) - arrays.begin());
+}
+
+inline auto scalarIndex(const LeafList& leaves, const float* value) -> std::size_t {
+  return static_cast<std::size_t>(std::find(leaves.scalars.begin(), leaves.scalars.end(), value) - leaves.scalars.begin());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Nodes ...
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Anything that can be evaluated elementwise.
+ * @details `at(i)` gives element `i`, `pack(i)` elements `[i, i + kPackWidth)`,
+ *  `size()` is the length (0 for broadcast scalars), `collect` registers
+ *  leaves and `msl` prints the node as an MSL expression of `gid`.
+ */
+template <typename E>
+concept Expression = requires(const E& e, std::size_t i, LeafList& leaves) {
+  { e.size() } -> std::convertible_to<std::size_t>;
+  { e.at(i) } -> std::convertible_to<float>;
+  { e.pack(i) } -> std::same_as<Pack>;
+  e.collect(leaves);
+  { e.msl(std::as_const(leaves)) } -> std::convertible_to<std::string>;
+};
+
+/// @brief A borrowed input array.
+class Leaf {
+public:
+  explicit Leaf(std::span<const float> data, const Vector* owner = nullptr) : data_(data), owner_(owner) {}
+
+  auto size() const -> std::size_t { return data_.size(); }
+  auto at(std::size_t i) const -> float { return data_[i]; }
+  auto pack(std::size_t i) const -> Pack { return loadPack(data_.data() + i); }
+  auto data() const -> const float* { return data_.data(); }
+
+  auto collect(LeafList& leaves) const -> void {
+    if (leafIndex(leaves, data_.data()) == leaves.arrays.size()) { leaves.arrays.push_back({data_.data(), owner_}); }
+  }
+  auto msl(const LeafList& leaves) const -> std::string {
+    return "in" + std::to_string(leafIndex(leaves, data_.data())) + "[gid]";
+  }
+
+private:
+  std::span<const float> data_;
+  const Vector* owner_;
+};
+
+/// @brief A constant broadcast to every element.
+class Scalar {
+public:
+  explicit Scalar(float value) : value_(value) {}
+
+  auto size() const -> std::size_t { return 0; }
+  auto at(std::size_t) const -> float { return value_; }
+  auto pack(std::size_t) const -> Pack { return Pack{} + value_; }
+
+  auto collect(LeafList& leaves) const -> void { leaves.scalars.push_back(&value_); }
+  auto msl(const LeafList& leaves) const -> std::string {
+    return "scalars[" + std::to_string(scalarIndex(leaves, &value_)) + "]";
+  }
+
+private:
+  float value_;
+};
+
+struct AddOp {
+  static auto apply(auto a, auto b) { return a + b; }
+  static constexpr const char* symbol = "+";
+};
+struct SubOp {
+  static auto apply(auto a, auto b) { return a - b; }
+  static constexpr const char* symbol = "-";
+};
+struct MulOp {
+  static auto apply(auto a, auto b) { return a * b; }
+  static constexpr const char* symbol = "*";
+};
+struct DivOp {
+  static auto apply(auto a, auto b) { return a / b; }
+  static constexpr const char* symbol = "/";
+};
+
+template <typename Op, Expression L, Expression R>
+class Binary {
+public:
+  Binary(L lhs, R rhs) : lhs_(std::move(lhs)), rhs_(std::move(rhs)) {
+    if (lhs_.size() && rhs_.size() && lhs_.size() != rhs_.size()) {
+      throw std::runtime_error(
+        "Expression operands differ in length: " +
+        std::to_string(lhs_.size()) + " vs " + std::to_string(rhs_.size()) + ".");
+    }
+  }
+
+  auto size() const -> std::size_t { return lhs_.size() ? lhs_.size() : rhs_.size(); }
+  auto at(std::size_t i) const -> float { return Op::apply(lhs_.at(i), rhs_.at(i)); }
+  auto pack(std::size_t i) const -> Pack { return Op::apply(lhs_.pack(i), rhs_.pack(i)); }
+
+  auto collect(LeafList& leaves) const -> void {
+    lhs_.collect(leaves);
+    rhs_.collect(leaves);
+  }
+  auto msl(const LeafList& leaves) const -> std::string {
+    return "(" + lhs_.msl(leaves) + " " + Op::symbol + " " + rhs_.msl(leaves) + ")";
+  }
+
+private:
+  L lhs_;
+  R rhs_;
+};
+
+template <Expression E>
+class Negate {
+public:
+  explicit Negate(E operand) : operand_(std::move(operand)) {}
+
+  auto size() const -> std::size_t { return operand_.size(); }
+  auto at(std::size_t i) const -> float { return -operand_.at(i); }
+  auto pack(std::size_t i) const -> Pack { return -operand_.pack(i); }
+
+  auto collect(LeafList& leaves) const -> void { operand_.collect(leaves); }
+  auto msl(const LeafList& leaves) const -> std::string { return "(-" + operand_.msl(leaves) + ")"; }
+
+private:
+  E operand_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// * Vector ...
+///////////////////////////////////////////////////////////////////////////////
+
+template <Expression E>
+auto evaluate(const E& expression, std::span<float> out) -> void;
+
+/**
+ * @brief Owning float array that evaluates expressions assigned to it.
+ * @note Storage is a `PageVector`, so `Vector(n)` leaves the elements
+ *  uninitialised and `buffer(device)` wraps them without a copy. The wrap
+ *  is kept, so repeated device evaluations reuse it.
+ */
+class Vector {
+public:
+  Vector() = default;
+  explicit Vector(std::size_t n) : data_(n) {}
+  Vector(std::size_t n, float value) : data_(n, value) {}
+  Vector(std::initializer_list<float> values) : data_(values) {}
+  explicit Vector(PageVector<float> values) : data_(std::move(values)) {}
+
+  template <Expression E>
+  Vector(const E& expression) : data_(expression.size()) {
+    evaluate(expression, span());
+  }
+
+  template <Expression E>
+  auto operator=(const E& expression) -> Vector& {
+    if (data_.size() == expression.size()) {
+      // * Same length: every element only reads its own index, so writing in
+      // * place is safe even when this vector appears in the expression.
+      evaluate(expression, span());
+    } else {
+      Vector result(expression);
+      data_.swap(result.data_);
+      wrap_ = {};
+    }
+    return *this;
+  }
+
+  auto size() const -> std::size_t { return data_.size(); }
+  auto data() -> float* { return data_.data(); }
+  auto data() const -> const float* { return data_.data(); }
+  auto span() -> std::span<float> { return data_; }
+  auto span() const -> std::span<const float> { return data_; }
+  auto operator[](std::size_t i) -> float& { return data_[i]; }
+  auto operator[](std::size_t i) const -> float { return data_[i]; }
+  auto begin() { return data_.begin(); }
+  auto end() { return data_.end(); }
+  auto begin() const { return data_.begin(); }
+  auto end() const { return data_.end(); }
+  /// @brief The storage, which the caller may resize; drops the device wrap.
+  auto storage() -> PageVector<float>& {
+    wrap_ = {};
+    return data_;
+  }
+
+  /// @brief The storage as a no-copy buffer on `device`, made on first use.
+  auto buffer(Device& device) const -> Buffer& {
+    if (!wrap_.buffer || wrap_.device != &device) {
+      wrap_.buffer = wrapBuffer(device, const_cast<PageVector<float>&>(data_));
+      wrap_.device = &device;
+    }
+    return *wrap_.buffer;
+  }
+
+private:
+  /// @brief A device wrap of `data_`. Copies start without one: the new
+  ///  vector's storage is elsewhere.
+  struct Wrap {
+    Wrap() = default;
+    Wrap(const Wrap&) {}
+    auto operator=(const Wrap&) -> Wrap& {
+      buffer.reset();
+      device = nullptr;
+      return *this;
+    }
+
+    std::unique_ptr<Buffer> buffer;
+    const Device* device = nullptr;
+  };
+
+  PageVector<float> data_;
+  // * After `data_`, so the buffer is released before the memory it wraps.
+  mutable Wrap wrap_;
+};
+
+/// @brief Leaf over any contiguous float range, e.g. a `std::vector<float>`.
+inline auto view(std::span<const float> data) -> Leaf { return Leaf(data); }
+
+///////////////////////////////////////////////////////////////////////////////
+// * Operators ...
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+concept Operand = Expression<std::remove_cvref_t<T>> ||
+                  std::same_as<std::remove_cvref_t<T>, Vector> ||
+                  std::is_arithmetic_v<std::remove_cvref_t<T>>;
+
+/// @brief Lifts an operand into a node. Vectors must be lvalues: a leaf
+///  only borrows the data, so a temporary would dangle.
+template <Operand T>
+auto asNode(T&& operand) {
+  using U = std::remove_cvref_t<T>;
+  if constexpr (std::same_as<U, Vector>) {
+    static_assert(std::is_lvalue_reference_v<T>, "A temporary Vector can't be an expression leaf.");
+    return Leaf(operand.span(), &operand);
+  } else if constexpr (std::is_arithmetic_v<U>) {
+    return Scalar(static_cast<float>(operand));
+  } else {
+    return U(std::forward<T>(operand));
+  }
+}
+
+// * At least one side must be a vector or a node; `float + float` stays a float.
+template <typename L, typename R>
+concept BinaryOperands = Operand<L> && Operand<R> &&
+  !(std::is_arithmetic_v<std::remove_cvref_t<L>> && std::is_arithmetic_v<std::remove_cvref_t<R>>);
+
+template <typename Op, typename L, typename R>
+auto makeBinary(L&& lhs, R&& rhs) {
+  auto l = asNode(std::forward<L>(lhs));
+  auto r = asNode(std::forward<R>(rhs));
+  return Binary<Op, decltype(l), decltype(r)>(std::move(l), std::move(r));
+}
+
+template <typename L, typename R> requires BinaryOperands<L, R>
+auto operator+(L&& lhs, R&& rhs) { return makeBinary<AddOp>(std::forward<L>(lhs), std::forward<R>(rhs)); }
+
+template <typename L, typename R> requires BinaryOperands<L, R>
+auto operator-(L&& lhs, R&& rhs) { return makeBinary<SubOp>(std::forward<L>(lhs), std::forward<R>(rhs)); }
+
+template <typename L, typename R> requires BinaryOperands<L, R>
+auto operator*(L&& lhs, R&& rhs) { return makeBinary<MulOp>(std::forward<L>(lhs), std::forward<R>(rhs)); }
+
+template <typename L, typename R> requires BinaryOperands<L, R>
+auto operator/(L&& lhs, R&& rhs) { return makeBinary<DivOp>(std::forward<L>(lhs), std::forward<R>(rhs)); }
+
+template <typename T> requires (Operand<T> && !std::is_arithmetic_v<std::remove_cvref_t<T>>)
+auto operator-(T&& operand) {
+  auto node = asNode(std::forward<T>(operand));
+  return Negate<decltype(node)>(std::move(node));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Evaluation ...
+///////////////////////////////////////////////////////////////////////////////
+
+// * Large enough to amortise the pool hand-off, small enough to balance.
+constexpr std::size_t kChunkElements = std::size_t{1} << 15;
+
+/**
+ * @brief Evaluates `expression` into `out` in a single fused pass on the CPU.
+ * @note `out` may alias any leaf at the same offset; other overlaps are
+ *  undefined.
+ */
+template <Expression E>
+auto evaluate(const E& expression, std::span<float> out) -> void {
+  const std::size_t n = expression.size();
+  if (n != out.size()) {
+    throw std::runtime_error(
+      "Expression of length " + std::to_string(n) +
+      " assigned to output of length " + std::to_string(out.size()) + ".");
+  }
+  float* dst = out.data();
+  ThreadPool::global().parallelFor(n, kChunkElements, [&](std::size_t begin, std::size_t end) {
+    std::size_t i = begin;
+    for (; i + kPackWidth <= end; i += kPackWidth) {
+      storePack(dst + i, expression.pack(i));
+    }
+    for (; i < end; ++i) {
+      dst[i] = expression.at(i);
+    }
+  });
+}
+
+/**
+ * @brief MSL source for one kernel that evaluates `expression`.
+ * @details Buffers `0..k-1` are the distinct input arrays in `collect`
+ *  order, buffer `k` is the output, buffer `k+1` the length (`uint`) and,
+ *  if the tree has scalars, buffer `k+2` their values (`float[]`).
+ */
+template <Expression E>
+auto mslKernelSource(const E& expression, const std::string& functionName = "fused_elementwise") -> std::string {
+  LeafList leaves;
+  expression.collect(leaves);
+
+  std::string source =
+    "#include <metal_stdlib>\n"
+    "using namespace metal;\n\n"
+    "kernel void " + functionName + "(\n";
+  const std::size_t k = leaves.arrays.size();
+  for (std::size_t i = 0; i < k; ++i) {
+    source += "  device const float* in" + std::to_string(i) +
+              " [[ buffer(" + std::to_string(i) + ") ]],\n";
+  }
+  source += "  device float* out [[ buffer(" + std::to_string(k) + ") ]],\n";
+  source += "  constant uint& length [[ buffer(" + std::to_string(k + 1) + ") ]],\n";
+  if (!leaves.scalars.empty()) {
+    source += "  constant float* scalars [[ buffer(" + std::to_string(k + 2) + ") ]],\n";
+  }
+  source += "  uint gid [[ thread_position_in_grid ]]\n) {\n";
+  source += "  if (gid >= length) { return; }\n";
+  source += "  out[gid] = " + expression.msl(leaves) + ";\n}\n";
+  return source;
+}
+
+/**
+ * @brief `n` floats at `data` as a buffer: wrapped in place when they start
+ *  on a page, copied otherwise.
+ * @details Protection is per page, so the page holding the last float is
+ *  mapped in full and the wrap may round up to it.
+ */
+inline auto borrowBuffer(Device& device, const float* data, std::size_t n) -> std::unique_ptr<Buffer> {
+  if (reinterpret_cast<std::uintptr_t>(data) % pageSize() != 0) {
+    return device.newBuffer(data, n * sizeof(float));
+  }
+  return device.newBufferNoCopy(const_cast<float*>(data), roundToPages(n * sizeof(float)));
+}
+
+namespace detail {
+
+/// @brief Dispatches the generated kernel of `expression` with `out` bound as the result.
+template <Expression E>
+auto dispatch(Context& context, const E& expression, Buffer& out) -> void {
+  Device& device = context.device();
+  const std::size_t n = expression.size();
+  static const std::string functionName = "fused_elementwise";
+  Pipeline& pipeline = context.pipelineFromSource(
+    functionName, mslKernelSource(expression, functionName), functionName);
+
+  LeafList leaves;
+  expression.collect(leaves);
+  // * Vectors lend their kept wraps; other page-aligned inputs are wrapped
+  // * for this call; only unaligned ones are copied.
+  std::vector<std::unique_ptr<Buffer>> borrowed;
+  Arguments arguments;
+  const std::size_t k = leaves.arrays.size();
+  for (std::size_t i = 0; i < k; ++i) {
+    const LeafRef& leaf = leaves.arrays[i];
+    Buffer* buffer = nullptr;
+    if (leaf.owner) {
+      buffer = &leaf.owner->buffer(device);
+    } else {
+      borrowed.push_back(borrowBuffer(device, leaf.data, n));
+      buffer = borrowed.back().get();
+    }
+    arguments.setBuffer(*buffer, 0, static_cast<std::uint32_t>(i));
+  }
+  arguments.setBuffer(out, 0, static_cast<std::uint32_t>(k));
+  arguments.setValue(static_cast<std::uint32_t>(n), static_cast<std::uint32_t>(k + 1));
+  if (!leaves.scalars.empty()) {
+    std::vector<float> scalars;
+    for (const float* value : leaves.scalars) { scalars.push_back(*value); }
+    arguments.setBytes(scalars.data(), scalars.size() * sizeof(float), static_cast<std::uint32_t>(k + 2));
+  }
+
+  const std::size_t threads = std::min(pipeline.maxTotalThreadsPerThreadgroup(), n);
+  context.queue().dispatchThreads(pipeline, arguments, {n, 1, 1}, {threads, 1, 1});
+}
+
+inline auto requireLength(std::size_t n, std::size_t out) -> void {
+  if (n != out) {
+    throw std::runtime_error(
+      "Expression of length " + std::to_string(n) + " assigned to output of length " + std::to_string(out) + ".");
+  }
+}
+
+}  // namespace detail
+
+/**
+ * @brief Evaluates `expression` into `out` on the context's device.
+ * @details On a device that compiles source (Metal), the tree is turned into
+ *  one generated kernel, cached by its source text, and dispatched once.
+ *  Otherwise (CPU backend) it runs as the fused host pass above.
+ *  Page-aligned inputs and output are used in place, so the kernel makes the
+ *  only trip through memory; an unaligned `out` goes through a temporary.
+ */
+template <Expression E>
+auto evaluate(Context& context, const E& expression, std::span<float> out) -> void {
+  if (!context.device().compilesSource()) {
+    evaluate(expression, out);
+    return;
+  }
+  const std::size_t n = expression.size();
+  detail::requireLength(n, out.size());
+  if (n == 0) { return; }
+  if (reinterpret_cast<std::uintptr_t>(out.data()) % pageSize() == 0) {
+    auto pOut = borrowBuffer(context.device(), out.data(), n);
+    detail::dispatch(context, expression, *pOut);
+    return;
+  }
+  auto pOut = context.device().newBuffer(n * sizeof(float));
+  detail::dispatch(context, expression, *pOut);
+  std::copy_n(pOut->as<float>(), n, out.data());
+}
+
+/// @brief Same, into a `Vector`, whose kept wrap is the output buffer.
+template <Expression E>
+auto evaluate(Context& context, const E& expression, Vector& out) -> void {
+  if (!context.device().compilesSource()) {
+    evaluate(expression, out.span());
+    return;
+  }
+  detail::requireLength(expression.size(), out.size());
+  if (out.size() == 0) { return; }
+  detail::dispatch(context, expression, out.buffer(context.device()));
+}
+
+}  // namespace compute::expr
@@ -0,0 +1,341 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numbers>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// * Mixed-radix FFTs for the convolution engine.
+// *
+// * `Plan` is a complex FFT of any length: the length is factored into
+// * radix-4 and radix-2 stages first, then 3, 5 and any other prime, and run
+// * as an iterative Stockham FFT with per-stage twiddle tables. Lengths whose
+// * factors are all 2, 3 and 5 (`nextFastSize`) are the fast ones; other
+// * primes fall back to an O(n·p) butterfly.
+// *
+// * `RealPlan` is a real-to-complex FFT of even length n through one complex
+// * FFT of length n/2 plus a split pass, so it costs about half of a complex
+// * FFT of the same length.
+// *
+// * Plans are immutable once built, so one plan can be shared by any number
+// * of threads; each call takes its scratch from the caller. `RealPlan::get`
+// * returns a process-wide cached plan per length.
+
+namespace compute::fft {
+
+using Complex = std::complex<float>;
+
+/// @brief Complex product without `std::complex`'s NaN/Inf recovery path
+///  (which GCC routes through `__mulsc3` unless -ffast-math is on).
+inline auto mul(Complex a, Complex b) -> Complex {
+  return {a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real()};
+}
+
+/// @brief Smallest `m >= n` whose only prime factors are 2, 3 and 5.
+inline auto nextFastSize(std::size_t n) -> std::size_t {
+  if (n <= 1) { return 1; }
+  for (std::size_t m = n;; ++m) {
+    std::size_t r = m;
+    for (std::size_t p : {2, 3, 5}) {
+      while (r % p == 0) { r /= p; }
+    }
+    if (r == 1) { return m; }
+  }
+}
+
+/**
+ * @brief Complex FFT of length `size()`: forward `X[k] = sum x[j] e^{-2πijk/n}`,
+ *  inverse with `+` and no 1/n scaling.
+ * @details Iterative Stockham: each stage reads one buffer and writes the
+ *  other in natural order, so there is no bit-reversal pass and every inner
+ *  loop walks contiguous inputs, outputs and twiddles.
+ */
+class Plan {
+public:
+  explicit Plan(std::size_t n) : n_(n) {
+    if (n == 0) { throw std::runtime_error("FFT length must be positive."); }
+    // * Radix 4 first (fewest multiplies), then 2, 3, 5 and the remaining primes.
+    std::size_t rest = n;
+    std::size_t p = 4;
+    std::size_t solved = 1;
+    while (rest > 1) {
+      while (rest % p != 0) {
+        p = p == 4 ? 2 : p == 2 ? 3 : p + 2;
+        if (p * p > rest) { p = rest; }
+      }
+      Stage stage{p, solved, {}, {}};
+      // * Twiddle r·k of the stage, stored [r - 1][k] so the k loop is contiguous.
+      stage.twiddles.resize((p - 1) * solved);
+      for (std::size_t r = 1; r < p; ++r) {
+        for (std::size_t k = 0; k < solved; ++k) {
+          stage.twiddles[(r - 1) * solved + k] = root(r * k, p * solved);
+        }
+      }
+      if (p > 5) {
+        stage.roots.resize(p);
+        for (std::size_t r = 0; r < p; ++r) { stage.roots[r] = root(r, p); }
+      }
+      stages_.push_back(std::move(stage));
+      rest /= p;
+      solved *= p;
+    }
+  }
+
+  auto size() const -> std::size_t { return n_; }
+
+  /// @brief `out = FFT(in)`, using `work` (`size()` elements) as the other
+  ///  buffer. The three buffers must not overlap.
+  auto forward(const Complex* in, Complex* out, Complex* work) const -> void { run<false>(in, out, work); }
+  /// @brief `out = n * IFFT(in)`, same buffer rules as `forward`.
+  auto inverse(const Complex* in, Complex* out, Complex* work) const -> void { run<true>(in, out, work); }
+
+private:
+  struct Stage {
+    std::size_t radix;
+    std::size_t solved;                // * length of the sub-transforms already done
+    std::vector<Complex> twiddles;     // * e^{-2πi r k / (radix · solved)}
+    std::vector<Complex> roots;        // * e^{-2πi r / radix}, generic radices only
+  };
+
+  static auto root(std::size_t k, std::size_t n) -> Complex {
+    const double phase = -2.0 * std::numbers::pi * static_cast<double>(k) / static_cast<double>(n);
+    return Complex(static_cast<float>(std::cos(phase)), static_cast<float>(std::sin(phase)));
+  }
+
+  template <bool Inverse>
+  static auto direction(Complex w) -> Complex { return Inverse ? std::conj(w) : w; }
+
+  /// @brief `-i · z` for the forward transform, `+i · z` for the inverse.
+  template <bool Inverse>
+  static auto rotate(Complex z) -> Complex {
+    return Inverse ? Complex(-z.imag(), z.real()) : Complex(z.imag(), -z.real());
+  }
+
+  template <bool Inverse>
+  auto run(const Complex* in, Complex* out, Complex* work) const -> void {
+    if (n_ == 1) {
+      out[0] = in[0];
+      return;
+    }
+    // * Ping-pong so that the last stage lands in `out`.
+    const std::size_t count = stages_.size();
+    const Complex* src = in;
+    for (std::size_t s = 0; s < count; ++s) {
+      Complex* dst = (count - s) % 2 == 1 ? out : work;
+      pass<Inverse>(stages_[s], src, dst);
+      src = dst;
+    }
+  }
+
+  /**
+   * @brief One Stockham stage: for output block b and position k within the
+   *  solved sub-transforms, `radix` inputs `src[j + r·n/radix]` (j = b·solved + k)
+   *  are twiddled, transformed and written to `dst[b·solved·radix + r·solved + k]`.
+   */
+  template <bool Inverse>
+  auto pass(const Stage& stage, const Complex* src, Complex* dst) const -> void {
+    switch (stage.radix) {
+      case 2:  sweep(stage, src, dst, radix2<Inverse>); break;
+      case 3:  sweep(stage, src, dst, radix3<Inverse>); break;
+      case 4:  sweep(stage, src, dst, radix4<Inverse>); break;
+      case 5:  sweep(stage, src, dst, radix5<Inverse>); break;
+      default: generic<Inverse>(stage, src, dst); break;
+    }
+  }
+
+  // * The longer of (blocks, solved) is the inner loop: early stages have
+  // * many blocks of one point, late stages one block of many points.
+  template <typename Butterfly>
+  auto sweep(const Stage& stage, const Complex* src, Complex* dst, Butterfly butterfly) const -> void {
+    const std::size_t p = stage.radix;
+    const std::size_t ns = stage.solved;
+    const std::size_t stride = n_ / p;
+    const std::size_t blocks = stride / ns;
+    const Complex* tw = stage.twiddles.data();
+    if (ns >= blocks) {
+      for (std::size_t b = 0; b < blocks; ++b) {
+        for (std::size_t k = 0; k < ns; ++k) { butterfly(src + b * ns, dst + b * ns * p, tw, ns, stride, k); }
+      }
+    } else {
+      for (std::size_t k = 0; k < ns; ++k) {
+        for (std::size_t b = 0; b < blocks; ++b) { butterfly(src + b * ns, dst + b * ns * p, tw, ns, stride, k); }
+      }
+    }
+  }
+
+  // * Each butterfly reads x[k + r·stride], twiddle r of point k, and writes y[k + r·ns].
+
+  template <bool Inverse>
+  static auto radix2(const Complex* x, Complex* y, const Complex* tw, std::size_t ns, std::size_t stride, std::size_t k) -> void {
+    const Complex a = x[k];
+    const Complex b = mul(x[k + stride], direction<Inverse>(tw[k]));
+    y[k] = a + b;
+    y[k + ns] = a - b;
+  }
+
+  template <bool Inverse>
+  static auto radix3(const Complex* x, Complex* y, const Complex* tw, std::size_t ns, std::size_t stride, std::size_t k) -> void {
+    constexpr float kSin60 = 0.86602540378443864676f;
+    const Complex a = x[k];
+    const Complex b = mul(x[k + stride],     direction<Inverse>(tw[k]));
+    const Complex c = mul(x[k + 2 * stride], direction<Inverse>(tw[ns + k]));
+    const Complex sum = b + c;
+    const Complex mid = a - 0.5f * sum;
+    const Complex rot = rotate<Inverse>(kSin60 * (b - c));
+    y[k] = a + sum;
+    y[k + ns] = mid + rot;
+    y[k + 2 * ns] = mid - rot;
+  }
+
+  template <bool Inverse>
+  static auto radix4(const Complex* x, Complex* y, const Complex* tw, std::size_t ns, std::size_t stride, std::size_t k) -> void {
+    const Complex a = x[k];
+    const Complex b = mul(x[k + stride],     direction<Inverse>(tw[k]));
+    const Complex c = mul(x[k + 2 * stride], direction<Inverse>(tw[ns + k]));
+    const Complex d = mul(x[k + 3 * stride], direction<Inverse>(tw[2 * ns + k]));
+    const Complex ac0 = a + c, ac1 = a - c;
+    const Complex bd0 = b + d, bd1 = rotate<Inverse>(b - d);
+    y[k] = ac0 + bd0;
+    y[k + ns] = ac1 + bd1;
+    y[k + 2 * ns] = ac0 - bd0;
+    y[k + 3 * ns] = ac1 - bd1;
+  }
+
+  template <bool Inverse>
+  static auto radix5(const Complex* x, Complex* y, const Complex* tw, std::size_t ns, std::size_t stride, std::size_t k) -> void {
+    constexpr float kCos72 = 0.30901699437494742410f, kCos144 = -0.80901699437494742410f;
+    constexpr float kSin72 = 0.95105651629515357212f, kSin144 = 0.58778525229247312917f;
+    const Complex x0 = x[k];
+    const Complex x1 = mul(x[k + stride],     direction<Inverse>(tw[k]));
+    const Complex x2 = mul(x[k + 2 * stride], direction<Inverse>(tw[ns + k]));
+    const Complex x3 = mul(x[k + 3 * stride], direction<Inverse>(tw[2 * ns + k]));
+    const Complex x4 = mul(x[k + 4 * stride], direction<Inverse>(tw[3 * ns + k]));
+    const Complex a1 = x1 + x4, b1 = x1 - x4;
+    const Complex a2 = x2 + x3, b2 = x2 - x3;
+    const Complex m1 = x0 + kCos72 * a1 + kCos144 * a2;
+    const Complex m2 = x0 + kCos144 * a1 + kCos72 * a2;
+    const Complex r1 = rotate<Inverse>(kSin72 * b1 + kSin144 * b2);
+    const Complex r2 = rotate<Inverse>(kSin144 * b1 - kSin72 * b2);
+    y[k] = x0 + a1 + a2;
+    y[k + ns] = m1 + r1;
+    y[k + 2 * ns] = m2 + r2;
+    y[k + 3 * ns] = m2 - r2;
+    y[k + 4 * ns] = m1 - r1;
+  }
+
+  // * O(p²) DFT per butterfly; only reached for lengths with a prime factor above 5.
+  template <bool Inverse>
+  auto generic(const Stage& stage, const Complex* src, Complex* dst) const -> void {
+    const std::size_t p = stage.radix;
+    const std::size_t ns = stage.solved;
+    const std::size_t stride = n_ / p;
+    const Complex* tw = stage.twiddles.data();
+    std::vector<Complex> v(p);
+    for (std::size_t j = 0; j < stride; ++j) {
+      const std::size_t k = j % ns;
+      const Complex* x = src + j;
+      Complex* y = dst + (j - k) * p + k;
+      v[0] = x[0];
+      for (std::size_t r = 1; r < p; ++r) { v[r] = mul(x[r * stride], direction<Inverse>(tw[(r - 1) * ns + k])); }
+      for (std::size_t q = 0; q < p; ++q) {
+        Complex sum = v[0];
+        std::size_t index = 0;
+        for (std::size_t r = 1; r < p; ++r) {
+          index += q;
+          if (index >= p) { index -= p; }
+          sum += mul(v[r], direction<Inverse>(stage.roots[index]));
+        }
+        y[q * ns] = sum;
+      }
+    }
+  }
+
+  std::size_t n_;
+  std::vector<Stage> stages_;
+};
+
+/**
+ * @brief Real-to-complex FFT of even length n: `n/2 + 1` output bins (the
+ *  rest are their conjugates), and the matching complex-to-real inverse.
+ */
+class RealPlan {
+public:
+  explicit RealPlan(std::size_t n) : n_(n), half_(n / 2) {
+    if (n < 2 || n % 2 != 0) {
+      throw std::runtime_error("Real FFT length must be even and positive, got " + std::to_string(n) + ".");
+    }
+    plan_ = std::make_unique<Plan>(half_);
+    split_.resize(half_ + 1);
+    for (std::size_t k = 0; k <= half_; ++k) {
+      const double phase = -2.0 * std::numbers::pi * static_cast<double>(k) / static_cast<double>(n);
+      split_[k] = Complex(static_cast<float>(std::cos(phase)), static_cast<float>(std::sin(phase)));
+    }
+  }
+
+  auto size() const -> std::size_t { return n_; }
+  auto bins() const -> std::size_t { return half_ + 1; }
+  /// @brief Complex scratch each call needs, in elements.
+  auto scratchSize() const -> std::size_t { return 2 * half_; }
+
+  /// @brief `out[0..n/2]` = FFT of the `n` reals at `in`.
+  auto forward(const float* in, Complex* out, Complex* scratch) const -> void {
+    // * Even samples as the real parts, odd as the imaginary parts.
+    for (std::size_t k = 0; k < half_; ++k) { scratch[k] = Complex(in[2 * k], in[2 * k + 1]); }
+    plan_->forward(scratch, out, scratch + half_);
+
+    const Complex z0 = out[0];
+    out[0] = Complex(z0.real() + z0.imag(), 0.0f);
+    out[half_] = Complex(z0.real() - z0.imag(), 0.0f);
+    for (std::size_t k = 1; k <= half_ / 2; ++k) {
+      const Complex a = out[k];
+      const Complex b = std::conj(out[half_ - k]);
+      const Complex even = 0.5f * (a + b);
+      const Complex diff = 0.5f * (a - b);
+      const Complex odd(diff.imag(), -diff.real());  // * -i * diff
+      out[k] = even + mul(split_[k], odd);
+      out[half_ - k] = std::conj(even) + mul(split_[half_ - k], std::conj(odd));
+    }
+  }
+
+  /// @brief The `n` reals whose FFT is `in[0..n/2]` (scaled by 1/n, so exact).
+  auto inverse(const Complex* in, float* out, Complex* scratch) const -> void {
+    const float scale = 1.0f / static_cast<float>(n_);
+    for (std::size_t k = 0; k < half_; ++k) {
+      const Complex a = in[k];
+      const Complex b = std::conj(in[half_ - k]);
+      const Complex even = a + b;
+      const Complex odd = mul(a - b, std::conj(split_[k]));
+      // * even + i * odd
+      scratch[k] = scale * Complex(even.real() - odd.imag(), even.imag() + odd.real());
+    }
+    // * The complex transform writes its result over `out`, viewed as n/2 complexes.
+    plan_->inverse(scratch, reinterpret_cast<Complex*>(out), scratch + half_);
+  }
+
+  /// @brief Process-wide plan for length `n`, built on first use.
+  static auto get(std::size_t n) -> std::shared_ptr<const RealPlan> {
+    static std::mutex mutex;
+    static std::map<std::size_t, std::shared_ptr<const RealPlan>> cache;
+    std::lock_guard lock(mutex);
+    auto& plan = cache[n];
+    if (!plan) { plan = std::make_shared<const RealPlan>(n); }
+    return plan;
+  }
+
+private:
+  std::size_t n_;
+  std::size_t half_;
+  std::unique_ptr<Plan> plan_;
+  std::vector<Complex> split_;  // * e^{-2πik/n}, k = 0..n/2
+};
+
+}  // namespace compute::fft
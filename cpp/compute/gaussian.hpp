@@ -0,0 +1,250 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "convolution.hpp"
+#include "thread_pool.hpp"
+
+// * Gaussian smoothing in O(1) per sample, whatever sigma: Deriche's
+// * recursive (IIR) approximation, 4th order, as laid out in Getreuer's
+// * "A Survey of Gaussian Convolution Algorithms" (IPOL 2013).
+// *
+// * The Gaussian is fitted by four complex exponentials,
+// *
+// *   g(t) ~ sum_k alpha_k exp(-lambda_k |t| / sigma),
+// *
+// * so it is a causal filter (t >= 0) plus an anticausal one (t < 0), each a
+// * 4-tap recursion. Output is the normalised sum of both passes, with the
+// * same "same"-size, centred semantics and `Boundary` rules as the FIR path
+// * of `convolution.hpp`.
+// *
+// * A recursion can't be split across SIMD lanes, so lanes take different
+// * sequences instead: separate channels, or chunks of one long signal that
+// * each warm up over a halo of `halo()` samples, after which the IIR state
+// * no longer depends on where it started.
+// *
+// * Accuracy, measured against the sampled Gaussian for sigma in [0.5, 128]:
+// * the impulse response is within 6e-4 of the FIR peak tap (relative). On
+// * samples in [-1, 1], every output is within 7e-4 of the direct FIR result
+// * for sigma >= 0.55 (worst near sigma = 1); the fit degrades below that,
+// * to 8e-4 at sigma = 0.5, so allow 1e-3 there.
+
+namespace compute::convolution {
+
+class RecursiveGaussian {
+public:
+  /// @brief Sequences run side by side, one per SIMD lane.
+  static constexpr std::size_t kLanes = 8;
+  /// @brief Shortest chunk a long signal is split into.
+  static constexpr std::size_t kMinChunk = 4096;
+  /// @brief Narrowest Gaussian the fit was measured at (see the header).
+  static constexpr double kMinSigma = 0.5;
+
+  explicit RecursiveGaussian(double sigma) : sigma_(sigma) {
+    if (!(sigma >= kMinSigma)) {
+      throw std::runtime_error(
+        "Recursive Gaussian needs sigma >= " + std::to_string(kMinSigma) + "; got " + std::to_string(sigma) + ".");
+    }
+    // * Deriche's 4th-order fit.
+    using C = std::complex<double>;
+    constexpr std::array<C, kOrder> alpha{C{0.84, 1.8675}, C{0.84, -1.8675}, C{-0.34015, -0.1299}, C{-0.34015, 0.1299}};
+    constexpr std::array<C, kOrder> lambda{C{1.783, 0.6318}, C{1.783, -0.6318}, C{1.723, 1.997}, C{1.723, -1.997}};
+
+    // * sum_k alpha_k / (1 - beta_k z^-1) as one ratio B(z^-1) / A(z^-1),
+    // * multiplied out one pole at a time.
+    std::array<C, kOrder + 1> a{C{1.0}}, b{};
+    for (std::size_t k = 0; k < kOrder; ++k) {
+      const C beta = std::exp(-lambda[k] / sigma);
+      for (std::size_t j = k + 1; j > 0; --j) {
+        b[j] = b[j] - beta * b[j - 1] + alpha[k] * a[j];
+        a[j] = a[j] - beta * a[j - 1];
+      }
+      b[0] += alpha[k] * a[0];
+    }
+    // * The anticausal half is the mirror image without the t = 0 sample:
+    // * B(z) / A(z) - b0, numerator B - b0·A.
+    double sumA = 0.0, sumB = 0.0, sumAnti = 0.0;
+    for (std::size_t j = 0; j <= kOrder; ++j) {
+      a_[j] = a[j].real();
+      causal_[j] = j < kOrder ? b[j].real() : 0.0;
+      anticausal_[j] = j == 0 ? 0.0 : causal_[j] - causal_[0] * a_[j];
+      sumA += a_[j];
+      sumB += causal_[j];
+      sumAnti += anticausal_[j];
+    }
+    scale_ = sumA / (sumB + sumAnti);
+    // * The slowest pole decays as exp(-1.723 t / sigma): 1e-7 after 9.4 sigma.
+    halo_ = static_cast<std::size_t>(std::ceil(10.0 * sigma));
+  }
+
+  auto sigma() const -> double { return sigma_; }
+  /// @brief Warm-up samples before (and after) a chunk.
+  auto halo() const -> std::size_t { return halo_; }
+
+  /// @brief One signal, cut into chunks that run side by side.
+  auto apply(std::span<const float> signal, std::span<float> out, Boundary boundary = Boundary::Zero) const -> void {
+    requireOutputSize(signal.size(), out.size());
+    applyBatch(signal, signal.size(), out, boundary);
+  }
+
+  /**
+   * @brief `signals.size() / length` channels of `length` samples, back to
+   *  back, each smoothed into the matching slice of `out`.
+   * @details Channels longer than a chunk are cut into chunks. Every group
+   *  of `kLanes` chunks is one task for the thread pool.
+   */
+  auto applyBatch(
+    std::span<const float> signals,
+    std::size_t length,
+    std::span<float> out,
+    Boundary boundary = Boundary::Zero) const -> void {
+    requireOutputSize(signals.size(), out.size());
+    if (signals.empty()) { return; }
+    batchShape(signals.size(), length, 1, 1);
+
+    // * Chunks at least 8 halos long keep the warm-up under 25% of the work.
+    const std::size_t chunk = std::max(kMinChunk, 8 * halo_);
+    const std::size_t perChannel = (length + chunk - 1) / chunk;
+    std::vector<Segment> segments;
+    segments.reserve(signals.size() / length * perChannel);
+    for (std::size_t offset = 0; offset < signals.size(); offset += length) {
+      const std::span<const float> channel = signals.subspan(offset, length);
+      for (std::size_t begin = 0; begin < length; begin += chunk) {
+        segments.push_back({channel, out.data() + offset, begin, std::min(begin + chunk, length)});
+      }
+    }
+    const std::size_t groups = (segments.size() + kLanes - 1) / kLanes;
+    ThreadPool::global().parallelFor(groups, 1, [&](std::size_t first, std::size_t last) {
+      std::vector<float> scratch;
+      for (std::size_t g = first; g < last; ++g) {
+        const std::size_t begin = g * kLanes;
+        run(std::span(segments).subspan(begin, std::min(kLanes, segments.size() - begin)), boundary, scratch);
+      }
+    });
+  }
+
+private:
+  static constexpr std::size_t kOrder = 4;
+
+  /// @brief One double per lane (GCC/Clang vector extension).
+  typedef double Lanes __attribute__((vector_size(kLanes * sizeof(double))));
+
+  // * By reference: passing 64-byte vectors by value changes ABI with the ISA.
+  static auto load(const float* p, Lanes& v) -> void {
+    for (std::size_t lane = 0; lane < kLanes; ++lane) { v[lane] = p[lane]; }
+  }
+
+  static auto store(float* p, const Lanes& v) -> void {
+    for (std::size_t lane = 0; lane < kLanes; ++lane) { p[lane] = static_cast<float>(v[lane]); }
+  }
+
+  /// @brief Outputs `[begin, end)` of one channel.
+  struct Segment {
+    std::span<const float> channel;
+    float* out;
+    std::size_t begin;
+    std::size_t end;
+  };
+
+  // * Samples a segment reads before its first output: none at a zero
+  // * boundary, where a zero state is exact, else the halo.
+  auto leadIn(const Segment& s, Boundary boundary) const -> std::size_t {
+    return s.begin == 0 && boundary == Boundary::Zero ? 0 : halo_;
+  }
+  auto leadOut(const Segment& s, Boundary boundary) const -> std::size_t {
+    return s.end == s.channel.size() && boundary == Boundary::Zero ? 0 : halo_;
+  }
+
+  /**
+   * @brief Up to `kLanes` segments in lockstep.
+   * @details Inputs are interleaved (`lanes[t * kLanes + lane]`) so each
+   *  step of the recursion is one vector operation across lanes. Lanes
+   *  whose segment is shorter read zeros past its end.
+   */
+  auto run(std::span<const Segment> segments, Boundary boundary, std::vector<float>& scratch) const -> void {
+    std::size_t steps = 0;
+    for (const Segment& s : segments) {
+      steps = std::max(steps, leadIn(s, boundary) + (s.end - s.begin) + leadOut(s, boundary));
+    }
+    scratch.assign(2 * steps * kLanes, 0.0f);
+    float* input = scratch.data();
+    float* forward = input + steps * kLanes;
+    for (std::size_t lane = 0; lane < segments.size(); ++lane) {
+      const Segment& s = segments[lane];
+      const auto first = static_cast<std::ptrdiff_t>(s.begin) - static_cast<std::ptrdiff_t>(leadIn(s, boundary));
+      const std::size_t count = leadIn(s, boundary) + (s.end - s.begin) + leadOut(s, boundary);
+      // * Only the lead-in and lead-out past the ends need the boundary rule.
+      const auto n = static_cast<std::ptrdiff_t>(s.channel.size());
+      const auto lo = static_cast<std::size_t>(std::clamp<std::ptrdiff_t>(-first, 0, static_cast<std::ptrdiff_t>(count)));
+      const auto hi = static_cast<std::size_t>(std::clamp<std::ptrdiff_t>(n - first, static_cast<std::ptrdiff_t>(lo), static_cast<std::ptrdiff_t>(count)));
+      for (std::size_t t = 0; t < lo; ++t) {
+        input[t * kLanes + lane] = sampleAt(s.channel, first + static_cast<std::ptrdiff_t>(t), boundary);
+      }
+      for (std::size_t t = lo; t < hi; ++t) { input[t * kLanes + lane] = s.channel[first + static_cast<std::ptrdiff_t>(t)]; }
+      for (std::size_t t = hi; t < count; ++t) {
+        input[t * kLanes + lane] = sampleAt(s.channel, first + static_cast<std::ptrdiff_t>(t), boundary);
+      }
+    }
+
+    // * y[t] = sum_j b_j x[t - j] - sum_{j>0} a_j y[t - j], state in double:
+    // * poles sit within a few 1e-3 of the unit circle for large sigma.
+    const double b0 = causal_[0], b1 = causal_[1], b2 = causal_[2], b3 = causal_[3];
+    const double a1 = a_[1], a2 = a_[2], a3 = a_[3], a4 = a_[4];
+    Lanes x1{}, x2{}, x3{}, y1{}, y2{}, y3{}, y4{};
+    for (std::size_t t = 0; t < steps; ++t) {
+      Lanes x0;
+      load(input + t * kLanes, x0);
+      const Lanes y0 = b0 * x0 + b1 * x1 + b2 * x2 + b3 * x3 - a1 * y1 - a2 * y2 - a3 * y3 - a4 * y4;
+      store(forward + t * kLanes, y0);
+      x3 = x2; x2 = x1; x1 = x0;
+      y4 = y3; y3 = y2; y2 = y1; y1 = y0;
+    }
+
+    // * Anticausal: y[t] = sum_{j>0} b'_j x[t + j] - sum_{j>0} a_j y[t + j].
+    // * The sum of both passes overwrites `input`, already consumed.
+    const double c1 = anticausal_[1], c2 = anticausal_[2], c3 = anticausal_[3], c4 = anticausal_[4];
+    Lanes x4{};
+    x1 = x2 = x3 = y1 = y2 = y3 = y4 = Lanes{};
+    for (std::size_t t = steps; t-- > 0;) {
+      const Lanes y0 = c1 * x1 + c2 * x2 + c3 * x3 + c4 * x4 - a1 * y1 - a2 * y2 - a3 * y3 - a4 * y4;
+      x4 = x3; x3 = x2; x2 = x1;
+      load(input + t * kLanes, x1);
+      y4 = y3; y3 = y2; y2 = y1; y1 = y0;
+      Lanes causal;
+      load(forward + t * kLanes, causal);
+      store(input + t * kLanes, scale_ * (causal + y0));
+    }
+
+    for (std::size_t lane = 0; lane < segments.size(); ++lane) {
+      const Segment& s = segments[lane];
+      const float* result = input + leadIn(s, boundary) * kLanes + lane;
+      for (std::size_t i = s.begin; i < s.end; ++i, result += kLanes) { s.out[i] = *result; }
+    }
+  }
+
+  double sigma_;
+  std::size_t halo_ = 0;
+  std::array<double, kOrder + 1> a_{};
+  std::array<double, kOrder + 1> causal_{};
+  std::array<double, kOrder + 1> anticausal_{};
+  double scale_ = 1.0;
+};
+
+/// @brief `signal` smoothed by a Gaussian of `sigma` samples, recursively.
+inline auto recursiveGaussian(
+  std::span<const float> signal,
+  double sigma,
+  std::span<float> out,
+  Boundary boundary = Boundary::Zero) -> void {
+  RecursiveGaussian(sigma).apply(signal, out, boundary);
+}
+
+}  // namespace compute::convolution
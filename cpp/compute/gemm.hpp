@@ -0,0 +1,528 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+#include "elementwise.hpp"
+#include "memory.hpp"
+#include "thread_pool.hpp"
+
+// * Single-precision matrix multiply on the CPU, the way BLAS libraries do
+// * it (Goto & van de Geijn, "Anatomy of High-Performance Matrix
+// * Multiplication", 2008):
+// *
+// *   for each nc-wide column panel of B and C           (L3)
+// *     for each kc-deep slice of the inner dimension
+// *       pack B[kc x nc] into kCols-wide micro-panels   (L3 -> L2)
+// *       for each mc-tall block of A and C
+// *         pack A[mc x kc] into kRows-tall micro-panels (L2)
+// *         for every kRows x kCols tile of the block: micro-kernel (L1)
+// *
+// * Packing lays both operands out in the exact order the micro-kernel reads
+// * them, contiguous and zero-padded to whole tiles, so the kernel never
+// * checks bounds or strides. Edge tiles run the same kernel into a local
+// * tile and copy the valid part out.
+// *
+// * On several threads, each (nc, kc) panel of B is packed cooperatively and
+// * then shared read-only; the C block it feeds is cut into macro-tiles of
+// * whole micro-panels (see `partition`), each a task on the work-stealing
+// * `ThreadPool`. A task packs its rows of A into a per-thread buffer, and
+// * consecutive tasks of one thread reuse it when they share those rows.
+// *
+// * Micro-kernels (`gemm_kernels.inl`) per ISA, rows x columns of C held in
+// * registers:
+// *   AVX-512  14 x 32  (28 of 32 zmm accumulate)
+// *   AVX2      6 x 16  (12 of 16 ymm)
+// *   NEON      8 x 12  (24 of 32 q registers)
+// *   scalar    4 x 4
+
+namespace compute::gemm {
+
+using elementwise::Isa;
+using elementwise::activeIsa;
+using elementwise::isaName;
+using elementwise::supported;
+
+/// @brief Cache blocking: rows of A, depth, and columns of B per block.
+struct Blocking {
+  std::size_t mc;
+  std::size_t kc;
+  std::size_t nc;
+};
+
+/// @brief One ISA's register-blocked kernel and the blocking tuned around it.
+struct MicroKernel {
+  std::size_t rows;
+  std::size_t cols;
+  void (*run)(std::size_t depth, const float* a, const float* b, float* c, std::size_t ldc, float alpha, float beta);
+  Blocking blocking;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// * Per-ISA instantiations ...
+///////////////////////////////////////////////////////////////////////////////
+
+// * The portable fallback, kept one float at a time so it measures what the
+// * SIMD kernels buy. GCC would otherwise vectorize it for the build's own
+// * ISA; clang has no per-region switch, so there it may still be.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC optimize("no-tree-vectorize")
+#endif
+namespace scalar {
+struct Vec {
+  using type = float;
+  static constexpr std::size_t width = 1;
+  static auto load(const float* p) -> type { return *p; }
+  static auto storeu(float* p, type v) -> void { *p = v; }
+  static auto set1(float v) -> type { return v; }
+  static auto mul(type a, type b) -> type { return a * b; }
+  static auto fmadd(type a, type b, type c) -> type { return a * b + c; }
+};
+constexpr std::size_t kRows = 4;
+constexpr std::size_t kVectors = 4;
+constexpr Blocking kBlocking{64, 256, 1024};
+#include "gemm_kernels.inl"
+}  // namespace scalar
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC pop_options
+#endif
+
+#ifdef REPOUSSE_X86
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2,fma"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+namespace avx2 {
+struct Vec {
+  using type = __m256;
+  static constexpr std::size_t width = 8;
+  static inline auto load(const float* p) -> type { return _mm256_loadu_ps(p); }
+  static inline auto storeu(float* p, type v) -> void { _mm256_storeu_ps(p, v); }
+  static inline auto set1(float v) -> type { return _mm256_set1_ps(v); }
+  static inline auto mul(type a, type b) -> type { return _mm256_mul_ps(a, b); }
+  static inline auto fmadd(type a, type b, type c) -> type { return _mm256_fmadd_ps(a, b, c); }
+};
+constexpr std::size_t kRows = 6;
+constexpr std::size_t kVectors = 2;
+constexpr Blocking kBlocking{144, 256, 2048};
+#include "gemm_kernels.inl"
+}  // namespace avx2
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx512f"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+// ! GCC 12's avx512fintrin.h seeds its masked builtins with `_mm*_undefined_*`,
+// ! which -Wall reports as uninitialised once inlined here.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+namespace avx512 {
+struct Vec {
+  using type = __m512;
+  static constexpr std::size_t width = 16;
+  static inline auto load(const float* p) -> type { return _mm512_loadu_ps(p); }
+  static inline auto storeu(float* p, type v) -> void { _mm512_storeu_ps(p, v); }
+  static inline auto set1(float v) -> type { return _mm512_set1_ps(v); }
+  static inline auto mul(type a, type b) -> type { return _mm512_mul_ps(a, b); }
+  static inline auto fmadd(type a, type b, type c) -> type { return _mm512_fmadd_ps(a, b, c); }
+};
+constexpr std::size_t kRows = 14;
+constexpr std::size_t kVectors = 2;
+constexpr Blocking kBlocking{168, 256, 2048};
+#include "gemm_kernels.inl"
+}  // namespace avx512
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+#endif
+
+#endif  // REPOUSSE_X86
+
+#ifdef REPOUSSE_NEON
+namespace neon {
+struct Vec {
+  using type = float32x4_t;
+  static constexpr std::size_t width = 4;
+  static inline auto load(const float* p) -> type { return vld1q_f32(p); }
+  static inline auto storeu(float* p, type v) -> void { vst1q_f32(p, v); }
+  static inline auto set1(float v) -> type { return vdupq_n_f32(v); }
+  static inline auto mul(type a, type b) -> type { return vmulq_f32(a, b); }
+  static inline auto fmadd(type a, type b, type c) -> type { return vfmaq_f32(c, a, b); }
+};
+constexpr std::size_t kRows = 8;
+constexpr std::size_t kVectors = 3;
+constexpr Blocking kBlocking{128, 256, 2040};
+#include "gemm_kernels.inl"
+}  // namespace neon
+#endif  // REPOUSSE_NEON
+
+inline auto microKernel(Isa isa) -> const MicroKernel& {
+  if (!supported(isa)) {
+    throw std::runtime_error("ISA '" + std::string(isaName(isa)) + "' is not supported on this CPU.");
+  }
+  switch (isa) {
+#ifdef REPOUSSE_X86
+    case Isa::Avx2:   return avx2::table;
+    case Isa::Avx512: return avx512::table;
+#endif
+#ifdef REPOUSSE_NEON
+    case Isa::Neon:   return neon::table;
+#endif
+    default:          return scalar::table;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Packing ...
+///////////////////////////////////////////////////////////////////////////////
+
+/// @brief A read-only matrix: element (i, j) at `data[i * rowStride + j * colStride]`.
+struct View {
+  const float* data;
+  std::size_t rowStride;
+  std::size_t colStride;
+
+  auto operator()(std::size_t i, std::size_t j) const -> float { return data[i * rowStride + j * colStride]; }
+};
+
+/**
+ * @brief Rows [i0, i0 + rows) x columns [p0, p0 + depth) of A into
+ *  `tileRows`-tall micro-panels: panel q holds `depth` columns of
+ *  `tileRows` values, rows past the end zero.
+ */
+inline auto packA(View a, std::size_t i0, std::size_t rows, std::size_t p0, std::size_t depth, std::size_t tileRows, float* dst) -> void {
+  for (std::size_t ir = 0; ir < rows; ir += tileRows) {
+    const std::size_t h = std::min(tileRows, rows - ir);
+    for (std::size_t r = 0; r < h; ++r) {
+      const float* src = a.data + (i0 + ir + r) * a.rowStride + p0 * a.colStride;
+      float* out = dst + r;
+      for (std::size_t p = 0; p < depth; ++p) { out[p * tileRows] = src[p * a.colStride]; }
+    }
+    for (std::size_t r = h; r < tileRows; ++r) {
+      for (std::size_t p = 0; p < depth; ++p) { dst[p * tileRows + r] = 0.0f; }
+    }
+    dst += depth * tileRows;
+  }
+}
+
+/**
+ * @brief Rows [p0, p0 + depth) x columns [j0, j0 + cols) of B into
+ *  `tileCols`-wide micro-panels: panel q holds `depth` rows of `tileCols`
+ *  values, columns past the end zero.
+ */
+inline auto packB(View b, std::size_t p0, std::size_t depth, std::size_t j0, std::size_t cols, std::size_t tileCols, float* dst) -> void {
+  for (std::size_t jr = 0; jr < cols; jr += tileCols) {
+    const std::size_t w = std::min(tileCols, cols - jr);
+    for (std::size_t p = 0; p < depth; ++p) {
+      const float* src = b.data + (p0 + p) * b.rowStride + (j0 + jr) * b.colStride;
+      float* out = dst + p * tileCols;
+      if (b.colStride == 1) {
+        std::copy_n(src, w, out);
+      } else {
+        for (std::size_t c = 0; c < w; ++c) { out[c] = src[c * b.colStride]; }
+      }
+      std::fill(out + w, out + tileCols, 0.0f);
+    }
+    dst += depth * tileCols;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Blocked driver ...
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief C[rows x cols] = alpha·Ap·Bp + beta·C from packed blocks, one
+ *  micro-kernel call per tile; partial tiles go through a local tile.
+ */
+inline auto macroKernel(
+  const MicroKernel& kernel, std::size_t rows, std::size_t cols, std::size_t depth,
+  const float* aPacked, const float* bPacked, float* c, std::size_t ldc, float alpha, float beta) -> void {
+  const std::size_t mr = kernel.rows, nr = kernel.cols;
+  alignas(64) float tile[32 * 64];
+  for (std::size_t jr = 0; jr < cols; jr += nr) {
+    const std::size_t w = std::min(nr, cols - jr);
+    const float* b = bPacked + jr * depth;
+    for (std::size_t ir = 0; ir < rows; ir += mr) {
+      const std::size_t h = std::min(mr, rows - ir);
+      const float* a = aPacked + ir * depth;
+      float* out = c + ir * ldc + jr;
+      if (h == mr && w == nr) {
+        kernel.run(depth, a, b, out, ldc, alpha, beta);
+        continue;
+      }
+      kernel.run(depth, a, b, tile, nr, alpha, 0.0f);
+      for (std::size_t r = 0; r < h; ++r) {
+        for (std::size_t j = 0; j < w; ++j) {
+          out[r * ldc + j] = beta == 0.0f ? tile[r * nr + j] : tile[r * nr + j] + beta * out[r * ldc + j];
+        }
+      }
+    }
+  }
+}
+
+/// @brief C = beta·C over an m x n block, without reading C when beta is 0.
+inline auto scale(std::size_t m, std::size_t n, float beta, float* c, std::size_t ldc) -> void {
+  for (std::size_t i = 0; i < m; ++i) {
+    float* row = c + i * ldc;
+    if (beta == 0.0f) {
+      std::fill_n(row, n, 0.0f);
+    } else {
+      for (std::size_t j = 0; j < n; ++j) { row[j] *= beta; }
+    }
+  }
+}
+
+/**
+ * @brief How the C block under one packed B panel is cut into tasks: `mWays`
+ *  row blocks of `rows` (a multiple of the micro-tile height) times `nWays`
+ *  column chunks of `cols` (a multiple of its width).
+ */
+struct Partition {
+  std::size_t threads;
+  std::size_t mWays;
+  std::size_t nWays;
+  std::size_t rows;
+  std::size_t cols;
+};
+
+/// @brief Tasks per thread, so stealing can even out uneven tiles and cores.
+constexpr std::size_t kTasksPerThread = 4;
+/// @brief Work (2·m·n·k flops) below which another thread costs more than it saves.
+constexpr double kFlopsPerThread = 4.0e6;
+
+/**
+ * @brief Picks the thread count and the split of an m x n block of C for
+ *  `threads` available threads.
+ * @details Small products get fewer threads. The task grid aims for
+ *  `kTasksPerThread` tasks per thread with tiles as close to square as the
+ *  shape allows: a tall C is mostly split along M (each task packs its own
+ *  rows of A), a wide one along N (tasks share the packed B). Row blocks
+ *  never exceed `mc`, so packed A still fits L2.
+ */
+inline auto partition(
+  std::size_t m, std::size_t n, std::size_t k, std::size_t threads, const MicroKernel& kernel, Blocking blocking)
+  -> Partition {
+  const std::size_t mr = kernel.rows, nr = kernel.cols;
+  const std::size_t mc = std::max(mr, blocking.mc / mr * mr);
+  const std::size_t rowPanels = (m + mr - 1) / mr;
+  const std::size_t colPanels = (n + nr - 1) / nr;
+
+  const double flops = 2.0 * double(m) * double(n) * double(k);
+  threads = std::clamp<std::size_t>(static_cast<std::size_t>(flops / kFlopsPerThread), 1, threads);
+  if (threads == 1) {
+    const std::size_t rows = std::min(mc, rowPanels * mr);
+    return {1, (m + rows - 1) / rows, 1, rows, colPanels * nr};
+  }
+  const std::size_t target = threads * kTasksPerThread;
+
+  // * nWays / mWays ≈ n / m keeps the tiles square.
+  const double ratio = std::sqrt(double(target) * double(n) / double(m));
+  std::size_t nWays = std::clamp<std::size_t>(static_cast<std::size_t>(std::lround(ratio)), 1, colPanels);
+  std::size_t mWays = std::clamp<std::size_t>((target + nWays - 1) / nWays, 1, rowPanels);
+
+  const std::size_t rows = std::min(mc, (rowPanels + mWays - 1) / mWays * mr);
+  const std::size_t cols = (colPanels + nWays - 1) / nWays * nr;
+  mWays = (m + rows - 1) / rows;
+  nWays = (n + cols - 1) / cols;
+  return {threads, mWays, nWays, rows, cols};
+}
+
+/**
+ * @brief C = alpha·A·B + beta·C, A m x k, B k x n, C row-major with row
+ *  stride `ldc`, on `pool`.
+ * @details Packing buffers are per thread and grow to the largest blocks
+ *  seen. `blocking` defaults to the kernel's; mc is rounded to whole
+ *  micro-panels. A pool of one thread (or a call from inside a pool task)
+ *  runs the plain serial loop.
+ */
+inline auto multiply(
+  std::size_t m, std::size_t n, std::size_t k,
+  float alpha, View a, View b, float beta, float* c, std::size_t ldc,
+  const MicroKernel& kernel, Blocking blocking, ThreadPool& pool = ThreadPool::global()) -> void {
+  if (m == 0 || n == 0) { return; }
+  if (k == 0 || alpha == 0.0f) {
+    scale(m, n, beta, c, ldc);
+    return;
+  }
+  const std::size_t mr = kernel.rows, nr = kernel.cols;
+  const std::size_t kc = std::max<std::size_t>(blocking.kc, 1);
+  const std::size_t nc = std::max(nr, blocking.nc / nr * nr);
+  const std::size_t bPanels = (std::min(nc, n) + nr - 1) / nr;
+
+  thread_local PageVector<float> bBuffer;
+  const std::size_t bSize = bPanels * nr * std::min(kc, k);
+  if (bBuffer.size() < bSize) { bBuffer.resize(bSize); }
+  float* const bPacked = bBuffer.data();
+
+  const Partition split = partition(m, std::min(nc, n), k, pool.size(), kernel, blocking);
+  const std::size_t aSize = split.rows * std::min(kc, k);
+
+  // * Which (pc, ic) block the calling thread's A buffer holds, so a run of
+  // * tasks along N packs it once.
+  struct PackedA {
+    std::uint64_t slice = 0;
+    std::size_t row = 0;
+  };
+  static std::atomic<std::uint64_t> slices{0};
+
+  for (std::size_t jc = 0; jc < n; jc += nc) {
+    const std::size_t cols = std::min(nc, n - jc);
+    const std::size_t colPanels = (cols + nr - 1) / nr;
+    for (std::size_t pc = 0; pc < k; pc += kc) {
+      const std::size_t depth = std::min(kc, k - pc);
+      // * The first slice applies beta; later ones add onto it.
+      const float sliceBeta = pc == 0 ? beta : 1.0f;
+      const std::uint64_t slice = ++slices;
+
+      auto packPanels = [&](std::size_t first, std::size_t last) {
+        const std::size_t j0 = first * nr;
+        packB(b, pc, depth, jc + j0, std::min(last * nr, cols) - j0, nr, bPacked + j0 * depth);
+      };
+      auto runTiles = [&](std::size_t first, std::size_t last) {
+        thread_local PageVector<float> aBuffer;
+        thread_local PackedA packed;
+        if (aBuffer.size() < aSize) {
+          aBuffer.resize(aSize);
+          packed = {};
+        }
+        for (std::size_t task = first; task < last; ++task) {
+          const std::size_t ic = task / split.nWays * split.rows;
+          const std::size_t j0 = task % split.nWays * split.cols;
+          if (ic >= m || j0 >= cols) { continue; }
+          const std::size_t rows = std::min(split.rows, m - ic);
+          if (packed.slice != slice || packed.row != ic) {
+            packA(a, ic, rows, pc, depth, mr, aBuffer.data());
+            packed = {slice, ic};
+          }
+          macroKernel(
+            kernel, rows, std::min(split.cols, cols - j0), depth, aBuffer.data(), bPacked + j0 * depth,
+            c + ic * ldc + jc + j0, ldc, alpha, sliceBeta);
+        }
+      };
+
+      if (split.threads == 1) {
+        packPanels(0, colPanels);
+        runTiles(0, split.mWays * split.nWays);
+        continue;
+      }
+      // * Never more chunks than `split.threads`, so a small product stays on
+      // * the threads `partition` gave it instead of spreading over the pool.
+      // * With the whole pool, one task per chunk lets stealing balance them.
+      const std::size_t tasks = split.mWays * split.nWays;
+      pool.parallelFor(colPanels, (colPanels + split.threads - 1) / split.threads, packPanels);
+      pool.parallelFor(tasks, split.threads < pool.size() ? (tasks + split.threads - 1) / split.threads : 1, runTiles);
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * BLAS-style entry point ...
+///////////////////////////////////////////////////////////////////////////////
+
+/// @brief Whether an operand is used as stored or transposed (BLAS 'N' / 'T').
+enum class Transpose { No, Yes };
+
+inline auto transposeName(Transpose op) -> const char* { return op == Transpose::Yes ? "T" : "N"; }
+
+/**
+ * @brief `op(X)` of a row-major matrix with leading dimension `ld`: element
+ *  (i, j) is `x[i * ld + j]`, or `x[j * ld + i]` when transposed.
+ */
+inline auto view(Transpose op, const float* x, std::size_t ld) -> View {
+  return op == Transpose::Yes ? View{x, 1, ld} : View{x, ld, 1};
+}
+
+/**
+ * @brief Throws unless a row-major `rows x cols` operand fits leading
+ *  dimension `ld` (at least `cols`, or 1 for an empty operand).
+ */
+inline auto requireLeading(const char* name, std::size_t rows, std::size_t cols, std::size_t ld) -> void {
+  if (ld < std::max<std::size_t>(cols, 1) && rows > 0) {
+    throw std::runtime_error(
+      std::string("gemm: ") + name + " is stored " + std::to_string(rows) + "x" + std::to_string(cols) +
+      " but its leading dimension is " + std::to_string(ld) + ".");
+  }
+}
+
+/**
+ * @brief C = alpha·op(A)·op(B) + beta·C, row-major, like BLAS `sgemm`.
+ * @details op(A) is m x k, op(B) is k x n and C is m x n. Each operand may be
+ *  a view into a larger matrix: `lda`, `ldb` and `ldc` are the row strides
+ *  of the stored matrices (A is stored m x k, or k x m when transposed).
+ *  C is updated in place and only read when beta is non-zero, so
+ *  `beta = 1` accumulates and `beta = 0` overwrites whatever C held.
+ * @throws std::runtime_error if a leading dimension is too small.
+ */
+inline auto gemm(
+  Transpose transA, Transpose transB, std::size_t m, std::size_t n, std::size_t k,
+  float alpha, const float* a, std::size_t lda, const float* b, std::size_t ldb,
+  float beta, float* c, std::size_t ldc, Isa isa = activeIsa(), ThreadPool& pool = ThreadPool::global()) -> void {
+  const bool ta = transA == Transpose::Yes, tb = transB == Transpose::Yes;
+  requireLeading("A", ta ? k : m, ta ? m : k, lda);
+  requireLeading("B", tb ? n : k, tb ? k : n, ldb);
+  requireLeading("C", m, n, ldc);
+  const MicroKernel& kernel = microKernel(isa);
+  multiply(m, n, k, alpha, view(transA, a, lda), view(transB, b, ldb), beta, c, ldc, kernel, kernel.blocking, pool);
+}
+
+/**
+ * @brief Arguments of `gemm` in `day3/mat_mul.metal` (and its CPU twin),
+ *  bound as bytes at index 3; the layout matches the shader's `GemmParams`.
+ */
+struct KernelParams {
+  std::uint32_t m, n, k;
+  std::uint32_t lda, ldb, ldc;
+  std::uint32_t transA, transB;
+  float alpha, beta;
+};
+static_assert(sizeof(KernelParams) == 40);
+
+/**
+ * @brief Arguments of `gemm_batched` / `gemm_batched_indexed` in
+ *  `day3/mat_mul.metal`, bound at index 3; matches the shader's `BatchParams`.
+ */
+struct BatchParams {
+  std::uint32_t m, n, k;
+  std::uint32_t lda, ldb, ldc;
+  std::uint32_t strideA, strideB, strideC;
+  std::uint32_t count;
+  float alpha, beta;
+};
+static_assert(sizeof(BatchParams) == 48);
+
+/// @brief C = A·B for row-major A (m x k), B (k x n) and C (m x n).
+inline auto matmul(
+  std::span<const float> a, std::span<const float> b, std::span<float> c,
+  std::size_t m, std::size_t n, std::size_t k, Isa isa = activeIsa(), ThreadPool& pool = ThreadPool::global()) -> void {
+  if (a.size() != m * k || b.size() != k * n || c.size() != m * n) {
+    throw std::runtime_error(
+      "Matrix multiply of " + std::to_string(m) + "x" + std::to_string(k) + " by " + std::to_string(k) + "x" +
+      std::to_string(n) + " got buffers of " + std::to_string(a.size()) + ", " + std::to_string(b.size()) + " and " +
+      std::to_string(c.size()) + " floats.");
+  }
+  const MicroKernel& kernel = microKernel(isa);
+  multiply(m, n, k, 1.0f, {a.data(), k, 1}, {b.data(), n, 1}, 0.0f, c.data(), n, kernel, kernel.blocking, pool);
+}
+
+}  // namespace compute::gemm
@@ -0,0 +1,372 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "gemm.hpp"
+#include "memory.hpp"
+#include "thread_pool.hpp"
+
+// * Many small products at once: C_i = alpha·A_i·B_i + beta·C_i for a batch
+// * of row-major matrices from 2x2 up to about 64x64.
+// *
+// * At these sizes the packed GEMM of `gemm.hpp` spends more time packing and
+// * dispatching than multiplying, so each product runs one of:
+// *
+// *   fixed       a kernel specialised for one (m, n, k), fully unrolled
+// *               (`fixedProduct`): square 2, 3, 4, 8, 16, 32 and 64
+// *   loop        an i-p-j loop with runtime sizes, vectorised along a row
+// *               of C, for other shapes under `kPackedFlops`
+// *   packed      the serial packed GEMM, for other shapes above it
+// *
+// * and the batch is split across the thread pool, several products per task.
+// *
+// * `Interleaved` is the other way round for the smallest shapes: matrices are
+// * stored in groups of `kBatchLanes`, element by element, so one SIMD lane
+// * works on one matrix and no lane ever waits on a shuffle or a partial row.
+
+namespace compute::gemm {
+
+/// @brief Products below this many flops (2·m·n·k) skip packing.
+constexpr std::size_t kPackedFlops = 2 * 32 * 32 * 32;
+/// @brief Flops per pool task, so a task outweighs its scheduling.
+constexpr std::size_t kBatchTaskFlops = std::size_t{1} << 18;
+
+/// @brief One product of the batch; C is read only when beta is non-zero.
+using SmallProduct = void (*)(
+  std::size_t m, std::size_t n, std::size_t k, float alpha, const float* a, std::size_t lda,
+  const float* b, std::size_t ldb, float beta, float* c, std::size_t ldc);
+
+namespace detail {
+
+/// @brief `acc` (row stride `n`) into C as alpha·acc + beta·C.
+inline auto storeProduct(
+  std::size_t m, std::size_t n, const float* acc, float alpha, float beta, float* c, std::size_t ldc) -> void {
+  for (std::size_t i = 0; i < m; ++i) {
+    float* row = c + i * ldc;
+    if (beta == 0.0f) {
+      for (std::size_t j = 0; j < n; ++j) { row[j] = alpha * acc[i * n + j]; }
+    } else {
+      for (std::size_t j = 0; j < n; ++j) { row[j] = alpha * acc[i * n + j] + beta * row[j]; }
+    }
+  }
+}
+
+/// @brief Largest divisor of `m` that is at most `limit` (and at least 1).
+constexpr auto rowBlock(std::size_t m, std::size_t limit) -> std::size_t {
+  for (std::size_t rows = std::min(m, std::max<std::size_t>(limit, 1)); rows > 1; --rows) {
+    if (m % rows == 0) { return rows; }
+  }
+  return 1;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Product with compile-time sizes: every loop has a constant trip
+ *  count and is unrolled completely.
+ * @details When rows of C are whole vectors (N a multiple of 4), C is held
+ *  in vector accumulators, a block of rows at a time, fed by broadcasts of A:
+ *  the scheme of the packed micro-kernels, without the packing. The block
+ *  keeps at most `kAccumulators` vectors live. Other widths use plain loops
+ *  that the compiler vectorises; it handles 2x2 and 3x3 fine, but shuffles
+ *  badly from 8x8 up, which is why the vector form exists.
+ */
+template <std::size_t M, std::size_t N, std::size_t K>
+inline auto fixedProduct(
+  std::size_t, std::size_t, std::size_t, float alpha, const float* a, std::size_t lda,
+  const float* b, std::size_t ldb, float beta, float* c, std::size_t ldc) -> void {
+  if constexpr (N % 4 == 0) {
+    constexpr std::size_t kWidth = N % 16 == 0 ? 16 : N % 8 == 0 ? 8 : 4;
+    constexpr std::size_t kVectors = N / kWidth;
+    constexpr std::size_t kAccumulators = 24;
+    constexpr std::size_t kRows = detail::rowBlock(M, kAccumulators / kVectors);
+    typedef float Row __attribute__((vector_size(kWidth * sizeof(float))));
+
+    for (std::size_t i0 = 0; i0 < M; i0 += kRows) {
+      Row acc[kRows][kVectors] = {};
+#pragma GCC unroll 64
+      for (std::size_t p = 0; p < K; ++p) {
+        Row bRow[kVectors];
+        __builtin_memcpy(bRow, b + p * ldb, sizeof(bRow));
+#pragma GCC unroll 24
+        for (std::size_t i = 0; i < kRows; ++i) {
+          const float aip = a[(i0 + i) * lda + p];
+#pragma GCC unroll 4
+          for (std::size_t v = 0; v < kVectors; ++v) { acc[i][v] += aip * bRow[v]; }
+        }
+      }
+#pragma GCC unroll 24
+      for (std::size_t i = 0; i < kRows; ++i) {
+        float* row = c + (i0 + i) * ldc;
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < kVectors; ++v) {
+          Row out = alpha * acc[i][v];
+          if (beta != 0.0f) {
+            Row old;
+            __builtin_memcpy(&old, row + v * kWidth, sizeof(Row));
+            out += beta * old;
+          }
+          __builtin_memcpy(row + v * kWidth, &out, sizeof(Row));
+        }
+      }
+    }
+  } else {
+    float acc[M * N] = {};
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < M; ++i) {
+#pragma GCC unroll 16
+      for (std::size_t p = 0; p < K; ++p) {
+        const float aip = a[i * lda + p];
+#pragma GCC unroll 16
+        for (std::size_t j = 0; j < N; ++j) { acc[i * N + j] += aip * b[p * ldb + j]; }
+      }
+    }
+    detail::storeProduct(M, N, acc, alpha, beta, c, ldc);
+  }
+}
+
+/// @brief Runtime sizes, same loop order as `fixedProduct`; C must fit 64x64.
+inline auto loopProduct(
+  std::size_t m, std::size_t n, std::size_t k, float alpha, const float* a, std::size_t lda,
+  const float* b, std::size_t ldb, float beta, float* c, std::size_t ldc) -> void {
+  alignas(64) float acc[64 * 64];
+  std::fill_n(acc, m * n, 0.0f);
+  for (std::size_t i = 0; i < m; ++i) {
+    float* row = acc + i * n;
+    for (std::size_t p = 0; p < k; ++p) {
+      const float aip = a[i * lda + p];
+      const float* bRow = b + p * ldb;
+      for (std::size_t j = 0; j < n; ++j) { row[j] += aip * bRow[j]; }
+    }
+  }
+  detail::storeProduct(m, n, acc, alpha, beta, c, ldc);
+}
+
+/// @brief The packed GEMM on the calling thread, for the larger end of the range.
+inline auto packedProduct(
+  std::size_t m, std::size_t n, std::size_t k, float alpha, const float* a, std::size_t lda,
+  const float* b, std::size_t ldb, float beta, float* c, std::size_t ldc) -> void {
+  const MicroKernel& kernel = microKernel(activeIsa());
+  multiply(m, n, k, alpha, {a, lda, 1}, {b, ldb, 1}, beta, c, ldc, kernel, kernel.blocking);
+}
+
+/// @brief Which of the three paths a batch of m x n x k products takes.
+inline auto smallProduct(std::size_t m, std::size_t n, std::size_t k) -> SmallProduct {
+  if (m == n && n == k) {
+    switch (m) {
+      case 2:  return fixedProduct<2, 2, 2>;
+      case 3:  return fixedProduct<3, 3, 3>;
+      case 4:  return fixedProduct<4, 4, 4>;
+      case 8:  return fixedProduct<8, 8, 8>;
+      case 16: return fixedProduct<16, 16, 16>;
+      case 32: return fixedProduct<32, 32, 32>;
+      case 64: return fixedProduct<64, 64, 64>;
+      default: break;
+    }
+  }
+  if (2 * m * n * k >= kPackedFlops || m * n > 64 * 64) { return packedProduct; }
+  return loopProduct;
+}
+
+/// @brief Name of the path `smallProduct` picks, for labels.
+inline auto smallProductName(std::size_t m, std::size_t n, std::size_t k) -> const char* {
+  const SmallProduct product = smallProduct(m, n, k);
+  return product == loopProduct ? "loop" : product == packedProduct ? "packed" : "fixed";
+}
+
+namespace detail {
+
+/// @brief `product(i)` for every i < count, a few products per pool task.
+template <typename Fn>
+inline auto forBatch(std::size_t m, std::size_t n, std::size_t k, std::size_t count, ThreadPool& pool, Fn&& product) -> void {
+  const std::size_t flops = std::max<std::size_t>(2 * m * n * k, 1);
+  const std::size_t grain = std::max<std::size_t>(1, kBatchTaskFlops / flops);
+  pool.parallelFor(count, grain, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) { product(i); }
+  });
+}
+
+inline auto requireBatchLeading(std::size_t m, std::size_t n, std::size_t k, std::size_t lda, std::size_t ldb, std::size_t ldc) -> void {
+  requireLeading("A", m, k, lda);
+  requireLeading("B", k, n, ldb);
+  requireLeading("C", m, n, ldc);
+}
+
+}  // namespace detail
+
+/**
+ * @brief Strided batch: product i reads `a + i * strideA` and `b + i * strideB`
+ *  and updates `c + i * strideC`, like cuBLAS `gemmStridedBatched`.
+ * @details A stride of 0 shares one operand across the batch (one B applied
+ *  to many A, say). Products must not overlap in C.
+ */
+inline auto gemmStridedBatched(
+  std::size_t m, std::size_t n, std::size_t k, float alpha,
+  const float* a, std::size_t lda, std::size_t strideA,
+  const float* b, std::size_t ldb, std::size_t strideB,
+  float beta, float* c, std::size_t ldc, std::size_t strideC,
+  std::size_t count, ThreadPool& pool = ThreadPool::global()) -> void {
+  detail::requireBatchLeading(m, n, k, lda, ldb, ldc);
+  if (m == 0 || n == 0) { return; }
+  const SmallProduct product = smallProduct(m, n, k);
+  detail::forBatch(m, n, k, count, pool, [&](std::size_t i) {
+    product(m, n, k, alpha, a + i * strideA, lda, b + i * strideB, ldb, beta, c + i * strideC, ldc);
+  });
+}
+
+/// @brief Pointer-array batch: product i uses `a[i]`, `b[i]` and `c[i]`.
+inline auto gemmBatched(
+  std::size_t m, std::size_t n, std::size_t k, float alpha,
+  std::span<const float* const> a, std::size_t lda,
+  std::span<const float* const> b, std::size_t ldb,
+  float beta, std::span<float* const> c, std::size_t ldc,
+  ThreadPool& pool = ThreadPool::global()) -> void {
+  if (a.size() != c.size() || b.size() != c.size()) {
+    throw std::runtime_error(
+      "gemmBatched got " + std::to_string(a.size()) + " A, " + std::to_string(b.size()) + " B and " +
+      std::to_string(c.size()) + " C matrices.");
+  }
+  detail::requireBatchLeading(m, n, k, lda, ldb, ldc);
+  if (m == 0 || n == 0) { return; }
+  const SmallProduct product = smallProduct(m, n, k);
+  detail::forBatch(m, n, k, c.size(), pool, [&](std::size_t i) {
+    product(m, n, k, alpha, a[i], lda, b[i], ldb, beta, c[i], ldc);
+  });
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * SIMD across the batch ...
+///////////////////////////////////////////////////////////////////////////////
+
+/// @brief Matrices per interleaved group: one 512-bit vector of floats.
+constexpr std::size_t kBatchLanes = 16;
+
+/**
+ * @brief A batch stored lane-interleaved: group g holds matrices
+ *  [g·kBatchLanes, (g + 1)·kBatchLanes), and element e of the matrix in lane
+ *  l is at `data[(g * elements + e) * kBatchLanes + l]`. The last group is
+ *  zero-padded.
+ */
+class Interleaved {
+public:
+  Interleaved(std::size_t count, std::size_t rows, std::size_t cols)
+    : count_(count), rows_(rows), cols_(cols), data_(groups() * rows * cols * kBatchLanes, 0.0f) {}
+
+  /// @brief Contiguous row-major matrices, `rows * cols` floats apart.
+  static auto from(std::span<const float> matrices, std::size_t rows, std::size_t cols) -> Interleaved {
+    const std::size_t elements = rows * cols;
+    if (elements == 0 || matrices.size() % elements != 0) {
+      throw std::runtime_error(
+        std::to_string(matrices.size()) + " floats is not a whole number of " + std::to_string(rows) + "x" +
+        std::to_string(cols) + " matrices.");
+    }
+    Interleaved batch(matrices.size() / elements, rows, cols);
+    for (std::size_t i = 0; i < batch.count_; ++i) {
+      float* dst = batch.lane(i);
+      for (std::size_t e = 0; e < elements; ++e) { dst[e * kBatchLanes] = matrices[i * elements + e]; }
+    }
+    return batch;
+  }
+
+  /// @brief Back to contiguous row-major matrices.
+  auto to(std::span<float> matrices) const -> void {
+    const std::size_t elements = rows_ * cols_;
+    if (matrices.size() != count_ * elements) {
+      throw std::runtime_error(
+        "Interleaved batch of " + std::to_string(count_ * elements) + " floats copied into " +
+        std::to_string(matrices.size()) + ".");
+    }
+    for (std::size_t i = 0; i < count_; ++i) {
+      const float* src = data_.data() + (i / kBatchLanes * elements) * kBatchLanes + i % kBatchLanes;
+      for (std::size_t e = 0; e < elements; ++e) { matrices[i * elements + e] = src[e * kBatchLanes]; }
+    }
+  }
+
+  auto count() const -> std::size_t { return count_; }
+  auto rows() const -> std::size_t { return rows_; }
+  auto cols() const -> std::size_t { return cols_; }
+  auto groups() const -> std::size_t { return (count_ + kBatchLanes - 1) / kBatchLanes; }
+  auto group(std::size_t g) -> float* { return data_.data() + g * rows_ * cols_ * kBatchLanes; }
+  auto group(std::size_t g) const -> const float* { return data_.data() + g * rows_ * cols_ * kBatchLanes; }
+
+private:
+  auto lane(std::size_t i) -> float* { return group(i / kBatchLanes) + i % kBatchLanes; }
+
+  std::size_t count_;
+  std::size_t rows_;
+  std::size_t cols_;
+  PageVector<float> data_;
+};
+
+namespace detail {
+
+typedef float BatchLanes __attribute__((vector_size(kBatchLanes * sizeof(float))));
+
+inline auto loadLanes(const float* p) -> BatchLanes {
+  BatchLanes v;
+  __builtin_memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline auto storeLanes(float* p, const BatchLanes& v) -> void { __builtin_memcpy(p, &v, sizeof(v)); }
+
+/// @brief One group: C = alpha·A·B + beta·C in every lane at once.
+template <std::size_t M, std::size_t N, std::size_t K>
+inline auto interleavedGroup(
+  std::size_t m, std::size_t n, std::size_t k, float alpha, const float* a, const float* b, float beta, float* c) -> void {
+  // * Zero sizes mean "runtime"; fixed ones let the compiler unroll.
+  if constexpr (M != 0) { m = M; n = N; k = K; }
+  for (std::size_t i = 0; i < m; ++i) {
+#pragma GCC unroll 16
+    for (std::size_t j = 0; j < n; ++j) {
+      BatchLanes acc = {};
+#pragma GCC unroll 16
+      for (std::size_t p = 0; p < k; ++p) {
+        acc += loadLanes(a + (i * k + p) * kBatchLanes) * loadLanes(b + (p * n + j) * kBatchLanes);
+      }
+      float* out = c + (i * n + j) * kBatchLanes;
+      storeLanes(out, beta == 0.0f ? alpha * acc : alpha * acc + beta * loadLanes(out));
+    }
+  }
+}
+
+}  // namespace detail
+
+/**
+ * @brief C = alpha·A·B + beta·C over interleaved batches, `kBatchLanes`
+ *  products per vector instruction.
+ * @throws std::runtime_error if the batches' counts or shapes don't agree.
+ */
+inline auto gemmInterleaved(
+  float alpha, const Interleaved& a, const Interleaved& b, float beta, Interleaved& c,
+  ThreadPool& pool = ThreadPool::global()) -> void {
+  const std::size_t m = a.rows(), k = a.cols(), n = b.cols();
+  if (b.rows() != k || c.rows() != m || c.cols() != n || a.count() != c.count() || b.count() != c.count()) {
+    throw std::runtime_error(
+      "gemmInterleaved: " + std::to_string(a.count()) + " of " + std::to_string(m) + "x" + std::to_string(k) +
+      " times " + std::to_string(b.count()) + " of " + std::to_string(b.rows()) + "x" + std::to_string(n) +
+      " into " + std::to_string(c.count()) + " of " + std::to_string(c.rows()) + "x" + std::to_string(c.cols()) + ".");
+  }
+  if (m == 0 || n == 0) { return; }
+  auto group = detail::interleavedGroup<0, 0, 0>;
+  if (m == n && n == k) {
+    switch (m) {
+      case 2: group = detail::interleavedGroup<2, 2, 2>; break;
+      case 3: group = detail::interleavedGroup<3, 3, 3>; break;
+      case 4: group = detail::interleavedGroup<4, 4, 4>; break;
+      case 8: group = detail::interleavedGroup<8, 8, 8>; break;
+      default: break;
+    }
+  }
+  const std::size_t flops = std::max<std::size_t>(2 * m * n * k * kBatchLanes, 1);
+  pool.parallelFor(c.groups(), std::max<std::size_t>(1, kBatchTaskFlops / flops), [&](std::size_t begin, std::size_t end) {
+    for (std::size_t g = begin; g < end; ++g) { group(m, n, k, alpha, a.group(g), b.group(g), beta, c.group(g)); }
+  });
+}
+
+}  // namespace compute::gemm
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "backend.hpp"
+#include "context.hpp"
+#include "gemm.hpp"
+
+// * Device side of `gemm.hpp`: the tiled `gemm` kernel of `day3/mat_mul.metal`
+// * driven through a `Context`, so the same call runs on Metal or on the CPU
+// * twin in `cpu_kernels.hpp`.
+
+namespace compute::gemm {
+
+/// @brief A matrix inside a device buffer, starting `offset` floats in.
+struct DeviceMatrix {
+  Buffer& buffer;
+  std::size_t offset = 0;
+};
+
+/**
+ * @brief `gemm` on device buffers.
+ * @details One thread per element of C, in `tile() x tile()` threadgroups that
+ *  stage tiles of op(A) and op(B) in threadgroup memory. The operands may be
+ *  views into larger matrices (an offset plus a leading dimension), and C is
+ *  updated in place, so repeated calls can accumulate into one result.
+ */
+class DeviceGemm {
+public:
+  /// @brief `MAX_TILE_SIZE` in `day3/mat_mul.metal`: the largest tile side.
+  static constexpr std::size_t kMaxTile = 32;
+  /// @brief Tile side until `setTile` (or the tuner) picks another.
+  static constexpr std::size_t kDefaultTile = 16;
+  /// @brief Threads per threadgroup of the batched kernels.
+  static constexpr std::size_t kBatchGroupThreads = 256;
+
+  explicit DeviceGemm(Context& context, std::filesystem::path library = "./mat_mul.metallib")
+    : context_(context), library_(std::move(library)) {}
+
+  auto context() -> Context& { return context_; }
+
+  auto tile() const -> std::size_t { return tile_; }
+
+  /// @brief Largest tile this device runs: `kMaxTile`, or less if tile² threads don't fit one group.
+  auto maxTile() -> std::size_t {
+    const std::size_t threads = context_.pipeline(library_, "gemm").maxTotalThreadsPerThreadgroup();
+    std::size_t tile = kMaxTile;
+    while (tile > 1 && tile * tile > threads) { --tile; }
+    return tile;
+  }
+
+  /**
+   * @brief Side of the square threadgroups (and of the tiles staged in
+   *  threadgroup memory) used by `gemm`. The shader reads it from the
+   *  threadgroup size, so any value up to `maxTile()` works without edits.
+   * @throws std::runtime_error if `tile` is 0 or above `maxTile()`.
+   */
+  auto setTile(std::size_t tile) -> void {
+    if (const std::size_t limit = maxTile(); tile == 0 || tile > limit) {
+      throw std::runtime_error(
+        "gemm tile " + std::to_string(tile) + " must be between 1 and " + std::to_string(limit) + " on this device.");
+    }
+    tile_ = tile;
+  }
+
+  /**
+   * @brief C = alpha·op(A)·op(B) + beta·C, with the conventions of the CPU
+   *  `gemm`: row-major, `ld*` the row strides of the stored matrices.
+   * @throws std::runtime_error if a leading dimension is too small, a view
+   *  runs past the end of its buffer, or a size needs more than 32 bits.
+   */
+  auto gemm(
+    Transpose transA, Transpose transB, std::size_t m, std::size_t n, std::size_t k,
+    float alpha, DeviceMatrix a, std::size_t lda, DeviceMatrix b, std::size_t ldb,
+    float beta, DeviceMatrix c, std::size_t ldc) -> void {
+    const bool ta = transA == Transpose::Yes, tb = transB == Transpose::Yes;
+    requireLeading("A", ta ? k : m, ta ? m : k, lda);
+    requireLeading("B", tb ? n : k, tb ? k : n, ldb);
+    requireLeading("C", m, n, ldc);
+    if (m == 0 || n == 0) { return; }
+    requireFits("A", a, ta ? k : m, ta ? m : k, lda);
+    requireFits("B", b, tb ? n : k, tb ? k : n, ldb);
+    requireFits("C", c, m, n, ldc);
+
+    const KernelParams params{
+      checked(m, "m"), checked(n, "n"), checked(k, "k"),
+      checked(lda, "lda"), checked(ldb, "ldb"), checked(ldc, "ldc"),
+      ta ? 1u : 0u, tb ? 1u : 0u, alpha, beta};
+    Arguments arguments;
+    arguments.setBuffer(a.buffer, a.offset * sizeof(float), 0)
+             .setBuffer(b.buffer, b.offset * sizeof(float), 1)
+             .setBuffer(c.buffer, c.offset * sizeof(float), 2)
+             .setValue(params, 3);
+    Pipeline& pipeline = context_.pipeline(library_, "gemm");
+    context_.queue().dispatchThreadgroups(
+      pipeline, arguments, {(n + tile_ - 1) / tile_, (m + tile_ - 1) / tile_, 1}, {tile_, tile_, 1});
+  }
+
+  /**
+   * @brief A strided batch of small products in a single dispatch: product i
+   *  reads A and B `i * stride` floats past their views and updates C the
+   *  same way (see `gemmStridedBatched`).
+   * @details One thread per element of every C, several products per
+   *  threadgroup, so thousands of 4x4 products still fill the GPU.
+   */
+  auto stridedBatched(
+    std::size_t m, std::size_t n, std::size_t k, float alpha,
+    DeviceMatrix a, std::size_t lda, std::size_t strideA,
+    DeviceMatrix b, std::size_t ldb, std::size_t strideB,
+    float beta, DeviceMatrix c, std::size_t ldc, std::size_t strideC, std::size_t count) -> void {
+    requireLeading("A", m, k, lda);
+    requireLeading("B", k, n, ldb);
+    requireLeading("C", m, n, ldc);
+    if (m == 0 || n == 0 || count == 0) { return; }
+    const std::size_t last = count - 1;
+    requireFits("A", {a.buffer, a.offset + last * strideA}, m, k, lda);
+    requireFits("B", {b.buffer, b.offset + last * strideB}, k, n, ldb);
+    requireFits("C", {c.buffer, c.offset + last * strideC}, m, n, ldc);
+    batch("gemm_batched", batchParams(m, n, k, alpha, lda, ldb, beta, ldc, count, strideA, strideB, strideC),
+      a, b, c, nullptr);
+  }
+
+  /**
+   * @brief The pointer-array form on the device: product i starts
+   *  `offsets[3i]`, `offsets[3i + 1]` and `offsets[3i + 2]` floats into A, B
+   *  and C (`count` triples of u32 in `offsets`).
+   * @throws std::runtime_error if an offset puts a matrix past its buffer.
+   */
+  auto indexedBatched(
+    std::size_t m, std::size_t n, std::size_t k, float alpha,
+    Buffer& a, std::size_t lda, Buffer& b, std::size_t ldb,
+    float beta, Buffer& c, std::size_t ldc, Buffer& offsets, std::size_t count) -> void {
+    requireLeading("A", m, k, lda);
+    requireLeading("B", k, n, ldb);
+    requireLeading("C", m, n, ldc);
+    if (m == 0 || n == 0 || count == 0) { return; }
+    if (offsets.length() < 3 * count * sizeof(std::uint32_t)) {
+      throw std::runtime_error("gemm: " + std::to_string(count) + " products need " + std::to_string(3 * count) + " offsets.");
+    }
+    // * Buffers are host-visible, so the offsets can be checked before the GPU trusts them.
+    const std::uint32_t* offset = offsets.as<std::uint32_t>();
+    for (std::size_t i = 0; i < count; ++i, offset += 3) {
+      requireFits("A", {a, offset[0]}, m, k, lda);
+      requireFits("B", {b, offset[1]}, k, n, ldb);
+      requireFits("C", {c, offset[2]}, m, n, ldc);
+    }
+    batch("gemm_batched_indexed", batchParams(m, n, k, alpha, lda, ldb, beta, ldc, count, 0, 0, 0),
+      {a}, {b}, {c}, &offsets);
+  }
+
+private:
+  static auto batchParams(
+    std::size_t m, std::size_t n, std::size_t k, float alpha, std::size_t lda, std::size_t ldb, float beta,
+    std::size_t ldc, std::size_t count, std::size_t strideA, std::size_t strideB, std::size_t strideC) -> BatchParams {
+    checked(m * n, "m*n");
+    return {
+      checked(m, "m"), checked(n, "n"), checked(k, "k"),
+      checked(lda, "lda"), checked(ldb, "ldb"), checked(ldc, "ldc"),
+      checked(strideA, "strideA"), checked(strideB, "strideB"), checked(strideC, "strideC"),
+      checked(count, "count"), alpha, beta};
+  }
+
+  /// @brief Grid of (elements of C, products); a group spans whole products where it can.
+  auto batch(const std::string& function, const BatchParams& params, DeviceMatrix a, DeviceMatrix b, DeviceMatrix c, Buffer* offsets) -> void {
+    Pipeline& pipeline = context_.pipeline(library_, function);
+    Arguments arguments;
+    arguments.setBuffer(a.buffer, a.offset * sizeof(float), 0)
+             .setBuffer(b.buffer, b.offset * sizeof(float), 1)
+             .setBuffer(c.buffer, c.offset * sizeof(float), 2)
+             .setValue(params, 3);
+    if (offsets) { arguments.setBuffer(*offsets, 0, 4); }
+    const std::size_t elements = std::size_t{params.m} * params.n;
+    const std::size_t limit = std::min<std::size_t>(pipeline.maxTotalThreadsPerThreadgroup(), kBatchGroupThreads);
+    const std::size_t width = std::min(elements, limit);
+    context_.queue().dispatchThreads(
+      pipeline, arguments, {elements, params.count, 1}, {width, std::max<std::size_t>(1, limit / width), 1});
+  }
+
+  static auto checked(std::size_t value, const char* name) -> std::uint32_t {
+    if (value > UINT32_MAX) {
+      throw std::runtime_error(std::string("Device gemm indexes with 32 bits; ") + name + " is " + std::to_string(value) + ".");
+    }
+    return static_cast<std::uint32_t>(value);
+  }
+
+  /// @brief Throws unless a `rows x cols` view with stride `ld` lies inside its buffer.
+  static auto requireFits(const char* name, const DeviceMatrix& x, std::size_t rows, std::size_t cols, std::size_t ld) -> void {
+    if (rows == 0 || cols == 0) { return; }
+    const std::size_t end = x.offset + (rows - 1) * ld + cols;
+    if (end * sizeof(float) > x.buffer.length()) {
+      throw std::runtime_error(
+        std::string("gemm: ") + name + " needs " + std::to_string(end) + " floats but its buffer holds " +
+        std::to_string(x.buffer.length() / sizeof(float)) + ".");
+    }
+  }
+
+  Context& context_;
+  std::filesystem::path library_;
+  std::size_t tile_ = kDefaultTile;
+};
+
+}  // namespace compute::gemm
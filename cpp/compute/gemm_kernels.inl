@@ -0,0 +1,64 @@
+// * GEMM micro-kernels, compiled once per instruction set.
+// *
+// * `gemm.hpp` includes this file several times, each time inside its own
+// * namespace that defines a `Vec` traits struct and the register block
+// * (`kRows` rows by `kVectors` vectors of C), and (on x86) inside a
+// * `#pragma GCC target` region, like `reduce_kernels.inl`.
+// *
+// * `Vec` provides: `type`, `width`, `load`, `storeu`, `set1`, `mul` and
+// * `fmadd` (a*b+c). The tile of C lives in kRows·kVectors registers for the
+// * whole depth; each step loads one row of the packed B panel and
+// * broadcasts one packed A value per row (folded into the FMA as a
+// * broadcast operand where the ISA has one).
+// !  No include guard on purpose.
+
+constexpr std::size_t kCols = kVectors * Vec::width;
+
+/**
+ * @brief C = alpha·A·B + beta·C for one kRows x kCols tile of C.
+ * @param a Packed A: `depth` columns of kRows values.
+ * @param b Packed B: `depth` rows of kCols values.
+ * @note With beta == 0, C is not read, so it may hold garbage.
+ */
+inline auto microKernel(
+  std::size_t depth, const float* a, const float* b, float* c, std::size_t ldc, float alpha, float beta) -> void {
+  using V = typename Vec::type;
+  V acc[kRows][kVectors];
+#pragma GCC unroll 32
+  for (std::size_t r = 0; r < kRows; ++r) {
+#pragma GCC unroll 8
+    for (std::size_t v = 0; v < kVectors; ++v) { acc[r][v] = Vec::set1(0.0f); }
+  }
+  for (std::size_t p = 0; p < depth; ++p, a += kRows, b += kCols) {
+    V row[kVectors];
+#pragma GCC unroll 8
+    for (std::size_t v = 0; v < kVectors; ++v) { row[v] = Vec::load(b + v * Vec::width); }
+#pragma GCC unroll 32
+    for (std::size_t r = 0; r < kRows; ++r) {
+      const V value = Vec::set1(a[r]);
+#pragma GCC unroll 8
+      for (std::size_t v = 0; v < kVectors; ++v) { acc[r][v] = Vec::fmadd(value, row[v], acc[r][v]); }
+    }
+  }
+
+  const V scale = Vec::set1(alpha);
+  if (beta == 0.0f) {
+#pragma GCC unroll 32
+    for (std::size_t r = 0; r < kRows; ++r) {
+#pragma GCC unroll 8
+      for (std::size_t v = 0; v < kVectors; ++v) { Vec::storeu(c + r * ldc + v * Vec::width, Vec::mul(scale, acc[r][v])); }
+    }
+    return;
+  }
+  const V keep = Vec::set1(beta);
+#pragma GCC unroll 32
+  for (std::size_t r = 0; r < kRows; ++r) {
+#pragma GCC unroll 8
+    for (std::size_t v = 0; v < kVectors; ++v) {
+      float* out = c + r * ldc + v * Vec::width;
+      Vec::storeu(out, Vec::fmadd(keep, Vec::load(out), Vec::mul(scale, acc[r][v])));
+    }
+  }
+}
+
+inline const MicroKernel table{kRows, kCols, microKernel, kBlocking};
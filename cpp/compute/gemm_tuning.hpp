@@ -0,0 +1,233 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "autotune.hpp"
+#include "gemm.hpp"
+#include "gemm_device.hpp"
+#include "memory.hpp"
+#include "thread_pool.hpp"
+
+// * GEMM configurations picked by measurement (see `autotune.hpp`).
+// *
+// * CPU: the cache blocking (mc, kc, nc) and the thread count, searched per
+// * (ISA, shape class) by coordinate descent from the ISA's defaults: kc
+// * first (it sizes both packed panels), then mc, nc and threads. Fewer
+// * threads than the pool can win on small shapes or SMT siblings; such a
+// * plan runs on a pool of its own size.
+// *
+// * Device: the `gemm` tile, searched per (GPU, shape class) over the square
+// * tiles the pipeline can run. The shader takes its tile from the
+// * threadgroup size, so the tuned value needs no kernel edit.
+
+namespace compute::gemm {
+
+/// @brief How a tuned CPU call runs, and where the numbers came from.
+struct Plan {
+  Blocking blocking;
+  std::size_t threads;
+  const char* source;  // * "default", "cached" or "searched"
+};
+
+/**
+ * @brief Looks up (or, depending on `mode`, searches) GEMM configurations
+ *  for this machine and runs with them.
+ * @details With the default mode (`REPOUSSE_TUNE` unset) nothing is ever
+ *  measured: a cached entry is used when there is one, the built-in
+ *  defaults otherwise. Searches hold a lock, so concurrent callers wait for
+ *  one search instead of timing each other.
+ */
+class Tuner {
+public:
+  explicit Tuner(
+    Isa isa = activeIsa(), ThreadPool& pool = ThreadPool::global(),
+    autotune::Cache& cache = autotune::Cache::global(), autotune::Mode mode = autotune::defaultMode())
+    : isa_(isa), kernel_(microKernel(isa)), pool_(pool), cache_(cache), mode_(mode) {}
+
+  Tuner(const Tuner&) = delete;
+  auto operator=(const Tuner&) -> Tuner& = delete;
+
+  auto mode() const -> autotune::Mode { return mode_; }
+
+  /// @brief Blocking and thread count for an m x n x k product.
+  auto plan(std::size_t m, std::size_t n, std::size_t k) -> Plan {
+    const std::string key = "gemm/" + std::string(isaName(isa_)) + "/" + autotune::shapeClass(m, n, k);
+    const Plan fallback{kernel_.blocking, pool_.size(), "default"};
+    if (mode_ == autotune::Mode::Off) { return fallback; }
+
+    std::lock_guard lock(mutex_);
+    const bool fresh = mode_ == autotune::Mode::Retune && !searched_.contains(key);
+    if (!fresh) {
+      if (auto cached = cache_.find(autotune::cpuFingerprint(), key)) {
+        if (auto plan = toPlan(*cached, "cached")) { return *plan; }
+      }
+      if (mode_ == autotune::Mode::Cached) { return fallback; }
+    }
+    const autotune::Config best = searchCpu(m, n, k);
+    save(autotune::cpuFingerprint(), key, best);
+    searched_.insert(key);
+    return toPlan(best, "searched").value_or(fallback);
+  }
+
+  /// @brief `gemm` (same arguments and checks) with the plan for its shape.
+  auto gemm(
+    Transpose transA, Transpose transB, std::size_t m, std::size_t n, std::size_t k,
+    float alpha, const float* a, std::size_t lda, const float* b, std::size_t ldb,
+    float beta, float* c, std::size_t ldc) -> void {
+    const bool ta = transA == Transpose::Yes, tb = transB == Transpose::Yes;
+    requireLeading("A", ta ? k : m, ta ? m : k, lda);
+    requireLeading("B", tb ? n : k, tb ? k : n, ldb);
+    requireLeading("C", m, n, ldc);
+    const Plan p = plan(m, n, k);
+    multiply(m, n, k, alpha, view(transA, a, lda), view(transB, b, ldb), beta, c, ldc, kernel_, p.blocking, pool(p.threads));
+  }
+
+  /**
+   * @brief Sets `device`'s tile for m x n x k products (cached, searched or
+   *  `DeviceGemm::kDefaultTile`, by the same rules as `plan`) and returns
+   *  where it came from.
+   */
+  auto tuneTile(DeviceGemm& device, std::size_t m, std::size_t n, std::size_t k) -> const char* {
+    const std::string key = "gemm-tile/" + autotune::shapeClass(m, n, k);
+    const std::string fingerprint = autotune::deviceFingerprint(device.context().device().name());
+    const std::size_t limit = device.maxTile();
+    device.setTile(std::min(DeviceGemm::kDefaultTile, limit));
+    if (mode_ == autotune::Mode::Off) { return "default"; }
+
+    std::lock_guard lock(mutex_);
+    const bool fresh = mode_ == autotune::Mode::Retune && !searched_.contains(fingerprint + key);
+    if (!fresh) {
+      if (auto cached = cache_.find(fingerprint, key); cached && cached->contains("tile")) {
+        if (const std::size_t tile = cached->at("tile"); tile >= 1 && tile <= limit) {
+          device.setTile(tile);
+          return "cached";
+        }
+      }
+      if (mode_ == autotune::Mode::Cached) { return "default"; }
+    }
+
+    std::vector<std::size_t> tiles;
+    for (std::size_t tile : {8, 16, 32}) {
+      if (tile <= limit) { tiles.push_back(tile); }
+    }
+    const std::size_t repeats = repeatsFor(m, n, k);
+    Device& gpu = device.context().device();
+    auto a = gpu.newBuffer(std::max<std::size_t>(m * k, 1) * sizeof(float));
+    auto b = gpu.newBuffer(std::max<std::size_t>(k * n, 1) * sizeof(float));
+    auto c = gpu.newBuffer(std::max<std::size_t>(m * n, 1) * sizeof(float));
+    std::fill_n(a->as<float>(), m * k, 1.0f);
+    std::fill_n(b->as<float>(), k * n, 1.0f);
+    const autotune::Axis axis{"tile", tiles};
+    const autotune::Config best = autotune::search(
+      {{"tile", device.tile()}}, std::span(&axis, 1), [&](const autotune::Config& config) {
+        device.setTile(config.at("tile"));
+        return autotune::bestOf(repeats, [&] {
+          device.gemm(Transpose::No, Transpose::No, m, n, k, 1.0f, {*a}, k, {*b}, n, 0.0f, {*c}, n);
+        });
+      });
+    save(fingerprint, key, best);
+    searched_.insert(fingerprint + key);
+    device.setTile(best.at("tile"));
+    return "searched";
+  }
+
+  /// @brief Why the last search couldn't be saved to disk; empty if it was.
+  auto saveError() const -> std::string {
+    std::lock_guard lock(mutex_);
+    return saveError_;
+  }
+
+  /// @brief The pool a plan with `threads` threads runs on.
+  auto pool(std::size_t threads) -> ThreadPool& {
+    if (threads >= pool_.size()) { return pool_; }
+    std::lock_guard lock(poolsMutex_);
+    auto& pool = pools_[threads];
+    if (!pool) { pool = std::make_unique<ThreadPool>(threads); }
+    return *pool;
+  }
+
+private:
+  /**
+   * @brief Stores a search result. An unwritable cache file mustn't fail the
+   *  product that triggered the search: the entry stays in memory for this
+   *  process and the reason is kept for `saveError`.
+   */
+  auto save(const std::string& fingerprint, const std::string& key, const autotune::Config& config) -> void {
+    try {
+      cache_.store(fingerprint, key, config);
+      saveError_.clear();
+    } catch (const std::exception& error) {
+      saveError_ = error.what();
+    }
+  }
+
+  /// @brief Timed runs per candidate: enough that small shapes aren't one noisy sample.
+  static auto repeatsFor(std::size_t m, std::size_t n, std::size_t k) -> std::size_t {
+    const double flops = 2.0 * double(m) * double(n) * double(k);
+    return std::clamp<std::size_t>(static_cast<std::size_t>(1.0e9 / std::max(flops, 1.0)), 3, 100);
+  }
+
+  /// @brief A plan from a cached or searched config; nullopt if a field is missing or zero.
+  auto toPlan(const autotune::Config& config, const char* source) const -> std::optional<Plan> {
+    std::size_t values[4] = {};
+    const char* names[4] = {"mc", "kc", "nc", "threads"};
+    for (std::size_t i = 0; i < 4; ++i) {
+      auto it = config.find(names[i]);
+      if (it == config.end() || it->second == 0) { return std::nullopt; }
+      values[i] = it->second;
+    }
+    return Plan{{values[0], values[1], values[2]}, std::min(values[3], pool_.size()), source};
+  }
+
+  auto searchCpu(std::size_t m, std::size_t n, std::size_t k) -> autotune::Config {
+    const std::size_t mr = kernel_.rows, cores = pool_.size();
+    const Blocking defaults = kernel_.blocking;
+    std::vector<std::size_t> mcs;
+    for (std::size_t panels : {4, 8, 12, 16, 24}) { mcs.push_back(panels * mr); }
+    std::vector<std::size_t> threads{cores};
+    if (cores > 2) { threads.push_back(cores / 2); }
+    if (cores > 1) { threads.push_back(1); }
+    const autotune::Axis axes[] = {
+      {"kc", {128, 256, 384, 512}},
+      {"mc", mcs},
+      {"nc", {1024, 2048, 4096}},
+      {"threads", threads},
+    };
+
+    PageVector<float> a(std::max<std::size_t>(m * k, 1), 1.0f);
+    PageVector<float> b(std::max<std::size_t>(k * n, 1), 1.0f);
+    PageVector<float> c(std::max<std::size_t>(m * n, 1));
+    const std::size_t repeats = repeatsFor(m, n, k);
+    return autotune::search(
+      {{"mc", defaults.mc}, {"kc", defaults.kc}, {"nc", defaults.nc}, {"threads", cores}}, axes,
+      [&](const autotune::Config& config) {
+        const Blocking blocking{config.at("mc"), config.at("kc"), config.at("nc")};
+        ThreadPool& runner = pool(config.at("threads"));
+        return autotune::bestOf(repeats, [&] {
+          multiply(m, n, k, 1.0f, {a.data(), k, 1}, {b.data(), n, 1}, 0.0f, c.data(), n, kernel_, blocking, runner);
+        });
+      });
+  }
+
+  Isa isa_;
+  const MicroKernel& kernel_;
+  ThreadPool& pool_;
+  autotune::Cache& cache_;
+  autotune::Mode mode_;
+  mutable std::mutex mutex_;
+  std::set<std::string> searched_;
+  std::string saveError_;
+  std::mutex poolsMutex_;
+  std::map<std::size_t, std::unique_ptr<ThreadPool>> pools_;
+};
+
+}  // namespace compute::gemm
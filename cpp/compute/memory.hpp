@@ -0,0 +1,186 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "backend.hpp"
+
+// * Page-aligned host memory that a device can use in place.
+// *
+// * `PageVector<T>` is a `std::vector` whose storage comes straight from
+// * `mmap`: page-aligned, rounded up to whole pages, and optionally backed by
+// * transparent huge pages or hugetlbfs. Such storage can be handed to
+// * `Device::newBufferNoCopy` (Metal's no-copy buffer, or the memory itself on
+// * the CPU backend) instead of being copied into a fresh buffer every run.
+// * Elements are default-initialised, so `PageVector<float> v(n)` leaves the
+// * pages untouched until first written.
+
+namespace compute {
+
+enum class PageKind {
+  Default,      // * regular pages
+  Transparent,  // * 2 MiB-aligned and `madvise(MADV_HUGEPAGE)` (Linux THP)
+  HugeTlb,      // * `MAP_HUGETLB` from the hugetlbfs pool; Transparent if empty
+};
+
+/// @brief The system page size (4 KiB on x86, 16 KiB on Apple silicon).
+inline auto pageSize() -> std::size_t {
+  static const std::size_t size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  return size;
+}
+
+// * PMD-sized huge page on x86-64 and arm64 Linux.
+constexpr std::size_t kHugePageSize = std::size_t{2} << 20;
+
+/// @brief Granularity allocations of `kind` are rounded up to.
+inline auto pageGranularity(PageKind kind) -> std::size_t {
+  return kind == PageKind::Default ? pageSize() : kHugePageSize;
+}
+
+inline auto roundToPages(std::size_t bytes, PageKind kind = PageKind::Default) -> std::size_t {
+  const std::size_t granularity = pageGranularity(kind);
+  return (bytes + granularity - 1) / granularity * granularity;
+}
+
+/// @brief `REPOUSSE_PAGES=default|thp|hugetlb`, otherwise `Default`.
+inline auto defaultPageKind() -> PageKind {
+  static const PageKind kind = [] {
+    const char* env = std::getenv("REPOUSSE_PAGES");
+    const std::string_view value = env ? env : "";
+    if (value == "thp")     { return PageKind::Transparent; }
+    if (value == "hugetlb") { return PageKind::HugeTlb; }
+    if (value.empty() || value == "default") { return PageKind::Default; }
+    throw std::runtime_error("Unknown REPOUSSE_PAGES '" + std::string(value) + "'.");
+  }();
+  return kind;
+}
+
+namespace detail {
+
+inline auto mapAnonymous(std::size_t bytes, int extraFlags) -> void* {
+  void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | extraFlags, -1, 0);
+  return p == MAP_FAILED ? nullptr : p;
+}
+
+/// @brief `bytes` (a multiple of `alignment`) mapped at an `alignment` boundary.
+inline auto mapAligned(std::size_t bytes, std::size_t alignment) -> void* {
+  if (alignment <= pageSize()) { return mapAnonymous(bytes, 0); }
+  // * Over-map, then give back the misaligned head and the unused tail.
+  const std::size_t padded = bytes + alignment;
+  auto* raw = static_cast<std::byte*>(mapAnonymous(padded, 0));
+  if (!raw) { return nullptr; }
+  const auto address = reinterpret_cast<std::uintptr_t>(raw);
+  auto* aligned = raw + ((alignment - address % alignment) % alignment);
+  if (const std::size_t head = static_cast<std::size_t>(aligned - raw)) { ::munmap(raw, head); }
+  if (const std::size_t tail = static_cast<std::size_t>(raw + padded - (aligned + bytes))) {
+    ::munmap(aligned + bytes, tail);
+  }
+  return aligned;
+}
+
+}  // namespace detail
+
+/**
+ * @brief `roundToPages(bytes, kind)` bytes of zero-filled, page-aligned memory.
+ * @details Huge-page requests are best effort: hugetlbfs falls back to THP
+ *  when the pool is empty, and THP is only advice (and a no-op off Linux).
+ *  Either way the mapping is aligned to `pageGranularity(kind)`.
+ * @throws std::bad_alloc if the mapping fails.
+ */
+inline auto allocatePages(std::size_t bytes, PageKind kind = PageKind::Default) -> void* {
+  const std::size_t length = roundToPages(bytes ? bytes : 1, kind);
+  void* p = nullptr;
+#ifdef MAP_HUGETLB
+  if (kind == PageKind::HugeTlb) { p = detail::mapAnonymous(length, MAP_HUGETLB); }
+#endif
+  if (!p) {
+    p = detail::mapAligned(length, pageGranularity(kind));
+#ifdef MADV_HUGEPAGE
+    if (p && kind != PageKind::Default) { ::madvise(p, length, MADV_HUGEPAGE); }
+#endif
+  }
+  if (!p) { throw std::bad_alloc(); }
+  return p;
+}
+
+/// @brief Releases memory from `allocatePages(bytes, kind)`.
+inline auto releasePages(void* p, std::size_t bytes, PageKind kind = PageKind::Default) -> void {
+  if (p) { ::munmap(p, roundToPages(bytes ? bytes : 1, kind)); }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Allocator and container ...
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Standard allocator over `allocatePages`.
+ * @details `construct` with no arguments default-initialises, so trivially
+ *  constructible elements (floats, ints) aren't zeroed a second time on top
+ *  of the kernel's zero pages.
+ */
+template <typename T>
+class PageAllocator {
+public:
+  using value_type = T;
+
+  PageAllocator() : kind_(defaultPageKind()) {}
+  explicit PageAllocator(PageKind kind) noexcept : kind_(kind) {}
+  template <typename U>
+  PageAllocator(const PageAllocator<U>& other) noexcept : kind_(other.kind()) {}
+
+  auto allocate(std::size_t n) -> T* {
+    if (n > std::size_t(-1) / sizeof(T)) { throw std::bad_array_new_length(); }
+    return static_cast<T*>(allocatePages(n * sizeof(T), kind_));
+  }
+  auto deallocate(T* p, std::size_t n) noexcept -> void { releasePages(p, n * sizeof(T), kind_); }
+
+  template <typename U>
+  auto construct(U* p) noexcept(std::is_nothrow_default_constructible_v<U>) -> void {
+    ::new (static_cast<void*>(p)) U;
+  }
+  template <typename U, typename... Args>
+  auto construct(U* p, Args&&... args) -> void {
+    ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+  }
+
+  auto kind() const noexcept -> PageKind { return kind_; }
+
+  template <typename U>
+  auto operator==(const PageAllocator<U>& other) const noexcept -> bool { return kind_ == other.kind(); }
+
+private:
+  PageKind kind_;
+};
+
+template <typename T>
+using PageVector = std::vector<T, PageAllocator<T>>;
+
+/**
+ * @brief A buffer over `v`'s storage, without copying.
+ * @details The length covers every page of the allocation, as Metal's
+ *  no-copy path requires; kernels still only see what they index. `v` must
+ *  outlive the buffer and must not reallocate while it exists.
+ */
+template <typename T>
+auto wrapBuffer(Device& device, PageVector<T>& v) -> std::unique_ptr<Buffer> {
+  if (v.capacity() == 0) {
+    throw std::runtime_error("Can't wrap an empty PageVector in a buffer.");
+  }
+  const PageKind kind = v.get_allocator().kind();
+  return device.newBufferNoCopy(v.data(), roundToPages(v.capacity() * sizeof(T), kind));
+}
+
+}  // namespace compute
@@ -0,0 +1,254 @@
+#pragma once
+
+// * Metal implementation of the backend interface. Only built on Apple
+// * platforms; the including translation unit must define
+// * `NS_PRIVATE_IMPLEMENTATION` and `MTL_PRIVATE_IMPLEMENTATION` first, as
+// * every day's `main.cc` already does.
+
+#ifdef __APPLE__
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <unistd.h>
+
+#include "../Metal.hpp"
+#include "backend.hpp"
+
+namespace compute {
+
+/// @brief Drains autoreleased temporaries (strings, errors, command buffers) on scope exit.
+class AutoreleasePoolScope {
+public:
+  AutoreleasePoolScope() : pPool_(NS::AutoreleasePool::alloc()->init()) {}
+  ~AutoreleasePoolScope() { pPool_->release(); }
+  AutoreleasePoolScope(const AutoreleasePoolScope&) = delete;
+  auto operator=(const AutoreleasePoolScope&) -> AutoreleasePoolScope& = delete;
+
+private:
+  NS::AutoreleasePool* pPool_;
+};
+
+class MetalBuffer final : public Buffer {
+public:
+  explicit MetalBuffer(NS::SharedPtr<MTL::Buffer> pBuffer) : pBuffer_(std::move(pBuffer)) {}
+
+  auto contents() -> void* override { return pBuffer_->contents(); }
+  auto length() const -> std::size_t override { return pBuffer_->length(); }
+  auto handle() const -> MTL::Buffer* { return pBuffer_.get(); }
+
+private:
+  NS::SharedPtr<MTL::Buffer> pBuffer_;
+};
+
+class MetalLibrary final : public Library {
+public:
+  MetalLibrary(std::string name, NS::SharedPtr<MTL::Library> pLibrary)
+    : name_(std::move(name)), pLibrary_(std::move(pLibrary)) {}
+
+  auto name() const -> const std::string& override { return name_; }
+  auto handle() const -> MTL::Library* { return pLibrary_.get(); }
+
+private:
+  std::string name_;
+  NS::SharedPtr<MTL::Library> pLibrary_;
+};
+
+class MetalPipeline final : public Pipeline {
+public:
+  MetalPipeline(
+    std::string functionName,
+    NS::SharedPtr<MTL::Function> pFunction,
+    NS::SharedPtr<MTL::ComputePipelineState> pComputePipelineState)
+    : functionName_(std::move(functionName)),
+      pFunction_(std::move(pFunction)),
+      pComputePipelineState_(std::move(pComputePipelineState)) {}
+
+  auto functionName() const -> const std::string& override { return functionName_; }
+  auto maxTotalThreadsPerThreadgroup() const -> std::size_t override {
+    return pComputePipelineState_->maxTotalThreadsPerThreadgroup();
+  }
+  auto threadExecutionWidth() const -> std::size_t override {
+    return pComputePipelineState_->threadExecutionWidth();
+  }
+  auto handle() const -> MTL::ComputePipelineState* { return pComputePipelineState_.get(); }
+
+private:
+  std::string functionName_;
+  NS::SharedPtr<MTL::Function> pFunction_;
+  NS::SharedPtr<MTL::ComputePipelineState> pComputePipelineState_;
+};
+
+class MetalQueue final : public Queue {
+public:
+  explicit MetalQueue(NS::SharedPtr<MTL::CommandQueue> pCommandQueue)
+    : pCommandQueue_(std::move(pCommandQueue)) {}
+
+  auto dispatchThreads(
+    const Pipeline& pipeline,
+    const Arguments& arguments,
+    Size grid,
+    Size threadsPerThreadgroup) -> void override {
+    encodeAndWait(pipeline, arguments, [&](MTL::ComputeCommandEncoder* pEncoder) {
+      pEncoder->dispatchThreads(toMtl(grid), toMtl(threadsPerThreadgroup));
+    });
+  }
+
+  auto dispatchThreadgroups(
+    const Pipeline& pipeline,
+    const Arguments& arguments,
+    Size threadgroups,
+    Size threadsPerThreadgroup) -> void override {
+    encodeAndWait(pipeline, arguments, [&](MTL::ComputeCommandEncoder* pEncoder) {
+      pEncoder->dispatchThreadgroups(toMtl(threadgroups), toMtl(threadsPerThreadgroup));
+    });
+  }
+
+private:
+  static auto toMtl(Size size) -> MTL::Size {
+    return MTL::Size(size.width, size.height, size.depth);
+  }
+
+  template <typename Dispatch>
+  auto encodeAndWait(const Pipeline& pipeline, const Arguments& arguments, Dispatch&& dispatch) -> void {
+    const auto* metalPipeline = dynamic_cast<const MetalPipeline*>(&pipeline);
+    if (!metalPipeline) {
+      throw std::runtime_error("Metal queue was given a pipeline from another backend.");
+    }
+
+    // * Command buffers and encoders are autoreleased; drain them per dispatch
+    // * so long benchmark loops don't accumulate them.
+    AutoreleasePoolScope pool;
+    MTL::CommandBuffer* pCommandBuffer = pCommandQueue_->commandBuffer();
+    MTL::ComputeCommandEncoder* pCommandEncoder = pCommandBuffer->computeCommandEncoder();
+
+    pCommandEncoder->setComputePipelineState(metalPipeline->handle());
+    const auto& slots = arguments.slots();
+    for (NS::UInteger index = 0; index < slots.size(); ++index) {
+      const auto& slot = slots[index];
+      if (slot.buffer) {
+        const auto* metalBuffer = dynamic_cast<const MetalBuffer*>(slot.buffer);
+        if (!metalBuffer) {
+          throw std::runtime_error("Metal queue was given a buffer from another backend.");
+        }
+        pCommandEncoder->setBuffer(metalBuffer->handle(), slot.offset, index);
+      } else if (!slot.bytes.empty()) {
+        pCommandEncoder->setBytes(slot.bytes.data(), slot.bytes.size(), index);
+      }
+    }
+
+    dispatch(pCommandEncoder);
+    pCommandEncoder->endEncoding();
+    pCommandBuffer->commit();
+    pCommandBuffer->waitUntilCompleted();
+  }
+
+  NS::SharedPtr<MTL::CommandQueue> pCommandQueue_;
+};
+
+class MetalDevice final : public Device {
+public:
+  MetalDevice() : pDevice_(NS::TransferPtr(MTL::CreateSystemDefaultDevice())) {
+    if (!pDevice_) {
+      throw std::runtime_error("No Metal-compatible GPU found.");
+    }
+  }
+
+  auto name() const -> std::string override {
+    AutoreleasePoolScope pool;
+    return pDevice_->name()->utf8String();
+  }
+
+  auto newBuffer(std::size_t length) -> std::unique_ptr<Buffer> override {
+    return wrap(pDevice_->newBuffer(length, MTL::ResourceStorageModeShared));
+  }
+
+  auto newBuffer(const void* pointer, std::size_t length) -> std::unique_ptr<Buffer> override {
+    return wrap(pDevice_->newBuffer(pointer, length, MTL::ResourceStorageModeShared));
+  }
+
+  auto newBufferNoCopy(void* pointer, std::size_t length) -> std::unique_ptr<Buffer> override {
+    const std::size_t page = static_cast<std::size_t>(::getpagesize());
+    if (reinterpret_cast<std::uintptr_t>(pointer) % page != 0 || length == 0 || length % page != 0) {
+      throw std::runtime_error("No-copy Metal buffers need page-aligned memory and a whole number of pages.");
+    }
+    // * No deallocator: the caller owns the memory.
+    return wrap(pDevice_->newBuffer(pointer, length, MTL::ResourceStorageModeShared, nullptr));
+  }
+
+  auto newLibrary(const std::filesystem::path& path) -> std::unique_ptr<Library> override {
+    AutoreleasePoolScope pool;
+    NS::Error* pError = nullptr;
+    auto pLibrary = NS::TransferPtr(pDevice_->newLibrary(
+      NS::String::string(path.string().c_str(), NS::UTF8StringEncoding), &pError));
+    if (!pLibrary) {
+      throw std::runtime_error(
+        "Couldn't find the .metallib file: " +
+        std::string(pError ? pError->localizedDescription()->utf8String() : path.string()));
+    }
+    return std::make_unique<MetalLibrary>(path.stem().string(), std::move(pLibrary));
+  }
+
+  auto compilesSource() const -> bool override { return true; }
+
+  auto newLibraryFromSource(
+    const std::string& name,
+    const std::string& source) -> std::unique_ptr<Library> override {
+    AutoreleasePoolScope pool;
+    NS::Error* pError = nullptr;
+    auto pLibrary = NS::TransferPtr(pDevice_->newLibrary(
+      NS::String::string(source.c_str(), NS::UTF8StringEncoding), nullptr, &pError));
+    if (!pLibrary) {
+      throw std::runtime_error(
+        "Failed to compile library '" + name + "': " +
+        std::string(pError ? pError->localizedDescription()->utf8String() : "Unknown error"));
+    }
+    return std::make_unique<MetalLibrary>(name, std::move(pLibrary));
+  }
+
+  auto newPipeline(
+    const Library& library,
+    const std::string& functionName) -> std::unique_ptr<Pipeline> override {
+    AutoreleasePoolScope pool;
+    const auto& metalLibrary = dynamic_cast<const MetalLibrary&>(library);
+    auto pFunction = NS::TransferPtr(metalLibrary.handle()->newFunction(
+      NS::String::string(functionName.c_str(), NS::UTF8StringEncoding)));
+    if (!pFunction) {
+      throw std::runtime_error("Failed to get compute function '" + functionName + "'.");
+    }
+
+    NS::Error* pError = nullptr;
+    auto pComputePipelineState =
+      NS::TransferPtr(pDevice_->newComputePipelineState(pFunction.get(), &pError));
+    if (!pComputePipelineState) {
+      throw std::runtime_error(
+        "Failed to create compute pipeline state: " +
+        std::string(pError ? pError->localizedDescription()->utf8String() : "Unknown error"));
+    }
+    return std::make_unique<MetalPipeline>(functionName, std::move(pFunction), std::move(pComputePipelineState));
+  }
+
+  auto newQueue() -> std::unique_ptr<Queue> override {
+    return std::make_unique<MetalQueue>(NS::TransferPtr(pDevice_->newCommandQueue()));
+  }
+
+  auto handle() const -> MTL::Device* { return pDevice_.get(); }
+
+private:
+  static auto wrap(MTL::Buffer* pBuffer) -> std::unique_ptr<Buffer> {
+    if (!pBuffer) {
+      throw std::runtime_error("Failed to allocate Metal buffer.");
+    }
+    return std::make_unique<MetalBuffer>(NS::TransferPtr(pBuffer));
+  }
+
+  NS::SharedPtr<MTL::Device> pDevice_;
+};
+
+}  // namespace compute
+
+#endif  // __APPLE__
@@ -0,0 +1,333 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// * Writing result arrays to disk without making the benchmark about text
+// * formatting.
+// *
+// * A table is a set of equally long float columns, written column after
+// * column (columnar) in one of three formats:
+// *
+// *   Npy  NumPy `.npy` v1.0, `<f4`: shape (rows,) for one column, else
+// *        (rows, columns) in Fortran order, so `np.load` sees the columns
+// *        that are laid out back to back.
+// *   Raw  a small header (see `RawHeader`), the column names, then the
+// *        columns as little-endian float32.
+// *   Csv  "Index,<names>" and one line per row, formatted with
+// *        `std::to_chars` into a 64 KiB buffer: the same text as
+// *        `std::println("{},{}", i, v)`, without a stream call per value.
+// *
+// * `Writer` runs the writes on a background thread, so the compute loop
+// * only pays for handing the data over.
+
+namespace compute::output {
+
+enum class Format { Npy, Raw, Csv };
+
+inline auto formatName(Format format) -> const char* {
+  switch (format) {
+    case Format::Npy: return "npy";
+    case Format::Raw: return "raw";
+    case Format::Csv: return "csv";
+  }
+  return "?";
+}
+
+/// @brief File extension, with the dot.
+inline auto extension(Format format) -> const char* {
+  switch (format) {
+    case Format::Npy: return ".npy";
+    case Format::Raw: return ".bin";
+    case Format::Csv: return ".csv";
+  }
+  return "";
+}
+
+inline auto parseFormat(std::string_view name) -> Format {
+  for (Format format : {Format::Npy, Format::Raw, Format::Csv}) {
+    if (name == formatName(format)) { return format; }
+  }
+  throw std::runtime_error("Unknown output format '" + std::string(name) + "'; expected npy, raw or csv.");
+}
+
+/// @brief `REPOUSSE_OUTPUT=npy|raw|csv`, else `fallback`.
+inline auto defaultFormat(Format fallback = Format::Csv) -> Format {
+  const char* env = std::getenv("REPOUSSE_OUTPUT");
+  return env && *env ? parseFormat(env) : fallback;
+}
+
+/// @brief A named column; the data must outlive the write.
+struct Column {
+  std::string name;
+  std::span<const float> data;
+};
+
+/**
+ * @brief Start of a `Raw` file, all fields little-endian. It is followed by
+ *  `columns` names, each a u32 byte length and the bytes, then the columns.
+ */
+struct RawHeader {
+  static constexpr char kMagic[8] = {'R', 'E', 'P', 'O', 'U', 'S', 'S', 'E'};
+  static constexpr std::uint32_t kVersion = 1;
+  /// @brief Element type code: 1 is float32, the only one so far.
+  static constexpr std::uint32_t kFloat32 = 1;
+
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t type;
+  std::uint64_t columns;
+  std::uint64_t rows;
+};
+static_assert(sizeof(RawHeader) == 32);
+
+namespace detail {
+
+/// @brief Bytes appended to a buffer and flushed to a file in large writes.
+class Sink {
+public:
+  static constexpr std::size_t kCapacity = 64 * 1024;
+
+  explicit Sink(const std::filesystem::path& path) : path_(path), file_(path, std::ios::binary | std::ios::trunc) {
+    if (!file_) { throw std::runtime_error("Couldn't open '" + path.string() + "' for writing."); }
+    buffer_.reserve(kCapacity);
+  }
+
+  auto append(const void* data, std::size_t bytes) -> void {
+    if (buffer_.size() + bytes > kCapacity) { flush(); }
+    if (bytes >= kCapacity) {
+      put(static_cast<const char*>(data), bytes);
+      return;
+    }
+    const auto* p = static_cast<const char*>(data);
+    buffer_.insert(buffer_.end(), p, p + bytes);
+  }
+
+  template <typename T>
+  auto appendLittle(T value) -> void {
+    if constexpr (std::endian::native == std::endian::big) { value = std::byteswap(value); }
+    append(&value, sizeof(T));
+  }
+
+  /// @brief Floats as little-endian float32, swapped a buffer at a time if needed.
+  auto appendFloats(std::span<const float> values) -> void {
+    if constexpr (std::endian::native == std::endian::little) {
+      append(values.data(), values.size_bytes());
+    } else {
+      for (float v : values) { appendLittle(std::bit_cast<std::uint32_t>(v)); }
+    }
+  }
+
+  /// @brief Room for at least `bytes` more characters, to format into.
+  auto reserve(std::size_t bytes) -> char* {
+    if (buffer_.size() + bytes > kCapacity) { flush(); }
+    const std::size_t used = buffer_.size();
+    buffer_.resize(used + bytes);
+    return buffer_.data() + used;
+  }
+  /// @brief Gives back what `reserve` handed out past `end`.
+  auto commit(const char* end) -> void { buffer_.resize(static_cast<std::size_t>(end - buffer_.data())); }
+
+  auto close() -> void {
+    flush();
+    file_.close();
+    if (!file_) { throw std::runtime_error("Couldn't write '" + path_.string() + "'."); }
+  }
+
+private:
+  auto flush() -> void {
+    put(buffer_.data(), buffer_.size());
+    buffer_.clear();
+  }
+
+  auto put(const char* data, std::size_t bytes) -> void {
+    file_.write(data, static_cast<std::streamsize>(bytes));
+    if (!file_) { throw std::runtime_error("Couldn't write '" + path_.string() + "'."); }
+  }
+
+  std::filesystem::path path_;
+  std::ofstream file_;
+  std::vector<char> buffer_;
+};
+
+inline auto writeNpy(Sink& sink, std::span<const Column> columns, std::size_t rows) -> void {
+  std::string header = columns.size() == 1
+    ? "{'descr': '<f4', 'fortran_order': False, 'shape': (" + std::to_string(rows) + ",), }"
+    : "{'descr': '<f4', 'fortran_order': True, 'shape': (" + std::to_string(rows) + ", " +
+        std::to_string(columns.size()) + "), }";
+  // * Magic, version, u16 length, then the header padded with spaces and a
+  // * newline so the data starts on a 64-byte boundary.
+  constexpr std::size_t kPreamble = 10;
+  const std::size_t total = (kPreamble + header.size() + 1 + 63) / 64 * 64;
+  header.append(total - kPreamble - header.size() - 1, ' ');
+  header.push_back('\n');
+  sink.append("\x93NUMPY\x01\x00", 8);
+  sink.appendLittle(static_cast<std::uint16_t>(header.size()));
+  sink.append(header.data(), header.size());
+  for (const Column& column : columns) { sink.appendFloats(column.data); }
+}
+
+inline auto writeRaw(Sink& sink, std::span<const Column> columns, std::size_t rows) -> void {
+  sink.append(RawHeader::kMagic, sizeof(RawHeader::kMagic));
+  sink.appendLittle(RawHeader::kVersion);
+  sink.appendLittle(RawHeader::kFloat32);
+  sink.appendLittle(static_cast<std::uint64_t>(columns.size()));
+  sink.appendLittle(static_cast<std::uint64_t>(rows));
+  for (const Column& column : columns) {
+    sink.appendLittle(static_cast<std::uint32_t>(column.name.size()));
+    sink.append(column.name.data(), column.name.size());
+  }
+  for (const Column& column : columns) { sink.appendFloats(column.data); }
+}
+
+inline auto writeCsv(Sink& sink, std::span<const Column> columns, std::size_t rows) -> void {
+  std::string header = "Index";
+  for (const Column& column : columns) { header += "," + column.name; }
+  header += "\n";
+  sink.append(header.data(), header.size());
+  // * 20 digits of index, then up to 16 characters per shortest float.
+  const std::size_t line = 21 + columns.size() * 17;
+  for (std::size_t i = 0; i < rows; ++i) {
+    char* p = sink.reserve(line);
+    char* const end = p + line;
+    p = std::to_chars(p, end, i).ptr;
+    for (const Column& column : columns) {
+      *p++ = ',';
+      p = std::to_chars(p, end, column.data[i]).ptr;
+    }
+    *p++ = '\n';
+    sink.commit(p);
+  }
+}
+
+}  // namespace detail
+
+/// @brief `columns` into `path` in `format`. Throws on mismatched lengths or I/O errors.
+inline auto write(const std::filesystem::path& path, std::span<const Column> columns, Format format) -> void {
+  const std::size_t rows = columns.empty() ? 0 : columns.front().data.size();
+  for (const Column& column : columns) {
+    if (column.data.size() != rows) {
+      throw std::runtime_error(
+        "Column '" + column.name + "' has " + std::to_string(column.data.size()) + " rows, expected " +
+        std::to_string(rows) + ".");
+    }
+  }
+  detail::Sink sink(path);
+  switch (format) {
+    case Format::Npy: detail::writeNpy(sink, columns, rows); break;
+    case Format::Raw: detail::writeRaw(sink, columns, rows); break;
+    case Format::Csv: detail::writeCsv(sink, columns, rows); break;
+  }
+  sink.close();
+}
+
+/// @brief One column named `Value`.
+inline auto write(const std::filesystem::path& path, std::span<const float> data, Format format) -> void {
+  const Column column{"Value", data};
+  write(path, std::span(&column, 1), format);
+}
+
+/**
+ * @brief Writes files on one background thread, in submission order.
+ * @details `submit` takes ownership of the data and returns at once with a
+ *  future that holds any error of that write. `wait` blocks until every
+ *  write submitted so far is on disk; the destructor waits too.
+ */
+class Writer {
+public:
+  Writer() : thread_([this] { run(); }) {}
+  Writer(const Writer&) = delete;
+  auto operator=(const Writer&) -> Writer& = delete;
+
+  ~Writer() {
+    {
+      std::lock_guard lock(mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    thread_.join();
+  }
+
+  /// @brief Process-wide writer, started on first use.
+  static auto global() -> Writer& {
+    static Writer writer;
+    return writer;
+  }
+
+  auto submit(std::filesystem::path path, std::vector<float> data, Format format) -> std::future<void> {
+    return enqueue([path = std::move(path), data = std::move(data), format] { write(path, data, format); });
+  }
+
+  /// @brief Several named columns of equal length.
+  auto submit(std::filesystem::path path, std::vector<std::pair<std::string, std::vector<float>>> columns, Format format)
+    -> std::future<void> {
+    return enqueue([path = std::move(path), columns = std::move(columns), format] {
+      std::vector<Column> views;
+      views.reserve(columns.size());
+      for (const auto& [name, data] : columns) { views.push_back({name, data}); }
+      write(path, views, format);
+    });
+  }
+
+  auto wait() -> void {
+    std::unique_lock lock(mutex_);
+    idle_.wait(lock, [this] { return jobs_.empty() && !busy_; });
+  }
+
+private:
+  template <typename Fn>
+  auto enqueue(Fn&& fn) -> std::future<void> {
+    std::packaged_task<void()> task(std::forward<Fn>(fn));
+    std::future<void> done = task.get_future();
+    {
+      std::lock_guard lock(mutex_);
+      jobs_.push_back(std::move(task));
+    }
+    wake_.notify_one();
+    return done;
+  }
+
+  auto run() -> void {
+    std::unique_lock lock(mutex_);
+    while (true) {
+      wake_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+      if (jobs_.empty()) { return; }  // * stopping, and every job is done
+      std::packaged_task<void()> task = std::move(jobs_.front());
+      jobs_.pop_front();
+      busy_ = true;
+      lock.unlock();
+      task();  // * errors land in the task's future
+      lock.lock();
+      busy_ = false;
+      if (jobs_.empty()) { idle_.notify_all(); }
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable idle_;
+  std::deque<std::packaged_task<void()>> jobs_;
+  bool busy_ = false;
+  bool stopping_ = false;
+  std::thread thread_;
+};
+
+}  // namespace compute::output
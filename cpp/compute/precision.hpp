@@ -0,0 +1,321 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+#include "elementwise.hpp"
+#include "thread_pool.hpp"
+
+// * Reduced-precision storage for bandwidth-bound vector work.
+// *
+// * Arrays are stored as fp16 (`Half`, IEEE binary16) or bf16 (`BFloat16`,
+// * the top half of an fp32) and widened to fp32 for the arithmetic, so each
+// * element moves half the bytes of a float while every operation still
+// * rounds once, in fp32, before the result is narrowed back. Narrowing
+// * rounds to nearest even.
+// *
+// * - fp16: 11-bit significand (~3 decimal digits), range ±65504.
+// * - bf16: 8-bit significand (~2 digits), the full fp32 range.
+// *
+// * The conversions use F16C (`vcvtph2ps`/`vcvtps2ph`) under AVX2, their
+// * 512-bit AVX-512F forms, and `fcvtl`/`fcvtn` on NEON. bf16 is integer
+// * shifts and a rounding add on every ISA.
+
+namespace compute::precision {
+
+using elementwise::Isa;
+using elementwise::activeIsa;
+using elementwise::isaName;
+using elementwise::supported;
+
+// * Native on every compiler and target we build for (GCC >= 12 and clang on
+// * x86-64, clang on arm64).
+using Half = _Float16;
+
+/// @brief bfloat16: sign, 8-bit exponent, 7-bit fraction, as raw bits.
+struct BFloat16 {
+  std::uint16_t bits = 0;
+};
+
+template <typename T>
+concept Storage = std::same_as<T, float> || std::same_as<T, Half> || std::same_as<T, BFloat16>;
+
+template <typename T>
+concept NarrowStorage = Storage<T> && !std::same_as<T, float>;
+
+template <Storage T>
+constexpr auto storageName() -> const char* {
+  if constexpr (std::same_as<T, Half>)     { return "fp16"; }
+  if constexpr (std::same_as<T, BFloat16>) { return "bf16"; }
+  return "fp32";
+}
+
+inline auto toFloat(float x) -> float { return x; }
+inline auto toFloat(Half x) -> float { return static_cast<float>(x); }
+inline auto toFloat(BFloat16 x) -> float { return std::bit_cast<float>(std::uint32_t{x.bits} << 16); }
+
+/// @brief fp32 to `T`, rounding to nearest even. NaNs stay (quiet) NaNs.
+template <Storage T>
+inline auto fromFloat(float x) -> T {
+  if constexpr (std::same_as<T, BFloat16>) {
+    const std::uint32_t u = std::bit_cast<std::uint32_t>(x);
+    if (std::isnan(x)) { return {static_cast<std::uint16_t>((u >> 16) | 0x40)}; }
+    return {static_cast<std::uint16_t>((u + 0x7fff + ((u >> 16) & 1)) >> 16)};
+  } else {
+    return static_cast<T>(x);
+  }
+}
+
+/// @brief One ISA's loops for storage type `T`.
+template <NarrowStorage T>
+struct Loops {
+  void (*add)(const T* a, const T* b, T* out, std::size_t n);
+  void (*widen)(const T* in, float* out, std::size_t n);
+  void (*narrow)(const float* in, T* out, std::size_t n);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// * Per-ISA instantiations ...
+///////////////////////////////////////////////////////////////////////////////
+
+namespace scalar {
+struct Vec {
+  using type = float;
+  static constexpr std::size_t width = 1;
+  static auto load(const float* p) -> type { return *p; }
+  static auto store(float* p, type v) -> void { *p = v; }
+  static auto add(type a, type b) -> type { return a + b; }
+};
+template <typename T>
+struct Lanes {
+  static auto load(const T* p) -> float { return toFloat(*p); }
+  static auto store(T* p, float v) -> void { *p = fromFloat<T>(v); }
+};
+#include "precision_kernels.inl"
+}  // namespace scalar
+
+#ifdef REPOUSSE_X86
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2,fma,f16c"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2,fma,f16c")
+#endif
+namespace avx2 {
+struct Vec {
+  using type = __m256;
+  static constexpr std::size_t width = 8;
+  static inline auto load(const float* p) -> type { return _mm256_loadu_ps(p); }
+  static inline auto store(float* p, type v) -> void { _mm256_storeu_ps(p, v); }
+  static inline auto add(type a, type b) -> type { return _mm256_add_ps(a, b); }
+};
+template <typename T>
+struct Lanes;
+template <>
+struct Lanes<Half> {
+  static inline auto load(const Half* p) -> __m256 {
+    return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+  }
+  static inline auto store(Half* p, __m256 v) -> void {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+  }
+};
+template <>
+struct Lanes<BFloat16> {
+  static inline auto load(const BFloat16* p) -> __m256 {
+    const __m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+    return _mm256_castsi256_ps(_mm256_slli_epi32(wide, 16));
+  }
+  static inline auto store(BFloat16* p, __m256 v) -> void {
+    const __m256i u = _mm256_castps_si256(v);
+    const __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(u, 16), _mm256_set1_epi32(1));
+    __m256i r = _mm256_srli_epi32(_mm256_add_epi32(u, _mm256_add_epi32(_mm256_set1_epi32(0x7fff), lsb)), 16);
+    const __m256i nan = _mm256_castps_si256(_mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+    const __m256i quiet = _mm256_or_si256(_mm256_srli_epi32(u, 16), _mm256_set1_epi32(0x40));
+    r = _mm256_blendv_epi8(r, quiet, nan);
+    // * Every lane is <= 0xffff, so the unsigned-saturating pack is exact.
+    const __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), packed);
+  }
+};
+#include "precision_kernels.inl"
+}  // namespace avx2
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx512f"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+// ! See reduce.hpp: GCC 12's avx512fintrin.h trips -Wuninitialized when inlined.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+namespace avx512 {
+struct Vec {
+  using type = __m512;
+  static constexpr std::size_t width = 16;
+  static inline auto load(const float* p) -> type { return _mm512_loadu_ps(p); }
+  static inline auto store(float* p, type v) -> void { _mm512_storeu_ps(p, v); }
+  static inline auto add(type a, type b) -> type { return _mm512_add_ps(a, b); }
+};
+template <typename T>
+struct Lanes;
+template <>
+struct Lanes<Half> {
+  static inline auto load(const Half* p) -> __m512 {
+    return _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+  }
+  static inline auto store(Half* p, __m512 v) -> void {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm512_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+  }
+};
+template <>
+struct Lanes<BFloat16> {
+  static inline auto load(const BFloat16* p) -> __m512 {
+    const __m512i wide = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+    return _mm512_castsi512_ps(_mm512_slli_epi32(wide, 16));
+  }
+  static inline auto store(BFloat16* p, __m512 v) -> void {
+    const __m512i u = _mm512_castps_si512(v);
+    const __m512i lsb = _mm512_and_si512(_mm512_srli_epi32(u, 16), _mm512_set1_epi32(1));
+    __m512i r = _mm512_srli_epi32(_mm512_add_epi32(u, _mm512_add_epi32(_mm512_set1_epi32(0x7fff), lsb)), 16);
+    const __mmask16 nan = _mm512_cmp_ps_mask(v, v, _CMP_UNORD_Q);
+    r = _mm512_mask_mov_epi32(r, nan, _mm512_or_si512(_mm512_srli_epi32(u, 16), _mm512_set1_epi32(0x40)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm512_cvtepi32_epi16(r));
+  }
+};
+#include "precision_kernels.inl"
+}  // namespace avx512
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+#endif
+
+#endif  // REPOUSSE_X86
+
+#ifdef REPOUSSE_NEON
+namespace neon {
+struct Vec {
+  using type = float32x4_t;
+  static constexpr std::size_t width = 4;
+  static inline auto load(const float* p) -> type { return vld1q_f32(p); }
+  static inline auto store(float* p, type v) -> void { vst1q_f32(p, v); }
+  static inline auto add(type a, type b) -> type { return vaddq_f32(a, b); }
+};
+template <typename T>
+struct Lanes;
+template <>
+struct Lanes<Half> {
+  static inline auto load(const Half* p) -> float32x4_t {
+    return vcvt_f32_f16(vld1_f16(reinterpret_cast<const float16_t*>(p)));
+  }
+  static inline auto store(Half* p, float32x4_t v) -> void {
+    vst1_f16(reinterpret_cast<float16_t*>(p), vcvt_f16_f32(v));
+  }
+};
+template <>
+struct Lanes<BFloat16> {
+  static inline auto load(const BFloat16* p) -> float32x4_t {
+    return vreinterpretq_f32_u32(vshll_n_u16(vld1_u16(reinterpret_cast<const std::uint16_t*>(p)), 16));
+  }
+  static inline auto store(BFloat16* p, float32x4_t v) -> void {
+    const uint32x4_t u = vreinterpretq_u32_f32(v);
+    const uint32x4_t lsb = vandq_u32(vshrq_n_u32(u, 16), vdupq_n_u32(1));
+    const uint32x4_t rounded = vshrq_n_u32(vaddq_u32(u, vaddq_u32(vdupq_n_u32(0x7fff), lsb)), 16);
+    const uint32x4_t quiet = vorrq_u32(vshrq_n_u32(u, 16), vdupq_n_u32(0x40));
+    const uint32x4_t r = vbslq_u32(vceqq_f32(v, v), rounded, quiet);
+    vst1_u16(reinterpret_cast<std::uint16_t*>(p), vmovn_u32(r));
+  }
+};
+#include "precision_kernels.inl"
+}  // namespace neon
+#endif  // REPOUSSE_NEON
+
+template <NarrowStorage T>
+inline auto loops(Isa isa) -> const Loops<T>& {
+  if (!supported(isa)) {
+    throw std::runtime_error("ISA '" + std::string(isaName(isa)) + "' is not supported on this CPU.");
+  }
+  switch (isa) {
+#ifdef REPOUSSE_X86
+    case Isa::Avx2:
+      __builtin_cpu_init();
+      // * Every AVX2 CPU we know of has F16C, but it is a separate CPUID bit.
+      if (std::same_as<T, Half> && !__builtin_cpu_supports("f16c")) { return scalar::table<T>; }
+      return avx2::table<T>;
+    case Isa::Avx512: return avx512::table<T>;
+#endif
+#ifdef REPOUSSE_NEON
+    case Isa::Neon:   return neon::table<T>;
+#endif
+    default:          return scalar::table<T>;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Public API ...
+///////////////////////////////////////////////////////////////////////////////
+
+/// @brief out = a + b, with fp32 arithmetic whatever the storage type.
+template <Storage T>
+inline auto add(std::span<const T> a, std::span<const T> b, std::span<T> out, Isa isa = activeIsa()) -> void {
+  if constexpr (std::same_as<T, float>) {
+    elementwise::add(a, b, out, isa);
+  } else {
+    elementwise::requireSameSize(a.size(), b.size());
+    elementwise::requireSameSize(a.size(), out.size());
+    const auto fn = loops<T>(isa).add;
+    ThreadPool::global().parallelFor(a.size(), elementwise::kChunkFloats, [&](std::size_t begin, std::size_t end) {
+      fn(a.data() + begin, b.data() + begin, out.data() + begin, end - begin);
+    });
+  }
+}
+
+/// @brief fp32 copy of `in`.
+template <NarrowStorage T>
+inline auto widen(std::span<const T> in, std::span<float> out, Isa isa = activeIsa()) -> void {
+  elementwise::requireSameSize(in.size(), out.size());
+  const auto fn = loops<T>(isa).widen;
+  ThreadPool::global().parallelFor(in.size(), elementwise::kChunkFloats, [&](std::size_t begin, std::size_t end) {
+    fn(in.data() + begin, out.data() + begin, end - begin);
+  });
+}
+
+/// @brief `in` rounded to `T` (nearest even).
+template <NarrowStorage T>
+inline auto narrow(std::span<const float> in, std::span<T> out, Isa isa = activeIsa()) -> void {
+  elementwise::requireSameSize(in.size(), out.size());
+  const auto fn = loops<T>(isa).narrow;
+  ThreadPool::global().parallelFor(in.size(), elementwise::kChunkFloats, [&](std::size_t begin, std::size_t end) {
+    fn(in.data() + begin, out.data() + begin, end - begin);
+  });
+}
+
+/// @brief Largest `|values[i] - reference[i]|`, in fp64.
+template <Storage T>
+inline auto maxAbsError(std::span<const T> values, std::span<const float> reference) -> double {
+  elementwise::requireSameSize(values.size(), reference.size());
+  double worst = 0.0;
+  for (std::size_t i = 0; i < values.size(); ++i) {
+    worst = std::max(worst, std::fabs(double(toFloat(values[i])) - double(reference[i])));
+  }
+  return worst;
+}
+
+}  // namespace compute::precision
@@ -0,0 +1,38 @@
+// * Reduced-precision loops, compiled once per instruction set.
+// *
+// * `precision.hpp` includes this file several times, each time inside its
+// * own namespace that defines `Vec` (fp32 arithmetic) and `Lanes<T>` (load
+// * `Vec::width` values of storage type `T` widened to fp32, and store fp32
+// * narrowed back to `T` with round-to-nearest-even), and (on x86) inside a
+// * `#pragma GCC target` region. Arithmetic is always fp32; only storage is
+// * narrow. Tails shorter than a vector go through the scalar conversions.
+// !  No include guard on purpose.
+
+template <typename T>
+inline auto addLoop(const T* a, const T* b, T* out, std::size_t n) -> void {
+  constexpr std::size_t W = Vec::width;
+  std::size_t i = 0;
+  for (; i + W <= n; i += W) {
+    Lanes<T>::store(out + i, Vec::add(Lanes<T>::load(a + i), Lanes<T>::load(b + i)));
+  }
+  for (; i < n; ++i) { out[i] = fromFloat<T>(toFloat(a[i]) + toFloat(b[i])); }
+}
+
+template <typename T>
+inline auto widenLoop(const T* in, float* out, std::size_t n) -> void {
+  constexpr std::size_t W = Vec::width;
+  std::size_t i = 0;
+  for (; i + W <= n; i += W) { Vec::store(out + i, Lanes<T>::load(in + i)); }
+  for (; i < n; ++i) { out[i] = toFloat(in[i]); }
+}
+
+template <typename T>
+inline auto narrowLoop(const float* in, T* out, std::size_t n) -> void {
+  constexpr std::size_t W = Vec::width;
+  std::size_t i = 0;
+  for (; i + W <= n; i += W) { Lanes<T>::store(out + i, Vec::load(in + i)); }
+  for (; i < n; ++i) { out[i] = fromFloat<T>(in[i]); }
+}
+
+template <typename T>
+inline const Loops<T> table = {addLoop<T>, widenLoop<T>, narrowLoop<T>};
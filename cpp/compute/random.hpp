@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+// * Counter-based random numbers (Philox4x32-10, Salmon et al., SC'11).
+// *
+// * Element `i` of a fill is a pure function of `(seed, i)`: block `i / 4` of
+// * the Philox stream, lane `i % 4`. There is no state to advance, so any
+// * thread can produce any slice and the result is bit-identical whatever the
+// * thread count or chunking. Blocks are computed `kLanes` at a time so the
+// * rounds run SIMD-wide.
+
+namespace compute::random {
+
+constexpr std::uint32_t kPhiloxM0 = 0xD2511F53;
+constexpr std::uint32_t kPhiloxM1 = 0xCD9E8D57;
+constexpr std::uint32_t kPhiloxW0 = 0x9E3779B9;  // * golden ratio
+constexpr std::uint32_t kPhiloxW1 = 0xBB67AE85;  // * sqrt(3) - 1
+constexpr int kPhiloxRounds = 10;
+
+using Block = std::array<std::uint32_t, 4>;
+
+/// @brief One Philox4x32-10 block for `counter` under `key`.
+constexpr auto philox(Block counter, std::array<std::uint32_t, 2> key) -> Block {
+  for (int round = 0; round < kPhiloxRounds; ++round) {
+    const std::uint64_t p0 = std::uint64_t{kPhiloxM0} * counter[0];
+    const std::uint64_t p1 = std::uint64_t{kPhiloxM1} * counter[2];
+    counter = {
+      static_cast<std::uint32_t>(p1 >> 32) ^ counter[1] ^ key[0],
+      static_cast<std::uint32_t>(p1),
+      static_cast<std::uint32_t>(p0 >> 32) ^ counter[3] ^ key[1],
+      static_cast<std::uint32_t>(p0)};
+    key[0] += kPhiloxW0;
+    key[1] += kPhiloxW1;
+  }
+  return counter;
+}
+
+/// @brief Top 24 bits as a float in `[0, 1)`; every value is exact.
+constexpr auto toUnit(std::uint32_t bits) -> float {
+  return static_cast<float>(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * SIMD-wide blocks ...
+///////////////////////////////////////////////////////////////////////////////
+
+// * Blocks per call to `philoxLanes`; 16 fills one AVX-512 register and is
+// * split into two or four registers on narrower targets.
+constexpr std::size_t kLanes = 16;
+
+// * Elements produced by one call to `philoxLanes`.
+constexpr std::size_t kElementsPerStep = 4 * kLanes;
+
+typedef std::uint32_t U32s __attribute__((vector_size(kLanes * sizeof(std::uint32_t))));
+// * Same register viewed as `kLanes / 2` 64-bit lanes.
+typedef std::uint64_t U64s __attribute__((vector_size(kLanes * sizeof(std::uint32_t))));
+
+/**
+ * @brief Full 32x32 -> 64-bit products `m * c` per lane, split into low and
+ *  high words.
+ * @details Vector extensions have no widening multiply, so even and odd lanes
+ *  are multiplied as 64-bit lanes and the halves shuffled back in place.
+ */
+inline auto mulWide(const U32s& c, std::uint32_t m, U32s& lo, U32s& hi) -> void {
+  const U64s mm = U64s{} + m;
+  U64s wide;
+  std::memcpy(&wide, &c, sizeof(wide));
+  const U64s even = (wide & 0xFFFFFFFFull) * mm;
+  const U64s odd  = (wide >> 32) * mm;
+  U32s e, o;
+  std::memcpy(&e, &even, sizeof(e));
+  std::memcpy(&o, &odd, sizeof(o));
+  // * e = [lo0, hi0, lo2, hi2, ...], o = [lo1, hi1, lo3, hi3, ...]
+  lo = __builtin_shufflevector(e, o, 0, 16, 2, 18, 4, 20, 6, 22, 8, 24, 10, 26, 12, 28, 14, 30);
+  hi = __builtin_shufflevector(e, o, 1, 17, 3, 19, 5, 21, 7, 23, 9, 25, 11, 27, 13, 29, 15, 31);
+}
+
+/**
+ * @brief `kLanes` consecutive Philox blocks starting at block `first`, written
+ *  out in stream order (block-major, 4 words each) to `out`.
+ * @details Same arithmetic as `philox`, one block per vector lane.
+ */
+inline auto philoxLanes(std::uint64_t first, std::uint64_t seed, std::uint32_t* out) -> void {
+  const U32s lane = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+  const std::uint32_t firstLo = static_cast<std::uint32_t>(first);
+  U32s c0 = lane + firstLo;
+  // * Carry into the high word where the low word wrapped (comparisons give -1).
+  U32s c1 = (U32s{} + static_cast<std::uint32_t>(first >> 32)) - (U32s)(c0 < firstLo);
+  U32s c2 = {};
+  U32s c3 = {};
+  std::uint32_t k0 = static_cast<std::uint32_t>(seed);
+  std::uint32_t k1 = static_cast<std::uint32_t>(seed >> 32);
+
+  for (int round = 0; round < kPhiloxRounds; ++round) {
+    U32s lo0, hi0, lo1, hi1;
+    mulWide(c0, kPhiloxM0, lo0, hi0);
+    mulWide(c2, kPhiloxM1, lo1, hi1);
+    c0 = hi1 ^ c1 ^ k0;
+    c1 = lo1;
+    c2 = hi0 ^ c3 ^ k1;
+    c3 = lo0;
+    k0 += kPhiloxW0;
+    k1 += kPhiloxW1;
+  }
+
+  for (std::size_t l = 0; l < kLanes; ++l) {
+    out[4 * l + 0] = c0[l];
+    out[4 * l + 1] = c1[l];
+    out[4 * l + 2] = c2[l];
+    out[4 * l + 3] = c3[l];
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Fills ...
+///////////////////////////////////////////////////////////////////////////////
+
+// * Per-chunk work for the pool; a multiple of `kElementsPerStep`.
+constexpr std::size_t kChunkElements = std::size_t{1} << 16;
+
+/**
+ * @brief Fills `out` with uniform floats in `[lo, hi)`.
+ * @details `out[i]` is element `offset + i` of the stream for `seed`, so a
+ *  buffer can also be filled piecewise with the same result.
+ */
+inline auto fillUniform(
+  std::span<float> out,
+  float lo,
+  float hi,
+  std::uint64_t seed,
+  std::uint64_t offset = 0,
+  ThreadPool& pool = ThreadPool::global()) -> void {
+  const float scale = hi - lo;
+  // * `lo + scale·u` rounds up to `hi` when `hi - lo` is small next to `|lo|`
+  // * (e.g. [100, 101)); clamping to the float below `hi` keeps it half-open.
+  const float top = lo < hi ? std::nextafter(hi, lo) : std::numeric_limits<float>::infinity();
+  float* dst = out.data();
+
+  // * Work in whole steps of the stream; the first and last may be partial.
+  const std::uint64_t firstStep = offset / kElementsPerStep;
+  const std::uint64_t lastStep  = (offset + out.size() + kElementsPerStep - 1) / kElementsPerStep;
+  const std::size_t steps = static_cast<std::size_t>(lastStep - firstStep);
+
+  pool.parallelFor(steps, kChunkElements / kElementsPerStep, [&](std::size_t begin, std::size_t end) {
+    alignas(64) std::uint32_t bits[kElementsPerStep];
+    for (std::size_t s = begin; s < end; ++s) {
+      const std::uint64_t step = firstStep + s;
+      philoxLanes(step * kLanes, seed, bits);
+
+      // * Clip this step's elements to the requested window.
+      const std::uint64_t stepStart = step * kElementsPerStep;
+      const std::size_t from = stepStart < offset ? static_cast<std::size_t>(offset - stepStart) : 0;
+      const std::size_t to = static_cast<std::size_t>(
+        std::min<std::uint64_t>(kElementsPerStep, offset + out.size() - stepStart));
+      float* row = dst + (stepStart + from - offset);
+      for (std::size_t j = from; j < to; ++j) {
+        row[j - from] = std::min(lo + scale * toUnit(bits[j]), top);
+      }
+    }
+  });
+}
+
+/// @brief Fills `out` with raw 32-bit words of the stream for `seed`.
+inline auto fillBits(
+  std::span<std::uint32_t> out,
+  std::uint64_t seed,
+  ThreadPool& pool = ThreadPool::global()) -> void {
+  const std::size_t steps = (out.size() + kElementsPerStep - 1) / kElementsPerStep;
+  pool.parallelFor(steps, kChunkElements / kElementsPerStep, [&](std::size_t begin, std::size_t end) {
+    alignas(64) std::uint32_t bits[kElementsPerStep];
+    for (std::size_t s = begin; s < end; ++s) {
+      const std::size_t at = s * kElementsPerStep;
+      if (at + kElementsPerStep <= out.size()) {
+        philoxLanes(s * kLanes, seed, out.data() + at);
+      } else {
+        philoxLanes(s * kLanes, seed, bits);
+        std::memcpy(out.data() + at, bits, (out.size() - at) * sizeof(std::uint32_t));
+      }
+    }
+  });
+}
+
+/// @brief `n` uniform floats in `[lo, hi)` for `seed`.
+inline auto uniform(std::size_t n, float lo, float hi, std::uint64_t seed) -> std::vector<float> {
+  std::vector<float> v(n);
+  fillUniform(v, lo, hi, seed);
+  return v;
+}
+
+}  // namespace compute::random
@@ -0,0 +1,427 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "convolution.hpp"
+#include "thread_pool.hpp"
+
+// * Sliding-window order statistics: out[i] is the `rank`-th smallest of
+// * the `window` samples x[i - window/2, i - window/2 + window), the same
+// * "same"-size, centred windows and `Boundary` rules as `convolution.hpp`.
+// * rank = window/2 is the median filter, the usual cure for impulse noise.
+// *
+// * Two ways to get there:
+// *
+// *   Network  windows up to `kMaxNetworkWindow`: Batcher's odd-even merge
+// *            sort, unrolled at compile time for each width and run on
+// *            vectors of `kNetworkLanes` consecutive windows, so every
+// *            compare-exchange is a vector min and max. No branches.
+// *   Heap     any window: the window's slots split between a max-heap of
+// *            the rank + 1 smallest and a min-heap of the rest. Sliding
+// *            overwrites the oldest slot in place and restores both heaps,
+// *            O(log window) per sample.
+
+namespace compute::convolution {
+
+enum class Selection { Auto, Network, Heap };
+
+inline auto selectionName(Selection selection) -> const char* {
+  switch (selection) {
+    case Selection::Auto:    return "auto";
+    case Selection::Network: return "network";
+    case Selection::Heap:    return "heap";
+  }
+  return "unknown";
+}
+
+/// @brief Widest window with a sorting network.
+inline constexpr std::size_t kMaxNetworkWindow = 25;
+/// @brief Windows sorted side by side by one network.
+inline constexpr std::size_t kNetworkLanes = 8;
+
+///////////////////////////////////////////////////////////////////////////////
+// * Sorting networks ...
+///////////////////////////////////////////////////////////////////////////////
+
+namespace network {
+
+struct Comparator {
+  std::uint8_t lo;
+  std::uint8_t hi;
+};
+
+// * Batcher's odd-even merge sort for any n: `emit(lo, hi)` per comparator.
+template <typename Emit>
+constexpr auto batcher(std::size_t n, Emit&& emit) -> void {
+  for (std::size_t p = 1; p < n; p <<= 1) {
+    for (std::size_t k = p; k >= 1; k >>= 1) {
+      for (std::size_t j = k % p; j + k < n; j += 2 * k) {
+        for (std::size_t i = 0; i < std::min(k, n - j - k); ++i) {
+          if ((i + j) / (2 * p) == (i + j + k) / (2 * p)) { emit(i + j, i + j + k); }
+        }
+      }
+    }
+  }
+}
+
+template <std::size_t N>
+constexpr auto comparatorCount() -> std::size_t {
+  std::size_t count = 0;
+  batcher(N, [&](std::size_t, std::size_t) { ++count; });
+  return count;
+}
+
+template <std::size_t N>
+constexpr auto comparators() -> std::array<Comparator, comparatorCount<N>()> {
+  std::array<Comparator, comparatorCount<N>()> out{};
+  std::size_t count = 0;
+  batcher(N, [&](std::size_t lo, std::size_t hi) {
+    out[count++] = {static_cast<std::uint8_t>(lo), static_cast<std::uint8_t>(hi)};
+  });
+  return out;
+}
+
+/// @brief One float per window (GCC/Clang vector extension).
+typedef float Lanes __attribute__((vector_size(kNetworkLanes * sizeof(float))));
+
+// * Min into `a`, max into `b`, lane by lane.
+inline auto exchange(Lanes& a, Lanes& b) -> void {
+  const Lanes x = a;
+  a = x < b ? x : b;
+  b = x < b ? b : x;
+}
+
+/**
+ * @brief Outputs `[0, count)` of the valid filter: out[i] is the `rank`-th
+ *  smallest of input[i, i + N). Reads `count + N - 1` inputs.
+ * @details v[j] holds input[i + j] for the lanes' `kNetworkLanes` windows;
+ *  after the network, v[rank] is the answer for all of them. A tail that
+ *  doesn't fill the lanes reruns the last full block, or pads a copy when
+ *  there is none.
+ */
+template <std::size_t N>
+inline auto select(const float* input, std::size_t count, std::size_t rank, float* out) -> void {
+  static constexpr auto network = comparators<N>();
+  auto block = [rank](const float* in, float* dst) {
+    Lanes v[N];
+    for (std::size_t j = 0; j < N; ++j) { std::memcpy(&v[j], in + j, sizeof(Lanes)); }
+    [&]<std::size_t... C>(std::index_sequence<C...>) {
+      (exchange(v[network[C].lo], v[network[C].hi]), ...);
+    }(std::make_index_sequence<network.size()>{});
+    std::memcpy(dst, &v[rank], sizeof(Lanes));
+  };
+  std::size_t i = 0;
+  for (; i + kNetworkLanes <= count; i += kNetworkLanes) { block(input + i, out + i); }
+  if (i == count) { return; }
+  if (count >= kNetworkLanes) {
+    block(input + count - kNetworkLanes, out + count - kNetworkLanes);
+    return;
+  }
+  float padded[kNetworkLanes + N - 1] = {};
+  float result[kNetworkLanes];
+  std::copy_n(input, count + N - 1, padded);
+  block(padded, result);
+  std::copy_n(result, count, out);
+}
+
+using Select = void (*)(const float* input, std::size_t count, std::size_t rank, float* out);
+
+/// @brief The network kernel for windows of `n`, 1 <= n <= `kMaxNetworkWindow`.
+inline auto selectFor(std::size_t n) -> Select {
+  static constexpr auto table = []<std::size_t... W>(std::index_sequence<W...>) {
+    return std::array<Select, sizeof...(W)>{select<W + 1>...};
+  }(std::make_index_sequence<kMaxNetworkWindow>{});
+  return table[n - 1];
+}
+
+}  // namespace network
+
+///////////////////////////////////////////////////////////////////////////////
+// * Double heap ...
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The last `window` samples of a sequence and their `rank`-th
+ *  smallest, updated in O(log window) per sample.
+ * @details Slots form a ring in arrival order; `low_` is a max-heap of the
+ *  `rank + 1` smallest slots, `high_` a min-heap of the others, and each
+ *  slot knows its heap and position. `push` overwrites the oldest slot,
+ *  sifts it within its heap, and if that leaves the tops out of order,
+ *  swaps them once: only the one changed value can be on the wrong side.
+ */
+class OrderWindow {
+public:
+  OrderWindow(std::size_t window, std::size_t rank)
+    : window_(window), rank_(rank), values_(window), inLow_(window), position_(window) {
+    low_.reserve(rank + 1);
+    high_.reserve(window - rank - 1);
+  }
+
+  /// @brief Starts over from `window` samples, oldest first.
+  auto fill(const float* samples) -> void {
+    std::copy_n(samples, window_, values_.begin());
+    std::vector<std::uint32_t> order(window_);
+    std::iota(order.begin(), order.end(), 0u);
+    std::nth_element(order.begin(), order.begin() + rank_, order.end(),
+                     [&](std::uint32_t a, std::uint32_t b) { return values_[a] < values_[b]; });
+    low_.assign(order.begin(), order.begin() + rank_ + 1);
+    high_.assign(order.begin() + rank_ + 1, order.end());
+    std::make_heap(low_.begin(), low_.end(), [&](std::uint32_t a, std::uint32_t b) { return values_[a] < values_[b]; });
+    std::make_heap(high_.begin(), high_.end(), [&](std::uint32_t a, std::uint32_t b) { return values_[a] > values_[b]; });
+    for (std::size_t i = 0; i < low_.size(); ++i) { place(low_, i, true); }
+    for (std::size_t i = 0; i < high_.size(); ++i) { place(high_, i, false); }
+    oldest_ = 0;
+  }
+
+  /// @brief Drops the oldest sample for `value`.
+  auto push(float value) -> void {
+    const std::uint32_t slot = oldest_;
+    oldest_ = oldest_ + 1 == window_ ? 0 : oldest_ + 1;
+    values_[slot] = value;
+    if (inLow_[slot]) {
+      restore<true>(low_, position_[slot]);
+    } else {
+      restore<false>(high_, position_[slot]);
+    }
+    if (!high_.empty() && values_[low_[0]] > values_[high_[0]]) {
+      std::swap(low_[0], high_[0]);
+      place(low_, 0, true);
+      place(high_, 0, false);
+      siftDown<true>(low_, 0);
+      siftDown<false>(high_, 0);
+    }
+  }
+
+  /// @brief The `rank`-th smallest sample in the window.
+  auto value() const -> float { return values_[low_[0]]; }
+
+private:
+  auto place(std::vector<std::uint32_t>& heap, std::size_t i, bool low) -> void {
+    inLow_[heap[i]] = low;
+    position_[heap[i]] = static_cast<std::uint32_t>(i);
+  }
+
+  // * Max-heap for `low_`, min-heap for `high_`: does `a` belong above `b`?
+  template <bool Low>
+  auto above(std::uint32_t a, std::uint32_t b) const -> bool {
+    return Low ? values_[a] > values_[b] : values_[a] < values_[b];
+  }
+
+  template <bool Low>
+  auto siftUp(std::vector<std::uint32_t>& heap, std::size_t i) -> bool {
+    const std::size_t start = i;
+    while (i > 0) {
+      const std::size_t parent = (i - 1) / 2;
+      if (!above<Low>(heap[i], heap[parent])) { break; }
+      std::swap(heap[i], heap[parent]);
+      place(heap, i, Low);
+      i = parent;
+    }
+    place(heap, i, Low);
+    return i != start;
+  }
+
+  template <bool Low>
+  auto siftDown(std::vector<std::uint32_t>& heap, std::size_t i) -> void {
+    const std::size_t n = heap.size();
+    while (true) {
+      const std::size_t left = 2 * i + 1;
+      if (left >= n) { break; }
+      std::size_t child = left;
+      if (left + 1 < n && above<Low>(heap[left + 1], heap[left])) { child = left + 1; }
+      if (!above<Low>(heap[child], heap[i])) { break; }
+      std::swap(heap[i], heap[child]);
+      place(heap, i, Low);
+      i = child;
+    }
+    place(heap, i, Low);
+  }
+
+  template <bool Low>
+  auto restore(std::vector<std::uint32_t>& heap, std::size_t i) -> void {
+    if (!siftUp<Low>(heap, i)) { siftDown<Low>(heap, i); }
+  }
+
+  std::size_t window_;
+  std::size_t rank_;
+  std::vector<float> values_;
+  std::vector<std::uint8_t> inLow_;
+  std::vector<std::uint32_t> position_;
+  std::vector<std::uint32_t> low_;
+  std::vector<std::uint32_t> high_;
+  std::uint32_t oldest_ = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// * Filter ...
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Sliding `rank`-th order statistic over windows of `window`
+ *  samples, on whole signals (`apply`) or streams (`process`).
+ * @details A stream is `latency()` = window - 1 - window/2 samples behind,
+ *  like `StreamingConvolver`: the first `latency()` outputs are zeros, and
+ *  `flush` feeds zeros to emit the last ones, so `process` + `flush` give
+ *  `apply` with `Boundary::Zero`, shifted by the latency. Stream state is
+ *  meant for one stream on one thread.
+ */
+class RankFilter {
+public:
+  /// @brief Outputs per task of `apply`; heap tasks also refill once each.
+  static constexpr std::size_t kChunk = 16384;
+
+  RankFilter(std::size_t window, std::size_t rank, Selection selection = Selection::Auto)
+    : window_(checked(window, rank)), rank_(rank), selection_(selection), heap_(window, rank) {
+    if (selection_ == Selection::Auto) {
+      selection_ = window <= kMaxNetworkWindow ? Selection::Network : Selection::Heap;
+    }
+    if (selection_ == Selection::Network && window > kMaxNetworkWindow) {
+      throw std::runtime_error(
+        "Sorting networks go up to " + std::to_string(kMaxNetworkWindow) + " samples; the window has " +
+        std::to_string(window) + ".");
+    }
+    reset();
+  }
+
+  /// @brief Median: rank window/2 (the upper median for even windows).
+  static auto median(std::size_t window, Selection selection = Selection::Auto) -> RankFilter {
+    return RankFilter(window, window / 2, selection);
+  }
+
+  /// @brief `p`-th percentile, 0 to 100, rounded to the nearest rank.
+  static auto percentile(std::size_t window, double p, Selection selection = Selection::Auto) -> RankFilter {
+    if (!(p >= 0.0 && p <= 100.0)) {
+      throw std::runtime_error("Percentile must be within [0, 100], got " + std::to_string(p) + ".");
+    }
+    const auto rank = static_cast<std::size_t>(std::lround(p / 100.0 * static_cast<double>(window > 0 ? window - 1 : 0)));
+    return RankFilter(window, rank, selection);
+  }
+
+  auto window() const -> std::size_t { return window_; }
+  auto rank() const -> std::size_t { return rank_; }
+  /// @brief The way windows are ranked, never `Auto`.
+  auto selection() const -> Selection { return selection_; }
+  auto latency() const -> std::size_t { return window_ - 1 - window_ / 2; }
+
+  /// @brief Whole signal into `out` (same size), in parallel chunks.
+  auto apply(std::span<const float> signal, std::span<float> out, Boundary boundary = Boundary::Zero) const -> void {
+    requireOutputSize(signal.size(), out.size());
+    const std::size_t chunk = std::max(kChunk, 4 * window_);
+    const auto n = static_cast<std::ptrdiff_t>(signal.size());
+    ThreadPool::global().parallelFor(signal.size(), chunk, [&](std::size_t begin, std::size_t end) {
+      std::vector<float> gathered;
+      std::optional<OrderWindow> heap;
+      for (std::size_t first = begin; first < end; first += chunk) {
+        const std::size_t count = std::min(chunk, end - first);
+        // * Inputs of outputs [first, first + count), boundary applied at the ends.
+        const auto left = static_cast<std::ptrdiff_t>(first) - static_cast<std::ptrdiff_t>(window_ / 2);
+        const auto inputs = static_cast<std::ptrdiff_t>(count + window_ - 1);
+        const std::ptrdiff_t lo = std::clamp<std::ptrdiff_t>(-left, 0, inputs);
+        const std::ptrdiff_t hi = std::clamp<std::ptrdiff_t>(n - left, lo, inputs);
+        gathered.resize(static_cast<std::size_t>(inputs));
+        for (std::ptrdiff_t j = 0; j < lo; ++j) { gathered[j] = sampleAt(signal, left + j, boundary); }
+        std::copy(signal.begin() + (left + lo), signal.begin() + (left + hi), gathered.begin() + lo);
+        for (std::ptrdiff_t j = hi; j < inputs; ++j) { gathered[j] = sampleAt(signal, left + j, boundary); }
+
+        if (selection_ == Selection::Network) {
+          network::selectFor(window_)(gathered.data(), count, rank_, out.data() + first);
+          continue;
+        }
+        if (!heap) { heap.emplace(window_, rank_); }
+        heap->fill(gathered.data());
+        out[first] = heap->value();
+        for (std::size_t i = 1; i < count; ++i) {
+          heap->push(gathered[i + window_ - 1]);
+          out[first + i] = heap->value();
+        }
+      }
+    });
+  }
+
+  /// @brief Filters `in` into `out` (same size), `latency()` samples behind.
+  auto process(std::span<const float> in, std::span<float> out) -> void {
+    requireOutputSize(in.size(), out.size());
+    if (selection_ == Selection::Network) {
+      // * The last window - 1 samples, then `in`: one output per new sample.
+      history_.insert(history_.end(), in.begin(), in.end());
+      network::selectFor(window_)(history_.data(), in.size(), rank_, out.data());
+      history_.erase(history_.begin(), history_.end() - static_cast<std::ptrdiff_t>(window_ - 1));
+    } else {
+      for (std::size_t i = 0; i < in.size(); ++i) {
+        heap_.push(in[i]);
+        out[i] = heap_.value();
+      }
+    }
+    // * Pre-roll: windows that end before the first real output.
+    const std::size_t preroll = std::min(in.size(), latency() - std::min(latency(), seen_));
+    std::fill_n(out.begin(), preroll, 0.0f);
+    seen_ += in.size();
+  }
+
+  /// @brief The last `latency()` outputs (into `out`, which must hold that
+  ///  many), feeding zeros as the rest of the stream. Call `reset` to reuse.
+  auto flush(std::span<float> out) -> void {
+    const std::vector<float> zeros(latency(), 0.0f);
+    process(zeros, out);
+  }
+
+  /// @brief Back to the state of a new stream: a window of zeros.
+  auto reset() -> void {
+    history_.assign(window_ - 1, 0.0f);
+    const std::vector<float> zeros(window_, 0.0f);
+    heap_.fill(zeros.data());
+    seen_ = 0;
+  }
+
+private:
+  static auto checked(std::size_t window, std::size_t rank) -> std::size_t {
+    if (window == 0 || rank >= window) {
+      throw std::runtime_error(
+        "Rank filter needs 0 <= rank < window; got rank " + std::to_string(rank) + " of " + std::to_string(window) + ".");
+    }
+    return window;
+  }
+
+  std::size_t window_;
+  std::size_t rank_;
+  Selection selection_;
+
+  // * Stream state: the last window - 1 samples (network) or the window
+  // * itself (heap), and how many samples came in.
+  std::vector<float> history_;
+  OrderWindow heap_;
+  std::size_t seen_ = 0;
+};
+
+/// @brief Median of every `window`-sample window of `signal`.
+inline auto medianFilter(
+  std::span<const float> signal,
+  std::size_t window,
+  std::span<float> out,
+  Boundary boundary = Boundary::Zero) -> void {
+  RankFilter::median(window).apply(signal, out, boundary);
+}
+
+/// @brief `p`-th percentile (0 to 100) of every `window`-sample window of `signal`.
+inline auto percentileFilter(
+  std::span<const float> signal,
+  std::size_t window,
+  double p,
+  std::span<float> out,
+  Boundary boundary = Boundary::Zero) -> void {
+  RankFilter::percentile(window, p).apply(signal, out, boundary);
+}
+
+}  // namespace compute::convolution
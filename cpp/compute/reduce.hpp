@@ -0,0 +1,392 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "elementwise.hpp"
+#include "thread_pool.hpp"
+
+// * Parallel reductions: sum, dot, min/max and argmin/argmax.
+// *
+// * The input is cut into fixed-size blocks (independent of the thread
+// * count), the blocks are reduced in parallel with per-ISA SIMD leaves
+// * (`reduce_kernels.inl`), and the per-block partials are combined as a
+// * balanced tree. Because the blocking never depends on how many threads
+// * run, results are bit-identical for any `REPOUSSE_THREADS`.
+// *
+// * Sums and dots come in three accuracies:
+// * - `Fast`: each block in a handful of vector accumulators.
+// * - `Pairwise`: each block as a binary tree of short leaves; the error
+// *   grows with log(n) instead of n.
+// * - `Kahan`: compensated summation per lane and across blocks, close to
+// *   exact float rounding at roughly the cost of `Pairwise`.
+// *
+// * NaNs are not treated specially; `min`/`max` with NaN inputs are undefined.
+
+namespace compute::reduce {
+
+using elementwise::Isa;
+using elementwise::activeIsa;
+using elementwise::isaName;
+using elementwise::supported;
+
+enum class Accuracy { Fast, Pairwise, Kahan };
+
+inline auto accuracyName(Accuracy accuracy) -> const char* {
+  switch (accuracy) {
+    case Accuracy::Fast:     return "fast";
+    case Accuracy::Pairwise: return "pairwise";
+    case Accuracy::Kahan:    return "kahan";
+  }
+  return "unknown";
+}
+
+/// @brief A running sum with its Kahan–Babuška (Neumaier) compensation.
+struct Compensated {
+  float sum = 0.0f;
+  float compensation = 0.0f;
+
+  auto add(float x) -> void {
+    const float t = sum + x;
+    if (std::fabs(sum) >= std::fabs(x)) { compensation += (sum - t) + x; }
+    else                                { compensation += (x - t) + sum; }
+    sum = t;
+  }
+  auto add(const Compensated& other) -> void {
+    add(other.sum);
+    compensation += other.compensation;
+  }
+  auto value() const -> float { return sum + compensation; }
+};
+
+/// @brief A value and where it was found.
+struct Indexed {
+  float value = 0.0f;
+  std::size_t index = 0;
+};
+
+/// @brief One ISA's reduction leaves.
+struct Leaves {
+  float (*sum)(const float*, std::size_t);
+  float (*dot)(const float*, const float*, std::size_t);
+  // * `b == nullptr` for a plain sum
+  Compensated (*compensated)(const float*, const float*, std::size_t);
+  float (*minimum)(const float*, std::size_t);
+  float (*maximum)(const float*, std::size_t);
+  Indexed (*argmin)(const float*, std::size_t);
+  Indexed (*argmax)(const float*, std::size_t);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// * Per-ISA instantiations ...
+///////////////////////////////////////////////////////////////////////////////
+
+namespace scalar {
+struct Vec {
+  using type = float;
+  static constexpr std::size_t width = 1;
+  static auto load(const float* p) -> type { return *p; }
+  static auto storeAligned(float* p, type v) -> void { *p = v; }
+  static auto set1(float v) -> type { return v; }
+  static auto add(type a, type b) -> type { return a + b; }
+  static auto sub(type a, type b) -> type { return a - b; }
+  static auto mul(type a, type b) -> type { return a * b; }
+  static auto fmadd(type a, type b, type c) -> type { return std::fma(a, b, c); }
+  static auto min(type a, type b) -> type { return std::min(a, b); }
+  static auto max(type a, type b) -> type { return std::max(a, b); }
+  static auto hsum(type v) -> float { return v; }
+  static auto hmin(type v) -> float { return v; }
+  static auto hmax(type v) -> float { return v; }
+  static auto anyEqual(type a, type b) -> bool { return a == b; }
+};
+#include "reduce_kernels.inl"
+}  // namespace scalar
+
+#ifdef REPOUSSE_X86
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2,fma"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+namespace avx2 {
+struct Vec {
+  using type = __m256;
+  static constexpr std::size_t width = 8;
+  static inline auto load(const float* p) -> type { return _mm256_loadu_ps(p); }
+  static inline auto storeAligned(float* p, type v) -> void { _mm256_store_ps(p, v); }
+  static inline auto set1(float v) -> type { return _mm256_set1_ps(v); }
+  static inline auto add(type a, type b) -> type { return _mm256_add_ps(a, b); }
+  static inline auto sub(type a, type b) -> type { return _mm256_sub_ps(a, b); }
+  static inline auto mul(type a, type b) -> type { return _mm256_mul_ps(a, b); }
+  static inline auto fmadd(type a, type b, type c) -> type { return _mm256_fmadd_ps(a, b, c); }
+  static inline auto min(type a, type b) -> type { return _mm256_min_ps(a, b); }
+  static inline auto max(type a, type b) -> type { return _mm256_max_ps(a, b); }
+  static inline auto half(type v) -> __m128 {
+    return _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  }
+  static inline auto hsum(type v) -> float {
+    __m128 x = half(v);
+    x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_add_ss(x, _mm_movehdup_ps(x));
+    return _mm_cvtss_f32(x);
+  }
+  static inline auto hmin(type v) -> float {
+    __m128 x = _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    x = _mm_min_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_min_ss(x, _mm_movehdup_ps(x));
+    return _mm_cvtss_f32(x);
+  }
+  static inline auto hmax(type v) -> float {
+    __m128 x = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    x = _mm_max_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_max_ss(x, _mm_movehdup_ps(x));
+    return _mm_cvtss_f32(x);
+  }
+  static inline auto anyEqual(type a, type b) -> bool {
+    return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_EQ_OQ)) != 0;
+  }
+};
+#include "reduce_kernels.inl"
+}  // namespace avx2
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx512f"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+// ! GCC 12's avx512fintrin.h seeds its masked builtins with `_mm*_undefined_*`,
+// ! which -Wall reports as uninitialised once inlined here.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+namespace avx512 {
+struct Vec {
+  using type = __m512;
+  static constexpr std::size_t width = 16;
+  static inline auto load(const float* p) -> type { return _mm512_loadu_ps(p); }
+  static inline auto storeAligned(float* p, type v) -> void { _mm512_store_ps(p, v); }
+  static inline auto set1(float v) -> type { return _mm512_set1_ps(v); }
+  static inline auto add(type a, type b) -> type { return _mm512_add_ps(a, b); }
+  static inline auto sub(type a, type b) -> type { return _mm512_sub_ps(a, b); }
+  static inline auto mul(type a, type b) -> type { return _mm512_mul_ps(a, b); }
+  static inline auto fmadd(type a, type b, type c) -> type { return _mm512_fmadd_ps(a, b, c); }
+  static inline auto min(type a, type b) -> type { return _mm512_min_ps(a, b); }
+  static inline auto max(type a, type b) -> type { return _mm512_max_ps(a, b); }
+  static inline auto hsum(type v) -> float { return _mm512_reduce_add_ps(v); }
+  static inline auto hmin(type v) -> float { return _mm512_reduce_min_ps(v); }
+  static inline auto hmax(type v) -> float { return _mm512_reduce_max_ps(v); }
+  static inline auto anyEqual(type a, type b) -> bool {
+    return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ) != 0;
+  }
+};
+#include "reduce_kernels.inl"
+}  // namespace avx512
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+#endif
+
+#endif  // REPOUSSE_X86
+
+#ifdef REPOUSSE_NEON
+namespace neon {
+struct Vec {
+  using type = float32x4_t;
+  static constexpr std::size_t width = 4;
+  static inline auto load(const float* p) -> type { return vld1q_f32(p); }
+  static inline auto storeAligned(float* p, type v) -> void { vst1q_f32(p, v); }
+  static inline auto set1(float v) -> type { return vdupq_n_f32(v); }
+  static inline auto add(type a, type b) -> type { return vaddq_f32(a, b); }
+  static inline auto sub(type a, type b) -> type { return vsubq_f32(a, b); }
+  static inline auto mul(type a, type b) -> type { return vmulq_f32(a, b); }
+  static inline auto fmadd(type a, type b, type c) -> type { return vfmaq_f32(c, a, b); }
+  static inline auto min(type a, type b) -> type { return vminq_f32(a, b); }
+  static inline auto max(type a, type b) -> type { return vmaxq_f32(a, b); }
+  static inline auto hsum(type v) -> float { return vaddvq_f32(v); }
+  static inline auto hmin(type v) -> float { return vminvq_f32(v); }
+  static inline auto hmax(type v) -> float { return vmaxvq_f32(v); }
+  static inline auto anyEqual(type a, type b) -> bool { return vmaxvq_u32(vceqq_f32(a, b)) != 0; }
+};
+#include "reduce_kernels.inl"
+}  // namespace neon
+#endif  // REPOUSSE_NEON
+
+inline auto leaves(Isa isa) -> const Leaves& {
+  if (!supported(isa)) {
+    throw std::runtime_error("ISA '" + std::string(isaName(isa)) + "' is not supported on this CPU.");
+  }
+  switch (isa) {
+#ifdef REPOUSSE_X86
+    case Isa::Avx2:   return avx2::table;
+    case Isa::Avx512: return avx512::table;
+#endif
+#ifdef REPOUSSE_NEON
+    case Isa::Neon:   return neon::table;
+#endif
+    default:          return scalar::table;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Blocking and tree combination ...
+///////////////////////////////////////////////////////////////////////////////
+
+// * Unit of parallel work: 256 KiB, so a block's second pass (argmax) still
+// * hits L2. Fixed, so results don't depend on the thread count.
+constexpr std::size_t kBlockFloats = std::size_t{1} << 16;
+
+// * Pairwise leaves: short enough that the per-lane error stays tiny, long
+// * enough for the vector accumulators to stay busy.
+constexpr std::size_t kLeafFloats = 256;
+
+/// @brief `op(a[i], b[i])` over `[0, n)` as a balanced tree of `kLeafFloats` leaves.
+template <typename LeafFn>
+inline auto pairwise(std::size_t n, std::size_t first, const LeafFn& leaf) -> float {
+  if (n <= kLeafFloats) { return leaf(first, n); }
+  // * Split on a leaf boundary so every leaf but the last is full.
+  const std::size_t half = (n / 2 + kLeafFloats - 1) / kLeafFloats * kLeafFloats;
+  return pairwise(half, first, leaf) + pairwise(n - half, first + half, leaf);
+}
+
+/// @brief Balanced-tree sum of per-block partials.
+inline auto treeSum(std::span<const float> partials) -> float {
+  if (partials.empty()) { return 0.0f; }
+  if (partials.size() == 1) { return partials[0]; }
+  const std::size_t half = partials.size() / 2;
+  return treeSum(partials.first(half)) + treeSum(partials.subspan(half));
+}
+
+/// @brief Runs `blockFn(begin, count)` for each fixed block, in parallel.
+template <typename T, typename BlockFn>
+inline auto perBlock(std::size_t n, const BlockFn& blockFn) -> std::vector<T> {
+  const std::size_t blocks = (n + kBlockFloats - 1) / kBlockFloats;
+  std::vector<T> partials(blocks);
+  ThreadPool::global().parallelFor(blocks, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t block = begin; block < end; ++block) {
+      const std::size_t first = block * kBlockFloats;
+      partials[block] = blockFn(first, std::min(kBlockFloats, n - first));
+    }
+  });
+  return partials;
+}
+
+/// @brief Sum (or dot when `b` is given) of `n` floats.
+inline auto accumulate(const float* a, const float* b, std::size_t n, Accuracy accuracy, Isa isa) -> float {
+  const Leaves& leaf = leaves(isa);
+  switch (accuracy) {
+    case Accuracy::Kahan: {
+      const auto partials = perBlock<Compensated>(n, [&](std::size_t first, std::size_t count) {
+        return leaf.compensated(a + first, b ? b + first : nullptr, count);
+      });
+      Compensated total;
+      for (const Compensated& partial : partials) { total.add(partial); }
+      return total.value();
+    }
+    case Accuracy::Pairwise: {
+      const auto partials = perBlock<float>(n, [&](std::size_t first, std::size_t count) {
+        return pairwise(count, first, [&](std::size_t at, std::size_t m) {
+          return b ? leaf.dot(a + at, b + at, m) : leaf.sum(a + at, m);
+        });
+      });
+      return treeSum(partials);
+    }
+    case Accuracy::Fast:
+    default: {
+      const auto partials = perBlock<float>(n, [&](std::size_t first, std::size_t count) {
+        return b ? leaf.dot(a + first, b + first, count) : leaf.sum(a + first, count);
+      });
+      return treeSum(partials);
+    }
+  }
+}
+
+inline auto requireNonEmpty(std::size_t n, const char* what) -> void {
+  if (n == 0) { throw std::runtime_error(std::string(what) + " of an empty range."); }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Public API ...
+///////////////////////////////////////////////////////////////////////////////
+
+inline auto sum(std::span<const float> a, Accuracy accuracy = Accuracy::Pairwise,
+                Isa isa = activeIsa()) -> float {
+  return accumulate(a.data(), nullptr, a.size(), accuracy, isa);
+}
+
+inline auto dot(std::span<const float> a, std::span<const float> b,
+                Accuracy accuracy = Accuracy::Pairwise, Isa isa = activeIsa()) -> float {
+  elementwise::requireSameSize(a.size(), b.size());
+  return accumulate(a.data(), b.data(), a.size(), accuracy, isa);
+}
+
+/// @throws std::runtime_error on an empty range.
+inline auto min(std::span<const float> a, Isa isa = activeIsa()) -> float {
+  requireNonEmpty(a.size(), "min");
+  const Leaves& leaf = leaves(isa);
+  const auto partials = perBlock<float>(a.size(), [&](std::size_t first, std::size_t count) {
+    return leaf.minimum(a.data() + first, count);
+  });
+  return *std::min_element(partials.begin(), partials.end());
+}
+
+/// @throws std::runtime_error on an empty range.
+inline auto max(std::span<const float> a, Isa isa = activeIsa()) -> float {
+  requireNonEmpty(a.size(), "max");
+  const Leaves& leaf = leaves(isa);
+  const auto partials = perBlock<float>(a.size(), [&](std::size_t first, std::size_t count) {
+    return leaf.maximum(a.data() + first, count);
+  });
+  return *std::max_element(partials.begin(), partials.end());
+}
+
+/// @brief Largest element and its first index. @throws std::runtime_error on an empty range.
+inline auto argmax(std::span<const float> a, Isa isa = activeIsa()) -> Indexed {
+  requireNonEmpty(a.size(), "argmax");
+  const Leaves& leaf = leaves(isa);
+  const auto partials = perBlock<Indexed>(a.size(), [&](std::size_t first, std::size_t count) {
+    Indexed local = leaf.argmax(a.data() + first, count);
+    local.index += first;
+    return local;
+  });
+  // * Strict `>` keeps the earliest block on ties.
+  Indexed best = partials[0];
+  for (const Indexed& partial : partials) {
+    if (partial.value > best.value) { best = partial; }
+  }
+  return best;
+}
+
+/// @brief Smallest element and its first index. @throws std::runtime_error on an empty range.
+inline auto argmin(std::span<const float> a, Isa isa = activeIsa()) -> Indexed {
+  requireNonEmpty(a.size(), "argmin");
+  const Leaves& leaf = leaves(isa);
+  const auto partials = perBlock<Indexed>(a.size(), [&](std::size_t first, std::size_t count) {
+    Indexed local = leaf.argmin(a.data() + first, count);
+    local.index += first;
+    return local;
+  });
+  Indexed best = partials[0];
+  for (const Indexed& partial : partials) {
+    if (partial.value < best.value) { best = partial; }
+  }
+  return best;
+}
+
+}  // namespace compute::reduce
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "backend.hpp"
+#include "context.hpp"
+#include "reduce.hpp"
+
+// * Device side of `reduce.hpp`: the two-pass kernels of `day1/reduce.metal`
+// * driven through a `Context`, so the same calls run on Metal or on the CPU
+// * twins in `cpu_kernels.hpp`.
+
+namespace compute::reduce {
+
+/**
+ * @brief Sums, dots, min/max and argmax of device buffers.
+ * @details Pass 1 runs up to `kMaxGroups` threadgroups, each folding a
+ *  grid-strided share of the input into one partial; pass 2 folds the
+ *  partials in a single threadgroup. The scratch buffers for the partials
+ *  are allocated once, with the reducer. GPU sums accumulate in fp32 per
+ *  thread and are `Accuracy::Fast`-grade.
+ */
+class DeviceReduction {
+public:
+  // * Enough groups to fill any Apple GPU a few times over, few enough that
+  // * pass 2 is one group doing a single strided read each.
+  static constexpr std::size_t kMaxGroups = 1024;
+
+  explicit DeviceReduction(Context& context, std::filesystem::path library = "./reduce.metallib")
+    : context_(context),
+      library_(std::move(library)),
+      partials_(context.device().newBuffer(kMaxGroups * sizeof(float))),
+      indices_(context.device().newBuffer(kMaxGroups * sizeof(std::uint32_t))),
+      result_(context.device().newBuffer(sizeof(float))),
+      resultIndex_(context.device().newBuffer(sizeof(std::uint32_t))) {}
+
+  auto sum(Buffer& in, std::size_t n) -> float { return fold("reduce_sum", in, nullptr, n); }
+
+  auto dot(Buffer& a, Buffer& b, std::size_t n) -> float { return fold("reduce_dot", a, &b, n); }
+
+  /// @throws std::runtime_error if `n == 0`.
+  auto min(Buffer& in, std::size_t n) -> float {
+    requireNonEmpty(n, "min");
+    return fold("reduce_min", in, nullptr, n);
+  }
+
+  /// @throws std::runtime_error if `n == 0`.
+  auto max(Buffer& in, std::size_t n) -> float {
+    requireNonEmpty(n, "max");
+    return fold("reduce_max", in, nullptr, n);
+  }
+
+  /// @brief Largest element and its first index. @throws std::runtime_error if `n == 0`.
+  auto argmax(Buffer& in, std::size_t n) -> Indexed {
+    requireNonEmpty(n, "argmax");
+    const auto length = checkedLength(n);
+    const Shape shape = shapeFor("reduce_argmax", n);
+
+    Arguments first;
+    first.setBuffer(in, 0, 0).setBuffer(*partials_, 0, 1).setBuffer(*indices_, 0, 2).setValue(length, 3);
+    context_.queue().dispatchThreadgroups(*shape.pipeline, first, {shape.groups, 1, 1}, {shape.threads, 1, 1});
+
+    Pipeline& pairs = context_.pipeline(library_, "reduce_argmax_pairs");
+    const auto groups = static_cast<std::uint32_t>(shape.groups);
+    Arguments second;
+    second.setBuffer(*partials_, 0, 0).setBuffer(*indices_, 0, 1)
+          .setBuffer(*result_, 0, 2).setBuffer(*resultIndex_, 0, 3).setValue(groups, 4);
+    context_.queue().dispatchThreadgroups(pairs, second, {1, 1, 1}, {threadsFor(pairs), 1, 1});
+    return {*result_->as<float>(), *resultIndex_->as<std::uint32_t>()};
+  }
+
+private:
+  struct Shape {
+    Pipeline* pipeline;
+    std::size_t threads;
+    std::size_t groups;
+  };
+
+  static auto checkedLength(std::size_t n) -> std::uint32_t {
+    if (n > UINT32_MAX) {
+      throw std::runtime_error("Device reductions index with 32 bits; got " + std::to_string(n) + " elements.");
+    }
+    return static_cast<std::uint32_t>(n);
+  }
+
+  // * Whole SIMD groups, up to 256 threads: enough to hide latency, small
+  // * enough that several groups share a core.
+  static auto threadsFor(const Pipeline& pipeline) -> std::size_t {
+    const std::size_t simd = std::max<std::size_t>(pipeline.threadExecutionWidth(), 1);
+    const std::size_t limit = std::min<std::size_t>(pipeline.maxTotalThreadsPerThreadgroup(), 256);
+    return std::max(simd, limit / simd * simd);
+  }
+
+  auto shapeFor(const std::string& function, std::size_t n) -> Shape {
+    Pipeline& pipeline = context_.pipeline(library_, function);
+    const std::size_t threads = threadsFor(pipeline);
+    // * At least a few elements per thread, so the strided loop amortises the fold.
+    constexpr std::size_t kPerThread = 8;
+    const std::size_t groups = std::clamp<std::size_t>((n + threads * kPerThread - 1) / (threads * kPerThread), 1, kMaxGroups);
+    return {&pipeline, threads, groups};
+  }
+
+  /// @brief Pass 1 with `function`, then pass 2 with the same reduction over the partials.
+  auto fold(const std::string& function, Buffer& a, Buffer* b, std::size_t n) -> float {
+    const auto length = checkedLength(n);
+    const Shape shape = shapeFor(function, n);
+
+    Arguments first;
+    first.setBuffer(a, 0, 0);
+    // * `reduce_dot` takes its second input at index 1 and shifts the rest.
+    const std::uint32_t shift = b ? 1 : 0;
+    if (b) { first.setBuffer(*b, 0, 1); }
+    first.setBuffer(*partials_, 0, 1 + shift).setValue(length, 2 + shift);
+    context_.queue().dispatchThreadgroups(*shape.pipeline, first, {shape.groups, 1, 1}, {shape.threads, 1, 1});
+
+    // * The partials of a dot are summed.
+    Pipeline& combine = b ? context_.pipeline(library_, "reduce_sum") : *shape.pipeline;
+    const auto groups = static_cast<std::uint32_t>(shape.groups);
+    Arguments second;
+    second.setBuffer(*partials_, 0, 0).setBuffer(*result_, 0, 1).setValue(groups, 2);
+    context_.queue().dispatchThreadgroups(combine, second, {1, 1, 1}, {threadsFor(combine), 1, 1});
+    return *result_->as<float>();
+  }
+
+  Context& context_;
+  std::filesystem::path library_;
+  std::unique_ptr<Buffer> partials_;
+  std::unique_ptr<Buffer> indices_;
+  std::unique_ptr<Buffer> result_;
+  std::unique_ptr<Buffer> resultIndex_;
+};
+
+}  // namespace compute::reduce
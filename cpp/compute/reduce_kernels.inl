@@ -0,0 +1,164 @@
+// * Reduction leaves, compiled once per instruction set.
+// *
+// * `reduce.hpp` includes this file several times, each time inside its own
+// * namespace that defines a `Vec` traits struct and (on x86) inside a
+// * `#pragma GCC target` region, exactly like `elementwise_kernels.inl`.
+// *
+// * `Vec` provides: `type`, `width`, `load`, `set1`, `add`, `sub`, `mul`,
+// * `fmadd` (a*b+c), `min`, `max`, `hsum`, `hmin`, `hmax` and `anyEqual`.
+// * Every leaf reads `n` contiguous floats once and reduces them in
+// * `kAccumulators` independent vector registers, which are then combined as
+// * a tree (0+1, 2+3, then the pair) before the horizontal step.
+// !  No include guard on purpose.
+
+constexpr std::size_t kAccumulators = 4;
+
+template <typename V>
+inline auto combine(V acc[kAccumulators]) -> V {
+  return Vec::add(Vec::add(acc[0], acc[1]), Vec::add(acc[2], acc[3]));
+}
+
+inline auto sum(const float* a, std::size_t n) -> float {
+  using V = typename Vec::type;
+  constexpr std::size_t W = Vec::width;
+  V acc[kAccumulators] = {Vec::set1(0.0f), Vec::set1(0.0f), Vec::set1(0.0f), Vec::set1(0.0f)};
+  std::size_t i = 0;
+  for (; i + kAccumulators * W <= n; i += kAccumulators * W) {
+    for (std::size_t k = 0; k < kAccumulators; ++k) { acc[k] = Vec::add(acc[k], Vec::load(a + i + k * W)); }
+  }
+  for (; i + W <= n; i += W) { acc[0] = Vec::add(acc[0], Vec::load(a + i)); }
+  float total = Vec::hsum(combine(acc));
+  for (; i < n; ++i) { total += a[i]; }
+  return total;
+}
+
+inline auto dot(const float* a, const float* b, std::size_t n) -> float {
+  using V = typename Vec::type;
+  constexpr std::size_t W = Vec::width;
+  V acc[kAccumulators] = {Vec::set1(0.0f), Vec::set1(0.0f), Vec::set1(0.0f), Vec::set1(0.0f)};
+  std::size_t i = 0;
+  for (; i + kAccumulators * W <= n; i += kAccumulators * W) {
+    for (std::size_t k = 0; k < kAccumulators; ++k) {
+      acc[k] = Vec::fmadd(Vec::load(a + i + k * W), Vec::load(b + i + k * W), acc[k]);
+    }
+  }
+  for (; i + W <= n; i += W) { acc[0] = Vec::fmadd(Vec::load(a + i), Vec::load(b + i), acc[0]); }
+  float total = Vec::hsum(combine(acc));
+  for (; i < n; ++i) { total += a[i] * b[i]; }
+  return total;
+}
+
+/**
+ * @brief Kahan-compensated sum, one running (sum, compensation) per lane
+ *  of each accumulator.
+ * @details With `b`, the terms are `a[i] * b[i]` and the rounding error of
+ *  each product (recovered exactly with an fma) is folded into the
+ *  compensation as well, so a dot product is as accurate as a sum.
+ */
+inline auto compensated(const float* a, const float* b, std::size_t n) -> Compensated {
+  using V = typename Vec::type;
+  constexpr std::size_t W = Vec::width;
+  V s[kAccumulators], c[kAccumulators];
+  for (std::size_t k = 0; k < kAccumulators; ++k) { s[k] = c[k] = Vec::set1(0.0f); }
+  auto step = [&](std::size_t k, const float* x, const float* y) {
+    const V xv = Vec::load(x);
+    V term = xv;
+    V error = Vec::set1(0.0f);
+    if (b) {
+      const V yv = Vec::load(y);
+      term = Vec::mul(xv, yv);
+      error = Vec::fmadd(xv, yv, Vec::sub(Vec::set1(0.0f), term));  // * x*y - fl(x*y)
+    }
+    const V t = Vec::sub(term, c[k]);
+    const V next = Vec::add(s[k], t);
+    c[k] = Vec::sub(Vec::sub(Vec::sub(next, s[k]), t), error);
+    s[k] = next;
+  };
+  std::size_t i = 0;
+  // * Independent chains, so the four-op dependency of each step overlaps.
+  for (; i + kAccumulators * W <= n; i += kAccumulators * W) {
+    for (std::size_t k = 0; k < kAccumulators; ++k) {
+      step(k, a + i + k * W, b ? b + i + k * W : nullptr);
+    }
+  }
+  for (; i + W <= n; i += W) { step(0, a + i, b ? b + i : nullptr); }
+
+  // * Fold the lanes together with the same compensated step.
+  alignas(64) float sums[W];
+  alignas(64) float comps[W];
+  Compensated total;
+  for (std::size_t k = 0; k < kAccumulators; ++k) {
+    Vec::storeAligned(sums, s[k]);
+    Vec::storeAligned(comps, c[k]);
+    for (std::size_t l = 0; l < W; ++l) {
+      total.add(sums[l]);
+      total.add(-comps[l]);
+    }
+  }
+  for (; i < n; ++i) {
+    if (b) {
+      const float product = a[i] * b[i];
+      total.add(product);
+      total.add(std::fma(a[i], b[i], -product));
+    } else {
+      total.add(a[i]);
+    }
+  }
+  return total;
+}
+
+inline auto minimum(const float* a, std::size_t n) -> float {
+  using V = typename Vec::type;
+  constexpr std::size_t W = Vec::width;
+  float best = std::numeric_limits<float>::infinity();
+  std::size_t i = 0;
+  if (n >= W) {
+    V acc = Vec::load(a);
+    for (i = W; i + W <= n; i += W) { acc = Vec::min(acc, Vec::load(a + i)); }
+    best = Vec::hmin(acc);
+  }
+  for (; i < n; ++i) { best = std::min(best, a[i]); }
+  return best;
+}
+
+inline auto maximum(const float* a, std::size_t n) -> float {
+  using V = typename Vec::type;
+  constexpr std::size_t W = Vec::width;
+  float best = -std::numeric_limits<float>::infinity();
+  std::size_t i = 0;
+  if (n >= W) {
+    V acc = Vec::load(a);
+    for (i = W; i + W <= n; i += W) { acc = Vec::max(acc, Vec::load(a + i)); }
+    best = Vec::hmax(acc);
+  }
+  for (; i < n; ++i) { best = std::max(best, a[i]); }
+  return best;
+}
+
+/// @brief First index holding `value`, scanning a vector at a time; `n` if absent.
+inline auto find(const float* a, std::size_t n, float value) -> std::size_t {
+  using V = typename Vec::type;
+  constexpr std::size_t W = Vec::width;
+  const V needle = Vec::set1(value);
+  std::size_t i = 0;
+  for (; i + W <= n; i += W) {
+    if (Vec::anyEqual(Vec::load(a + i), needle)) { break; }
+  }
+  for (; i < n; ++i) {
+    if (a[i] == value) { return i; }
+  }
+  return n;
+}
+
+/// @brief Largest value and its first index (a max pass, then a find pass).
+inline auto argmax(const float* a, std::size_t n) -> Indexed {
+  const float best = maximum(a, n);
+  return {best, find(a, n, best)};
+}
+
+inline auto argmin(const float* a, std::size_t n) -> Indexed {
+  const float best = minimum(a, n);
+  return {best, find(a, n, best)};
+}
+
+inline const Leaves table = {sum, dot, compensated, minimum, maximum, argmin, argmax};
@@ -0,0 +1,331 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <numbers>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "convolution.hpp"
+#include "reduce.hpp"
+#include "thread_pool.hpp"
+
+// * Rational resampling by L/M with a polyphase FIR.
+// *
+// * Conceptually: insert L - 1 zeros after every sample, filter at the high
+// * rate with `filter` (K taps, same "same"-size, centred, unflipped
+// * convention as `convolution.hpp`), keep every M-th sample:
+// *
+// *   u[m]   = x[m / L] if L divides m, else 0
+// *   out[n] = sum_j u[n·M + j - K/2] * filter[j],   0 <= n < ceil(N·L / M)
+// *
+// * Only taps that land on a real sample count, and those are the taps
+// * `filter[r], filter[r + L], ...` of one phase r. So each output is one dot
+// * product of ceil(K / L) taps with contiguous input, and no output that
+// * is thrown away is ever computed. Decimating by M costs 1/M of filtering
+// * at the full rate; interpolating by L costs 1/L of filtering the stuffed
+// * signal.
+
+namespace compute::convolution {
+
+/**
+ * @brief Blackman-windowed sinc low-pass for resampling by `up / down`:
+ *  cutoff at the lower of the two Nyquist rates, DC gain `up` (which the
+ *  zero stuffing divides back out), `tapsPerPhase · max(up, down)` taps
+ *  rounded up to odd so it is centred.
+ */
+inline auto resamplingFilter(std::size_t up, std::size_t down, std::size_t tapsPerPhase = 16) -> std::vector<float> {
+  if (up == 0 || down == 0 || tapsPerPhase == 0) {
+    throw std::runtime_error("Resampling filter needs non-zero up, down and taps per phase.");
+  }
+  const std::size_t taps = tapsPerPhase * std::max(up, down) | 1;
+  const double cutoff = 0.5 / static_cast<double>(std::max(up, down));  // * cycles per high-rate sample
+  const double middle = static_cast<double>(taps - 1) / 2.0;
+  std::vector<double> values(taps);
+  double sum = 0.0;
+  for (std::size_t k = 0; k < taps; ++k) {
+    const double t = static_cast<double>(k) - middle;
+    const double x = 2.0 * std::numbers::pi * cutoff * t;
+    const double sinc = t == 0.0 ? 1.0 : std::sin(x) / x;
+    const double phase = 2.0 * std::numbers::pi * static_cast<double>(k) / static_cast<double>(taps - 1 + (taps == 1));
+    const double window = 0.42 - 0.5 * std::cos(phase) + 0.08 * std::cos(2.0 * phase);
+    values[k] = sinc * (taps == 1 ? 1.0 : window);
+    sum += values[k];
+  }
+  std::vector<float> filter(taps);
+  for (std::size_t k = 0; k < taps; ++k) { filter[k] = static_cast<float>(values[k] * static_cast<double>(up) / sum); }
+  return filter;
+}
+
+/**
+ * @brief Polyphase resampler by `up / down`, whole signals or streams.
+ * @details The filter is split once into `up` phase tables of `phaseLength()`
+ *  taps each (`filter[r + i·up]`, zero-padded). Output k uses phase
+ *  r(k) = -(k·M - K/2) mod L, and both r and the input offset
+ *  relative to output k - L, repeats every L outputs. So outputs are run in
+ *  blocks: input is split into M planes (`plane[s][t] = x[t·M + s]`), after
+ *  which the outputs k ≡ ρ (mod L) of a block are, tap by tap, an axpy of
+ *  one contiguous plane row, vectorised across `kVectorOutputs` outputs.
+ *
+ *  For streams, `process` takes blocks of any size and appends every output
+ *  whose window is complete; `flush` ends the stream with zeros, so
+ *  `process` + `flush` over a whole signal gives `resample`, to rounding.
+ *  Stream state is meant for one stream on one thread.
+ */
+class Resampler {
+public:
+  /// @brief Outputs of one residue class per block.
+  static constexpr std::size_t kBlockOutputs = 512;
+  /// @brief Outputs one vectorised accumulator covers.
+  static constexpr std::size_t kVectorOutputs = 64;
+
+  Resampler(std::size_t up, std::size_t down, std::span<const float> filter)
+    : up_(up), down_(down), taps_(filter.size()), center_(filter.size() / 2),
+      dot_(reduce::leaves(reduce::activeIsa()).dot) {
+    if (up == 0 || down == 0) {
+      throw std::runtime_error(
+        "Resampling needs non-zero factors, got " + std::to_string(up) + "/" + std::to_string(down) + ".");
+    }
+    requireMask(filter.size());
+    phaseLength_ = (taps_ + up_ - 1) / up_;
+    phases_.assign(up_ * phaseLength_, 0.0f);
+    for (std::size_t r = 0; r < up_; ++r) {
+      for (std::size_t i = 0; r + i * up_ < taps_; ++i) { phases_[r * phaseLength_ + i] = filter[r + i * up_]; }
+    }
+
+    // * Tap i of residue ρ reads input base(ρ) - base(0) + i of the block:
+    // * plane (that mod M), row (that div M).
+    const std::ptrdiff_t first = tap(0).base;
+    residues_.reserve(up_ + 1);
+    for (std::size_t rho = 0; rho < up_; ++rho) {
+      residues_.push_back(blockTaps_.size());
+      const auto [phase, base] = tap(rho);
+      const auto offset = static_cast<std::size_t>(base - first);
+      for (std::size_t i = 0; i < phaseLength_; ++i) {
+        if (phase[i] == 0.0f) { continue; }
+        blockTaps_.push_back({(offset + i) % down_, (offset + i) / down_, phase[i]});
+      }
+      reach_ = std::max(reach_, offset + phaseLength_);
+    }
+    residues_.push_back(blockTaps_.size());
+    planeLength_ = kBlockOutputs + (reach_ + down_ - 1) / down_;
+    reset();
+  }
+
+  /// @brief `up / down` with the default `resamplingFilter`.
+  Resampler(std::size_t up, std::size_t down) : Resampler(up, down, resamplingFilter(up, down)) {}
+
+  auto up() const -> std::size_t { return up_; }
+  auto down() const -> std::size_t { return down_; }
+  /// @brief Multiply-adds per output.
+  auto phaseLength() const -> std::size_t { return phaseLength_; }
+  /// @brief `ceil(n · up / down)`.
+  auto outputSize(std::size_t n) const -> std::size_t { return (n * up_ + down_ - 1) / down_; }
+
+  /// @brief A whole signal into `out`, which holds `outputSize(signal.size())`.
+  auto resample(std::span<const float> signal, std::span<float> out, Boundary boundary = Boundary::Zero) const -> void {
+    if (out.size() != outputSize(signal.size())) {
+      throw std::runtime_error(
+        "Resampling " + std::to_string(signal.size()) + " samples by " + std::to_string(up_) + "/" +
+        std::to_string(down_) + " gives " + std::to_string(outputSize(signal.size())) + " outputs, not " +
+        std::to_string(out.size()) + ".");
+    }
+    const std::size_t perBlock = kBlockOutputs * up_;
+    const std::size_t blocks = (out.size() + perBlock - 1) / perBlock;
+    const std::size_t inputs = planeLength_ * down_;
+    const auto n = static_cast<std::ptrdiff_t>(signal.size());
+    ThreadPool::global().parallelFor(blocks, 1, [&](std::size_t begin, std::size_t end) {
+      std::vector<float> planes, gathered;
+      for (std::size_t b = begin; b < end; ++b) {
+        const std::size_t k0 = b * perBlock;
+        const std::ptrdiff_t base = tap(k0).base;
+        const float* input = signal.data() + std::clamp<std::ptrdiff_t>(base, 0, n);
+        if (base < 0 || base + static_cast<std::ptrdiff_t>(inputs) > n) {
+          // * Block past an end of the signal: gather it through the boundary rule.
+          gathered.resize(inputs);
+          const auto count = static_cast<std::ptrdiff_t>(inputs);
+          const std::ptrdiff_t lo = std::clamp<std::ptrdiff_t>(-base, 0, count);
+          const std::ptrdiff_t hi = std::clamp<std::ptrdiff_t>(n - base, lo, count);
+          for (std::ptrdiff_t i = 0; i < lo; ++i) { gathered[i] = sampleAt(signal, base + i, boundary); }
+          std::copy(signal.begin() + (base + lo), signal.begin() + (base + hi), gathered.begin() + lo);
+          for (std::ptrdiff_t i = hi; i < count; ++i) { gathered[i] = sampleAt(signal, base + i, boundary); }
+          input = gathered.data();
+        }
+        runBlock(input, inputs, std::min(perBlock, out.size() - k0), out.data() + k0, planes);
+      }
+    });
+  }
+
+  /// @brief Appends to `out` every output of the stream that `in` completes.
+  /// @return How many were appended.
+  auto process(std::span<const float> in, std::vector<float>& out) -> std::size_t {
+    if (history_.size() + in.size() > history_.capacity() && consumed_ > 0) {
+      // * Drop inputs no future window reads before growing.
+      history_.erase(history_.begin(), history_.begin() + consumed_);
+      origin_ += static_cast<std::ptrdiff_t>(consumed_);
+      consumed_ = 0;
+    }
+    history_.insert(history_.end(), in.begin(), in.end());
+    received_ += in.size();
+    return emit(std::numeric_limits<std::size_t>::max(), out);
+  }
+
+  /// @brief Ends the stream with zeros: appends its remaining outputs, up to
+  ///  `outputSize` of everything received. Call `reset` to reuse.
+  auto flush(std::vector<float>& out) -> std::size_t {
+    const std::size_t total = outputSize(received_);
+    if (produced_ >= total) { return 0; }
+    const std::ptrdiff_t needed = tap(total - 1).base + static_cast<std::ptrdiff_t>(phaseLength_) - available();
+    history_.insert(history_.end(), static_cast<std::size_t>(std::max<std::ptrdiff_t>(needed, 0)), 0.0f);
+    return emit(total, out);
+  }
+
+  /// @brief Back to the state of a new stream.
+  auto reset() -> void {
+    // * The first windows start before the stream: those inputs are zeros.
+    const auto lead = static_cast<std::ptrdiff_t>((center_ + up_ - 1) / up_);
+    history_.assign(static_cast<std::size_t>(lead), 0.0f);
+    history_.reserve(std::max<std::size_t>(4 * planeLength_ * down_, kDirectChunk));
+    origin_ = -lead;
+    consumed_ = 0;
+    received_ = 0;
+    produced_ = 0;
+  }
+
+private:
+  struct Tap {
+    const float* phase;
+    std::ptrdiff_t base;
+  };
+
+  // * Accumulators stay in registers across the taps (GCC/Clang vector
+  // * extension, split into narrower registers on narrower ISAs).
+  static constexpr std::size_t kVectorWidth = 16;
+  static constexpr std::size_t kAccumulators = kVectorOutputs / kVectorWidth;
+  typedef float Vector __attribute__((vector_size(kVectorWidth * sizeof(float))));
+
+  /// @brief One tap of a residue class in a block: plane, row, weight.
+  struct BlockTap {
+    std::size_t plane;
+    std::size_t row;
+    float weight;
+  };
+
+  static auto floorDiv(std::ptrdiff_t a, std::ptrdiff_t b) -> std::ptrdiff_t {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+  }
+
+  /// @brief Phase table and first input of output `k`: with q = k·M - K/2,
+  ///  the first tap landing on a real sample is r = -q mod L, at input (q + r) / L.
+  auto tap(std::size_t k) const -> Tap {
+    const auto L = static_cast<std::ptrdiff_t>(up_);
+    const std::ptrdiff_t q = static_cast<std::ptrdiff_t>(k * down_) - static_cast<std::ptrdiff_t>(center_);
+    const std::ptrdiff_t r = ((-q) % L + L) % L;
+    return {phases_.data() + static_cast<std::size_t>(r) * phaseLength_, (q + r) / L};
+  }
+
+  /**
+   * @brief Outputs `[0, count)` of a block starting at an output that is a
+   *  multiple of L; `input[0]` is its first input, and inputs past
+   *  `available` read as zeros.
+   */
+  auto runBlock(const float* input, std::size_t available, std::size_t count, float* out, std::vector<float>& planes) const -> void {
+    // * Only the rows the block's outputs reach, for short stream blocks.
+    const std::size_t M = down_;
+    const std::size_t columns = ((count + up_ - 1) / up_ + kVectorOutputs - 1) / kVectorOutputs * kVectorOutputs;
+    const std::size_t rows = std::min(planeLength_, columns + (reach_ + M - 1) / M);
+    planes.resize(M * rows);
+    for (std::size_t s = 0; s < M; ++s) {
+      float* plane = planes.data() + s * rows;
+      const std::size_t full = std::min(rows, available > s ? (available - s + M - 1) / M : 0);
+      for (std::size_t t = 0; t < full; ++t) { plane[t] = input[t * M + s]; }
+      std::fill(plane + full, plane + rows, 0.0f);
+    }
+
+    for (std::size_t rho = 0; rho < std::min(up_, count); ++rho) {
+      const std::size_t outputs = (count - rho + up_ - 1) / up_;
+      const std::span<const BlockTap> taps(blockTaps_.data() + residues_[rho], residues_[rho + 1] - residues_[rho]);
+      for (std::size_t j0 = 0; j0 < outputs; j0 += kVectorOutputs) {
+        Vector acc[kAccumulators] = {};
+        for (const BlockTap& t : taps) {
+          const float* row = planes.data() + t.plane * rows + t.row + j0;
+          for (std::size_t a = 0; a < kAccumulators; ++a) {
+            Vector x;
+            std::memcpy(&x, row + a * kVectorWidth, sizeof(Vector));
+            acc[a] += t.weight * x;
+          }
+        }
+        const std::size_t last = std::min(kVectorOutputs, outputs - j0);
+        for (std::size_t j = 0; j < last; ++j) { out[rho + (j0 + j) * up_] = acc[j / kVectorWidth][j % kVectorWidth]; }
+      }
+    }
+  }
+
+  auto available() const -> std::ptrdiff_t { return origin_ + static_cast<std::ptrdiff_t>(history_.size()); }
+
+  // * Outputs whose windows are all in `history_`, up to `limit` in total:
+  // * one dot product each until the next multiple of L, blocks from there.
+  auto emit(std::size_t limit, std::vector<float>& out) -> std::size_t {
+    const std::size_t before = produced_;
+    const auto L = static_cast<std::ptrdiff_t>(up_), M = static_cast<std::ptrdiff_t>(down_);
+    // * base(k) = ceil((k·M - K/2) / L) <= available - P.
+    const std::ptrdiff_t last = floorDiv((available() - static_cast<std::ptrdiff_t>(phaseLength_)) * L + static_cast<std::ptrdiff_t>(center_), M);
+    const std::size_t ready = std::min<std::size_t>(limit, static_cast<std::size_t>(std::max<std::ptrdiff_t>(last + 1, 0)));
+    for (; produced_ < ready && produced_ % up_ != 0; ++produced_) {
+      const auto [phase, base] = tap(produced_);
+      out.push_back(dot_(phase, history_.data() + (base - origin_), phaseLength_));
+    }
+    if (produced_ < ready) {
+      const std::size_t offset = out.size(), count = ready - produced_;
+      out.resize(offset + count);
+      for (std::size_t k = 0; k < count; k += kBlockOutputs * up_) {
+        const std::ptrdiff_t base = tap(produced_ + k).base;
+        const auto start = static_cast<std::size_t>(base - origin_);
+        runBlock(history_.data() + start, history_.size() - start, std::min(kBlockOutputs * up_, count - k), out.data() + offset + k, planes_);
+      }
+      produced_ = ready;
+    }
+    consumed_ = static_cast<std::size_t>(std::clamp<std::ptrdiff_t>(tap(produced_).base - origin_, 0, static_cast<std::ptrdiff_t>(history_.size())));
+    return produced_ - before;
+  }
+
+  std::size_t up_;
+  std::size_t down_;
+  std::size_t taps_;
+  std::size_t center_;
+  std::size_t phaseLength_ = 0;
+  std::vector<float> phases_;
+  float (*dot_)(const float*, const float*, std::size_t);
+
+  // * Block layout: taps of residue ρ are `blockTaps_[residues_[ρ], residues_[ρ + 1])`;
+  // * a block reads `reach_` inputs past its last residue-0 window start.
+  std::vector<BlockTap> blockTaps_;
+  std::vector<std::size_t> residues_;
+  std::size_t reach_ = 0;
+  std::size_t planeLength_ = 0;
+
+  // * Stream state: `history_[0]` is input `origin_` (negative for the
+  // * zeros before the stream); inputs before `consumed_` are no longer read.
+  std::vector<float> history_;
+  std::vector<float> planes_;
+  std::ptrdiff_t origin_ = 0;
+  std::size_t consumed_ = 0;
+  std::size_t received_ = 0;
+  std::size_t produced_ = 0;
+};
+
+/// @brief `signal` resampled by `up / down` with the default filter.
+inline auto resample(std::span<const float> signal, std::size_t up, std::size_t down, Boundary boundary = Boundary::Zero)
+  -> std::vector<float> {
+  const Resampler resampler(up, down);
+  std::vector<float> out(resampler.outputSize(signal.size()));
+  resampler.resample(signal, out, boundary);
+  return out;
+}
+
+}  // namespace compute::convolution
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#ifdef __APPLE__
+#include <sys/sysctl.h>
+#endif
+
+#include <benchmark/benchmark.h>
+
+#include "memory.hpp"
+#include "thread_pool.hpp"
+
+// * Memory-bandwidth roofline helpers for the benchmarks.
+// *
+// * A STREAM-style baseline (copy, scale, add, triad; McCalpin) measured on
+// * the same host gives the practical peak. Every bandwidth benchmark then
+// * reports the bytes it moves, the GB/s it reached and that rate as a
+// * fraction of the peak, as Google Benchmark counters. With
+// * `--benchmark_out=<file> --benchmark_out_format=csv|json` those counters
+// * land in the report, so regressions read as "fraction of peak" rather
+// * than nanoseconds.
+
+namespace compute::roofline {
+
+struct CacheSizes {
+  std::size_t l1 = 32 << 10;
+  std::size_t l2 = 1 << 20;
+  std::size_t llc = 8 << 20;  // * last level, whichever that is
+};
+
+/// @brief Data-cache sizes of this host, with conservative fallbacks.
+inline auto cacheSizes() -> CacheSizes {
+  CacheSizes sizes;
+#if defined(__APPLE__)
+  auto query = [](const char* name, std::size_t& out) {
+    std::uint64_t value = 0;
+    std::size_t length = sizeof(value);
+    if (::sysctlbyname(name, &value, &length, nullptr, 0) == 0 && value) { out = value; }
+  };
+  // * Apple silicon has no L3 exposed to the CPU; the P-cluster L2 is the LLC.
+  query("hw.l1dcachesize", sizes.l1);
+  query("hw.l2cachesize", sizes.l2);
+  sizes.llc = sizes.l2;
+  query("hw.perflevel0.l2cachesize", sizes.llc);
+  query("hw.l3cachesize", sizes.llc);
+#elif defined(_SC_LEVEL1_DCACHE_SIZE)
+  auto query = [](int name, std::size_t& out) {
+    const long value = ::sysconf(name);
+    if (value > 0) { out = static_cast<std::size_t>(value); }
+  };
+  query(_SC_LEVEL1_DCACHE_SIZE, sizes.l1);
+  query(_SC_LEVEL2_CACHE_SIZE, sizes.l2);
+  sizes.llc = sizes.l2;
+  query(_SC_LEVEL3_CACHE_SIZE, sizes.llc);
+#endif
+  return sizes;
+}
+
+/// @brief Largest per-array size worth sweeping: three arrays must fit in RAM.
+inline auto maxArrayBytes() -> std::size_t {
+  const long pages = ::sysconf(_SC_PHYS_PAGES);
+  const std::size_t physical = pages > 0
+    ? static_cast<std::size_t>(pages) * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE))
+    : std::size_t{8} << 30;
+  return physical / 8;
+}
+
+/**
+ * @brief Per-array element counts (floats) from L1-resident to well past the
+ *  LLC: powers of two from 4 KiB up to `max(8 * LLC, 256 MiB)` (capped by
+ *  `maxArrayBytes`), plus a point just under each cache size.
+ */
+inline auto sweepSizes() -> std::vector<std::int64_t> {
+  const CacheSizes caches = cacheSizes();
+  const std::size_t top = std::min(
+    std::max<std::size_t>(8 * caches.llc, std::size_t{256} << 20), maxArrayBytes());
+  std::vector<std::int64_t> sizes;
+  for (std::size_t bytes = 4 << 10; bytes <= top; bytes *= 2) {
+    sizes.push_back(static_cast<std::int64_t>(bytes / sizeof(float)));
+  }
+  // * Three arrays in flight: a third of each cache keeps the working set in it.
+  for (std::size_t cache : {caches.l1, caches.l2, caches.llc}) {
+    if (cache / 3 <= top) { sizes.push_back(static_cast<std::int64_t>(cache / 3 / sizeof(float))); }
+  }
+  std::sort(sizes.begin(), sizes.end());
+  sizes.erase(std::unique(sizes.begin(), sizes.end()), sizes.end());
+  return sizes;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * STREAM kernels ...
+///////////////////////////////////////////////////////////////////////////////
+
+enum class StreamOp { Copy, Scale, Add, Triad };
+
+inline auto streamOpName(StreamOp op) -> const char* {
+  switch (op) {
+    case StreamOp::Copy:  return "copy";
+    case StreamOp::Scale: return "scale";
+    case StreamOp::Add:   return "add";
+    case StreamOp::Triad: return "triad";
+  }
+  return "?";
+}
+
+/// @brief Bytes STREAM counts for one pass over `n` floats (reads + writes).
+constexpr auto streamBytes(StreamOp op, std::size_t n) -> std::size_t {
+  const std::size_t arrays = (op == StreamOp::Add || op == StreamOp::Triad) ? 3 : 2;
+  return arrays * n * sizeof(float);
+}
+
+// * Same chunking as the elementwise kernels, so both sides see the same pool overhead.
+constexpr std::size_t kStreamChunk = std::size_t{1} << 15;
+
+/**
+ * @brief One STREAM pass, as plain loops left to the compiler:
+ *  copy `c = a`, scale `b = q*c`, add `c = a + b`, triad `a = b + q*c`.
+ */
+inline auto stream(StreamOp op, float* a, float* b, float* c, std::size_t n, float q) -> void {
+  ThreadPool::global().parallelFor(n, kStreamChunk, [=](std::size_t begin, std::size_t end) {
+    switch (op) {
+      case StreamOp::Copy:  for (std::size_t i = begin; i < end; ++i) { c[i] = a[i]; } break;
+      case StreamOp::Scale: for (std::size_t i = begin; i < end; ++i) { b[i] = q * c[i]; } break;
+      case StreamOp::Add:   for (std::size_t i = begin; i < end; ++i) { c[i] = a[i] + b[i]; } break;
+      case StreamOp::Triad: for (std::size_t i = begin; i < end; ++i) { a[i] = b[i] + q * c[i]; } break;
+    }
+  });
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Peak and counters ...
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Best STREAM triad rate (bytes/s) over a few passes on arrays well
+ *  past the LLC. Measured on the first call, then cached.
+ */
+inline auto peakBandwidth() -> double {
+  static const double peak = [] {
+    const std::size_t bytes = std::min(
+      std::max<std::size_t>(4 * cacheSizes().llc, std::size_t{64} << 20), maxArrayBytes());
+    const std::size_t n = bytes / sizeof(float);
+    PageVector<float> a(n), b(n), c(n);
+    stream(StreamOp::Copy, a.data(), b.data(), c.data(), n, 0.0f);  // * fault the pages in
+    std::fill(a.begin(), a.end(), 1.0f);
+    std::fill(b.begin(), b.end(), 2.0f);
+    std::fill(c.begin(), c.end(), 0.5f);
+    double best = 0.0;
+    for (int pass = 0; pass < 5; ++pass) {
+      const auto start = std::chrono::steady_clock::now();
+      stream(StreamOp::Triad, a.data(), b.data(), c.data(), n, 3.0f);
+      const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      best = std::max(best, static_cast<double>(streamBytes(StreamOp::Triad, n)) / elapsed.count());
+    }
+    return best;
+  }();
+  return peak;
+}
+
+/**
+ * @brief Adds the roofline counters to a finished benchmark run:
+ *  `bytes` moved per iteration, `bandwidth` (bytes/s, base 1000 so it reads
+ *  as GB/s) and `peak_fraction` (that rate over `peakBandwidth()`; the
+ *  console prints it with a `/s` suffix, the CSV/JSON value is the plain
+ *  ratio). Cache-resident sizes go above 1: the peak is the DRAM roof.
+ * @note Register the benchmark with `UseRealTime()`. Rates are per CPU
+ *  second otherwise, which overstates them when the work runs on pool
+ *  threads or the GPU.
+ */
+inline auto setBandwidthCounters(benchmark::State& state, std::size_t bytesPerIteration) -> void {
+  using benchmark::Counter;
+  const double total = static_cast<double>(bytesPerIteration) * static_cast<double>(state.iterations());
+  state.counters["bytes"] = Counter(static_cast<double>(bytesPerIteration), Counter::kDefaults, Counter::kIs1024);
+  state.counters["bandwidth"] = Counter(total, Counter::kIsRate, Counter::kIs1000);
+  state.counters["peak_fraction"] = Counter(total / peakBandwidth(), Counter::kIsRate);
+}
+
+/// @brief Records the host's caches and measured peak in the report context.
+inline auto addRooflineContext() -> void {
+  const CacheSizes caches = cacheSizes();
+  benchmark::AddCustomContext("l1d_bytes", std::to_string(caches.l1));
+  benchmark::AddCustomContext("l2_bytes", std::to_string(caches.l2));
+  benchmark::AddCustomContext("llc_bytes", std::to_string(caches.llc));
+  benchmark::AddCustomContext("peak_triad_GBps", std::format("{:.2f}", peakBandwidth() / 1e9));
+}
+
+}  // namespace compute::roofline
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "elementwise.hpp"
+#include "memory.hpp"
+
+// * Out-of-core elementwise ops over memory-mapped files.
+// *
+// * Inputs and output are raw little-endian float files. They are processed
+// * a chunk at a time through short-lived `mmap` windows: at most two chunks
+// * (the one being computed and the one being loaded) are mapped per file, so
+// * memory stays bounded however large the files are. While chunk N is being
+// * computed, a helper thread maps chunk N+1, hints the kernel
+// * (`MADV_WILLNEED`) and touches one byte per page so the reads are in flight
+// * or done by the time the compute gets there.
+
+namespace compute::streaming {
+
+/// @brief An open file descriptor, closed on destruction.
+class File {
+public:
+  File(const std::filesystem::path& path, int flags, mode_t mode = 0644)
+    : fd_(::open(path.c_str(), flags, mode)) {
+    if (fd_ < 0) {
+      throw std::runtime_error("Couldn't open '" + path.string() + "': " + std::strerror(errno));
+    }
+  }
+  File(const File&) = delete;
+  auto operator=(const File&) -> File& = delete;
+  ~File() { ::close(fd_); }
+
+  auto fd() const -> int { return fd_; }
+  auto size() const -> std::size_t {
+    struct stat st {};
+    ::fstat(fd_, &st);
+    return static_cast<std::size_t>(st.st_size);
+  }
+
+private:
+  int fd_;
+};
+
+/**
+ * @brief A mapping of `[offset, offset + length)` of a file, unmapped on
+ *  destruction. `offset` must be page-aligned.
+ */
+class Window {
+public:
+  Window() = default;
+  Window(const File& file, std::size_t offset, std::size_t length, bool writable)
+    : length_(roundToPages(length)) {
+    const int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* p = ::mmap(nullptr, length_, prot, MAP_SHARED, file.fd(), static_cast<off_t>(offset));
+    if (p == MAP_FAILED) {
+      throw std::runtime_error(std::string("Couldn't map file window: ") + std::strerror(errno));
+    }
+    data_ = static_cast<std::byte*>(p);
+    ::madvise(data_, length_, MADV_SEQUENTIAL);
+  }
+  Window(Window&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr)), length_(std::exchange(other.length_, 0)) {}
+  auto operator=(Window&& other) noexcept -> Window& {
+    std::swap(data_, other.data_);
+    std::swap(length_, other.length_);
+    return *this;
+  }
+  ~Window() {
+    if (data_) { ::munmap(data_, length_); }
+  }
+
+  auto data() const -> std::byte* { return data_; }
+  auto length() const -> std::size_t { return length_; }
+
+  /// @brief Asks for the pages and faults them in, one read per page.
+  auto prefetch(std::size_t bytes) const -> void {
+    ::madvise(data_, length_, MADV_WILLNEED);
+    const std::size_t page = pageSize();
+    volatile std::byte sink{};
+    for (std::size_t at = 0; at < bytes; at += page) { sink = data_[at]; }
+    (void)sink;
+  }
+
+private:
+  std::byte* data_ = nullptr;
+  std::size_t length_ = 0;
+};
+
+/// @brief Sustained figures for one streaming run.
+struct Stats {
+  std::size_t elements = 0;
+  std::size_t chunks = 0;
+  std::size_t bytesMoved = 0;   // * inputs read + output written
+  std::size_t mappedBytes = 0;  // * most bytes mapped at any one time
+  double seconds = 0.0;
+
+  auto bytesPerSecond() const -> double { return seconds > 0.0 ? bytesMoved / seconds : 0.0; }
+};
+
+/// @brief Computes one chunk: `out[i] = f(a[i], b[i])` for `i < n`.
+using ChunkKernel = std::function<void(const float* a, const float* b, float* out, std::size_t n)>;
+
+/// @brief Default chunk: the SIMD, multithreaded `elementwise::add`.
+inline auto addChunk(const float* a, const float* b, float* out, std::size_t n) -> void {
+  elementwise::add({a, n}, {b, n}, {out, n});
+}
+
+// * 64 MiB per file per chunk: large enough to amortise the mapping and
+// * thread hand-off, small enough that 2 chunks x 3 files stay well under 1 GiB.
+constexpr std::size_t kDefaultChunkBytes = std::size_t{64} << 20;
+
+/**
+ * @brief `out = kernel(a, b)` over two float files of equal size, streamed in
+ *  chunks of `chunkBytes` (rounded to whole pages).
+ * @details `out` is created or truncated to the inputs' size. Loading chunk
+ *  N+1 overlaps with computing chunk N; at most two chunks per file are
+ *  mapped at once. Output pages are released with `msync(MS_ASYNC)` as each
+ *  chunk is unmapped, so the kernel writes them back in the background.
+ * @throws std::runtime_error if the inputs differ in size or can't be mapped.
+ */
+inline auto binary(
+  const std::filesystem::path& pathA,
+  const std::filesystem::path& pathB,
+  const std::filesystem::path& pathOut,
+  const ChunkKernel& kernel = addChunk,
+  std::size_t chunkBytes = kDefaultChunkBytes) -> Stats {
+  const File a(pathA, O_RDONLY);
+  const File b(pathB, O_RDONLY);
+  const std::size_t bytes = a.size();
+  if (b.size() != bytes || bytes % sizeof(float) != 0) {
+    throw std::runtime_error(
+      "Streaming inputs must be float files of equal size: " +
+      std::to_string(bytes) + " vs " + std::to_string(b.size()) + " bytes.");
+  }
+  const File out(pathOut, O_RDWR | O_CREAT | O_TRUNC);
+  if (::ftruncate(out.fd(), static_cast<off_t>(bytes)) != 0) {
+    throw std::runtime_error(std::string("Couldn't size output file: ") + std::strerror(errno));
+  }
+
+  chunkBytes = std::max(roundToPages(chunkBytes), pageSize());
+  const std::size_t chunks = (bytes + chunkBytes - 1) / chunkBytes;
+
+  struct Chunk {
+    Window a, b, out;
+    std::size_t bytes = 0;
+  };
+  auto load = [&](std::size_t index) {
+    Chunk chunk;
+    const std::size_t offset = index * chunkBytes;
+    chunk.bytes = std::min(chunkBytes, bytes - offset);
+    chunk.a   = Window(a,   offset, chunk.bytes, false);
+    chunk.b   = Window(b,   offset, chunk.bytes, false);
+    chunk.out = Window(out, offset, chunk.bytes, true);
+    chunk.a.prefetch(chunk.bytes);
+    chunk.b.prefetch(chunk.bytes);
+    return chunk;
+  };
+
+  Stats stats;
+  stats.elements = bytes / sizeof(float);
+  stats.chunks = chunks;
+  stats.bytesMoved = 3 * bytes;
+
+  const auto start = std::chrono::steady_clock::now();
+  std::future<Chunk> next;
+  if (chunks > 0) { next = std::async(std::launch::async, load, std::size_t{0}); }
+  for (std::size_t i = 0; i < chunks; ++i) {
+    Chunk current = next.get();
+    if (i + 1 < chunks) { next = std::async(std::launch::async, load, i + 1); }
+    stats.mappedBytes = std::max(
+      stats.mappedBytes, 3 * (current.a.length() + (i + 1 < chunks ? chunkBytes : 0)));
+
+    kernel(
+      reinterpret_cast<const float*>(current.a.data()),
+      reinterpret_cast<const float*>(current.b.data()),
+      reinterpret_cast<float*>(current.out.data()),
+      current.bytes / sizeof(float));
+    ::msync(current.out.data(), current.out.length(), MS_ASYNC);
+  }
+  stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return stats;
+}
+
+/**
+ * @brief Writes `elements` floats to `path`, produced `chunkBytes` at a time
+ *  by `fill(chunk, firstIndex)`, so test inputs of any size can be made in
+ *  bounded memory.
+ */
+inline auto writeFloats(
+  const std::filesystem::path& path,
+  std::size_t elements,
+  const std::function<void(std::span<float>, std::size_t)>& fill,
+  std::size_t chunkBytes = kDefaultChunkBytes) -> void {
+  const File file(path, O_RDWR | O_CREAT | O_TRUNC);
+  const std::size_t chunkElements = std::max<std::size_t>(chunkBytes / sizeof(float), 1);
+  PageVector<float> buffer(std::min(chunkElements, elements));
+  for (std::size_t first = 0; first < elements; first += chunkElements) {
+    const std::size_t n = std::min(chunkElements, elements - first);
+    fill(std::span(buffer.data(), n), first);
+    const auto* p = reinterpret_cast<const char*>(buffer.data());
+    std::size_t left = n * sizeof(float);
+    while (left > 0) {
+      const ssize_t written = ::write(file.fd(), p, left);
+      if (written < 0) {
+        throw std::runtime_error("Couldn't write '" + path.string() + "': " + std::strerror(errno));
+      }
+      p += written;
+      left -= static_cast<std::size_t>(written);
+    }
+  }
+}
+
+}  // namespace compute::streaming
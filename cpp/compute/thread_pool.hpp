@@ -0,0 +1,300 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace compute {
+
+/**
+ * @brief Fixed-size pool of worker threads for data-parallel loops.
+ * @details The calling thread takes part in every `parallelFor`, so a pool of
+ *  size N spawns N-1 workers. Workers sleep between jobs; keeping them alive
+ *  means repeated dispatches don't pay for thread creation.
+ *
+ *  Chunks are scheduled by work stealing: each thread starts with its own
+ *  contiguous run of chunks and takes them front to back, so neighbouring
+ *  chunks (which tend to share data) stay on one core. A thread that runs
+ *  out steals the back half of another thread's remaining run.
+ *
+ *  Nested `parallelFor` calls (from inside a running chunk) run serially on
+ *  the calling thread instead of deadlocking on the pool.
+ *
+ *  With `pin`, worker i is bound to logical CPU i (Linux only; elsewhere the
+ *  request is ignored). The calling thread keeps its own affinity.
+ */
+class ThreadPool {
+public:
+  explicit ThreadPool(std::size_t threadCount = defaultThreadCount(), bool pin = defaultPinning())
+    : slots_(std::make_unique<Slot[]>(std::max<std::size_t>(threadCount, 1))) {
+    threadCount = std::max<std::size_t>(threadCount, 1);
+    workers_.reserve(threadCount - 1);
+    for (std::size_t i = 1; i < threadCount; ++i) {
+      workers_.emplace_back([this, i, pin] {
+        if (pin) { pinned_ += pinToCpu(i) ? 1 : 0; }
+        workerLoop(i);
+      });
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  auto operator=(const ThreadPool&) -> ThreadPool& = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard lock(mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_) { worker.join(); }
+  }
+
+  /// @brief Number of threads that execute chunks, including the caller.
+  auto size() const -> std::size_t { return workers_.size() + 1; }
+
+  /**
+   * @brief Threads (the caller included) that ran at least one chunk of the
+   *  last top-level `parallelFor`; never more than its chunk count.
+   */
+  auto threadsUsed() const -> std::size_t { return threadsUsed_.load(); }
+
+  /// @brief Workers bound to a core so far (0 unless constructed with `pin`).
+  auto pinnedWorkers() const -> std::size_t { return pinned_.load(); }
+
+  /**
+   * @brief Splits `[0, count)` into chunks of `grain` and runs `fn(begin, end)`
+   *  on each chunk across the pool. Blocks until every chunk has finished.
+   * @note The first exception thrown by a chunk is rethrown on the caller.
+   */
+  template <typename Fn>
+  auto parallelFor(std::size_t count, std::size_t grain, Fn&& fn) -> void {
+    if (count == 0) { return; }
+    // * Chunk indices are packed two to a 64-bit word, so at most 2^32 - 1.
+    constexpr std::size_t kMaxChunks = std::numeric_limits<std::uint32_t>::max();
+    grain = std::max({grain, std::size_t{1}, (count + kMaxChunks - 1) / kMaxChunks});
+    const std::size_t chunks = (count + grain - 1) / grain;
+    if (chunks == 1 || workers_.empty() || insideJob()) {
+      if (!insideJob()) { threadsUsed_ = 1; }
+      fn(std::size_t{0}, count);
+      return;
+    }
+
+    Job job;
+    job.count = count;
+    job.grain = grain;
+    job.chunks = chunks;
+    job.context = static_cast<void*>(&fn);
+    job.invoke = [](void* ctx, std::size_t begin, std::size_t end) {
+      (*static_cast<std::remove_reference_t<Fn>*>(ctx))(begin, end);
+    };
+
+    std::lock_guard submit(submitMutex_);
+    const std::size_t threads = size();
+    for (std::size_t t = 0; t < threads; ++t) {
+      slots_[t].range.store(packRange(chunks * t / threads, chunks * (t + 1) / threads));
+    }
+    {
+      std::lock_guard lock(mutex_);
+      job_ = &job;
+      ++generation_;
+    }
+    wake_.notify_all();
+
+    runChunks(job, 0);
+
+    {
+      std::unique_lock lock(mutex_);
+      job_ = nullptr;
+      done_.wait(lock, [&] { return activeWorkers_ == 0; });
+    }
+    threadsUsed_ = job.participants.load();
+    if (job.error) { std::rethrow_exception(job.error); }
+  }
+
+  /// @brief Same as above, with the grain picked so each thread gets a few chunks.
+  template <typename Fn>
+  auto parallelFor(std::size_t count, Fn&& fn) -> void {
+    const std::size_t grain = std::max<std::size_t>(1, count / (size() * 4));
+    parallelFor(count, grain, std::forward<Fn>(fn));
+  }
+
+  /**
+   * @brief Thread count from `REPOUSSE_THREADS`, falling back to the number
+   *  of hardware threads.
+   */
+  static auto defaultThreadCount() -> std::size_t {
+    if (const char* env = std::getenv("REPOUSSE_THREADS")) {
+      const long requested = std::strtol(env, nullptr, 10);
+      if (requested > 0) { return static_cast<std::size_t>(requested); }
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  /// @brief `REPOUSSE_PIN` set to anything but empty or `0`.
+  static auto defaultPinning() -> bool {
+    const char* env = std::getenv("REPOUSSE_PIN");
+    return env && *env && std::string_view(env) != "0";
+  }
+
+  /// @brief Binds the calling thread to logical CPU `cpu` (modulo the CPU count). False where unsupported.
+  static auto pinToCpu(std::size_t cpu) -> bool {
+#ifdef __linux__
+    const std::size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % std::min<std::size_t>(cpus, CPU_SETSIZE), &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    // * macOS only offers affinity hints between threads, not binding.
+    (void)cpu;
+    return false;
+#endif
+  }
+
+  /// @brief Process-wide pool shared by the CPU backend and CPU kernels.
+  static auto global() -> ThreadPool& {
+    static ThreadPool pool;
+    return pool;
+  }
+
+private:
+  struct Job {
+    std::size_t count = 0;
+    std::size_t grain = 0;
+    std::size_t chunks = 0;
+    void* context = nullptr;
+    void (*invoke)(void*, std::size_t, std::size_t) = nullptr;
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    std::atomic<std::size_t> participants{0};
+  };
+
+  /// @brief One thread's remaining chunks [begin, end), as `begin << 32 | end`.
+  struct alignas(64) Slot {
+    std::atomic<std::uint64_t> range{0};
+  };
+
+  static auto packRange(std::size_t begin, std::size_t end) -> std::uint64_t {
+    return std::uint64_t(begin) << 32 | std::uint64_t(end);
+  }
+  static auto rangeBegin(std::uint64_t range) -> std::size_t { return static_cast<std::size_t>(range >> 32); }
+  static auto rangeEnd(std::uint64_t range) -> std::size_t { return static_cast<std::size_t>(range & 0xFFFFFFFFu); }
+
+  static auto insideJob() -> bool& {
+    thread_local bool inside = false;
+    return inside;
+  }
+
+  /// @brief Next chunk from the front of thread `self`'s own run.
+  auto takeOwn(std::size_t self, std::size_t& chunk) -> bool {
+    std::atomic<std::uint64_t>& own = slots_[self].range;
+    std::uint64_t range = own.load();
+    while (rangeBegin(range) < rangeEnd(range)) {
+      if (own.compare_exchange_weak(range, packRange(rangeBegin(range) + 1, rangeEnd(range)))) {
+        chunk = rangeBegin(range);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief Moves the back half of another thread's run into `self`'s (empty)
+   *  slot and returns its first chunk. False once every run is empty.
+   */
+  auto steal(std::size_t self, std::size_t& chunk) -> bool {
+    const std::size_t threads = size();
+    for (std::size_t i = 1; i < threads; ++i) {
+      std::atomic<std::uint64_t>& victim = slots_[(self + i) % threads].range;
+      std::uint64_t range = victim.load();
+      while (rangeBegin(range) < rangeEnd(range)) {
+        const std::size_t begin = rangeBegin(range), end = rangeEnd(range);
+        const std::size_t split = end - (end - begin + 1) / 2;
+        if (victim.compare_exchange_weak(range, packRange(begin, split))) {
+          // * Only the owner stores into its own slot, and only while it is empty.
+          slots_[self].range.store(packRange(split + 1, end));
+          chunk = split;
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  auto runChunks(Job& job, std::size_t self) -> void {
+    insideJob() = true;
+    std::size_t chunk = 0;
+    bool counted = false;
+    while (takeOwn(self, chunk) || steal(self, chunk)) {
+      if (!counted) {
+        ++job.participants;
+        counted = true;
+      }
+      const std::size_t begin = chunk * job.grain;
+      const std::size_t end = std::min(begin + job.grain, job.count);
+      try {
+        job.invoke(job.context, begin, end);
+      } catch (...) {
+        std::lock_guard lock(job.errorMutex);
+        if (!job.error) { job.error = std::current_exception(); }
+      }
+    }
+    insideJob() = false;
+  }
+
+  auto workerLoop(std::size_t self) -> void {
+    std::size_t seenGeneration = 0;
+    while (true) {
+      Job* job = nullptr;
+      {
+        std::unique_lock lock(mutex_);
+        wake_.wait(lock, [&] { return stopping_ || generation_ != seenGeneration; });
+        if (stopping_) { return; }
+        seenGeneration = generation_;
+        job = job_;
+        if (!job) { continue; }
+        ++activeWorkers_;
+      }
+
+      runChunks(*job, self);
+
+      {
+        std::lock_guard lock(mutex_);
+        --activeWorkers_;
+      }
+      done_.notify_one();
+    }
+  }
+
+  std::unique_ptr<Slot[]> slots_;
+  std::atomic<std::size_t> pinned_{0};
+  std::atomic<std::size_t> threadsUsed_{0};
+  std::vector<std::thread> workers_;
+  std::mutex submitMutex_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  Job* job_ = nullptr;
+  std::size_t generation_ = 0;
+  std::size_t activeWorkers_ = 0;
+  bool stopping_ = false;
+};
+
+}  // namespace compute
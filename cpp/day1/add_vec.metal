@@ -19,3 +19,28 @@ kernel void vector_add(
 ) {
   out[gid] = inA[gid] + inB[gid];
 }
+
+// * Reduced-precision storage: the inputs and output are 16-bit, the add is
+// * done in fp32 and rounded once on the way out.
+kernel void vector_add_half(
+  device const half* inA [[ buffer(0) ]],
+  device const half* inB [[ buffer(1) ]],
+  device       half* out [[ buffer(2) ]],
+  uint gid [[ thread_position_in_grid ]]
+) {
+  out[gid] = half(float(inA[gid]) + float(inB[gid]));
+}
+
+// * bf16 as raw `ushort` bits (the `bfloat` type needs MSL 3.1): the top
+// * half of an fp32, widened with a shift and narrowed rounding to nearest even.
+kernel void vector_add_bf16(
+  device const ushort* inA [[ buffer(0) ]],
+  device const ushort* inB [[ buffer(1) ]],
+  device       ushort* out [[ buffer(2) ]],
+  uint gid [[ thread_position_in_grid ]]
+) {
+  const float sum = as_type<float>(uint(inA[gid]) << 16) + as_type<float>(uint(inB[gid]) << 16);
+  const uint bits = as_type<uint>(sum);
+  out[gid] = isnan(sum) ? ushort((bits >> 16) | 0x40u)
+                        : ushort((bits + 0x7fffu + ((bits >> 16) & 1u)) >> 16);
+}
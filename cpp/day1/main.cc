@@ -1,113 +1,144 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <memory>
 #include <print>
 #include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
-#include <random>
+#include <version>
+#ifdef __cpp_lib_parallel_algorithm
+#include <execution>
+#include <numeric>
+#endif
 
 #include <benchmark/benchmark.h>
 
+#ifdef __APPLE__
 #define NS_PRIVATE_IMPLEMENTATION
 #define MTL_PRIVATE_IMPLEMENTATION
 #include "../Metal.hpp"
+#endif
+#include "../compute/context.hpp"
+#include "../compute/elementwise.hpp"
+#include "../compute/expression.hpp"
+#include "../compute/memory.hpp"
+#include "../compute/precision.hpp"
+#include "../compute/random.hpp"
+#include "../compute/reduce.hpp"
+#include "../compute/reduce_device.hpp"
+#include "../compute/roofline.hpp"
+#include "../compute/streaming.hpp"
 
-std::vector<float> genVec (unsigned int vecLength) {
-  std::vector<float> v;
-  v.reserve(vecLength);
-  std::mt19937 gen(42);
-  std::uniform_real_distribution<float> dis(0.0f, 1.0f);
-  for (unsigned int i = 0; i < vecLength; ++i) {
-    v.push_back(dis(gen));
-  }
+// * Counter-based (Philox) fill: parallel, SIMD-wide, and the same values for
+// * a given seed whatever the thread count.
+compute::PageVector<float> genVec (unsigned int vecLength, uint64_t seed = 42) {
+  compute::PageVector<float> v(vecLength);
+  compute::random::fillUniform(v, 0.0f, 1.0f, seed);
   return v;
 }
 
-void usingMetal(unsigned int vecLength) {
-  NS::AutoreleasePool* pAutoReleasePool = NS::AutoreleasePool::alloc()->init();
-  MTL::Device* pDevice = MTL::CreateSystemDefaultDevice();
-
-  // * Step 1: Load the Metal library from file
-  NS::Error* pError = nullptr;
-  MTL::Library* pLibrary = pDevice->newLibrary(NS::String::string("./add_vec.metallib", NS::UTF8StringEncoding), &pError);
-  if (!pLibrary) {
-    std::println("Failed to load Metal library: {}", pError ? pError->localizedDescription()->utf8String() : "Unknown error");
-    pDevice->release();
-    pAutoReleasePool->release();
-    return;
-  }
-
-  // * Step 2: Get the compute function
-  MTL::Function* pFunction = pLibrary->newFunction(NS::String::string("vector_add", NS::UTF8StringEncoding));
-  if (!pFunction) {
-    std::println("Failed to get compute function 'vector_add'");
-    pLibrary->release();
-    pDevice->release();
-    pAutoReleasePool->release();
-    return;
+// * The same values stored as `T`: generated in fp32, then rounded.
+template <compute::precision::Storage T>
+compute::PageVector<T> genVecAs (unsigned int vecLength, uint64_t seed = 42) {
+  if constexpr (std::is_same_v<T, float>) {
+    return genVec(vecLength, seed);
+  } else {
+    const compute::PageVector<float> wide = genVec(vecLength, seed);
+    compute::PageVector<T> v(vecLength);
+    compute::precision::narrow<T>(wide, v);
+    return v;
   }
+}
 
-  // * Step 3: Create the compute pipeline state
-  MTL::ComputePipelineState* pComputePipelineState = pDevice->newComputePipelineState(pFunction, &pError);
-  if (!pComputePipelineState) {
-    std::println("Failed to create compute pipeline state: {}", pError ? pError->localizedDescription()->utf8String() : "Unknown error");
-    pFunction->release();
-    pLibrary->release();
-    pDevice->release();
-    pAutoReleasePool->release();
-    return;
-  }
+// * Kernel in add_vec.metal for each storage type.
+template <compute::precision::Storage T>
+constexpr auto vectorAddKernel() -> const char* {
+  if constexpr (std::is_same_v<T, compute::precision::Half>)     { return "vector_add_half"; }
+  if constexpr (std::is_same_v<T, compute::precision::BFloat16>) { return "vector_add_bf16"; }
+  return "vector_add";
+}
 
-  // * Step 4: Create a command queue
-  MTL::CommandQueue* pCommandQueue = pDevice->newCommandQueue();
+// * Arrays, buffers and bindings for one vector_add over `T` storage; the
+// * pipeline comes from the context. The buffers borrow the arrays' pages, so
+// * the arrays are declared first and outlive them.
+template <compute::precision::Storage T = float>
+struct VectorAddJob {
+  compute::PageVector<T> vectorA;
+  compute::PageVector<T> vectorB;
+  compute::PageVector<T> vectorC;
+  std::unique_ptr<compute::Buffer> pBufferA;
+  std::unique_ptr<compute::Buffer> pBufferB;
+  std::unique_ptr<compute::Buffer> pBufferC;
+  compute::Arguments arguments;
+  size_t vecLength;
+};
 
-  // * Step 5: Create input and output buffers
-  std::vector<float> vectorA = genVec(vecLength);
-  std::vector<float> vectorB = genVec(vecLength);
-  std::vector<float> vectorC(vecLength, 0.0f);
+template <compute::precision::Storage T = float>
+auto prepareVectorAdd(compute::Context& context, unsigned int vecLength) -> VectorAddJob<T> {
+  compute::Device& device = context.device();
 
-  MTL::Buffer* pBufferA = pDevice->newBuffer(vectorA.data(), vectorA.size() * sizeof(float), MTL::ResourceStorageModeShared);
-  MTL::Buffer* pBufferB = pDevice->newBuffer(vectorB.data(), vectorB.size() * sizeof(float), MTL::ResourceStorageModeShared);
-  MTL::Buffer* pBufferC = pDevice->newBuffer(vectorC.data(), vectorC.size() * sizeof(float), MTL::ResourceStorageModeShared);
+  // * Step 1-3: Load the library and build the pipeline (the .metallib on
+  // * Metal, the registered C++ twins of its kernels on the CPU backend).
+  // * Both are cached by the context, so this is a lookup after the first call.
+  context.pipeline("./add_vec.metallib", vectorAddKernel<T>());
 
-  // * Step 6: Create command buffer and encoder
-  MTL::CommandBuffer* pCommandBuffer = pCommandQueue->commandBuffer();
-  MTL::ComputeCommandEncoder* pCommandEncoder = pCommandBuffer->computeCommandEncoder();
+  // * Step 5: Create input and output buffers. The arrays are page-aligned,
+  // * so the buffers wrap them in place instead of copying them.
+  VectorAddJob<T> job;
+  job.vecLength = vecLength;
+  job.vectorA = genVecAs<T>(vecLength);
+  job.vectorB = genVecAs<T>(vecLength, 43);
+  job.vectorC = compute::PageVector<T>(vecLength);
+  job.pBufferA = compute::wrapBuffer(device, job.vectorA);
+  job.pBufferB = compute::wrapBuffer(device, job.vectorB);
+  job.pBufferC = compute::wrapBuffer(device, job.vectorC);
 
-  // * Step 7: Set pipeline state and buffers
-  pCommandEncoder->setComputePipelineState(pComputePipelineState);
-  // *                      offset, index ▼
-  pCommandEncoder->setBuffer(pBufferA, 0, 0);
-  pCommandEncoder->setBuffer(pBufferB, 0, 1);
-  pCommandEncoder->setBuffer(pBufferC, 0, 2);
+  // * Step 6 & 7: Bind buffers
+  // *                              offset, index ▼
+  job.arguments.setBuffer(*job.pBufferA, 0, 0);
+  job.arguments.setBuffer(*job.pBufferB, 0, 1);
+  job.arguments.setBuffer(*job.pBufferC, 0, 2);
   // ! The index must correspond with the one defined in source MSL
+  return job;
+}
 
-  // * Step 8: Dispatch threads
-  MTL::Size gridSize(vecLength, 1, 1);
-  NS::UInteger threadGroupSize = pComputePipelineState->maxTotalThreadsPerThreadgroup();
-  if (threadGroupSize > vecLength) threadGroupSize = vecLength;
-  MTL::Size threadgroupSize(threadGroupSize, 1, 1);
-  pCommandEncoder->dispatchThreads(gridSize, threadgroupSize);
-
-  pCommandEncoder->endEncoding();
+template <compute::precision::Storage T>
+void dispatchVectorAdd(compute::Context& context, VectorAddJob<T>& job) {
+  compute::Pipeline& pipeline = context.pipeline("./add_vec.metallib", vectorAddKernel<T>());
 
-  // * Step 9: Commit and wait
-  pCommandBuffer->commit();
-  pCommandBuffer->waitUntilCompleted();
+  // * Step 8 & 9: Dispatch threads on the context's queue, commit and wait
+  size_t threadGroupSize = pipeline.maxTotalThreadsPerThreadgroup();
+  if (threadGroupSize > job.vecLength) threadGroupSize = job.vecLength;
+  context.queue().dispatchThreads(
+    pipeline, job.arguments, {job.vecLength, 1, 1}, {threadGroupSize, 1, 1});
+}
 
-  // * Step 10: Cleanup
-  pBufferA->release();
-  pBufferB->release();
-  pBufferC->release();
-  pCommandQueue->release();
-  pComputePipelineState->release();
-  pFunction->release();
-  pLibrary->release();
-  pDevice->release();
-  pAutoReleasePool->release();
+void usingDevice(compute::Context& context, unsigned int vecLength) {
+  VectorAddJob<> job = prepareVectorAdd(context, vecLength);
+  dispatchVectorAdd(context, job);
+  // * Step 10: Buffers are released with `job`; the pipeline stays cached
 }
 
 void usingCPU(unsigned int vecLength) {
-  std::vector<float> vectorA = genVec(vecLength);
-  std::vector<float> vectorB = genVec(vecLength);
-  std::vector<float> vectorC(vecLength);
+  compute::PageVector<float> vectorA = genVec(vecLength);
+  compute::PageVector<float> vectorB = genVec(vecLength, 43);
+  compute::PageVector<float> vectorC(vecLength);
+
+  // * SIMD kernel for this CPU's ISA, spread across the thread pool
+  compute::elementwise::add(vectorA, vectorB, vectorC);
+  return;
+}
+
+// * The original loop, kept to show what the autovectorizer manages alone.
+void usingCPUScalar(unsigned int vecLength) {
+  compute::PageVector<float> vectorA = genVec(vecLength);
+  compute::PageVector<float> vectorB = genVec(vecLength, 43);
+  compute::PageVector<float> vectorC(vecLength);
 
   for (size_t i = 0; i < vecLength; ++i) {
     vectorC[i] = vectorA[i] + vectorB[i];
@@ -115,18 +146,444 @@ void usingCPU(unsigned int vecLength) {
   return;
 }
 
-static void BM_Metal(benchmark::State& state) {
+// * Cold start: a fresh context per iteration, so device creation, library
+// * load, pipeline build and buffer setup are all timed (the old behaviour).
+static void BM_DeviceCold(benchmark::State& state) {
   unsigned int vecLength = state.range(0);
+  state.SetLabel(compute::Context::shared().device().name());
   for (auto _ : state) {
-    usingMetal(vecLength);
+    compute::Context context(compute::createDefaultDevice());
+    usingDevice(context, vecLength);
   }
 }
 
+// * Warm dispatch: pipeline and buffers are set up once; only the kernel runs.
+static void BM_DeviceWarm(benchmark::State& state) {
+  unsigned int vecLength = state.range(0);
+  compute::Context& context = compute::Context::shared();
+  state.SetLabel(context.device().name());
+  VectorAddJob<> job = prepareVectorAdd(context, vecLength);
+  dispatchVectorAdd(context, job);
+  for (auto _ : state) {
+    dispatchVectorAdd(context, job);
+  }
+  compute::roofline::setBandwidthCounters(state, 3 * size_t(vecLength) * sizeof(float));
+}
+
+// * A cached pipeline lookup, on a `CpuDevice` so it runs without a GPU. The
+// * first call builds; every later one must return the same pipeline from
+// * the cache (a hit, not a build), or the benchmark reports an error.
+static void BM_PipelineLookup(benchmark::State& state) {
+  compute::Context context(std::make_unique<compute::CpuDevice>(compute::defaultKernelRegistry()));
+  compute::Pipeline& first = context.pipeline("./add_vec.metallib", "vector_add");
+  compute::Pipeline& second = context.pipeline("./add_vec.metallib", "vector_add");
+  const compute::Context::Stats stats = context.stats();
+  if (&first != &second || stats.pipelineBuilds != 1 || stats.pipelineHits != 1 || stats.libraryLoads != 1) {
+    state.SkipWithError(std::format(
+      "pipeline cache broken: {} builds, {} hits, {} library loads, {} reference",
+      stats.pipelineBuilds, stats.pipelineHits, stats.libraryLoads, &first == &second ? "same" : "different").c_str());
+    return;
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(&context.pipeline("./add_vec.metallib", "vector_add"));
+  }
+  state.counters["pipeline_builds"] = double(context.stats().pipelineBuilds);
+}
+
 static void BM_CPU(benchmark::State& state) {
   unsigned int vecLength = state.range(0);
+  state.SetLabel(std::string(compute::elementwise::isaName(compute::elementwise::activeIsa())));
   for (auto _ : state) {
     usingCPU(vecLength);
   }
+  // * End to end: two inputs written by genVec, then read, plus the output.
+  compute::roofline::setBandwidthCounters(state, 5 * size_t(vecLength) * sizeof(float));
+}
+
+static void BM_CPUScalar(benchmark::State& state) {
+  unsigned int vecLength = state.range(0);
+  for (auto _ : state) {
+    usingCPUScalar(vecLength);
+  }
+  compute::roofline::setBandwidthCounters(state, 5 * size_t(vecLength) * sizeof(float));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Fused expressions: `d = (a + b) * c - a` as two-op passes with a
+// * temporary, against one lazy expression evaluated in a single pass.
+///////////////////////////////////////////////////////////////////////////////
+
+static void BM_CPUTwoPass(benchmark::State& state) {
+  const size_t n = state.range(0);
+  compute::PageVector<float> a = genVec(n), b = genVec(n, 43), c = genVec(n, 44);
+  compute::PageVector<float> tmp(n), d(n);
+  for (auto _ : state) {
+    compute::elementwise::add(a, b, tmp);
+    compute::elementwise::mul(tmp, c, tmp);
+    compute::elementwise::sub(tmp, a, d);
+    benchmark::ClobberMemory();
+  }
+  compute::roofline::setBandwidthCounters(state, 4 * n * sizeof(float));
+}
+
+static void BM_CPUFused(benchmark::State& state) {
+  const size_t n = state.range(0);
+  compute::expr::Vector a(genVec(n)), b(genVec(n, 43)), c(genVec(n, 44));
+  compute::expr::Vector d(n);
+  for (auto _ : state) {
+    d = (a + b) * c - a;
+    benchmark::ClobberMemory();
+  }
+  compute::roofline::setBandwidthCounters(state, 4 * n * sizeof(float));
+}
+
+// * Same expression on the context's device: one generated kernel on Metal,
+// * the fused host pass on the CPU backend.
+static void BM_DeviceFused(benchmark::State& state) {
+  const size_t n = state.range(0);
+  compute::Context& context = compute::Context::shared();
+  state.SetLabel(context.device().name());
+  compute::expr::Vector a(genVec(n)), b(genVec(n, 43)), c(genVec(n, 44));
+  compute::expr::Vector d(n);
+  for (auto _ : state) {
+    compute::expr::evaluate(context, (a + b) * c - a, d);
+  }
+  compute::roofline::setBandwidthCounters(state, 4 * n * sizeof(float));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Storage precision: the same add with fp32, fp16 or bf16 arrays (fp32
+// * arithmetic throughout). `max_error` is the largest absolute difference
+// * from the fp32 add of the unrounded inputs, so it includes the rounding of
+// * the inputs as well as of the result.
+///////////////////////////////////////////////////////////////////////////////
+
+// * fp32 `a + b` of the inputs `genVecAs` rounds from.
+static auto fp32Sum(size_t n) -> compute::PageVector<float> {
+  compute::PageVector<float> reference(n);
+  compute::elementwise::add(genVec(n), genVec(n, 43), reference);
+  return reference;
+}
+
+template <compute::precision::Storage T>
+static void BM_CPUPrecision(benchmark::State& state) {
+  const size_t n = state.range(0);
+  const compute::PageVector<T> a = genVecAs<T>(n), b = genVecAs<T>(n, 43);
+  compute::PageVector<T> c(n);
+  for (auto _ : state) {
+    compute::precision::add<T>(a, b, c);
+    benchmark::ClobberMemory();
+  }
+  compute::roofline::setBandwidthCounters(state, 3 * n * sizeof(T));
+  state.counters["max_error"] = compute::precision::maxAbsError<T>(c, fp32Sum(n));
+  state.SetLabel(compute::precision::storageName<T>());
+}
+
+// * Warm dispatch of vector_add / vector_add_half / vector_add_bf16.
+template <compute::precision::Storage T>
+static void BM_DevicePrecision(benchmark::State& state) {
+  const size_t n = state.range(0);
+  compute::Context& context = compute::Context::shared();
+  VectorAddJob<T> job = prepareVectorAdd<T>(context, n);
+  for (auto _ : state) {
+    dispatchVectorAdd(context, job);
+  }
+  compute::roofline::setBandwidthCounters(state, 3 * n * sizeof(T));
+  state.counters["max_error"] = compute::precision::maxAbsError<T>(job.vectorC, fp32Sum(n));
+  state.SetLabel(std::format("{} {}", compute::precision::storageName<T>(), context.device().name()));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Elementwise sweep: one op, one ISA, inputs prepared outside the timed loop.
+// * Reported as bytes/s (read + written) so it can be read against DRAM
+// * bandwidth.
+///////////////////////////////////////////////////////////////////////////////
+
+static void BM_Elementwise(
+  benchmark::State& state,
+  compute::elementwise::Kind kind,
+  compute::elementwise::Isa isa) {
+  using namespace compute::elementwise;
+  const size_t n = state.range(0);
+  compute::PageVector<float> a = genVec(n);
+  compute::PageVector<float> b = genVec(n, 43);
+  compute::PageVector<float> c = genVec(n, 44);
+  compute::PageVector<float> out(n);
+
+  for (auto _ : state) {
+    run(kind, a.data(), b.data(), c.data(), kind == Kind::Saxpy || kind == Kind::Axpby ? b.data() : out.data(),
+        n, 0.5f, 0.25f, isa);
+    benchmark::ClobberMemory();
+  }
+  const size_t streams = 2 + usesB(kind) + usesC(kind);
+  compute::roofline::setBandwidthCounters(state, streams * n * sizeof(float));
+  state.SetLabel(std::string(isaName(isa)));
+}
+
+static void registerElementwiseBenchmarks() {
+  using namespace compute::elementwise;
+  const std::pair<Kind, const char*> ops[] = {
+    {Kind::Add, "add"}, {Kind::Sub, "sub"}, {Kind::Mul, "mul"}, {Kind::Fma, "fma"},
+    {Kind::Saxpy, "saxpy"}, {Kind::Axpby, "axpby"}, {Kind::Scale, "scale"}};
+  for (Isa isa : {Isa::Scalar, Isa::Avx2, Isa::Avx512, Isa::Neon}) {
+    if (!supported(isa)) continue;
+    for (const auto& [kind, name] : ops) {
+      const std::string label = std::format("BM_Elementwise/{}/{}", name, isaName(isa));
+      auto* bm = benchmark::RegisterBenchmark(label.c_str(), BM_Elementwise, kind, isa)->UseRealTime();
+      // * L1-resident up to well past the LLC
+      for (int64_t n : compute::roofline::sweepSizes()) { bm->Arg(n); }
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Reductions: sum and dot at each accuracy, max and argmax, against the
+// * standard library's parallel `std::reduce` and on the device. `rel_error`
+// * is measured against a double-precision reference.
+///////////////////////////////////////////////////////////////////////////////
+
+enum class ReduceOp { Sum, Dot, Max, Argmax };
+
+static auto reduceOpName(ReduceOp op) -> const char* {
+  switch (op) {
+    case ReduceOp::Sum:    return "sum";
+    case ReduceOp::Dot:    return "dot";
+    case ReduceOp::Max:    return "max";
+    case ReduceOp::Argmax: return "argmax";
+  }
+  return "?";
+}
+
+// * Signed inputs, so cancellation shows up in the error.
+static auto reduceInput(size_t n, uint64_t seed) -> compute::PageVector<float> {
+  compute::PageVector<float> v(n);
+  compute::random::fillUniform(v, -1.0f, 1.0f, seed);
+  return v;
+}
+
+static auto referenceSum(const compute::PageVector<float>& a, const compute::PageVector<float>* b) -> double {
+  double total = 0.0;
+  for (size_t i = 0; i < a.size(); ++i) { total += b ? double(a[i]) * double((*b)[i]) : double(a[i]); }
+  return total;
+}
+
+static void setReduceCounters(benchmark::State& state, size_t streams, size_t n, double error) {
+  compute::roofline::setBandwidthCounters(state, streams * n * sizeof(float));
+  state.counters["rel_error"] = error;
+}
+
+static void BM_Reduce(benchmark::State& state, ReduceOp op, compute::reduce::Accuracy accuracy) {
+  namespace reduce = compute::reduce;
+  const size_t n = state.range(0);
+  const compute::PageVector<float> a = reduceInput(n, 42);
+  const compute::PageVector<float> b = reduceInput(n, 43);
+
+  float result = 0.0f;
+  for (auto _ : state) {
+    switch (op) {
+      case ReduceOp::Sum:    result = reduce::sum(a, accuracy); break;
+      case ReduceOp::Dot:    result = reduce::dot(a, b, accuracy); break;
+      case ReduceOp::Max:    result = reduce::max(a); break;
+      case ReduceOp::Argmax: result = static_cast<float>(reduce::argmax(a).index); break;
+    }
+    benchmark::DoNotOptimize(result);
+  }
+  double error = 0.0;
+  if (op == ReduceOp::Sum || op == ReduceOp::Dot) {
+    const double reference = referenceSum(a, op == ReduceOp::Dot ? &b : nullptr);
+    error = std::abs((result - reference) / reference);
+  }
+  setReduceCounters(state, op == ReduceOp::Dot ? 2 : 1, n, error);
+  state.SetLabel(std::string(reduce::isaName(reduce::activeIsa())));
+}
+
+#ifdef __cpp_lib_parallel_algorithm
+// * The baseline: `std::reduce` / `std::transform_reduce` with `par_unseq`.
+static void BM_StdReduce(benchmark::State& state, ReduceOp op) {
+  const size_t n = state.range(0);
+  const compute::PageVector<float> a = reduceInput(n, 42);
+  const compute::PageVector<float> b = reduceInput(n, 43);
+
+  float result = 0.0f;
+  for (auto _ : state) {
+    result = op == ReduceOp::Dot
+      ? std::transform_reduce(std::execution::par_unseq, a.begin(), a.end(), b.begin(), 0.0f)
+      : std::reduce(std::execution::par_unseq, a.begin(), a.end(), 0.0f);
+    benchmark::DoNotOptimize(result);
+  }
+  const double reference = referenceSum(a, op == ReduceOp::Dot ? &b : nullptr);
+  setReduceCounters(state, op == ReduceOp::Dot ? 2 : 1, n, std::abs((result - reference) / reference));
+}
+#endif
+
+// * Two-pass kernels of reduce.metal (or their CPU twins), warm: the
+// * pipelines and scratch buffers are set up before timing.
+static void BM_DeviceReduce(benchmark::State& state, ReduceOp op) {
+  const size_t n = state.range(0);
+  compute::Context& context = compute::Context::shared();
+  state.SetLabel(context.device().name());
+  compute::PageVector<float> a = reduceInput(n, 42);
+  compute::PageVector<float> b = reduceInput(n, 43);
+  auto bufferA = compute::wrapBuffer(context.device(), a);
+  auto bufferB = compute::wrapBuffer(context.device(), b);
+  compute::reduce::DeviceReduction reduction(context, "./reduce.metallib");
+
+  float result = 0.0f;
+  for (auto _ : state) {
+    switch (op) {
+      case ReduceOp::Sum:    result = reduction.sum(*bufferA, n); break;
+      case ReduceOp::Dot:    result = reduction.dot(*bufferA, *bufferB, n); break;
+      case ReduceOp::Max:    result = reduction.max(*bufferA, n); break;
+      case ReduceOp::Argmax: result = static_cast<float>(reduction.argmax(*bufferA, n).index); break;
+    }
+    benchmark::DoNotOptimize(result);
+  }
+  double error = 0.0;
+  if (op == ReduceOp::Sum || op == ReduceOp::Dot) {
+    const double reference = referenceSum(a, op == ReduceOp::Dot ? &b : nullptr);
+    error = std::abs((result - reference) / reference);
+  }
+  setReduceCounters(state, op == ReduceOp::Dot ? 2 : 1, n, error);
+}
+
+static void registerReduceBenchmarks() {
+  using compute::reduce::Accuracy;
+  const auto sizes = compute::roofline::sweepSizes();
+  auto withSizes = [&](benchmark::internal::Benchmark* bm) {
+    for (int64_t n : sizes) { bm->Arg(n); }
+    bm->UseRealTime();
+  };
+  for (ReduceOp op : {ReduceOp::Sum, ReduceOp::Dot}) {
+    for (Accuracy accuracy : {Accuracy::Fast, Accuracy::Pairwise, Accuracy::Kahan}) {
+      const std::string label = std::format(
+        "BM_Reduce/{}/{}", reduceOpName(op), compute::reduce::accuracyName(accuracy));
+      withSizes(benchmark::RegisterBenchmark(label.c_str(), BM_Reduce, op, accuracy));
+    }
+  }
+  for (ReduceOp op : {ReduceOp::Max, ReduceOp::Argmax}) {
+    const std::string label = std::format("BM_Reduce/{}", reduceOpName(op));
+    withSizes(benchmark::RegisterBenchmark(label.c_str(), BM_Reduce, op, Accuracy::Fast));
+  }
+#ifdef __cpp_lib_parallel_algorithm
+  for (ReduceOp op : {ReduceOp::Sum, ReduceOp::Dot}) {
+    const std::string label = std::format("BM_StdReduce/{}", reduceOpName(op));
+    withSizes(benchmark::RegisterBenchmark(label.c_str(), BM_StdReduce, op));
+  }
+#endif
+  for (ReduceOp op : {ReduceOp::Sum, ReduceOp::Dot, ReduceOp::Max, ReduceOp::Argmax}) {
+    const std::string label = std::format("BM_DeviceReduce/{}", reduceOpName(op));
+    withSizes(benchmark::RegisterBenchmark(label.c_str(), BM_DeviceReduce, op));
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Out-of-core: the vectors live in files and are streamed through `mmap`
+// * windows a chunk at a time, so they don't have to fit in RAM.
+///////////////////////////////////////////////////////////////////////////////
+
+// * `REPOUSSE_STREAM_BYTES` per file, 1 GiB by default.
+static auto streamingFileBytes() -> size_t {
+  const char* env = std::getenv("REPOUSSE_STREAM_BYTES");
+  return env ? std::stoull(env) : size_t{1} << 30;
+}
+
+// * Input files written once per process (in bounded memory), removed at exit.
+struct StreamingFiles {
+  std::filesystem::path a, b, out;
+  size_t elements;
+
+  StreamingFiles() {
+    const auto dir = std::filesystem::temp_directory_path();
+    a   = dir / "repousse_stream_a.f32";
+    b   = dir / "repousse_stream_b.f32";
+    out = dir / "repousse_stream_c.f32";
+    elements = streamingFileBytes() / sizeof(float);
+    compute::streaming::writeFloats(a, elements, [](std::span<float> chunk, size_t first) {
+      compute::random::fillUniform(chunk, 0.0f, 1.0f, 42, first);
+    });
+    compute::streaming::writeFloats(b, elements, [](std::span<float> chunk, size_t first) {
+      compute::random::fillUniform(chunk, 0.0f, 1.0f, 43, first);
+    });
+  }
+  ~StreamingFiles() {
+    std::error_code ec;
+    for (const auto& path : {a, b, out}) { std::filesystem::remove(path, ec); }
+  }
+
+  static auto shared() -> StreamingFiles& {
+    static StreamingFiles files;
+    return files;
+  }
+};
+
+// * Chunk kernel that runs `vector_add` on the device over the mapped windows
+// * themselves (they're page-aligned, so no copies on either backend).
+static auto deviceAddChunk(compute::Context& context) -> compute::streaming::ChunkKernel {
+  return [&context](const float* a, const float* b, float* out, size_t n) {
+    compute::Device& device = context.device();
+    compute::Pipeline& pipeline = context.pipeline("./add_vec.metallib", "vector_add");
+    const size_t length = compute::roundToPages(n * sizeof(float));
+    auto pBufferA = device.newBufferNoCopy(const_cast<float*>(a), length);
+    auto pBufferB = device.newBufferNoCopy(const_cast<float*>(b), length);
+    auto pBufferC = device.newBufferNoCopy(out, length);
+    compute::Arguments arguments;
+    arguments.setBuffer(*pBufferA, 0, 0).setBuffer(*pBufferB, 0, 1).setBuffer(*pBufferC, 0, 2);
+    const size_t threadGroupSize = std::min(pipeline.maxTotalThreadsPerThreadgroup(), n);
+    context.queue().dispatchThreads(pipeline, arguments, {n, 1, 1}, {threadGroupSize, 1, 1});
+  };
+}
+
+static void reportStreaming(benchmark::State& state, const compute::streaming::Stats& last) {
+  compute::roofline::setBandwidthCounters(state, last.bytesMoved);
+  state.counters["chunks"] = double(last.chunks);
+  state.counters["mapped"] = benchmark::Counter(
+    double(last.mappedBytes), benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+}
+
+static void BM_CPUStreaming(benchmark::State& state) {
+  StreamingFiles& files = StreamingFiles::shared();
+  const size_t chunkBytes = size_t(state.range(0)) << 20;
+  compute::streaming::Stats last;
+  for (auto _ : state) {
+    last = compute::streaming::binary(files.a, files.b, files.out, compute::streaming::addChunk, chunkBytes);
+  }
+  reportStreaming(state, last);
+}
+
+static void BM_DeviceStreaming(benchmark::State& state) {
+  StreamingFiles& files = StreamingFiles::shared();
+  compute::Context& context = compute::Context::shared();
+  state.SetLabel(context.device().name());
+  const size_t chunkBytes = size_t(state.range(0)) << 20;
+  compute::streaming::Stats last;
+  for (auto _ : state) {
+    last = compute::streaming::binary(files.a, files.b, files.out, deviceAddChunk(context), chunkBytes);
+  }
+  reportStreaming(state, last);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * STREAM baseline: copy / scale / add / triad over the same size sweep, so
+// * every kernel above can be read against what this host can actually move.
+///////////////////////////////////////////////////////////////////////////////
+
+static void BM_Stream(benchmark::State& state, compute::roofline::StreamOp op) {
+  const size_t n = state.range(0);
+  compute::PageVector<float> a = genVec(n), b = genVec(n, 43), c = genVec(n, 44);
+  for (auto _ : state) {
+    compute::roofline::stream(op, a.data(), b.data(), c.data(), n, 3.0f);
+    benchmark::ClobberMemory();
+  }
+  compute::roofline::setBandwidthCounters(state, compute::roofline::streamBytes(op, n));
+}
+
+static void registerStreamBenchmarks() {
+  using compute::roofline::StreamOp;
+  for (StreamOp op : {StreamOp::Copy, StreamOp::Scale, StreamOp::Add, StreamOp::Triad}) {
+    const std::string label = std::format("BM_Stream/{}", compute::roofline::streamOpName(op));
+    auto* bm = benchmark::RegisterBenchmark(label.c_str(), BM_Stream, op)->UseRealTime();
+    for (int64_t n : compute::roofline::sweepSizes()) { bm->Arg(n); }
+  }
 }
 
 const long long start = 100000000;
@@ -134,6 +591,33 @@ const long long end   = start*2;
 const long long step  = start;
 
 // * Value order to follow:     ▼ `start, end, step`
-BENCHMARK(BM_CPU)  ->DenseRange(start, end, step);
-BENCHMARK(BM_Metal)->DenseRange(start, end, step);
-BENCHMARK_MAIN();
+BENCHMARK(BM_CPU)       ->DenseRange(start, end, step)->UseRealTime();
+BENCHMARK(BM_CPUScalar) ->DenseRange(start, end, step)->UseRealTime();
+BENCHMARK(BM_DeviceCold)->DenseRange(start, end, step);
+BENCHMARK(BM_DeviceWarm)->DenseRange(start, end, step)->UseRealTime();
+BENCHMARK(BM_PipelineLookup);
+BENCHMARK(BM_CPUTwoPass) ->RangeMultiplier(8)->Range(1 << 12, 1 << 24)->UseRealTime();
+BENCHMARK(BM_CPUFused)   ->RangeMultiplier(8)->Range(1 << 12, 1 << 24)->UseRealTime();
+// * Chunk size in MiB per file
+BENCHMARK(BM_CPUStreaming)   ->RangeMultiplier(4)->Range(4, 256)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_DeviceStreaming)->RangeMultiplier(4)->Range(4, 256)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_DeviceFused)->RangeMultiplier(8)->Range(1 << 12, 1 << 24)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_CPUPrecision, float)                        ->RangeMultiplier(8)->Range(1 << 12, 1 << 24)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_CPUPrecision, compute::precision::Half)     ->RangeMultiplier(8)->Range(1 << 12, 1 << 24)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_CPUPrecision, compute::precision::BFloat16) ->RangeMultiplier(8)->Range(1 << 12, 1 << 24)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_DevicePrecision, float)                        ->RangeMultiplier(8)->Range(1 << 12, 1 << 24)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_DevicePrecision, compute::precision::Half)     ->RangeMultiplier(8)->Range(1 << 12, 1 << 24)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_DevicePrecision, compute::precision::BFloat16) ->RangeMultiplier(8)->Range(1 << 12, 1 << 24)->UseRealTime();
+
+int main(int argc, char** argv) {
+  registerStreamBenchmarks();
+  registerElementwiseBenchmarks();
+  registerReduceBenchmarks();
+
+  ::benchmark::Initialize(&argc, argv);
+  if (::benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+  compute::roofline::addRooflineContext();
+  ::benchmark::RunSpecifiedBenchmarks();
+  ::benchmark::Shutdown();
+  return 0;
+}
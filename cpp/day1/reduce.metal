@@ -0,0 +1,189 @@
+// * This is only the shader source code, not the complete program.
+// * This will be compiled by the Xcode bundle. - Don't use cpp features here.
+// *
+// * Two-pass reductions. Pass 1 launches a few hundred threadgroups; each
+// * thread walks the input with a grid-sized stride, the group folds its
+// * threads with `simd_*` and one threadgroup array, and writes one partial.
+// * Pass 2 runs the same kernel once more, as a single threadgroup over the
+// * partials. Threadgroup sizes must be a multiple of the SIMD width.
+
+#include <metal_stdlib>
+using namespace metal;
+
+// * One slot per simdgroup: 1024 threads / 32 lanes.
+constant uint kMaxSimdgroups = 32;
+
+// * Folds one value per thread; afterwards simdgroup 0 holds the group's result
+// * in `value`. `op` is simd_sum, simd_min or simd_max.
+#define REDUCE_GROUP(value, op, identity)                                     \
+  value = op(value);                                                          \
+  if (lane == 0) { shared[simd_group] = value; }                              \
+  threadgroup_barrier(mem_flags::mem_threadgroup);                            \
+  if (simd_group == 0) {                                                      \
+    value = lane < simd_groups ? shared[lane] : identity;                     \
+    value = op(value);                                                        \
+  }
+
+kernel void reduce_sum(
+  // ! Param order in buffer index is significant. Do not swap args.
+  device const float* in       [[ buffer(0) ]],
+  device       float* partials [[ buffer(1) ]],
+  constant     uint&  length   [[ buffer(2) ]],
+
+  uint gid          [[ thread_position_in_grid ]],
+  uint grid         [[ threads_per_grid ]],
+  uint group        [[ threadgroup_position_in_grid ]],
+  uint lane         [[ thread_index_in_simdgroup ]],
+  uint simd_group   [[ simdgroup_index_in_threadgroup ]],
+  uint simd_groups  [[ simdgroups_per_threadgroup ]]
+) {
+  threadgroup float shared[kMaxSimdgroups];
+  float value = 0.0f;
+  for (uint i = gid; i < length; i += grid) { value += in[i]; }
+  REDUCE_GROUP(value, simd_sum, 0.0f)
+  if (simd_group == 0 && lane == 0) { partials[group] = value; }
+}
+
+kernel void reduce_dot(
+  device const float* inA      [[ buffer(0) ]],
+  device const float* inB      [[ buffer(1) ]],
+  device       float* partials [[ buffer(2) ]],
+  constant     uint&  length   [[ buffer(3) ]],
+
+  uint gid          [[ thread_position_in_grid ]],
+  uint grid         [[ threads_per_grid ]],
+  uint group        [[ threadgroup_position_in_grid ]],
+  uint lane         [[ thread_index_in_simdgroup ]],
+  uint simd_group   [[ simdgroup_index_in_threadgroup ]],
+  uint simd_groups  [[ simdgroups_per_threadgroup ]]
+) {
+  threadgroup float shared[kMaxSimdgroups];
+  float value = 0.0f;
+  for (uint i = gid; i < length; i += grid) { value = fma(inA[i], inB[i], value); }
+  REDUCE_GROUP(value, simd_sum, 0.0f)
+  if (simd_group == 0 && lane == 0) { partials[group] = value; }
+}
+
+kernel void reduce_min(
+  device const float* in       [[ buffer(0) ]],
+  device       float* partials [[ buffer(1) ]],
+  constant     uint&  length   [[ buffer(2) ]],
+
+  uint gid          [[ thread_position_in_grid ]],
+  uint grid         [[ threads_per_grid ]],
+  uint group        [[ threadgroup_position_in_grid ]],
+  uint lane         [[ thread_index_in_simdgroup ]],
+  uint simd_group   [[ simdgroup_index_in_threadgroup ]],
+  uint simd_groups  [[ simdgroups_per_threadgroup ]]
+) {
+  threadgroup float shared[kMaxSimdgroups];
+  float value = INFINITY;
+  for (uint i = gid; i < length; i += grid) { value = min(value, in[i]); }
+  REDUCE_GROUP(value, simd_min, INFINITY)
+  if (simd_group == 0 && lane == 0) { partials[group] = value; }
+}
+
+kernel void reduce_max(
+  device const float* in       [[ buffer(0) ]],
+  device       float* partials [[ buffer(1) ]],
+  constant     uint&  length   [[ buffer(2) ]],
+
+  uint gid          [[ thread_position_in_grid ]],
+  uint grid         [[ threads_per_grid ]],
+  uint group        [[ threadgroup_position_in_grid ]],
+  uint lane         [[ thread_index_in_simdgroup ]],
+  uint simd_group   [[ simdgroup_index_in_threadgroup ]],
+  uint simd_groups  [[ simdgroups_per_threadgroup ]]
+) {
+  threadgroup float shared[kMaxSimdgroups];
+  float value = -INFINITY;
+  for (uint i = gid; i < length; i += grid) { value = max(value, in[i]); }
+  REDUCE_GROUP(value, simd_max, -INFINITY)
+  if (simd_group == 0 && lane == 0) { partials[group] = value; }
+}
+
+// * (value, index) pairs: larger value wins, the smaller index on ties.
+struct Arg {
+  float value;
+  uint index;
+};
+
+inline Arg better(Arg a, Arg b) {
+  if (b.value > a.value || (b.value == a.value && b.index < a.index)) { return b; }
+  return a;
+}
+
+// * No simd_* for pairs: find the SIMD max, then the smallest index holding it.
+inline Arg simd_argmax(Arg a) {
+  const float best = simd_max(a.value);
+  const uint index = simd_min(a.value == best ? a.index : 0xffffffffu);
+  return Arg{best, index};
+}
+
+inline Arg reduce_arg_group(
+  Arg local,
+  threadgroup Arg* shared,
+  uint lane,
+  uint simd_group,
+  uint simd_groups
+) {
+  local = simd_argmax(local);
+  if (lane == 0) { shared[simd_group] = local; }
+  threadgroup_barrier(mem_flags::mem_threadgroup);
+  if (simd_group == 0) {
+    local = lane < simd_groups ? shared[lane] : Arg{-INFINITY, 0xffffffffu};
+    local = simd_argmax(local);
+  }
+  return local;
+}
+
+kernel void reduce_argmax(
+  device const float* in      [[ buffer(0) ]],
+  device       float* values  [[ buffer(1) ]],
+  device       uint*  indices [[ buffer(2) ]],
+  constant     uint&  length  [[ buffer(3) ]],
+
+  uint gid          [[ thread_position_in_grid ]],
+  uint grid         [[ threads_per_grid ]],
+  uint group        [[ threadgroup_position_in_grid ]],
+  uint lane         [[ thread_index_in_simdgroup ]],
+  uint simd_group   [[ simdgroup_index_in_threadgroup ]],
+  uint simd_groups  [[ simdgroups_per_threadgroup ]]
+) {
+  threadgroup Arg shared[kMaxSimdgroups];
+  Arg local = Arg{-INFINITY, 0xffffffffu};
+  // * Each thread sees increasing indices, so strict `>` keeps the first.
+  for (uint i = gid; i < length; i += grid) {
+    if (in[i] > local.value || local.index == 0xffffffffu) { local = Arg{in[i], i}; }
+  }
+  local = reduce_arg_group(local, shared, lane, simd_group, simd_groups);
+  if (simd_group == 0 && lane == 0) {
+    values[group] = local.value;
+    indices[group] = local.index;
+  }
+}
+
+// * Pass 2 of argmax: folds the (value, index) partials of pass 1.
+kernel void reduce_argmax_pairs(
+  device const float* inValues   [[ buffer(0) ]],
+  device const uint*  inIndices  [[ buffer(1) ]],
+  device       float* outValues  [[ buffer(2) ]],
+  device       uint*  outIndices [[ buffer(3) ]],
+  constant     uint&  length     [[ buffer(4) ]],
+
+  uint gid          [[ thread_position_in_grid ]],
+  uint grid         [[ threads_per_grid ]],
+  uint group        [[ threadgroup_position_in_grid ]],
+  uint lane         [[ thread_index_in_simdgroup ]],
+  uint simd_group   [[ simdgroup_index_in_threadgroup ]],
+  uint simd_groups  [[ simdgroups_per_threadgroup ]]
+) {
+  threadgroup Arg shared[kMaxSimdgroups];
+  Arg local = Arg{-INFINITY, 0xffffffffu};
+  for (uint i = gid; i < length; i += grid) { local = better(local, Arg{inValues[i], inIndices[i]}); }
+  local = reduce_arg_group(local, shared, lane, simd_group, simd_groups);
+  if (simd_group == 0 && lane == 0) {
+    outValues[group] = local.value;
+    outIndices[group] = local.index;
+  }
+}
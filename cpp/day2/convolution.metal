@@ -32,3 +32,212 @@ kernel void convolution (
   }
   output[thread_id] = sum;
 }
+
+// * A batch of signals in one dispatch: x is the sample, y the signal.
+// * Signals (and per-signal masks) are stored back to back; `mask_stride` is
+// * 0 when every signal shares the one mask, `mask_width` otherwise.
+kernel void convolution_batched (
+  device const float* input  [[buffer(0)]],
+  device const float* masks  [[buffer(1)]],
+  device float*       output [[buffer(2)]],
+
+  constant uint& mask_width  [[buffer(3)]],
+  constant uint& input_width [[buffer(4)]],
+  constant uint& mask_stride [[buffer(5)]],
+  constant uint& batch       [[buffer(6)]],
+
+  uint2 gid [[thread_position_in_grid]]
+) {
+  if (gid.x >= input_width || gid.y >= batch) {
+    return;
+  }
+  device const float* signal = input + gid.y * input_width;
+  device const float* mask   = masks + gid.y * mask_stride;
+  const int center = static_cast<int>(mask_width/2);
+
+  float sum = 0.0f;
+  for (uint i = 0u; i < mask_width; i++) {
+    const int idx = static_cast<int>(gid.x) + static_cast<int>(i) - center;
+    if (idx >= 0 && idx < static_cast<int>(input_width)) {
+      sum += signal[uint(idx)] * mask[i];
+    }
+  }
+  output[gid.y * input_width + gid.x] = sum;
+}
+
+// * `convolution` with the mask width fixed at compile time: the tap loop
+// * unrolls and the mask sits in the constant address space, where every
+// * thread of a SIMD group reading the same tap is one broadcast. Only the
+// * `W - 1` threads at the ends of the signal take the bounds-checked path.
+// * Arguments match `convolution`, so hosts bind both the same way;
+// * `mask_width` is ignored. Instantiated as `convolution_3` ... `convolution_63`.
+template <uint W>
+kernel void convolution_fixed (
+  device const float* input  [[buffer(0)]],
+  constant float*     mask   [[buffer(1)]],
+  device float*       output [[buffer(2)]],
+
+  constant uint& mask_width  [[buffer(3)]],
+  constant uint& input_width [[buffer(4)]],
+
+  uint thread_id [[thread_position_in_grid]]
+) {
+  if (thread_id >= input_width) {
+    return;
+  }
+  constexpr int center = static_cast<int>(W/2);
+  const int first = static_cast<int>(thread_id) - center;
+
+  float sum = 0.0f;
+  if (first >= 0 && first + static_cast<int>(W) <= static_cast<int>(input_width)) {
+    device const float* in = input + first;
+    #pragma unroll
+    for (uint i = 0u; i < W; i++) {
+      sum = fma(in[i], mask[i], sum);
+    }
+  } else {
+    for (uint i = 0u; i < W; i++) {
+      const int idx = first + static_cast<int>(i);
+      if (idx >= 0 && idx < static_cast<int>(input_width)) {
+        sum += input[uint(idx)] * mask[i];
+      }
+    }
+  }
+  output[thread_id] = sum;
+}
+
+#define CONVOLUTION_FIXED(W)                                                  \
+  template [[host_name("convolution_" #W)]] kernel void convolution_fixed<W>( \
+    device const float* input  [[buffer(0)]],                                 \
+    constant float*     mask   [[buffer(1)]],                                 \
+    device float*       output [[buffer(2)]],                                 \
+    constant uint& mask_width  [[buffer(3)]],                                 \
+    constant uint& input_width [[buffer(4)]],                                 \
+    uint thread_id [[thread_position_in_grid]]);
+
+CONVOLUTION_FIXED(3)  CONVOLUTION_FIXED(5)  CONVOLUTION_FIXED(7)  CONVOLUTION_FIXED(9)
+CONVOLUTION_FIXED(11) CONVOLUTION_FIXED(13) CONVOLUTION_FIXED(15) CONVOLUTION_FIXED(17)
+CONVOLUTION_FIXED(19) CONVOLUTION_FIXED(21) CONVOLUTION_FIXED(23) CONVOLUTION_FIXED(25)
+CONVOLUTION_FIXED(27) CONVOLUTION_FIXED(29) CONVOLUTION_FIXED(31) CONVOLUTION_FIXED(33)
+CONVOLUTION_FIXED(35) CONVOLUTION_FIXED(37) CONVOLUTION_FIXED(39) CONVOLUTION_FIXED(41)
+CONVOLUTION_FIXED(43) CONVOLUTION_FIXED(45) CONVOLUTION_FIXED(47) CONVOLUTION_FIXED(49)
+CONVOLUTION_FIXED(51) CONVOLUTION_FIXED(53) CONVOLUTION_FIXED(55) CONVOLUTION_FIXED(57)
+CONVOLUTION_FIXED(59) CONVOLUTION_FIXED(61) CONVOLUTION_FIXED(63)
+
+// * Halo tiling. The interior outputs, whose taps are all inside the signal,
+// * go through `convolution_tiled`: each threadgroup stages its inputs plus
+// * the `mask_width - 1` halo samples in threadgroup memory once, then every
+// * thread runs the tap loop on the tile with no bounds checks. The few
+// * outputs near the ends go through `convolution_edge_<mode>`, which is
+// * where the boundary rule lives.
+
+// * Host-side limit: threads per group + mask_width - 1 must fit.
+constant constexpr uint kTileCapacity = 2048;
+
+// * "Valid" convolution: output[t] = sum_j input[t + j] * mask[j] for
+// * t < `count`. Hosts bind `output` at the first interior sample (offset
+// * `mask_width / 2`), so with `count = N - mask_width + 1` this fills the
+// * interior of a "same" convolution.
+kernel void convolution_tiled (
+  device const float* input  [[buffer(0)]],
+  constant float*     mask   [[buffer(1)]],
+  device float*       output [[buffer(2)]],
+
+  constant uint& mask_width  [[buffer(3)]],
+  constant uint& count       [[buffer(4)]],
+
+  uint thread_id [[thread_position_in_grid]],
+  uint lid       [[thread_position_in_threadgroup]],
+  uint threads   [[threads_per_threadgroup]]
+) {
+  threadgroup float tile[kTileCapacity];
+  const uint origin = thread_id - lid;
+  const uint span   = threads + mask_width - 1u;
+  const uint inputs = count + mask_width - 1u;
+  for (uint k = lid; k < span; k += threads) {
+    tile[k] = origin + k < inputs ? input[origin + k] : 0.0f;
+  }
+  threadgroup_barrier(mem_flags::mem_threadgroup);
+
+  if (thread_id >= count) {
+    return;
+  }
+  float sum = 0.0f;
+  for (uint j = 0u; j < mask_width; j++) {
+    sum = fma(tile[lid + j], mask[j], sum);
+  }
+  output[thread_id] = sum;
+}
+
+// * Boundary rules of `compute::convolution::Boundary`.
+constant constexpr uint kBoundaryZero    = 0;
+constant constexpr uint kBoundaryClamp   = 1;
+constant constexpr uint kBoundaryReflect = 2;
+constant constexpr uint kBoundaryWrap    = 3;
+
+template <uint Mode>
+inline float boundary_sample(device const float* input, int idx, int n) {
+  if (idx >= 0 && idx < n) {
+    return input[idx];
+  }
+  if (Mode == kBoundaryZero) {
+    return 0.0f;
+  } else if (Mode == kBoundaryClamp) {
+    return input[clamp(idx, 0, n - 1)];
+  } else if (Mode == kBoundaryWrap) {
+    return input[(idx % n + n) % n];
+  } else {
+    if (n == 1) {
+      return input[0];
+    }
+    const int period = 2 * (n - 1);
+    const int r = (idx % period + period) % period;
+    return input[r < n ? r : period - r];
+  }
+}
+
+// * The outputs `convolution_tiled` leaves out: thread t < left is output t,
+// * the rest are the outputs after the interior. The grid is
+// * `input_width - interior` threads, interior = max(N - mask_width + 1, 0).
+template <uint Mode>
+kernel void convolution_edge (
+  device const float* input  [[buffer(0)]],
+  constant float*     mask   [[buffer(1)]],
+  device float*       output [[buffer(2)]],
+
+  constant uint& mask_width  [[buffer(3)]],
+  constant uint& input_width [[buffer(4)]],
+
+  uint thread_id [[thread_position_in_grid]]
+) {
+  const int n = static_cast<int>(input_width);
+  const int m = static_cast<int>(mask_width);
+  const int center   = m / 2;
+  const int interior = max(n - m + 1, 0);
+  const int left     = min(center, n);
+  if (static_cast<int>(thread_id) >= n - interior) {
+    return;
+  }
+  const int i = static_cast<int>(thread_id) < left ? static_cast<int>(thread_id)
+                                                   : static_cast<int>(thread_id) + interior;
+  float sum = 0.0f;
+  for (int j = 0; j < m; j++) {
+    sum = fma(boundary_sample<Mode>(input, i + j - center, n), mask[j], sum);
+  }
+  output[i] = sum;
+}
+
+#define CONVOLUTION_EDGE(NAME, MODE)                                           \
+  template [[host_name("convolution_edge_" #NAME)]] kernel void                \
+  convolution_edge<MODE>(                                                      \
+    device const float* input  [[buffer(0)]],                                  \
+    constant float*     mask   [[buffer(1)]],                                  \
+    device float*       output [[buffer(2)]],                                  \
+    constant uint& mask_width  [[buffer(3)]],                                  \
+    constant uint& input_width [[buffer(4)]],                                  \
+    uint thread_id [[thread_position_in_grid]]);
+
+CONVOLUTION_EDGE(zero, kBoundaryZero)
+CONVOLUTION_EDGE(clamp, kBoundaryClamp)
+CONVOLUTION_EDGE(reflect, kBoundaryReflect)
+CONVOLUTION_EDGE(wrap, kBoundaryWrap)
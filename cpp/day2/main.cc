@@ -8,15 +8,30 @@
 #include <format>
 #include <filesystem>
 #include <span>
+#include <string>
 #include <string_view>
 #include <fstream>
+#include <future>
+#include <memory>
+#include <random>
+#include <vector>
 
 #include <benchmark/benchmark.h>
 #include <sys/types.h>
 
+#ifdef __APPLE__
 #define NS_PRIVATE_IMPLEMENTATION
 #define MTL_PRIVATE_IMPLEMENTATION
 #include "../Metal.hpp"
+#endif
+#include "../compute/context.hpp"
+#include "../compute/convolution.hpp"
+#include "../compute/convolution2d.hpp"
+#include "../compute/convolution_device.hpp"
+#include "../compute/gaussian.hpp"
+#include "../compute/output.hpp"
+#include "../compute/rank_filter.hpp"
+#include "../compute/resample.hpp"
 
 constexpr float PI = 3.14159265358979323846f;
 
@@ -25,17 +40,28 @@ constexpr size_t MASK_SIZE  = 31;  // ! Must be odd
 constexpr float SIGMA       = 2.0f;
 
 ///////////////////////////////////////////////////////////////////////////////
-// * Function to print to CSV:
-
-void writeToCSV (
-  std::span<const float> data,
-  std::string_view arr_name
-) {
-  const std::filesystem::path path = std::format("{}.csv", arr_name);
+// * Output files (`../compute/output.hpp`): `REPOUSSE_OUTPUT=npy|raw|csv`
+// * picks the format, CSV by default.
+
+// * Hands `data` to the background writer and returns at once.
+auto writeOutput(
+  std::vector<float> data,
+  std::string_view arr_name,
+  compute::output::Format format = compute::output::defaultFormat()
+) -> std::future<void> {
+  const std::filesystem::path path = std::format("{}{}", arr_name, compute::output::extension(format));
   std::println(
     "Writing {} data points to '{}'...",
     data.size(),
     path.string());
+  return compute::output::Writer::global().submit(path, std::move(data), format);
+}
+
+// * The old writer, one `std::println` per sample: the baseline of `BM_Output`.
+void writeToCSV (
+  std::span<const float> data,
+  const std::filesystem::path& path
+) {
   std::ofstream file(path);
 
   // * header for csv
@@ -44,16 +70,14 @@ void writeToCSV (
   for (size_t i = 0; i < data.size(); ++i) {
     std::println(file, "{},{}", i, data[i]);
   }
-
-  std::println("Finished writing to '{}'.\n", path.string());
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
-// std::vector<float> genTestSignal(size_t len) {
-auto genTestSignal() -> std::array<float, INPUT_SIZE> {
-  std::array<float, INPUT_SIZE> signal{};
-  for (size_t i = 0; i < INPUT_SIZE; ++i) {
+// * Defaults of the generators below; every API in this file takes any length.
+auto genTestSignal(size_t len = INPUT_SIZE) -> std::vector<float> {
+  std::vector<float> signal(len);
+  for (size_t i = 0; i < len; ++i) {
     float t = static_cast<float>(i);
     signal[i] =  std::sin(2.0f * PI * t / 10.0f);   // * high-freq component
     signal[i] += std::sin(2.0f * PI * t / 50.0f);   // * medium-freq component
@@ -63,16 +87,14 @@ auto genTestSignal() -> std::array<float, INPUT_SIZE> {
 }
 auto def_signal = genTestSignal();
 
-// std::vector<float> genMask(size_t len, float sigma = SIGMA) {
-auto genMask() -> std::array<float, MASK_SIZE> {
-  int center = static_cast<int>(MASK_SIZE / 2);
-  std::array<float, MASK_SIZE> mask{};
+auto genMask(size_t len = MASK_SIZE, float sigma = SIGMA) -> std::vector<float> {
+  const float center = static_cast<float>(len / 2);
+  std::vector<float> mask(len);
   float sum = 0.0f;
 
-  for (int i = 0; i < MASK_SIZE; ++i) {
-    int x = i - center;
-    float val = std::exp(
-      -1 * static_cast<float>(x * x) / (2.0f * SIGMA * SIGMA));
+  for (size_t i = 0; i < len; ++i) {
+    const float x = static_cast<float>(i) - center;
+    float val = std::exp(-1 * x * x / (2.0f * sigma * sigma));
     mask[i] = val;
     sum += val;
   }
@@ -83,113 +105,666 @@ auto genMask() -> std::array<float, MASK_SIZE> {
   }
   return mask;
 }
-auto def_mask = genMask();
-
-std::array<float, INPUT_SIZE> calculateConvolution(
-  const std::array<float, INPUT_SIZE>& signal = def_signal,
-  const std::array<float, MASK_SIZE>& mask = def_mask
-) {
+// * The default mask is built by the compiler (constexpr `exp`); `genMask`
+// * covers any other width at runtime.
+constexpr auto kDefaultMask = compute::convolution::gaussianMask<MASK_SIZE>(SIGMA);
+static_assert(kDefaultMask[MASK_SIZE / 2] > kDefaultMask[0]);
+auto def_mask = std::vector<float>(kDefaultMask.begin(), kDefaultMask.end());
+
+// * `function` defaults to the unrolled kernel for the mask's width, if any.
+auto calculateConvolution(
+  std::span<const float> signal = def_signal,
+  std::span<const float> mask = def_mask,
+  compute::Context& context = compute::Context::shared(),
+  std::string function = {}
+) -> std::vector<float> {
   /////////////////////////////////////////////////////////////////////////////
-  // * Metal boilerplate ...
+  // * Backend boilerplate (library and pipeline are cached by the context) ...
   /////////////////////////////////////////////////////////////////////////////
-  NS::AutoreleasePool* pAutoReleasePool = NS::AutoreleasePool::alloc()->init();
-  MTL::Device*  pDevice = MTL::CreateSystemDefaultDevice();
-  // MTL::Library* pLibrary = pDevice->newLibrary(
-  //   NS::String::string("./convolution.metallib", nullptr), nullptr);
-  MTL::Library* pLibrary = pDevice->newLibrary(
-    NS::String::string("./convolution.metallib", NS::ASCIIStringEncoding),
-    (NS::Error**)nullptr);
-
-  if (!pLibrary) {
-    throw std::runtime_error("Couldn't find the .metallib file");
-  }
-
-  MTL::Function* pFunction = pLibrary->newFunction(
-    NS::String::string("convolution", NS::UTF8StringEncoding));
-
-  MTL::ComputePipelineState* pComputePipelineState =
-    pDevice->newComputePipelineState(pFunction, (NS::Error**)nullptr);
+  compute::Device& device = context.device();
+  if (function.empty()) { function = compute::convolution::kernelName(mask.size()); }
+  compute::Pipeline& pipeline =
+    context.pipeline("./convolution.metallib", function);
 
   /////////////////////////////////////////////////////////////////////////////
   // * Function logic begins here ...
   /////////////////////////////////////////////////////////////////////////////
 
-  std::array<float, INPUT_SIZE> output{};
+  std::vector<float> output(signal.size());
 
   // * buffers
-  MTL::Buffer* pInputBuf = pDevice->newBuffer(
-    signal.data(), INPUT_SIZE * sizeof(float), MTL::ResourceStorageModeShared);
-  MTL::Buffer* pMaskBuf = pDevice->newBuffer(
-    mask.data(),    MASK_SIZE * sizeof(float), MTL::ResourceStorageModeShared);
-  MTL::Buffer* pOutputBuf = pDevice->newBuffer(
-                INPUT_SIZE * sizeof(float), MTL::ResourceStorageModeShared);
-  // *          ▲ equivalent to output.size()
-
-  MTL::CommandQueue*  pCommandQueue = pDevice->newCommandQueue();
-  MTL::CommandBuffer* pCommandBuffer = pCommandQueue->commandBuffer();
-  MTL::ComputeCommandEncoder*
-    pCommandEncoder = pCommandBuffer->computeCommandEncoder();
-
-  pCommandEncoder->setComputePipelineState(pComputePipelineState);
-  pCommandEncoder->setBuffer(pInputBuf,  0, 0);
-  pCommandEncoder->setBuffer(pMaskBuf,   0, 1);
-  pCommandEncoder->setBuffer(pOutputBuf, 0, 2);
-
-  uint32_t metal_mask_size = MASK_SIZE;
-  pCommandEncoder->setBytes(&metal_mask_size, sizeof(metal_mask_size), 3);
-  uint32_t metal_input_size = INPUT_SIZE;
-  pCommandEncoder->setBytes(&metal_input_size, sizeof(metal_input_size), 4);
-
-
-  MTL::Size threadsPerThreadgroup = MTL::Size(256, 1, 1);
-  MTL::Size numGroups = MTL::Size((INPUT_SIZE+255)/256, 1, 1);
+  auto pInputBuf  = device.newBuffer(signal.data(), signal.size_bytes());
+  auto pMaskBuf   = device.newBuffer(mask.data(),   mask.size_bytes());
+  auto pOutputBuf = device.newBuffer(               signal.size_bytes());
+  // *                                              ▲ equivalent to output.size()
+
+  compute::Arguments arguments;
+  arguments.setBuffer(*pInputBuf,  0, 0);
+  arguments.setBuffer(*pMaskBuf,   0, 1);
+  arguments.setBuffer(*pOutputBuf, 0, 2);
+
+  uint32_t metal_mask_size = static_cast<uint32_t>(mask.size());
+  arguments.setBytes(&metal_mask_size, sizeof(metal_mask_size), 3);
+  uint32_t metal_input_size = static_cast<uint32_t>(signal.size());
+  arguments.setBytes(&metal_input_size, sizeof(metal_input_size), 4);
+
+
+  compute::Size threadsPerThreadgroup = {256, 1, 1};
+  compute::Size numGroups = {(signal.size()+255)/256, 1, 1};
   // * Here, `threadsPerThreadgroup` is constant (=256).
   // * The total number of threads is    `numGroups * threadsPerThreadgroup`.
   // * Let total number of threads be T = numGroups * 256
   // * To ensure that every index of our `output` is processed by a thread,
-  // * we must ensure that `T >= INPUT_SIZE`.
+  // * we must ensure that `T >= signal.size()`.
   //
-  // o T = INPUT_SIZE ==> each thread worked on each element of `output` and
-  //   that no thread was idle.
-  // o T > INPUT_SIZE ==> threads up until `INPUT_SIZE` were used, the extra
-  //   threads became idle after checking the bounds of the vector.
-
-  // pCommandEncoder->dispatchThreads(numGroups, threadsPerThreadgroup);
-  pCommandEncoder->dispatchThreads(MTL::Size(INPUT_SIZE, 1, 1), threadsPerThreadgroup);
-  pCommandEncoder->endEncoding();
-  pCommandBuffer->commit();
-  pCommandBuffer->waitUntilCompleted();
-
-  float* pOutput = static_cast<float*>(pOutputBuf->contents());
-  std::copy(pOutput, pOutput+INPUT_SIZE, output.begin());
-  /////////////////////////////////////////////////////////////////////////////
-  // * Cleanup ...
-  /////////////////////////////////////////////////////////////////////////////
-  pDevice->release();
-  pInputBuf->release();
-  pMaskBuf->release();
-  pOutputBuf->release();
+  // o T = signal.size() ==> each thread worked on each element of `output`
+  //   and that no thread was idle.
+  // o T > signal.size() ==> threads up until `signal.size()` were used, the
+  //   extra threads became idle after checking the bounds of the vector.
+
+  // context.queue().dispatchThreadgroups(pipeline, arguments, numGroups, threadsPerThreadgroup);
+  context.queue().dispatchThreads(pipeline, arguments, {signal.size(), 1, 1}, threadsPerThreadgroup);
+
+  float* pOutput = pOutputBuf->as<float>();
+  std::copy(pOutput, pOutput+signal.size(), output.begin());
+  // * Buffers are released by their owning pointers; the pipeline stays cached.
+
+  return output;
+}
 
+// * `signals` holds `signals.size() / length` signals back to back; `masks`
+// * one shared mask of `mask_width` taps or one per signal. One dispatch.
+auto calculateConvolutionBatch(
+  std::span<const float> signals,
+  size_t length,
+  std::span<const float> masks,
+  size_t mask_width,
+  compute::Context& context = compute::Context::shared()
+) -> std::vector<float> {
+  std::vector<float> output(signals.size());
+  compute::convolution::DeviceConvolution(context).convolve(signals, length, masks, mask_width, output);
   return output;
 }
 
-static void BM_Metal(benchmark::State& state) {
+// * Cold start: a fresh context (device, library, pipeline) every iteration.
+// * Compute only: writing the result is `BM_Output`'s business.
+static void BM_DeviceCold(benchmark::State& state) {
+    state.SetLabel(compute::Context::shared().device().name());
+    for (auto _ : state) {
+      compute::Context context(compute::createDefaultDevice());
+      benchmark::DoNotOptimize(calculateConvolution(def_signal, def_mask, context));
+    }
+}
+BENCHMARK(BM_DeviceCold);
+
+// * Warm dispatch: the shared context already holds the pipeline.
+static void BM_DeviceWarm(benchmark::State& state) {
+    state.SetLabel(compute::Context::shared().device().name());
+    calculateConvolution();
     for (auto _ : state) {
-      writeToCSV(calculateConvolution(), "output_signal");
+      benchmark::DoNotOptimize(calculateConvolution());
+    }
+}
+BENCHMARK(BM_DeviceWarm);
+
+///////////////////////////////////////////////////////////////////////////////
+// * Output alone: `range(0)` samples to a temp file per format, against the
+// * old `std::println` CSV. Then warm dispatches whose results go to the
+// * background writer, each waiting only for the write before it.
+///////////////////////////////////////////////////////////////////////////////
+
+static auto outputPath(const char* ext) -> std::filesystem::path {
+  return std::filesystem::temp_directory_path() / std::format("repousse_output{}", ext);
+}
+
+static void BM_OutputPrintln(benchmark::State& state) {
+  const auto data = genTestSignal(state.range(0));
+  const auto path = outputPath(".csv");
+  for (auto _ : state) {
+    writeToCSV(data, path);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(std::filesystem::file_size(path)));
+  std::filesystem::remove(path);
+}
+
+static void BM_Output(benchmark::State& state, compute::output::Format format) {
+  const auto data = genTestSignal(state.range(0));
+  const auto path = outputPath(compute::output::extension(format));
+  for (auto _ : state) {
+    compute::output::write(path, data, format);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(std::filesystem::file_size(path)));
+  std::filesystem::remove(path);
+}
+
+static void BM_DeviceWarmWrite(benchmark::State& state, compute::output::Format format) {
+  state.SetLabel(compute::Context::shared().device().name());
+  const auto path = outputPath(compute::output::extension(format));
+  auto& writer = compute::output::Writer::global();
+  calculateConvolution();
+  std::future<void> previous;
+  for (auto _ : state) {
+    auto output = calculateConvolution();
+    if (previous.valid()) { previous.get(); }
+    previous = writer.submit(path, std::move(output), format);
+  }
+  if (previous.valid()) { previous.get(); }
+  std::filesystem::remove(path);
+}
+
+BENCHMARK(BM_OutputPrintln)->ArgName("N")->Arg(INPUT_SIZE)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Output, csv, compute::output::Format::Csv)
+  ->ArgName("N")->Arg(INPUT_SIZE)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Output, npy, compute::output::Format::Npy)
+  ->ArgName("N")->Arg(INPUT_SIZE)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Output, raw, compute::output::Format::Raw)
+  ->ArgName("N")->Arg(INPUT_SIZE)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_DeviceWarmWrite, csv, compute::output::Format::Csv);
+BENCHMARK_CAPTURE(BM_DeviceWarmWrite, npy, compute::output::Format::Npy);
+
+///////////////////////////////////////////////////////////////////////////////
+// * Host convolution: direct vs FFT over (signal length, mask length), and
+// * the cost model's pick (`../compute/convolution.hpp`).
+///////////////////////////////////////////////////////////////////////////////
+
+auto genSignal(size_t n) -> std::vector<float> {
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  std::vector<float> signal(n);
+  for (float& x : signal) { x = dist(rng); }
+  return signal;
+}
+
+// * Gaussian masks for the sweeps, sigma = width / 6.
+auto sweepMask(size_t width) -> std::vector<float> {
+  return genMask(width, std::max(static_cast<float>(width) / 6.0f, 0.5f));
+}
+
+static void BM_Conv(benchmark::State& state, compute::convolution::Method method) {
+  const size_t n = state.range(0);
+  const size_t m = state.range(1);
+  const auto signal = genSignal(n);
+  const auto mask = sweepMask(m);
+  std::vector<float> output(n);
+  auto used = compute::convolution::convolve(signal, mask, output, method);  // * warms plans and spectra
+  for (auto _ : state) {
+    used = compute::convolution::convolve(signal, mask, output, method);
+    benchmark::DoNotOptimize(output.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetLabel(compute::convolution::methodName(used));
+  state.counters["samples_per_s"] = benchmark::Counter(
+    static_cast<double>(n), benchmark::Counter::kIsIterationInvariantRate);
+  const auto& model = compute::convolution::CostModel::host();
+  state.counters["model_direct_us"] = model.directSeconds(n, m) * 1e6;
+  state.counters["model_fft_us"]    = model.fftSeconds(n, m, model.bestFftSize(n, m)) * 1e6;
+}
+
+constexpr std::array<int64_t, 3> kConvSignals = {1 << 12, 1 << 16, 1 << 20};
+constexpr std::array<int64_t, 9> kConvMasks   = {3, 7, 15, 31, 63, 127, 255, 511, 1023};
+
+static void registerConvolutionBenchmarks() {
+  using compute::convolution::Method;
+  for (Method method : {Method::Direct, Method::Fft, Method::Auto}) {
+    const std::string label = std::format("BM_Conv/{}", compute::convolution::methodName(method));
+    auto* bm = benchmark::RegisterBenchmark(label.c_str(), BM_Conv, method);
+    bm->ArgNames({"N", "M"})->Unit(benchmark::kMicrosecond);
+    for (int64_t n : kConvSignals) {
+      for (int64_t m : kConvMasks) { bm->Args({n, m}); }
+    }
+  }
+}
+
+// * An endless feed: the three sinusoids of `genTestSignal`, continued
+// * block after block.
+struct SineFeed {
+  size_t t = 0;
+
+  auto next(std::span<float> block) -> void {
+    for (float& x : block) {
+      const float ts = static_cast<float>(t++ % 100'000);  // * every period divides 100k
+      x =  std::sin(2.0f * PI * ts / 10.0f);
+      x += std::sin(2.0f * PI * ts / 50.0f);
+      x += std::sin(2.0f * PI * ts / 100.0f);
+    }
+  }
+};
+
+// * Streaming filter fed blocks of `range(0)` samples, with a latency of
+// * `range(1)` samples (0: the cost model's pick). Generation is excluded.
+static void BM_ConvStream(benchmark::State& state) {
+  const size_t block = state.range(0);
+  const auto mask = sweepMask(MASK_SIZE * 8 + 1);
+  compute::convolution::StreamingConvolver filter(mask, state.range(1));
+  SineFeed feed;
+  std::vector<float> in(block), out(block);
+  for (auto _ : state) {
+    state.PauseTiming();
+    feed.next(in);
+    state.ResumeTiming();
+    filter.process(in, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetLabel(compute::convolution::methodName(filter.method()));
+  state.counters["samples_per_s"] = benchmark::Counter(
+    static_cast<double>(block), benchmark::Counter::kIsIterationInvariantRate);
+  state.counters["latency"] = static_cast<double>(filter.latency());
+  state.counters["hop"]     = static_cast<double>(filter.hop());
+}
+BENCHMARK(BM_ConvStream)
+  ->ArgNames({"block", "latency"})
+  ->ArgsProduct({{1, 64, 1000, 1 << 16}, {0, 128, 1024}});
+
+// * Unrolled vs runtime-width kernels for the same odd mask widths, on a
+// * 1M-sample signal: host interior loops, then the device kernels.
+static void BM_ConvWidth(benchmark::State& state, bool fixed) {
+  const size_t n = 1 << 20, m = state.range(0);
+  const auto signal = genSignal(n);
+  const auto mask = sweepMask(m);
+  std::vector<float> output(n);
+  const auto interior = fixed ? compute::convolution::interiorKernel(m) : compute::convolution::interiorAnyWidth;
+  for (auto _ : state) {
+    compute::ThreadPool::global().parallelFor(n, compute::convolution::kDirectChunk, [&](size_t begin, size_t end) {
+      compute::convolution::directRange(signal, mask, output.data(), begin, end, interior);
+    });
+    benchmark::DoNotOptimize(output.data());
+  }
+  state.counters["taps_per_s"] = benchmark::Counter(
+    static_cast<double>(n * m), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+static void BM_DeviceWidth(benchmark::State& state, bool fixed) {
+  state.SetLabel(compute::Context::shared().device().name());
+  const size_t n = 1 << 20, m = state.range(0);
+  const auto signal = genSignal(n);
+  const auto mask = sweepMask(m);
+  const std::string function = fixed ? compute::convolution::kernelName(m) : "convolution";
+  calculateConvolution(signal, mask, compute::Context::shared(), function);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(calculateConvolution(signal, mask, compute::Context::shared(), function));
+  }
+  state.counters["taps_per_s"] = benchmark::Counter(
+    static_cast<double>(n * m), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+BENCHMARK_CAPTURE(BM_ConvWidth, fixed, true)     ->ArgName("M")->DenseRange(3, 63, 12);
+BENCHMARK_CAPTURE(BM_ConvWidth, any_width, false)->ArgName("M")->DenseRange(3, 63, 12);
+BENCHMARK_CAPTURE(BM_DeviceWidth, fixed, true)     ->ArgName("M")->DenseRange(3, 63, 12);
+BENCHMARK_CAPTURE(BM_DeviceWidth, any_width, false)->ArgName("M")->DenseRange(3, 63, 12);
+
+///////////////////////////////////////////////////////////////////////////////
+// * Halo tiles and boundary rules: the interior as one branch-free sweep,
+// * the ends through the boundary rule. Compare `BM_DeviceTiled` with
+// * `BM_DeviceWidth/any_width`, the untiled `convolution` kernel.
+///////////////////////////////////////////////////////////////////////////////
+
+static void BM_ConvBoundary(benchmark::State& state, compute::convolution::Boundary boundary) {
+  const size_t n = 1 << 20, m = state.range(0);
+  const auto signal = genSignal(n);
+  const auto mask = sweepMask(m);
+  std::vector<float> out(n);
+  for (auto _ : state) {
+    compute::convolution::convolve(signal, mask, out, compute::convolution::Method::Direct, boundary);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.counters["taps_per_s"] = benchmark::Counter(
+    static_cast<double>(n * m), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+static void BM_DeviceTiled(benchmark::State& state, compute::convolution::Boundary boundary) {
+  state.SetLabel(compute::Context::shared().device().name());
+  const size_t n = 1 << 20, m = state.range(0);
+  const auto signal = genSignal(n);
+  const auto mask = sweepMask(m);
+  std::vector<float> out(n);
+  compute::convolution::DeviceConvolution device(compute::Context::shared());
+  device.convolveTiled(signal, mask, out, boundary);
+  for (auto _ : state) {
+    device.convolveTiled(signal, mask, out, boundary);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.counters["taps_per_s"] = benchmark::Counter(
+    static_cast<double>(n * m), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+BENCHMARK_CAPTURE(BM_ConvBoundary, zero,    compute::convolution::Boundary::Zero)   ->ArgName("M")->DenseRange(3, 63, 12);
+BENCHMARK_CAPTURE(BM_ConvBoundary, clamp,   compute::convolution::Boundary::Clamp)  ->ArgName("M")->DenseRange(3, 63, 12);
+BENCHMARK_CAPTURE(BM_ConvBoundary, reflect, compute::convolution::Boundary::Reflect)->ArgName("M")->DenseRange(3, 63, 12);
+BENCHMARK_CAPTURE(BM_ConvBoundary, wrap,    compute::convolution::Boundary::Wrap)   ->ArgName("M")->DenseRange(3, 63, 12);
+BENCHMARK_CAPTURE(BM_DeviceTiled, zero,    compute::convolution::Boundary::Zero)   ->ArgName("M")->DenseRange(3, 63, 12);
+BENCHMARK_CAPTURE(BM_DeviceTiled, clamp,   compute::convolution::Boundary::Clamp)  ->ArgName("M")->DenseRange(3, 63, 12);
+BENCHMARK_CAPTURE(BM_DeviceTiled, reflect, compute::convolution::Boundary::Reflect)->ArgName("M")->DenseRange(3, 63, 12);
+BENCHMARK_CAPTURE(BM_DeviceTiled, wrap,    compute::convolution::Boundary::Wrap)   ->ArgName("M")->DenseRange(3, 63, 12);
+
+///////////////////////////////////////////////////////////////////////////////
+// * Gaussian smoothing of 1M samples as sigma grows: the FIR mask of `genMask`
+// * (radius 4 sigma) against the recursive filter, whose cost is flat.
+///////////////////////////////////////////////////////////////////////////////
+
+auto firGaussian(float sigma) -> std::vector<float> {
+  return genMask(2 * static_cast<size_t>(std::ceil(4.0f * sigma)) + 1, sigma);
+}
+
+static void BM_GaussianFir(benchmark::State& state, compute::convolution::Method method) {
+  const size_t n = 1 << 20;
+  const auto sigma = static_cast<float>(state.range(0));
+  const auto signal = genSignal(n);
+  const auto mask = firGaussian(sigma);
+  std::vector<float> out(n);
+  for (auto _ : state) {
+    compute::convolution::convolve(signal, mask, out, method);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.counters["samples_per_s"] = benchmark::Counter(
+    static_cast<double>(n), benchmark::Counter::kIsIterationInvariantRate);
+  state.counters["taps"] = static_cast<double>(mask.size());
+}
+
+// * `max_error`: largest difference from the direct FIR result, for
+// * samples in [-1, 1).
+static void BM_GaussianRecursive(benchmark::State& state, float sigma) {
+  const size_t n = 1 << 20;
+  const auto signal = genSignal(n);
+  const compute::convolution::RecursiveGaussian filter(sigma);
+  std::vector<float> out(n), reference(n);
+  for (auto _ : state) {
+    filter.apply(signal, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  compute::convolution::convolve(signal, firGaussian(sigma), reference, compute::convolution::Method::Direct);
+  float error = 0.0f;
+  for (size_t i = 0; i < n; ++i) { error = std::max(error, std::abs(out[i] - reference[i])); }
+  state.counters["samples_per_s"] = benchmark::Counter(
+    static_cast<double>(n), benchmark::Counter::kIsIterationInvariantRate);
+  state.counters["max_error"] = error;
+}
+
+BENCHMARK_CAPTURE(BM_GaussianFir, direct, compute::convolution::Method::Direct)
+  ->ArgName("sigma")->RangeMultiplier(2)->Range(1, 128)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_GaussianFir, auto, compute::convolution::Method::Auto)
+  ->ArgName("sigma")->RangeMultiplier(2)->Range(1, 128)->Unit(benchmark::kMillisecond);
+
+// * Sigma isn't a whole number at the narrow end, so the recursive sweep is
+// * registered by hand: from `kMinSigma`, where the fit is loosest, to 128.
+static void registerGaussianBenchmarks() {
+  using compute::convolution::RecursiveGaussian;
+  std::vector<float> sigmas{static_cast<float>(RecursiveGaussian::kMinSigma)};
+  for (float sigma = 1.0f; sigma <= 128.0f; sigma *= 2.0f) { sigmas.push_back(sigma); }
+  for (float sigma : sigmas) {
+    const std::string label = std::format("BM_GaussianRecursive/sigma:{}", sigma);
+    benchmark::RegisterBenchmark(label.c_str(), BM_GaussianRecursive, sigma)->Unit(benchmark::kMillisecond);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// * Images: a `range(0)`-square image and a `range(1)`-square mask, either
+// * the Gaussian `genMask ⊗ genMask` (separable) or random (dense).
+///////////////////////////////////////////////////////////////////////////////
+
+static void BM_Conv2d(benchmark::State& state, compute::convolution::Path path, bool separable) {
+  const size_t side = state.range(0), k = state.range(1);
+  const auto image = genSignal(side * side);
+  const auto mask = separable ? compute::convolution::outerProduct(sweepMask(k), sweepMask(k)) : genSignal(k * k);
+  std::vector<float> out(image.size());
+  for (auto _ : state) {
+    compute::convolution::convolve2d(image, side, side, mask, k, k, out, path);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.counters["pixels_per_s"] = benchmark::Counter(
+    static_cast<double>(side * side), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+BENCHMARK_CAPTURE(BM_Conv2d, separable, compute::convolution::Path::Separable, true)
+  ->ArgNames({"N", "K"})->ArgsProduct({{1024, 4096}, {3, 5, 7, 9, 15}})->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Conv2d, direct, compute::convolution::Path::Direct, true)
+  ->ArgNames({"N", "K"})->ArgsProduct({{1024, 4096}, {3, 5, 7, 9, 15}})->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Conv2d, dense, compute::convolution::Path::Auto, false)
+  ->ArgNames({"N", "K"})->ArgsProduct({{1024, 4096}, {3, 5, 7, 9, 15}})->Unit(benchmark::kMillisecond);
+
+///////////////////////////////////////////////////////////////////////////////
+// * Resampling 1M samples by L/M = range(0)/range(1) with the default
+// * anti-aliasing filter: polyphase (kept outputs only) against filtering at
+// * the full rate and dropping outputs, then the same as a stream.
+///////////////////////////////////////////////////////////////////////////////
+
+static void setResampleCounters(benchmark::State& state, size_t inputs, size_t outputs) {
+  state.counters["in_samples_per_s"] = benchmark::Counter(
+    static_cast<double>(inputs), benchmark::Counter::kIsIterationInvariantRate);
+  state.counters["out_samples_per_s"] = benchmark::Counter(
+    static_cast<double>(outputs), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+static void BM_Resample(benchmark::State& state) {
+  const size_t n = 1 << 20;
+  const compute::convolution::Resampler resampler(state.range(0), state.range(1));
+  const auto signal = genSignal(n);
+  std::vector<float> out(resampler.outputSize(n));
+  for (auto _ : state) {
+    resampler.resample(signal, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  setResampleCounters(state, n, out.size());
+}
+
+// * Decimation only (L = 1): the same filter on every input, then every M-th.
+static void BM_ResampleFullRate(benchmark::State& state) {
+  const size_t n = 1 << 20, down = state.range(1);
+  const auto filter = compute::convolution::resamplingFilter(1, down);
+  const auto signal = genSignal(n);
+  std::vector<float> filtered(n), out((n + down - 1) / down);
+  for (auto _ : state) {
+    compute::convolution::convolve(signal, filter, filtered);
+    for (size_t i = 0; i < out.size(); ++i) { out[i] = filtered[i * down]; }
+    benchmark::DoNotOptimize(out.data());
+  }
+  setResampleCounters(state, n, out.size());
+}
+
+static void BM_ResampleStream(benchmark::State& state) {
+  const size_t n = 1 << 20, block = 4096;
+  compute::convolution::Resampler resampler(state.range(0), state.range(1));
+  const auto signal = genSignal(n);
+  std::vector<float> out;
+  out.reserve(resampler.outputSize(n));
+  for (auto _ : state) {
+    resampler.reset();
+    out.clear();
+    for (size_t offset = 0; offset < n; offset += block) {
+      resampler.process(std::span(signal).subspan(offset, std::min(block, n - offset)), out);
     }
+    resampler.flush(out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  setResampleCounters(state, n, out.size());
+}
+
+BENCHMARK(BM_Resample)
+  ->ArgNames({"L", "M"})->Args({1, 2})->Args({1, 4})->Args({1, 8})->Args({2, 1})->Args({3, 2})->Args({147, 160})
+  ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ResampleFullRate)
+  ->ArgNames({"L", "M"})->Args({1, 2})->Args({1, 4})->Args({1, 8})->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ResampleStream)
+  ->ArgNames({"L", "M"})->Args({1, 8})->Args({3, 2})->Args({147, 160})->Unit(benchmark::kMillisecond);
+
+///////////////////////////////////////////////////////////////////////////////
+// * Median filters over windows of K samples: the sorting network and the
+// * double heap against sorting a copy of every window.
+///////////////////////////////////////////////////////////////////////////////
+
+// * 5% of samples replaced by spikes of +-8, the noise a median removes.
+auto genImpulsive(size_t n) -> std::vector<float> {
+  auto signal = genSignal(n);
+  std::mt19937 gen(7);
+  std::uniform_int_distribution<size_t> where(0, n - 1);
+  for (size_t i = 0; i < n / 20; ++i) { signal[where(gen)] = (i % 2 ? 8.0f : -8.0f); }
+  return signal;
+}
+
+static void BM_Median(benchmark::State& state, compute::convolution::Selection selection) {
+  const size_t n = 1 << 20, k = state.range(0);
+  const auto filter = compute::convolution::RankFilter::median(k, selection);
+  const auto signal = genImpulsive(n);
+  std::vector<float> out(n);
+  for (auto _ : state) {
+    filter.apply(signal, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.counters["samples_per_s"] = benchmark::Counter(
+    static_cast<double>(n), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+static void BM_MedianSort(benchmark::State& state) {
+  const size_t n = 1 << 20, k = state.range(0);
+  const auto signal = genImpulsive(n);
+  std::vector<float> out(n), window(k);
+  for (auto _ : state) {
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t j = 0; j < k; ++j) {
+        window[j] = compute::convolution::sampleAt(signal, static_cast<ptrdiff_t>(i + j) - static_cast<ptrdiff_t>(k / 2),
+          compute::convolution::Boundary::Zero);
+      }
+      std::sort(window.begin(), window.end());
+      out[i] = window[k / 2];
+    }
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.counters["samples_per_s"] = benchmark::Counter(
+    static_cast<double>(n), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+static void BM_MedianStream(benchmark::State& state) {
+  const size_t n = 1 << 20, k = state.range(0), block = 4096;
+  auto filter = compute::convolution::RankFilter::median(k);
+  const auto signal = genImpulsive(n);
+  std::vector<float> out(n + filter.latency());
+  for (auto _ : state) {
+    filter.reset();
+    for (size_t offset = 0; offset < n; offset += block) {
+      const size_t count = std::min(block, n - offset);
+      filter.process(std::span(signal).subspan(offset, count), std::span(out).subspan(offset, count));
+    }
+    filter.flush(std::span(out).subspan(n));
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetLabel(compute::convolution::selectionName(filter.selection()));
+  state.counters["samples_per_s"] = benchmark::Counter(
+    static_cast<double>(n), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+BENCHMARK_CAPTURE(BM_Median, network, compute::convolution::Selection::Network)
+  ->ArgName("K")->Arg(3)->Arg(5)->Arg(9)->Arg(15)->Arg(25)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Median, heap, compute::convolution::Selection::Heap)
+  ->ArgName("K")->Arg(3)->Arg(5)->Arg(9)->Arg(15)->Arg(25)->Arg(101)->Arg(1001)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_MedianSort)
+  ->ArgName("K")->Arg(3)->Arg(5)->Arg(9)->Arg(15)->Arg(25)->Arg(101)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_MedianStream)
+  ->ArgName("K")->Arg(5)->Arg(25)->Arg(101)->Unit(benchmark::kMillisecond);
+
+///////////////////////////////////////////////////////////////////////////////
+// * Batches of short channels: B signals of `range(1)` samples, one shared
+// * Gaussian (`range(2) == 0`) or one mask per signal.
+///////////////////////////////////////////////////////////////////////////////
+
+struct ChannelBatch {
+  std::vector<float> signals;
+  std::vector<float> masks;
+  std::vector<float> output;
+};
+
+auto genChannelBatch(size_t count, size_t length, bool shared) -> ChannelBatch {
+  ChannelBatch batch{genSignal(count * length), {}, std::vector<float>(count * length)};
+  for (size_t b = 0; b < (shared ? 1 : count); ++b) {
+    const auto mask = genMask(MASK_SIZE, SIGMA + static_cast<float>(b % 7) * 0.25f);
+    batch.masks.insert(batch.masks.end(), mask.begin(), mask.end());
+  }
+  return batch;
+}
+
+static void setBatchCounters(benchmark::State& state, size_t count, size_t length) {
+  state.counters["samples_per_s"] = benchmark::Counter(
+    static_cast<double>(count * length), benchmark::Counter::kIsIterationInvariantRate);
+  state.counters["signals_per_s"] = benchmark::Counter(
+    static_cast<double>(count), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+// * One parallel sweep on the host.
+static void BM_ConvBatchCPU(benchmark::State& state) {
+  const size_t count = state.range(0), length = state.range(1);
+  auto batch = genChannelBatch(count, length, state.range(2) == 0);
+  for (auto _ : state) {
+    compute::convolution::convolveBatch(batch.signals, length, batch.masks, MASK_SIZE, batch.output);
+    benchmark::DoNotOptimize(batch.output.data());
+  }
+  setBatchCounters(state, count, length);
+}
+
+// * One dispatch for the whole batch, uploads and read-back included.
+static void BM_ConvBatchDevice(benchmark::State& state) {
+  state.SetLabel(compute::Context::shared().device().name());
+  const size_t count = state.range(0), length = state.range(1);
+  auto batch = genChannelBatch(count, length, state.range(2) == 0);
+  calculateConvolutionBatch(batch.signals, length, batch.masks, MASK_SIZE);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(calculateConvolutionBatch(batch.signals, length, batch.masks, MASK_SIZE));
+  }
+  setBatchCounters(state, count, length);
+}
+
+// * Baseline: one `calculateConvolution` dispatch per signal.
+static void BM_ConvPerSignalDevice(benchmark::State& state) {
+  state.SetLabel(compute::Context::shared().device().name());
+  const size_t count = state.range(0), length = state.range(1);
+  auto batch = genChannelBatch(count, length, true);
+  for (auto _ : state) {
+    for (size_t b = 0; b < count; ++b) {
+      benchmark::DoNotOptimize(calculateConvolution(
+        std::span<const float>(batch.signals).subspan(b * length, length), batch.masks));
+    }
+  }
+  setBatchCounters(state, count, length);
+}
+
+BENCHMARK(BM_ConvBatchCPU)
+  ->ArgNames({"B", "len", "per_signal"})
+  ->ArgsProduct({{1, 16, 256, 4096}, {256, 4096}, {0, 1}});
+BENCHMARK(BM_ConvBatchDevice)
+  ->ArgNames({"B", "len", "per_signal"})
+  ->ArgsProduct({{1, 16, 256, 4096}, {256, 4096}, {0, 1}});
+BENCHMARK(BM_ConvPerSignalDevice)
+  ->ArgNames({"B", "len"})
+  ->ArgsProduct({{1, 16, 256, 4096}, {256}});
+
+// * The calibrated model and its crossover, so every results file says
+// * where this host switches from direct to FFT.
+static void addCrossoverContext() {
+  const auto& model = compute::convolution::CostModel::host();
+  benchmark::AddCustomContext("conv_ns_per_tap", std::format("{:.4f}", model.secondsPerTap * 1e9));
+  benchmark::AddCustomContext("conv_ns_per_fft_point", std::format("{:.4f}", model.secondsPerFftPoint * 1e9));
+  for (int64_t n : kConvSignals) {
+    benchmark::AddCustomContext(
+      std::format("conv_crossover_mask@N={}", n),
+      std::to_string(model.crossoverMaskSize(n)));
+  }
 }
-BENCHMARK(BM_Metal);
 
 //        ▼ I don't like doing this, but `benchmark` requires it
 int main (int argc, char** argv) {
-  writeToCSV(def_signal, "inp_signal");
-  writeToCSV(def_mask, "mask_arr");
+  std::array writes{
+    writeOutput(def_signal, "inp_signal"),
+    writeOutput(def_mask, "mask_arr"),
+    writeOutput(calculateConvolution(), "output_signal")};
+  // * Files are on disk before any benchmark competes for the disk.
+  for (auto& write : writes) { write.get(); }
+  std::println("Finished writing.\n");
 
-  auto output = calculateConvolution();
-  writeToCSV(output, "output_signal");
+  registerConvolutionBenchmarks();
+  registerGaussianBenchmarks();
 
   ::benchmark::Initialize(&argc, argv);
   if (::benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+  addCrossoverContext();
   ::benchmark::RunSpecifiedBenchmarks();
   ::benchmark::Shutdown();
   return 0;
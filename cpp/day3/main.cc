@@ -1,120 +1,141 @@
 #include <algorithm>
+#include <array>
 #include <cassert>
+#include <cstdint>
+#include <format>
+#include <memory>
 #include <print>
-#include <random>
+#include <thread>
 #include <vector>
 
+#ifdef __APPLE__
 #define NS_PRIVATE_IMPLEMENTATION
 #define MTL_PRIVATE_IMPLEMENTATION
 #include "../Metal.hpp"
+#endif
+#include "../compute/context.hpp"
+#include "../compute/gemm.hpp"
+#include "../compute/gemm_batched.hpp"
+#include "../compute/gemm_device.hpp"
+#include "../compute/gemm_tuning.hpp"
+#include "../compute/memory.hpp"
+#include "../compute/random.hpp"
+#include "../compute/thread_pool.hpp"
 
 #include <benchmark/benchmark.h>
 
-using Matrix = std::vector<float>;
+// * Page-aligned storage, so device buffers can wrap it without copying.
+using Matrix = compute::PageVector<float>;
 
 const auto MATRIX_DIMENSION = 1024;
 const size_t MATRIX_BUFFER_SIZE =
   MATRIX_DIMENSION * MATRIX_DIMENSION * sizeof(float);
 
+// * Counter-based (Philox) fill with a fixed seed, so runs are comparable and
+// * the values don't depend on the thread count.
 auto genMatrix (
+  uint64_t seed,
   uint rows = MATRIX_DIMENSION,
   uint cols = MATRIX_DIMENSION) -> Matrix {
-  std::random_device rd;
-  std::mt19937 gen(rd());
-  std::uniform_real_distribution<> distr(-5.0f, 5.0f);
-
-  Matrix matrix(rows * cols);
-  for (float& val : matrix) {
-      val = static_cast<float>(distr(gen));
-  }
+  Matrix matrix(size_t(rows) * cols);
+  compute::random::fillUniform(matrix, -5.0f, 5.0f, seed);
   return matrix;
 };
 
-auto matMultiplicationMetal (Matrix& a, Matrix& b) -> Matrix {
-  Matrix result(MATRIX_DIMENSION * MATRIX_DIMENSION, 0.0f);
-
-  NS::AutoreleasePool* pAutoReleasePool = NS::AutoreleasePool::alloc()->init();
-  // auto mtlStruct = MetalObjects (
-  //   static_cast<std::filesystem::path>("./mat_mul.metallib"), "mat_mul");
+// * 2·M·N·K floating-point operations per product.
+static void setFlops (benchmark::State& state, size_t m, size_t n, size_t k) {
+  state.counters["flops_per_s"] = benchmark::Counter(
+    2.0 * static_cast<double>(m) * static_cast<double>(n) * static_cast<double>(k),
+    benchmark::Counter::kIsIterationInvariantRate);
+}
 
-  MTL::Device* pDevice = MTL::CreateSystemDefaultDevice();
-  MTL::Library* pLibrary = pDevice->newLibrary (
-    NS::String::string("./mat_mul.metallib",
-    NS::StringEncoding::UTF8StringEncoding),
-    nullptr);
+// * The tuner behind the default paths: `REPOUSSE_TUNE` picks whether it
+// * only reads the cache (the default) or may search.
+static auto tuner () -> compute::gemm::Tuner& {
+  static compute::gemm::Tuner tuner;
+  return tuner;
+}
 
-  if (!pLibrary) {
-    throw std::runtime_error("Couldn't find the .metallib file");
-  }
+// * `DeviceGemm`'s tile for 1024³ on the shared context's device, from the
+// * tuning cache (or the default tile), looked up once.
+static auto deviceTile () -> size_t {
+  static const size_t tile = [] {
+    compute::gemm::DeviceGemm gemm(compute::Context::shared());
+    tuner().tuneTile(gemm, MATRIX_DIMENSION, MATRIX_DIMENSION, MATRIX_DIMENSION);
+    return gemm.tile();
+  }();
+  return tile;
+}
 
-  MTL::Function* pFunction = pLibrary->newFunction(
-    NS::String::string("mat_mul", NS::UTF8StringEncoding));
+auto matMultiplicationDevice (
+  Matrix& a,
+  Matrix& b,
+  compute::Context& context = compute::Context::shared()) -> Matrix {
+  // * Every element is written by the kernel, so no zero-fill.
+  Matrix result(MATRIX_DIMENSION * MATRIX_DIMENSION);
 
-  MTL::ComputePipelineState* pComputePipelineState =
-    pDevice->newComputePipelineState(pFunction, (NS::Error**)nullptr);
+  // * Library and pipeline are loaded once and cached by the context.
+  compute::Device& device = context.device();
+  compute::Pipeline& pipeline = context.pipeline("./mat_mul.metallib", "mat_mul");
 
-  pLibrary->release();
-  pFunction->release();
+  // * The buffers borrow the matrices' pages: nothing is copied in or out.
+  auto pBufferA      = compute::wrapBuffer(device, a);
+  auto pBufferB      = compute::wrapBuffer(device, b);
+  auto pBufferResult = compute::wrapBuffer(device, result);
 
-  MTL::Buffer
-    *pBufferA = pDevice->newBuffer( a.data(),
-                                    MATRIX_BUFFER_SIZE,
-                                    MTL::ResourceStorageModeShared),
-    *pBufferB = pDevice->newBuffer( b.data(),
-                                    MATRIX_BUFFER_SIZE,
-                                    MTL::ResourceStorageModeShared),
-    *pBufferResult = pDevice->newBuffer(
-                                    result.data(),
-                                    MATRIX_BUFFER_SIZE,
-                                    MTL::ResourceStorageModeShared);
+  compute::Arguments arguments;
+  arguments.setBuffer(*pBufferA,      0, 0);
+  arguments.setBuffer(*pBufferB,      0, 1);
+  arguments.setBuffer(*pBufferResult, 0, 2);
 
-  MTL::CommandQueue*  pCommandQueue = pDevice->newCommandQueue();
-  MTL::CommandBuffer* pCommandBuffer = pCommandQueue->commandBuffer();
-  MTL::ComputeCommandEncoder*
-    pCommandEncoder = pCommandBuffer->computeCommandEncoder();
+  uint32_t matrix_inner_dim = MATRIX_DIMENSION;
+  auto pBufferDim = device.newBuffer(&matrix_inner_dim, sizeof(uint32_t));
+  arguments.setBuffer(*pBufferDim, 0, 3);
+  // * Width and height of the result; the kernel no longer infers them from the grid.
+  const std::array<uint32_t, 2> resultSize = {MATRIX_DIMENSION, MATRIX_DIMENSION};
+  arguments.setValue(resultSize, 4);
 
-  pCommandEncoder->setComputePipelineState(pComputePipelineState);
-  pCommandEncoder->setBuffer(pBufferA,      0, 0);
-  pCommandEncoder->setBuffer(pBufferB,      0, 1);
-  pCommandEncoder->setBuffer(pBufferResult, 0, 2);
+  // * The kernel takes its tile from the threadgroup size: any square group
+  // * up to `MAX_TILE_SIZE` works, so the tuned tile needs no shader edit.
+  size_t tile = deviceTile();
+  while (tile > 1 && tile * tile > pipeline.maxTotalThreadsPerThreadgroup()) { --tile; }
+  compute::Size threadsPerThreadgroup = {tile, tile, 1};
+  compute::Size numGroups = {
+    (MATRIX_DIMENSION + tile - 1) / tile,
+    (MATRIX_DIMENSION + tile - 1) / tile, 1};
 
-  uint32_t matrix_inner_dim = MATRIX_DIMENSION;
-  MTL::Buffer* pBufferDim = pDevice->newBuffer(&matrix_inner_dim,
-                                               sizeof(uint32_t),
-                                               MTL::ResourceStorageModeShared);
-  pCommandEncoder->setBuffer(pBufferDim, 0, 3);
-
-  MTL::Size threadsPerThreadgroup = MTL::Size(16, 16, 1);
-  MTL::Size numGroups = MTL::Size(
-    (MATRIX_DIMENSION + 15) / 16,
-    (MATRIX_DIMENSION + 15) / 16, 1);
-
-  pCommandEncoder->dispatchThreadgroups(numGroups, threadsPerThreadgroup);
-  pCommandEncoder->endEncoding();
-  pCommandBuffer->commit();
-  pCommandBuffer->waitUntilCompleted();
-
-  float* pResult = static_cast<float*>(pBufferResult->contents());
-  std::copy(pResult, pResult + (MATRIX_DIMENSION * MATRIX_DIMENSION), result.begin());
-
-  pBufferDim->release();
-  pDevice->release();
-  pBufferA->release();
-  pBufferB->release();
-  pBufferResult->release();
+  context.queue().dispatchThreadgroups(pipeline, arguments, numGroups, threadsPerThreadgroup);
   return result;
 }
 
-static void BM_Metal (benchmark::State& state) {
-  Matrix a = genMatrix();
-  Matrix b = genMatrix();
+// * Cold start: a fresh context (device, library, pipeline) every iteration.
+static void BM_DeviceCold (benchmark::State& state) {
+  Matrix a = genMatrix(1);
+  Matrix b = genMatrix(2);
+  state.SetLabel(std::format("{}, tile {}", compute::Context::shared().device().name(), deviceTile()));
   for (auto _ : state) {
-    matMultiplicationMetal(a, b);
+    compute::Context context(compute::createDefaultDevice());
+    matMultiplicationDevice(a, b, context);
   }
+  setFlops(state, MATRIX_DIMENSION, MATRIX_DIMENSION, MATRIX_DIMENSION);
 }
-BENCHMARK(BM_Metal);
+BENCHMARK(BM_DeviceCold)->UseRealTime();
 
-auto matMultiplicationCPU (Matrix& a, Matrix& b) -> Matrix {
+// * Warm dispatch: the shared context already holds the pipeline.
+static void BM_DeviceWarm (benchmark::State& state) {
+  Matrix a = genMatrix(1);
+  Matrix b = genMatrix(2);
+  state.SetLabel(std::format("{}, tile {}", compute::Context::shared().device().name(), deviceTile()));
+  matMultiplicationDevice(a, b);
+  for (auto _ : state) {
+    matMultiplicationDevice(a, b);
+  }
+  setFlops(state, MATRIX_DIMENSION, MATRIX_DIMENSION, MATRIX_DIMENSION);
+}
+BENCHMARK(BM_DeviceWarm)->UseRealTime();
+
+// * The original i-j-k triple loop, kept as the baseline.
+auto matMultiplicationNaive (Matrix& a, Matrix& b) -> Matrix {
   Matrix result(MATRIX_DIMENSION * MATRIX_DIMENSION, 0.0f);
   for (uint32_t i = 0; i < MATRIX_DIMENSION; ++i) {
     for (uint32_t j = 0; j < MATRIX_DIMENSION; ++j) {
@@ -127,16 +148,323 @@ auto matMultiplicationCPU (Matrix& a, Matrix& b) -> Matrix {
   return result;
 }
 
+// * Packed, cache-blocked GEMM with the widest micro-kernel this CPU runs,
+// * blocked and threaded as the tuning cache says.
+auto matMultiplicationCPU (Matrix& a, Matrix& b) -> Matrix {
+  Matrix result(MATRIX_DIMENSION * MATRIX_DIMENSION);
+  tuner().gemm(
+    compute::gemm::Transpose::No, compute::gemm::Transpose::No, MATRIX_DIMENSION, MATRIX_DIMENSION, MATRIX_DIMENSION,
+    1.0f, a.data(), MATRIX_DIMENSION, b.data(), MATRIX_DIMENSION, 0.0f, result.data(), MATRIX_DIMENSION);
+  return result;
+}
+
+static void BM_CPUNaive (benchmark::State& state) {
+  Matrix a = genMatrix(1);
+  Matrix b = genMatrix(2);
+  for (auto _ : state) {
+    matMultiplicationNaive(a, b);
+  }
+  setFlops(state, MATRIX_DIMENSION, MATRIX_DIMENSION, MATRIX_DIMENSION);
+}
+BENCHMARK(BM_CPUNaive)->Unit(benchmark::kMillisecond);
+
 static void BM_CPU (benchmark::State& state) {
-  Matrix a = genMatrix();
-  Matrix b = genMatrix();
+  Matrix a = genMatrix(1);
+  Matrix b = genMatrix(2);
   for (auto _ : state) {
     matMultiplicationCPU(a, b);
   }
+  setFlops(state, MATRIX_DIMENSION, MATRIX_DIMENSION, MATRIX_DIMENSION);
+}
+BENCHMARK(BM_CPU)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// * One ISA's micro-kernel over square sizes.
+static void BM_Gemm (benchmark::State& state, compute::gemm::Isa isa) {
+  if (!compute::gemm::supported(isa)) {
+    state.SkipWithError("ISA not supported on this CPU");
+    return;
+  }
+  const size_t n = state.range(0);
+  Matrix a = genMatrix(1, n, n);
+  Matrix b = genMatrix(2, n, n);
+  Matrix c(n * n);
+  for (auto _ : state) {
+    compute::gemm::matmul(a, b, c, n, n, n, isa);
+    benchmark::DoNotOptimize(c.data());
+  }
+  setFlops(state, n, n, n);
+}
+BENCHMARK_CAPTURE(BM_Gemm, scalar, compute::gemm::Isa::Scalar)
+  ->ArgName("N")->RangeMultiplier(2)->Range(128, 2048)->UseRealTime()->Unit(benchmark::kMillisecond);
+#ifdef REPOUSSE_X86
+BENCHMARK_CAPTURE(BM_Gemm, avx2, compute::gemm::Isa::Avx2)
+  ->ArgName("N")->RangeMultiplier(2)->Range(128, 2048)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Gemm, avx512, compute::gemm::Isa::Avx512)
+  ->ArgName("N")->RangeMultiplier(2)->Range(128, 2048)->UseRealTime()->Unit(benchmark::kMillisecond);
+#elif defined(REPOUSSE_NEON)
+BENCHMARK_CAPTURE(BM_Gemm, neon, compute::gemm::Isa::Neon)
+  ->ArgName("N")->RangeMultiplier(2)->Range(128, 2048)->UseRealTime()->Unit(benchmark::kMillisecond);
+#endif
+
+// * C[block] += op(A[block])·op(B[block]): every operand is a view at an
+// * offset inside a 1024x1024 matrix, and C accumulates in place (beta = 1),
+// * so nothing is copied out or allocated per call.
+constexpr size_t kViewM = 1000, kViewN = 900, kViewK = 800;
+constexpr size_t kViewOffset = 5 * MATRIX_DIMENSION + 7;
+
+static void BM_GemmView (benchmark::State& state, compute::gemm::Transpose transA, compute::gemm::Transpose transB) {
+  Matrix a = genMatrix(1);
+  Matrix b = genMatrix(2);
+  Matrix c = genMatrix(3);
+  for (auto _ : state) {
+    compute::gemm::gemm(
+      transA, transB, kViewM, kViewN, kViewK,
+      1e-3f, a.data() + kViewOffset, MATRIX_DIMENSION, b.data() + kViewOffset, MATRIX_DIMENSION,
+      1.0f, c.data() + kViewOffset, MATRIX_DIMENSION);
+    benchmark::DoNotOptimize(c.data());
+  }
+  setFlops(state, kViewM, kViewN, kViewK);
+}
+
+// * The same views through `DeviceGemm`, with the matrices' pages wrapped as buffers.
+static void BM_DeviceGemmView (benchmark::State& state, compute::gemm::Transpose transA, compute::gemm::Transpose transB) {
+  compute::Context& context = compute::Context::shared();
+  state.SetLabel(context.device().name());
+  Matrix a = genMatrix(1);
+  Matrix b = genMatrix(2);
+  Matrix c = genMatrix(3);
+  auto pBufferA = compute::wrapBuffer(context.device(), a);
+  auto pBufferB = compute::wrapBuffer(context.device(), b);
+  auto pBufferC = compute::wrapBuffer(context.device(), c);
+  compute::gemm::DeviceGemm gemm(context);
+  for (auto _ : state) {
+    gemm.gemm(
+      transA, transB, kViewM, kViewN, kViewK,
+      1e-3f, {*pBufferA, kViewOffset}, MATRIX_DIMENSION, {*pBufferB, kViewOffset}, MATRIX_DIMENSION,
+      1.0f, {*pBufferC, kViewOffset}, MATRIX_DIMENSION);
+  }
+  setFlops(state, kViewM, kViewN, kViewK);
+}
+
+BENCHMARK_CAPTURE(BM_GemmView, NN, compute::gemm::Transpose::No, compute::gemm::Transpose::No)
+  ->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_GemmView, NT, compute::gemm::Transpose::No, compute::gemm::Transpose::Yes)
+  ->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_GemmView, TN, compute::gemm::Transpose::Yes, compute::gemm::Transpose::No)
+  ->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_GemmView, TT, compute::gemm::Transpose::Yes, compute::gemm::Transpose::Yes)
+  ->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_DeviceGemmView, NN, compute::gemm::Transpose::No, compute::gemm::Transpose::No)
+  ->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_DeviceGemmView, NT, compute::gemm::Transpose::No, compute::gemm::Transpose::Yes)
+  ->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_DeviceGemmView, TN, compute::gemm::Transpose::Yes, compute::gemm::Transpose::No)
+  ->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_DeviceGemmView, TT, compute::gemm::Transpose::Yes, compute::gemm::Transpose::Yes)
+  ->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// * Batches of small S x S products: 4096 of them, fewer at 64x64 so each
+// * operand stays at 16 MiB.
+static auto batchCount (size_t size) -> size_t {
+  return std::min<size_t>(4096, (size_t{1} << 22) / (size * size));
+}
+
+static void setMatrices (benchmark::State& state, size_t count, size_t size) {
+  state.counters["matrices_per_s"] = benchmark::Counter(
+    static_cast<double>(count), benchmark::Counter::kIsIterationInvariantRate);
+  setFlops(state, count * size, size, size);
+}
+
+enum class BatchForm { Loop, Strided, Pointers, Interleaved };
+
+// * Loop: one general `gemm` call per product, the baseline. Strided and
+// * Pointers: the two batched APIs. Interleaved: SIMD across the batch.
+static void BM_GemmBatched (benchmark::State& state, BatchForm form) {
+  const size_t size = state.range(0);
+  const size_t count = batchCount(size);
+  const size_t elements = size * size;
+  Matrix a = genMatrix(1, count * size, size);
+  Matrix b = genMatrix(2, count * size, size);
+  Matrix c(count * elements);
+
+  std::vector<const float*> as(count), bs(count);
+  std::vector<float*> cs(count);
+  for (size_t i = 0; i < count; ++i) {
+    as[i] = a.data() + i * elements;
+    bs[i] = b.data() + i * elements;
+    cs[i] = c.data() + i * elements;
+  }
+  using compute::gemm::Interleaved;
+  const Interleaved ia = Interleaved::from(a, size, size);
+  const Interleaved ib = Interleaved::from(b, size, size);
+  Interleaved ic(count, size, size);
+
+  for (auto _ : state) {
+    switch (form) {
+      case BatchForm::Loop:
+        for (size_t i = 0; i < count; ++i) {
+          compute::gemm::gemm(
+            compute::gemm::Transpose::No, compute::gemm::Transpose::No, size, size, size,
+            1.0f, as[i], size, bs[i], size, 0.0f, cs[i], size);
+        }
+        break;
+      case BatchForm::Strided:
+        compute::gemm::gemmStridedBatched(
+          size, size, size, 1.0f, a.data(), size, elements, b.data(), size, elements,
+          0.0f, c.data(), size, elements, count);
+        break;
+      case BatchForm::Pointers:
+        compute::gemm::gemmBatched(size, size, size, 1.0f, as, size, bs, size, 0.0f, cs, size);
+        break;
+      case BatchForm::Interleaved:
+        compute::gemm::gemmInterleaved(1.0f, ia, ib, 0.0f, ic);
+        break;
+    }
+    benchmark::DoNotOptimize(c.data());
+    benchmark::DoNotOptimize(ic.group(0));
+  }
+  if (form == BatchForm::Strided || form == BatchForm::Pointers) {
+    state.SetLabel(compute::gemm::smallProductName(size, size, size));
+  }
+  setMatrices(state, count, size);
+}
+BENCHMARK_CAPTURE(BM_GemmBatched, loop, BatchForm::Loop)
+  ->ArgName("S")->Arg(4)->Arg(8)->Arg(16)->Arg(32)->Arg(64)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_GemmBatched, strided, BatchForm::Strided)
+  ->ArgName("S")->Arg(4)->Arg(8)->Arg(16)->Arg(32)->Arg(64)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_GemmBatched, pointers, BatchForm::Pointers)
+  ->ArgName("S")->Arg(4)->Arg(8)->Arg(16)->Arg(32)->Arg(64)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_GemmBatched, interleaved, BatchForm::Interleaved)
+  ->ArgName("S")->Arg(4)->Arg(8)->Arg(16)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+// * The whole strided batch as one dispatch of `gemm_batched`.
+static void BM_DeviceGemmBatched (benchmark::State& state) {
+  const size_t size = state.range(0);
+  const size_t count = batchCount(size);
+  const size_t elements = size * size;
+  compute::Context& context = compute::Context::shared();
+  state.SetLabel(context.device().name());
+  Matrix a = genMatrix(1, count * size, size);
+  Matrix b = genMatrix(2, count * size, size);
+  Matrix c(count * elements);
+  auto pBufferA = compute::wrapBuffer(context.device(), a);
+  auto pBufferB = compute::wrapBuffer(context.device(), b);
+  auto pBufferC = compute::wrapBuffer(context.device(), c);
+  compute::gemm::DeviceGemm gemm(context);
+  for (auto _ : state) {
+    gemm.stridedBatched(
+      size, size, size, 1.0f, {*pBufferA}, size, elements, {*pBufferB}, size, elements,
+      0.0f, {*pBufferC}, size, elements, count);
+  }
+  setMatrices(state, count, size);
+}
+BENCHMARK(BM_DeviceGemmBatched)
+  ->ArgName("S")->Arg(4)->Arg(8)->Arg(16)->Arg(32)->Arg(64)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+// * Thread counts 1, 2, 4, ... up to the hardware's, which is always included.
+static void threadCounts (benchmark::internal::Benchmark* bench, const std::vector<int64_t>& shape) {
+  const int64_t cores = std::max(1u, std::thread::hardware_concurrency());
+  for (int64_t threads = 1; ; threads = std::min(threads * 2, cores)) {
+    std::vector<int64_t> args = shape;
+    args.push_back(threads);
+    bench->Args(args);
+    if (threads == cores) { break; }
+  }
+}
+
+// * M x N x K on a private pool of `threads` threads (`REPOUSSE_PIN=1` pins them).
+static void BM_GemmThreads (benchmark::State& state) {
+  const size_t m = state.range(0), n = state.range(1), k = state.range(2);
+  compute::ThreadPool pool(state.range(3));
+  Matrix a = genMatrix(1, m, k);
+  Matrix b = genMatrix(2, k, n);
+  Matrix c(m * n);
+  for (auto _ : state) {
+    compute::gemm::matmul(a, b, c, m, n, k, compute::gemm::activeIsa(), pool);
+    benchmark::DoNotOptimize(c.data());
+  }
+  // * The split of one packed panel of B, as `multiply` makes it. Its
+  // * thread count must be a cap, not a hint: the last tile pass may not
+  // * have spread over more threads than that.
+  const auto& kernel = compute::gemm::microKernel(compute::gemm::activeIsa());
+  const auto split = compute::gemm::partition(
+    m, std::min(n, kernel.blocking.nc), k, pool.size(), kernel, kernel.blocking);
+  if (pool.threadsUsed() > split.threads) {
+    state.SkipWithError(std::format(
+      "planned {} threads but the tiles ran on {}", split.threads, pool.threadsUsed()).c_str());
+    return;
+  }
+  state.SetLabel(std::format("{}x{} tiles of {}x{}{}", split.mWays, split.nWays, split.rows, split.cols,
+    pool.pinnedWorkers() ? ", pinned" : ""));
+  setFlops(state, m, n, k);
+}
+BENCHMARK(BM_GemmThreads)
+  ->ArgNames({"M", "N", "K", "threads"})
+  ->Apply([](benchmark::internal::Benchmark* bench) {
+    // * 160³ is small enough that `partition` leaves most of a big pool idle.
+    for (int64_t size : {160, 256, 1024, 4096}) { threadCounts(bench, {size, size, size}); }
+    // * Tall and skinny, short and wide, and a thin inner dimension.
+    threadCounts(bench, {4096, 256, 1024});
+    threadCounts(bench, {256, 4096, 1024});
+    threadCounts(bench, {2048, 2048, 64});
+  })
+  ->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// * N x N x N with the tuner's plan for this machine. Searches only with
+// * `REPOUSSE_TUNE=search` (or `retune`); the label says where the plan came from.
+static void BM_GemmTuned (benchmark::State& state) {
+  const size_t n = state.range(0);
+  compute::gemm::Tuner tuner;
+  Matrix a = genMatrix(1, n, n);
+  Matrix b = genMatrix(2, n, n);
+  Matrix c(n * n);
+  const compute::gemm::Plan plan = tuner.plan(n, n, n);
+  for (auto _ : state) {
+    tuner.gemm(
+      compute::gemm::Transpose::No, compute::gemm::Transpose::No, n, n, n,
+      1.0f, a.data(), n, b.data(), n, 0.0f, c.data(), n);
+    benchmark::DoNotOptimize(c.data());
+  }
+  state.SetLabel(std::format("{}: mc {} kc {} nc {}, {} threads",
+    plan.source, plan.blocking.mc, plan.blocking.kc, plan.blocking.nc, plan.threads));
+  setFlops(state, n, n, n);
+}
+BENCHMARK(BM_GemmTuned)
+  ->ArgName("N")->RangeMultiplier(4)->Range(256, 4096)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// * The device `gemm` with its tuned tile.
+static void BM_DeviceGemmTuned (benchmark::State& state) {
+  const size_t n = state.range(0);
+  compute::Context& context = compute::Context::shared();
+  Matrix a = genMatrix(1, n, n);
+  Matrix b = genMatrix(2, n, n);
+  Matrix c(n * n);
+  auto pBufferA = compute::wrapBuffer(context.device(), a);
+  auto pBufferB = compute::wrapBuffer(context.device(), b);
+  auto pBufferC = compute::wrapBuffer(context.device(), c);
+  compute::gemm::DeviceGemm gemm(context);
+  compute::gemm::Tuner tuner;
+  const char* source = tuner.tuneTile(gemm, n, n, n);
+  for (auto _ : state) {
+    gemm.gemm(
+      compute::gemm::Transpose::No, compute::gemm::Transpose::No, n, n, n,
+      1.0f, {*pBufferA}, n, {*pBufferB}, n, 0.0f, {*pBufferC}, n);
+  }
+  state.SetLabel(std::format("{}, {}: tile {}", context.device().name(), source, gemm.tile()));
+  setFlops(state, n, n, n);
 }
-BENCHMARK(BM_CPU);
+BENCHMARK(BM_DeviceGemmTuned)
+  ->ArgName("N")->RangeMultiplier(4)->Range(256, 1024)->UseRealTime()->Unit(benchmark::kMillisecond);
 
 auto main (int argc, char* argv[]) -> int {
+  // * Load the tuning cache, and the configurations the default paths use,
+  // * before anything is timed.
+  compute::autotune::Cache& tuning = compute::autotune::Cache::global();
+  benchmark::AddCustomContext("tuning", std::format("{} ({}, {} entries)",
+    tuning.path().string(), compute::autotune::modeName(compute::autotune::defaultMode()), tuning.size()));
+  const compute::gemm::Plan plan = tuner().plan(MATRIX_DIMENSION, MATRIX_DIMENSION, MATRIX_DIMENSION);
+  benchmark::AddCustomContext("tuned_1024", std::format("{}: mc {} kc {} nc {}, {} threads; device tile {}",
+    plan.source, plan.blocking.mc, plan.blocking.kc, plan.blocking.nc, plan.threads, deviceTile()));
   benchmark::Initialize(&argc, argv);
   if (::benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
   ::benchmark::RunSpecifiedBenchmarks();
@@ -1,10 +1,11 @@
 #include <metal_stdlib>
 using namespace metal;
 
-// Size of the tile and threadgroup. This must match the threadgroup
-// size set in the C++ host code. Use smaller tile size for it to fit
-// within the GPU's caches.
-#define TILE_SIZE 16
+// Largest tile (and threadgroup side) the kernels below accept. The tile
+// actually used is the threadgroup width, which must equal its height: the
+// host picks it (tuned per GPU, see `compute/gemm_tuning.hpp`) and nothing
+// here has to be edited to match. Smaller tiles use less threadgroup memory.
+#define MAX_TILE_SIZE 32
 
 kernel void mat_mul (
   device const float* matrix_a [[buffer(0)]],
@@ -13,46 +14,47 @@ kernel void mat_mul (
 
   // gid: Global thread ID
   // tid: Local thread ID within threadgroup
-  // tgroup_id: ID of the threadgroup itself within grid of groups.
   constant uint& matrix_inner_dim [[buffer(3)]],
+  // result_size.x = width of matrix B and the result matrix.
+  // result_size.y = height of matrix A and the result matrix.
+  // The grid is rounded up to whole threadgroups, so it can't stand in for
+  // either: it only matched the width for square multiples of the tile.
+  constant uint2& result_size [[buffer(4)]],
   uint2 gid [[thread_position_in_grid]],
   uint2 tid [[thread_position_in_threadgroup]],
-  uint2 tgroup_id [[threadgroup_position_in_grid]],
-  uint2 grid_size [[threads_per_grid]])
-  // grid_size.x = width of matrix B and the result matrix.
-  // grid_size.y = height of matrix A and the result matrix.
-  // The width of A and height of B are assumed to be equal (inner dimension).
+  uint2 group_size [[threads_per_threadgroup]])
 {
-  // Prevent threads from writing out of bounds if the
-  // matrix dimensions are not perfectly divisible by the tile size.
-  if (gid.x >= grid_size.x || gid.y >= grid_size.y) { return; }
+  const uint tile = group_size.x;
+  // Threads past the edge of the result still help load the tiles and must
+  // reach every barrier; they just don't write.
+  const bool inside = gid.x < result_size.x && gid.y < result_size.y;
 
-  threadgroup float tileA[TILE_SIZE][TILE_SIZE];
-  threadgroup float tileB[TILE_SIZE][TILE_SIZE];
+  threadgroup float tileA[MAX_TILE_SIZE][MAX_TILE_SIZE];
+  threadgroup float tileB[MAX_TILE_SIZE][MAX_TILE_SIZE];
 
   float sum = 0.0f;
   // Process matrices one tile at a time.
   // The number of tiles is the total inner dimension divided by the tile size.
-  uint num_tiles = (matrix_inner_dim + TILE_SIZE - 1) / TILE_SIZE;
+  uint num_tiles = (matrix_inner_dim + tile - 1) / tile;
   for (uint tile_idx = 0; tile_idx < num_tiles; ++tile_idx) {
     // Calculate the source indices in the global matrices.
-    const uint a_col = tile_idx * TILE_SIZE + tid.x;
+    const uint a_col = tile_idx * tile + tid.x;
     const uint a_row = gid.y;
 
     const uint b_col = gid.x;
-    const uint b_row = tile_idx * TILE_SIZE + tid.y;
+    const uint b_row = tile_idx * tile + tid.y;
 
     // Load the elements into the shared tiles.
     // Perform a bounds check for cases where matrix dimensions aren't a
-    // multiple of TILE_SIZE, preventing reads from out of bounds.
-    if (a_col < matrix_inner_dim) {
+    // multiple of the tile size, preventing reads from out of bounds.
+    if (a_row < result_size.y && a_col < matrix_inner_dim) {
       tileA[tid.y][tid.x] = matrix_a[a_row * matrix_inner_dim + a_col];
     } else {
       tileA[tid.y][tid.x] = 0.0f;
     }
 
-    if (b_row < matrix_inner_dim) {
-      tileB[tid.y][tid.x] = matrix_b[b_row * grid_size.x + b_col];
+    if (b_row < matrix_inner_dim && b_col < result_size.x) {
+      tileB[tid.y][tid.x] = matrix_b[b_row * result_size.x + b_col];
     } else {
       tileB[tid.y][tid.x] = 0.0f;
     }
@@ -62,7 +64,7 @@ kernel void mat_mul (
     threadgroup_barrier(mem_flags::mem_threadgroup);
 
     // Each thread performs dot product for its portion of the tile.
-    for (uint k = 0; k < TILE_SIZE; ++k) {
+    for (uint k = 0; k < tile; ++k) {
       sum += tileA[tid.y][k] * tileB[k][tid.x];
     }
 
@@ -71,5 +73,124 @@ kernel void mat_mul (
     threadgroup_barrier(mem_flags::mem_threadgroup);
   }
 
-  result_matrix[gid.y * grid_size.x + gid.x] = sum;
+  if (inside) {
+    result_matrix[gid.y * result_size.x + gid.x] = sum;
+  }
+}
+
+// Layout of `compute::gemm::KernelParams` on the host.
+struct GemmParams {
+  uint m, n, k;
+  uint lda, ldb, ldc;
+  uint trans_a, trans_b;
+  float alpha, beta;
+};
+
+// C = alpha * op(A) * op(B) + beta * C, row-major, on views into larger
+// matrices (the leading dimensions are the row strides of the stored
+// matrices; offsets are applied when the buffers are bound).
+// op(A) is m x k, op(B) is k x n, C is m x n. C is only read if beta != 0.
+kernel void gemm (
+  device const float* a      [[buffer(0)]],
+  device const float* b      [[buffer(1)]],
+  device float* c            [[buffer(2)]],
+  constant GemmParams& p     [[buffer(3)]],
+  uint2 gid [[thread_position_in_grid]],
+  uint2 tid [[thread_position_in_threadgroup]],
+  uint2 group_size [[threads_per_threadgroup]])
+{
+  const bool inside = gid.x < p.n && gid.y < p.m;
+  const uint tile = group_size.x;
+
+  threadgroup float tileA[MAX_TILE_SIZE][MAX_TILE_SIZE];
+  threadgroup float tileB[MAX_TILE_SIZE][MAX_TILE_SIZE];
+
+  float sum = 0.0f;
+  const uint num_tiles = (p.k + tile - 1) / tile;
+  for (uint tile_idx = 0; tile_idx < num_tiles; ++tile_idx) {
+    // op(A)[row, col] and op(B)[row, col] for this thread's slot in the tiles.
+    const uint a_row = gid.y;
+    const uint a_col = tile_idx * tile + tid.x;
+    const uint b_row = tile_idx * tile + tid.y;
+    const uint b_col = gid.x;
+
+    float a_value = 0.0f;
+    if (a_row < p.m && a_col < p.k) {
+      a_value = p.trans_a ? a[a_col * p.lda + a_row] : a[a_row * p.lda + a_col];
+    }
+    float b_value = 0.0f;
+    if (b_row < p.k && b_col < p.n) {
+      b_value = p.trans_b ? b[b_col * p.ldb + b_row] : b[b_row * p.ldb + b_col];
+    }
+    tileA[tid.y][tid.x] = a_value;
+    tileB[tid.y][tid.x] = b_value;
+
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+    for (uint k = 0; k < tile; ++k) {
+      sum += tileA[tid.y][k] * tileB[k][tid.x];
+    }
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+  }
+
+  if (inside) {
+    device float* out = c + gid.y * p.ldc + gid.x;
+    *out = p.beta == 0.0f ? p.alpha * sum : p.alpha * sum + p.beta * *out;
+  }
+}
+
+// Layout of `compute::gemm::BatchParams` on the host.
+struct BatchParams {
+  uint m, n, k;
+  uint lda, ldb, ldc;
+  uint stride_a, stride_b, stride_c;
+  uint count;
+  float alpha, beta;
+};
+
+// One element of one small product. The matrices are a few KiB, so the row
+// of A and column of B come straight from the cache; no threadgroup tiles
+// and no barriers.
+static inline void batched_element (
+  device const float* a,
+  device const float* b,
+  device float* c,
+  constant BatchParams& p,
+  uint element)
+{
+  const uint row = element / p.n;
+  const uint col = element % p.n;
+  float sum = 0.0f;
+  for (uint q = 0; q < p.k; ++q) {
+    sum += a[row * p.lda + q] * b[q * p.ldb + col];
+  }
+  device float* out = c + row * p.ldc + col;
+  *out = p.beta == 0.0f ? p.alpha * sum : p.alpha * sum + p.beta * *out;
+}
+
+// A whole batch in one dispatch: gid.x is the element of C (m * n of them),
+// gid.y the product. Product i starts i * stride floats into each buffer.
+kernel void gemm_batched (
+  device const float* a  [[buffer(0)]],
+  device const float* b  [[buffer(1)]],
+  device float* c        [[buffer(2)]],
+  constant BatchParams& p [[buffer(3)]],
+  uint2 gid [[thread_position_in_grid]])
+{
+  if (gid.x >= p.m * p.n || gid.y >= p.count) { return; }
+  batched_element(a + gid.y * p.stride_a, b + gid.y * p.stride_b, c + gid.y * p.stride_c, p, gid.x);
+}
+
+// Same, with the GPU's take on a pointer array: product i starts at
+// offsets[3i], offsets[3i + 1] and offsets[3i + 2] floats into a, b and c.
+kernel void gemm_batched_indexed (
+  device const float* a       [[buffer(0)]],
+  device const float* b       [[buffer(1)]],
+  device float* c             [[buffer(2)]],
+  constant BatchParams& p     [[buffer(3)]],
+  device const uint* offsets  [[buffer(4)]],
+  uint2 gid [[thread_position_in_grid]])
+{
+  if (gid.x >= p.m * p.n || gid.y >= p.count) { return; }
+  device const uint* offset = offsets + 3 * gid.y;
+  batched_element(a + offset[0], b + offset[1], c + offset[2], p, gid.x);
 }
@@ -3,6 +3,7 @@
 #include <filesystem>
 #include <fstream>
 #include <functional>
+#include <memory>
 #include <print>
 #include <random>
 #include <iomanip>
@@ -15,9 +16,12 @@
 #include <benchmark/benchmark.h>
 #include <sys/types.h>
 
+#ifdef __APPLE__
 #define NS_PRIVATE_IMPLEMENTATION
 #define MTL_PRIVATE_IMPLEMENTATION
 #include "../Metal.hpp"
+#endif
+#include "../compute/device.hpp"
 
 using grid = std::vector<uint32_t>;
 
@@ -53,69 +57,42 @@ auto golSimBuffer (
   const grid& initialGrid,
   const uint16_t generations,
   const std::function<void(const grid&, uint16_t)>& frameSaver) -> grid {
-  NS::AutoreleasePool* pAutoReleasePool = NS::AutoreleasePool::alloc()->init();
-  MTL::Device* pDevice = MTL::CreateSystemDefaultDevice();
-  MTL::Library* pLibrary = pDevice->newLibrary(
-    NS::String::string("./gol_buffer.metallib", NS::StringEncoding::UTF8StringEncoding),
-    nullptr);
-
-  if (!pLibrary) {
-    throw std::runtime_error("Couldn't find the .metallib file.");
-  }
-
-  MTL::Function* pFunction = pLibrary->newFunction(
-    NS::String::string("golBuffer", NS::StringEncoding::UTF8StringEncoding));
-  MTL::ComputePipelineState* pComputePipelineState =
-    pDevice->newComputePipelineState(pFunction, (NS::Error**)nullptr);
-
-  MTL::CommandQueue* pCommandQueue = pDevice->newCommandQueue();
+  std::unique_ptr<compute::Device> pDevice = compute::createDefaultDevice();
+  std::unique_ptr<compute::Library> pLibrary = pDevice->newLibrary("./gol_buffer.metallib");
+  std::unique_ptr<compute::Pipeline> pPipeline = pDevice->newPipeline(*pLibrary, "golBuffer");
+  std::unique_ptr<compute::Queue> pQueue = pDevice->newQueue();
 
   const size_t bufferSize = GRID_WIDTH * GRID_HEIGHT * sizeof(uint32_t);
-  MTL::Buffer* pReadBuffer = pDevice->newBuffer(bufferSize, MTL::ResourceStorageModeManaged);
-  MTL::Buffer* pWriteBuffer = pDevice->newBuffer(bufferSize, MTL::ResourceStorageModeManaged);
+  std::unique_ptr<compute::Buffer> pReadBuffer  = pDevice->newBuffer(initialGrid.data(), bufferSize);
+  std::unique_ptr<compute::Buffer> pWriteBuffer = pDevice->newBuffer(bufferSize);
 
-  std::copy(initialGrid.begin(), initialGrid.end(), static_cast<uint32_t*>(pReadBuffer->contents()));
-  pReadBuffer->didModifyRange(NS::Range(0, bufferSize));
-
-  MTL::Size threadsPerThreadgroup = MTL::Size(16, 16, 1);
-  MTL::Size numGroups = MTL::Size((GRID_WIDTH + 15) / 16, (GRID_HEIGHT + 15) / 16, 1);
+  compute::Size threadsPerThreadgroup = {16, 16, 1};
+  compute::Size numGroups = {(GRID_WIDTH + 15) / 16, (GRID_HEIGHT + 15) / 16, 1};
   grid frameGrid(GRID_WIDTH * GRID_HEIGHT);
 
   for (uint16_t i = 0; i < generations; ++i) {
-    MTL::CommandBuffer* pCommandBuffer = pCommandQueue->commandBuffer();
-
-    MTL::ComputeCommandEncoder* pCommandEncoder = pCommandBuffer->computeCommandEncoder();
-    pCommandEncoder->setComputePipelineState(pComputePipelineState);
-    pCommandEncoder->setBuffer(pReadBuffer,  0, 0);
-    pCommandEncoder->setBuffer(pWriteBuffer, 0, 1);
-    pCommandEncoder->setBytes(&GRID_WIDTH, sizeof(uint16_t), 2);
-    pCommandEncoder->setBytes(&GRID_HEIGHT, sizeof(uint16_t), 3);
-    pCommandEncoder->dispatchThreadgroups(numGroups, threadsPerThreadgroup);
-    pCommandEncoder->endEncoding();
-
-    pCommandBuffer->commit();
-    pCommandBuffer->waitUntilCompleted();
+    compute::Arguments arguments;
+    arguments.setBuffer(*pReadBuffer,  0, 0);
+    arguments.setBuffer(*pWriteBuffer, 0, 1);
+    arguments.setBytes(&GRID_WIDTH, sizeof(uint16_t), 2);
+    arguments.setBytes(&GRID_HEIGHT, sizeof(uint16_t), 3);
+    pQueue->dispatchThreadgroups(*pPipeline, arguments, numGroups, threadsPerThreadgroup);
 
     std::swap(pReadBuffer, pWriteBuffer);
 
-    auto* bufferContents = static_cast<uint32_t*>(pReadBuffer->contents());
+    auto* bufferContents = pReadBuffer->as<uint32_t>();
     std::copy(bufferContents, bufferContents + initialGrid.size(), frameGrid.begin());
     if (frameSaver) frameSaver(frameGrid, i + 1);
   }
 
-  auto* bufferContents = static_cast<uint32_t*>(pReadBuffer->contents());
+  auto* bufferContents = pReadBuffer->as<uint32_t>();
   std::copy(bufferContents, bufferContents + initialGrid.size(), frameGrid.begin());
-
-  pReadBuffer->release();
-  pWriteBuffer->release();
-  pCommandQueue->release();
-  pComputePipelineState->release();
-  pFunction->release();
-  pLibrary->release();
-  pDevice->release();
   return frameGrid;
 }
 
+// * Textures have no counterpart in the backend interface, so this path stays
+// * Metal-only.
+#ifdef __APPLE__
 auto golSimTexture(
   const grid& initialGrid,
   const uint16_t generations,
@@ -184,6 +161,7 @@ auto golSimTexture(
   pDevice->release();
   return frameGrid;
 }
+#endif  // __APPLE__
 
 auto main (int argc, char** argv) -> int {
   const grid initialGrid = genInitialGrid();
@@ -203,6 +181,7 @@ auto main (int argc, char** argv) -> int {
   saveFrame(textureOutputDir, initialGrid, 0);
 
   benchmark::RegisterBenchmark("BM_Buffer", [&](benchmark::State& state) {
+    state.SetLabel(compute::createDefaultDevice()->name());
     auto frameSaver = [&](const grid& g, uint16_t frameNum) {
       saveFrame(bufferOutputDir, g, frameNum);
     };
@@ -211,6 +190,7 @@ auto main (int argc, char** argv) -> int {
     }
   });
 
+#ifdef __APPLE__
   benchmark::RegisterBenchmark("BM_Texture", [&](benchmark::State& state) {
     auto frameSaver = [&](const grid& g, uint16_t frameNum){
       saveFrame(textureOutputDir, g, frameNum);
@@ -219,6 +199,7 @@ auto main (int argc, char** argv) -> int {
       golSimTexture(initialGrid, GENERATIONS, frameSaver);
     }
   });
+#endif
 
   benchmark::Initialize(&argc, argv);
   if (::benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;